@@ -0,0 +1,213 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+/*
+  Codec benchmark
+
+ This sketch compares three ways of turning a telemetry struct into
+ the bytes of a message and back:
+
+ * memcpy of the struct, which is as fast as it gets but sends the
+   compiler's padding and byte order, and checks nothing
+ * NetworkSchema, which packs big-endian fields and checks the
+   schema hash on decode
+ * a generic serializer driven by a table of field offsets and
+   sizes, looked up at run time
+
+ and prints the time per encode and decode, and the message size. It
+ needs no network connection, and C++17 (the Teensyduino default).
+
+ */
+
+#include <stddef.h>
+#include <NetworkMessageCodec.h>
+
+// Number of messages to time
+#define ITERATIONS 100000
+
+struct Telemetry {
+  uint32_t millis;
+  int16_t leftSpeed;
+  int16_t rightSpeed;
+  float heading;
+  float batteryVolts;
+  uint8_t mode;
+  uint8_t flags[3];
+  int32_t leftTicks;
+  int32_t rightTicks;
+};
+
+typedef NetworkSchema<Telemetry, 1, 1,
+  NetworkField<&Telemetry::millis>,
+  NetworkField<&Telemetry::leftSpeed>,
+  NetworkField<&Telemetry::rightSpeed>,
+  NetworkField<&Telemetry::heading>,
+  NetworkField<&Telemetry::batteryVolts>,
+  NetworkField<&Telemetry::mode>,
+  NetworkField<&Telemetry::flags>,
+  NetworkField<&Telemetry::leftTicks>,
+  NetworkField<&Telemetry::rightTicks>> TelemetrySchema;
+
+// The generic serializer: a table of fields, each copied byte by
+// byte into big-endian order.
+struct GenericField {
+  size_t offset;
+  uint8_t size;
+  uint8_t count;
+};
+
+const GenericField TELEMETRY_FIELDS[] = {
+  { offsetof(Telemetry, millis), 4, 1 },
+  { offsetof(Telemetry, leftSpeed), 2, 1 },
+  { offsetof(Telemetry, rightSpeed), 2, 1 },
+  { offsetof(Telemetry, heading), 4, 1 },
+  { offsetof(Telemetry, batteryVolts), 4, 1 },
+  { offsetof(Telemetry, mode), 1, 1 },
+  { offsetof(Telemetry, flags), 1, 3 },
+  { offsetof(Telemetry, leftTicks), 4, 1 },
+  { offsetof(Telemetry, rightTicks), 4, 1 },
+};
+const size_t TELEMETRY_FIELD_COUNT = sizeof(TELEMETRY_FIELDS) / sizeof(TELEMETRY_FIELDS[0]);
+
+size_t genericEncode(const GenericField* fields, size_t fieldCount, const void* message, uint8_t* buffer) {
+  const uint8_t* source = (const uint8_t*)message;
+  size_t length = 0;
+  for (size_t f = 0; f < fieldCount; f++) {
+    for (uint8_t e = 0; e < fields[f].count; e++) {
+      const uint8_t* value = source + fields[f].offset + e * fields[f].size;
+      for (uint8_t b = 0; b < fields[f].size; b++) {
+        buffer[length++] = value[fields[f].size - 1 - b];  // little-endian host
+      }
+    }
+  }
+  return length;
+}
+
+size_t genericDecode(const GenericField* fields, size_t fieldCount, const uint8_t* buffer, void* message) {
+  uint8_t* target = (uint8_t*)message;
+  size_t length = 0;
+  for (size_t f = 0; f < fieldCount; f++) {
+    for (uint8_t e = 0; e < fields[f].count; e++) {
+      uint8_t* value = target + fields[f].offset + e * fields[f].size;
+      for (uint8_t b = 0; b < fields[f].size; b++) {
+        value[fields[f].size - 1 - b] = buffer[length++];
+      }
+    }
+  }
+  return length;
+}
+
+uint8_t buffer[64];
+Telemetry telemetry;
+Telemetry decoded;
+volatile uint32_t sink;
+
+void report(const char* label, uint32_t encodeMicros, uint32_t decodeMicros, size_t size) {
+  Serial.println(label);
+  Serial.print("  encode ");
+  Serial.print(encodeMicros * 1000.0f / ITERATIONS, 1);
+  Serial.print(" ns, decode ");
+  Serial.print(decodeMicros * 1000.0f / ITERATIONS, 1);
+  Serial.print(" ns, ");
+  Serial.print(size);
+  Serial.println(" bytes");
+}
+
+void benchmarkMemcpy() {
+  uint32_t startMicros = micros();
+  for (uint32_t x = 0; x < ITERATIONS; x++) {
+    telemetry.millis = x;
+    memcpy(buffer, &telemetry, sizeof(telemetry));
+    sink = buffer[0];
+  }
+  uint32_t encodeMicros = micros() - startMicros;
+  
+  startMicros = micros();
+  for (uint32_t x = 0; x < ITERATIONS; x++) {
+    buffer[0] = x;
+    memcpy(&decoded, buffer, sizeof(decoded));
+    sink = decoded.millis;
+  }
+  report("memcpy", encodeMicros, micros() - startMicros, sizeof(telemetry));
+}
+
+void benchmarkSchema() {
+  uint32_t startMicros = micros();
+  for (uint32_t x = 0; x < ITERATIONS; x++) {
+    telemetry.millis = x;
+    TelemetrySchema::encode(telemetry, buffer);
+    sink = buffer[4];
+  }
+  uint32_t encodeMicros = micros() - startMicros;
+  
+  uint32_t failed = 0;
+  startMicros = micros();
+  for (uint32_t x = 0; x < ITERATIONS; x++) {
+    buffer[7] = x;
+    if (!TelemetrySchema::decode(buffer, TelemetrySchema::SIZE, decoded)) {
+      failed++;
+    }
+    sink = decoded.millis;
+  }
+  report("NetworkSchema", encodeMicros, micros() - startMicros, TelemetrySchema::SIZE);
+  if (failed > 0) {
+    Serial.print("  decode failed ");
+    Serial.println(failed);
+  }
+}
+
+void benchmarkGeneric() {
+  size_t size = 0;
+  uint32_t startMicros = micros();
+  for (uint32_t x = 0; x < ITERATIONS; x++) {
+    telemetry.millis = x;
+    size = genericEncode(TELEMETRY_FIELDS, TELEMETRY_FIELD_COUNT, &telemetry, buffer);
+    sink = buffer[0];
+  }
+  uint32_t encodeMicros = micros() - startMicros;
+  
+  startMicros = micros();
+  for (uint32_t x = 0; x < ITERATIONS; x++) {
+    buffer[3] = x;
+    genericDecode(TELEMETRY_FIELDS, TELEMETRY_FIELD_COUNT, buffer, &decoded);
+    sink = decoded.millis;
+  }
+  report("Generic table serializer", encodeMicros, micros() - startMicros, size);
+}
+
+void setup() {
+  
+  // Open serial communications and wait for port to open:
+  Serial.begin(9600);
+  while (!Serial) {
+    ; // wait for serial port to connect. Needed for native USB port only
+  }
+  Serial.println("Network CodecBenchmark Example");
+  
+  telemetry.leftSpeed = -120;
+  telemetry.rightSpeed = 118;
+  telemetry.heading = 87.5f;
+  telemetry.batteryVolts = 11.9f;
+  telemetry.mode = 2;
+  telemetry.leftTicks = 123456;
+  telemetry.rightTicks = -654321;
+  
+  benchmarkMemcpy();
+  benchmarkSchema();
+  benchmarkGeneric();
+  
+  // Check the codec gets back what it was given
+  TelemetrySchema::encode(telemetry, buffer);
+  bool same = TelemetrySchema::decode(buffer, TelemetrySchema::SIZE, decoded)
+    && decoded.rightTicks == telemetry.rightTicks && decoded.heading == telemetry.heading;
+  Serial.print("Round trip ");
+  Serial.println(same ? "OK" : "FAILED");
+  Serial.print("Schema hash 0x");
+  Serial.println(TelemetrySchema::HASH, HEX);
+}
+
+void loop() {
+  // Nothing to do
+}
@@ -0,0 +1,126 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+/*
+  FEC benchmark
+
+ This sketch runs a stream of telemetry datagrams through a
+ NetworkFECEncoder and a NetworkFECDecoder, dropping datagrams at
+ random on the way, for a few group sizes and loss rates. For each
+ it prints:
+
+ * the loss left after the decoder has rebuilt what it can
+ * the share of the lost datagrams that were rebuilt
+ * the bandwidth the parity adds
+ * the time per encode and decode
+
+ It needs no network connection; the same loss can be run for real
+ with NetworkFECEncoder::send() and extras/fec_receiver.py, using
+ netem on the host to drop packets.
+
+ */
+
+#include <NetworkFEC.h>
+
+// Datagrams per run
+#define DATAGRAMS 20000
+
+// Size of each telemetry payload
+#define PAYLOAD_SIZE 64
+
+const uint8_t GROUP_SIZES[] = { 2, 4, 8 };
+const uint8_t LOSS_PERCENTS[] = { 1, 5, 10 };
+
+NetworkFECEncoder encoder;
+NetworkFECDecoder decoder;
+uint8_t payload[PAYLOAD_SIZE];
+uint8_t datagram[NETWORKHUB_FEC_HEADER_SIZE + NETWORKHUB_FEC_PAYLOAD_SIZE];
+uint8_t buffer[NETWORKHUB_FEC_PAYLOAD_SIZE];
+uint32_t delivered;
+uint32_t decodeMicros;
+
+void deliver(size_t length, uint8_t lossPercent) {
+  if (length == 0 || (uint8_t)random(100) < lossPercent) {
+    return;
+  }
+  
+  uint32_t startMicros = micros();
+  if (decoder.decode(datagram, length, buffer, sizeof(buffer)) > 0) {
+    delivered++;
+  }
+  while (decoder.takeRecovered(buffer, sizeof(buffer)) > 0) {
+    delivered++;
+  }
+  decodeMicros += micros() - startMicros;
+}
+
+void benchmark(uint8_t groupSize, uint8_t lossPercent) {
+  encoder = NetworkFECEncoder();
+  decoder = NetworkFECDecoder();
+  encoder.setGroupSize(groupSize);
+  delivered = 0;
+  decodeMicros = 0;
+  uint32_t encodeMicros = 0;
+  
+  for (uint32_t x = 0; x < DATAGRAMS; x++) {
+    memcpy(payload, &x, sizeof(x));
+    
+    uint32_t startMicros = micros();
+    size_t length = encoder.encode(payload, sizeof(payload), datagram);
+    encodeMicros += micros() - startMicros;
+    deliver(length, lossPercent);
+    
+    startMicros = micros();
+    length = encoder.encodeParity(datagram);
+    encodeMicros += micros() - startMicros;
+    deliver(length, lossPercent);
+  }
+  
+  uint32_t datagrams = DATAGRAMS + encoder.getParityCount();
+  Serial.print("  group ");
+  Serial.print(groupSize);
+  Serial.print(", ");
+  Serial.print(lossPercent);
+  Serial.print("% loss: ");
+  Serial.print(100.0f * (DATAGRAMS - delivered) / DATAGRAMS, 2);
+  Serial.print("% lost, ");
+  uint32_t missed = decoder.getRecoveredCount() + decoder.getLostCount();
+  Serial.print(missed > 0 ? 100.0f * decoder.getRecoveredCount() / missed : 100.0f, 1);
+  Serial.print("% rebuilt, +");
+  Serial.print(100.0f * encoder.getParityCount() / DATAGRAMS, 0);
+  Serial.print("% bandwidth, encode ");
+  Serial.print((float)encodeMicros / datagrams, 2);
+  Serial.print(" us, decode ");
+  Serial.print((float)decodeMicros / datagrams, 2);
+  Serial.println(" us");
+}
+
+void setup() {
+  
+  // Open serial communications and wait for port to open:
+  Serial.begin(9600);
+  while (!Serial) {
+    ; // wait for serial port to connect. Needed for native USB port only
+  }
+  Serial.println("Network FECBenchmark Example");
+  
+  // The same losses every run
+  randomSeed(1);
+  memset(payload, 0xA5, sizeof(payload));
+  
+  Serial.print(DATAGRAMS);
+  Serial.print(" datagrams of ");
+  Serial.print(PAYLOAD_SIZE);
+  Serial.println(" bytes");
+  for (uint8_t l = 0; l < sizeof(LOSS_PERCENTS); l++) {
+    for (uint8_t g = 0; g < sizeof(GROUP_SIZES); g++) {
+      benchmark(GROUP_SIZES[g], LOSS_PERCENTS[l]);
+    }
+  }
+}
+
+void loop() {
+  // Nothing to do
+}
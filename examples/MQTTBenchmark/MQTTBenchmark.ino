@@ -0,0 +1,119 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+/*
+  MQTT benchmark
+
+ This sketch measures how many messages per second NetworkMQTTClient
+ can publish to a broker, at QoS 0 and at QoS 1, and how many of them
+ come back on a subscription to the same topics.
+
+ Run a local broker to test against, for instance mosquitto on Linux:
+
+   mosquitto -v
+
+ and set BROKER below to that machine's address. Watch the messages
+ with:
+
+   mosquitto_sub -h <broker> -t 'bench/#' -v
+
+ */
+
+// See this file for implementation spcific settings
+#include "connect_network_hub.h"
+
+#include <NetworkMQTTClient.h>
+
+//***** ALL OF THE CODE BELOW HERE IS COMMON AND NETWORK AGNOSTIC
+
+// The broker to publish to
+IPAddress BROKER(192, 168, 1, 10);
+
+// How long to run each test
+#define TEST_MILLIS 10000
+
+// Publishes made together in each pass of the loop, these are
+// batched into one write
+#define BATCH_SIZE 10
+
+NetworkMQTTClient mqtt(&networkHub);
+
+void runBenchmark(const char* label, const char* topic, uint8_t qos) {
+  uint32_t startPublished = mqtt.getPublishedCount();
+  uint32_t startReceived = mqtt.getReceivedCount();
+  uint32_t startWrites = mqtt.getWriteCount();
+  uint32_t refused = 0;
+  
+  char payload[16];
+  uint32_t sequence = 0;
+  uint32_t startMillis = millis();
+  while (millis() - startMillis < TEST_MILLIS) {
+    for (uint8_t x = 0; x < BATCH_SIZE; x++) {
+      ultoa(sequence, payload, 10);
+      if (mqtt.publish(topic, payload, qos)) {
+        sequence++;
+      } else {
+        refused++;
+      }
+    }
+    mqtt.poll();
+  }
+  
+  // Let the last messages come back
+  uint32_t drainMillis = millis();
+  while (millis() - drainMillis < 500) {
+    mqtt.poll();
+  }
+  
+  uint32_t published = mqtt.getPublishedCount() - startPublished;
+  uint32_t received = mqtt.getReceivedCount() - startReceived;
+  uint32_t writes = mqtt.getWriteCount() - startWrites;
+  
+  Serial.println(label);
+  Serial.print("  published ");
+  Serial.print(published * 1000 / TEST_MILLIS);
+  Serial.print(" messages/second in ");
+  Serial.print(writes);
+  Serial.println(" writes");
+  Serial.print("  received ");
+  Serial.print(received * 1000 / TEST_MILLIS);
+  Serial.print(" messages/second, refused ");
+  Serial.println(refused);
+}
+
+void setup() {
+  
+  // Open serial communications and wait for port to open:
+  Serial.begin(9600);
+  while (!Serial) {
+    ; // wait for serial port to connect. Needed for native USB port only
+  }
+  Serial.println("Network MQTTBenchmark Example");
+  
+  // Connect the network hub
+  connectNetworkHub();
+  
+  // Print the status of the network hub
+  networkHub.printStatus((Print*)&Serial);
+  
+  mqtt.setServer(BROKER);
+  mqtt.setClientId("TeensyNetworkHubBenchmark");
+  mqtt.subscribe("bench/#");
+  if (!mqtt.connect()) {
+    Serial.print("Could not connect to the broker, return code ");
+    Serial.println(mqtt.getLastReturnCode());
+    return;
+  }
+  
+  runBenchmark("QoS 0", "bench/qos0", 0);
+  runBenchmark("QoS 1", "bench/qos1", 1);
+  
+  mqtt.printStatus((Print*)&Serial);
+  mqtt.disconnect();
+}
+
+void loop() {
+  // Nothing to do
+}
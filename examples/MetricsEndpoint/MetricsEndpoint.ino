@@ -0,0 +1,108 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+/*
+  Metrics endpoint
+
+ This sketch serves the status of the network hub, and the value of
+ an analog input, as metrics on port 9100 for Prometheus to scrape.
+ Point a scrape job at it:
+
+   scrape_configs:
+     - job_name: teensy
+       static_configs:
+         - targets: ['<teensy address>:9100']
+
+ or look at it with curl:
+
+   curl http://<teensy address>:9100/metrics
+   curl http://<teensy address>:9100/metrics.json
+
+ Before serving it measures how long a scrape takes to render in
+ each format, which is the most loop() is held up by each poll() of
+ a scrape; a scrape the client can't take at once is sent over a few.
+
+ Circuit:
+ * Analog input attached to pin A0 (optional)
+
+ */
+
+// See this file for implementation spcific settings
+#include "connect_network_hub.h"
+
+#include <NetworkMetrics.h>
+
+//***** ALL OF THE CODE BELOW HERE IS COMMON AND NETWORK AGNOSTIC
+
+// Number of renders to average over
+#define BENCHMARK_RENDERS 1000
+
+// Counts what is printed to it and throws it away
+class NullPrint : public Print {
+  public:
+    size_t write(uint8_t b) { _count++; return 1; };
+    size_t write(const uint8_t* buf, size_t size) { _count += size; return size; };
+    
+    size_t getCount() { return _count; };
+    
+  private:
+    size_t _count = 0;
+};
+
+NetworkMetricsServer metrics(&networkHub);
+uint32_t loopCount = 0;
+
+void writeSketchMetrics(NetworkMetricsWriter& writer) {
+  writer.gauge("sketch_analog_input", "Reading of pin A0.", analogRead(A0));
+  writer.counter("sketch_loops_total", "Passes through loop().", loopCount);
+}
+
+void runBenchmark(const char* label, uint8_t format) {
+  NullPrint nullPrint;
+  uint32_t startMicros = micros();
+  for (uint32_t x = 0; x < BENCHMARK_RENDERS; x++) {
+    metrics.writeMetrics(&nullPrint, format);
+  }
+  uint32_t elapsedMicros = micros() - startMicros;
+  
+  Serial.println(label);
+  Serial.print("  ");
+  Serial.print(nullPrint.getCount() / BENCHMARK_RENDERS);
+  Serial.print(" bytes in ");
+  Serial.print(elapsedMicros / BENCHMARK_RENDERS);
+  Serial.println(" us per scrape");
+}
+
+void setup() {
+  
+  // Open serial communications and wait for port to open:
+  Serial.begin(9600);
+  while (!Serial) {
+    ; // wait for serial port to connect. Needed for native USB port only
+  }
+  Serial.println("Network MetricsEndpoint Example");
+  
+  // Connect the network hub
+  connectNetworkHub();
+  
+  // Print the status of the network hub
+  networkHub.printStatus((Print*)&Serial);
+  
+  metrics.addSource(writeSketchMetrics);
+  
+  runBenchmark("Prometheus", NETWORK_METRICS_PROMETHEUS);
+  runBenchmark("JSON", NETWORK_METRICS_JSON);
+  
+  metrics.begin(networkHub.getServer(9100));
+  Serial.print("metrics are at http://");
+  Serial.print(networkHub.getLocalIPAddress());
+  Serial.println(":9100/metrics");
+}
+
+void loop() {
+  loopCount++;
+  networkHub.service();
+  metrics.poll();
+}
@@ -0,0 +1,176 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+/*
+  Reliable channel benchmark
+
+ This sketch sends small commands to a host one at a time, first
+ over a NetworkReliableChannel and then over a TCP NetworkClient, and
+ prints the 50th, 90th and 99th percentile and worst time for each
+ command to be confirmed: its ack on the reliable channel, or its
+ echo over TCP.
+
+ Run extras/reliable_echo.py on the host, and set HOST below to that
+ machine's address. To compare the two under loss, have the host
+ drop packets with netem, ie 5% each way on Linux:
+
+   sudo tc qdisc add dev eth0 root netem loss 5%
+
+ and remove it afterwards with:
+
+   sudo tc qdisc del dev eth0 root
+
+ */
+
+// See this file for implementation spcific settings
+#include "connect_network_hub.h"
+
+#include <NetworkReliableChannel.h>
+
+//***** ALL OF THE CODE BELOW HERE IS COMMON AND NETWORK AGNOSTIC
+
+// The host running reliable_echo.py
+IPAddress HOST(192, 168, 1, 10);
+#define HOST_PORT 8124
+#define LOCAL_PORT 8124
+
+// Commands sent in each test, how often, and how big
+#define COMMAND_COUNT 1000
+#define COMMAND_INTERVAL_MILLIS 10
+#define COMMAND_SIZE 16
+
+// Longest a command is waited for before it counts as lost
+#define COMMAND_TIMEOUT_MILLIS 2000
+
+uint32_t latencies[COMMAND_COUNT];
+
+NetworkReliableChannel channel(networkHub.getUDP());
+
+void printLatencies(const char* label, uint32_t count, uint32_t lost) {
+  // Insertion sort, the run takes far longer than this
+  for (uint32_t x = 1; x < count; x++) {
+    uint32_t latency = latencies[x];
+    uint32_t y = x;
+    for (; y > 0 && latencies[y - 1] > latency; y--) {
+      latencies[y] = latencies[y - 1];
+    }
+    latencies[y] = latency;
+  }
+  
+  Serial.println(label);
+  if (count == 0) {
+    Serial.println("  no commands confirmed");
+    return;
+  }
+  Serial.print("  p50 ");
+  Serial.print(latencies[count * 50 / 100]);
+  Serial.print(" us, p90 ");
+  Serial.print(latencies[count * 90 / 100]);
+  Serial.print(" us, p99 ");
+  Serial.print(latencies[count * 99 / 100]);
+  Serial.print(" us, max ");
+  Serial.print(latencies[count - 1]);
+  Serial.print(" us, lost ");
+  Serial.println(lost);
+}
+
+void runReliable() {
+  if (!channel.begin(LOCAL_PORT, HOST, HOST_PORT)) {
+    Serial.println("Could not start the reliable channel");
+    return;
+  }
+  
+  uint8_t command[COMMAND_SIZE];
+  uint32_t count = 0;
+  uint32_t lost = 0;
+  for (uint32_t x = 0; x < COMMAND_COUNT; x++) {
+    memset(command, x, sizeof(command));
+    uint32_t failedCount = channel.getFailedCount();
+    uint32_t startMicros = micros();
+    if (!channel.send(command, sizeof(command))) {
+      lost++;
+      continue;
+    }
+    
+    while (channel.getPendingCount() > 0 && micros() - startMicros < COMMAND_TIMEOUT_MILLIS * 1000) {
+      channel.poll();
+    }
+    if (channel.getPendingCount() > 0 || channel.getFailedCount() != failedCount) {
+      lost++;
+    } else {
+      latencies[count++] = micros() - startMicros;
+    }
+    
+    while (micros() - startMicros < COMMAND_INTERVAL_MILLIS * 1000) {
+      channel.poll();
+    }
+  }
+  
+  printLatencies("Reliable channel", count, lost);
+  channel.printStatus((Print*)&Serial);
+}
+
+void runTCP() {
+  NetworkClient client = networkHub.getClient();
+  if (!client.connect(HOST, HOST_PORT)) {
+    Serial.println("Could not connect to the host");
+    return;
+  }
+  
+  uint8_t command[COMMAND_SIZE];
+  uint8_t reply[COMMAND_SIZE];
+  uint32_t count = 0;
+  uint32_t lost = 0;
+  for (uint32_t x = 0; x < COMMAND_COUNT; x++) {
+    memset(command, x, sizeof(command));
+    uint32_t startMicros = micros();
+    client.write(command, sizeof(command));
+    
+    size_t received = 0;
+    while (received < sizeof(reply) && micros() - startMicros < COMMAND_TIMEOUT_MILLIS * 1000) {
+      int length = client.read(reply + received, sizeof(reply) - received);
+      if (length > 0) {
+        received += length;
+      }
+    }
+    if (received < sizeof(reply)) {
+      // The rest of the echo would be mistaken for the next one's
+      Serial.println("TCP echo timed out, stopping");
+      lost++;
+      break;
+    }
+    latencies[count++] = micros() - startMicros;
+    
+    while (micros() - startMicros < COMMAND_INTERVAL_MILLIS * 1000) {
+      ; // wait
+    }
+  }
+  client.stop();
+  
+  printLatencies("TCP", count, lost);
+}
+
+void setup() {
+  
+  // Open serial communications and wait for port to open:
+  Serial.begin(9600);
+  while (!Serial) {
+    ; // wait for serial port to connect. Needed for native USB port only
+  }
+  Serial.println("Network ReliableBenchmark Example");
+  
+  // Connect the network hub
+  connectNetworkHub();
+  
+  // Print the status of the network hub
+  networkHub.printStatus((Print*)&Serial);
+  
+  runReliable();
+  runTCP();
+}
+
+void loop() {
+  // Nothing to do
+}
@@ -0,0 +1,134 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+/*
+  TLS benchmark
+
+ This sketch downloads the same object from a web server over
+ plain TCP and over TLS, and reports the time taken to connect
+ (including the TLS handshake) and the download rate for each.
+
+ With the WiFiNINA hub the TLS runs on the ESP32. Define
+ USE_SSLCLIENT to also run it in software on the Teensy with the
+ SSLClient library, to compare the two.
+
+ */
+
+// See this file for implementation spcific settings
+#include "connect_network_hub.h"
+
+// Uncomment to add a software TLS run using SSLClient
+//   https://github.com/OPEnSLab-OSU/SSLClient
+// trust_anchors.h must be generated for SERVER with the
+// pycert_bearssl tool that comes with SSLClient.
+//#define USE_SSLCLIENT
+
+#if defined(USE_SSLCLIENT)
+#include <SSLClient.h>
+#include "trust_anchors.h"
+
+// Hands SSLClient sessions to the network hub
+class SSLClientTLSProvider : public NetworkTLSProvider {
+  public:
+    Client* createSession(Client& transport) {
+      return new SSLClient(transport, TAs, (size_t)TAs_NUM, A7);
+    };
+    
+    void releaseSession(Client* session) {
+      delete session;
+    };
+};
+
+SSLClientTLSProvider tlsProvider;
+#endif
+
+//***** ALL OF THE CODE BELOW HERE IS COMMON AND NETWORK AGNOSTIC
+
+// How long to wait until deciding all data has been sent
+#define IDLE_THRESHOLD_MICROS 1000000  // 1 second
+
+// The server and object to download. Pick something large
+// enough (100k or more) for the rate to be meaningful.
+const char SERVER[] = "www.example.com";
+const char PATH[] = "/";
+
+// Connect, download PATH and print the results
+void runBenchmark(const char* label, bool secure) {
+  NetworkClient client = networkHub.getClient();
+  
+  Serial.print(label);
+  Serial.println(":");
+  
+  int connected = secure ? client.connectSecure(SERVER, 443) : client.connect(SERVER, 80);
+  if (!connected) {
+    Serial.println("  connection failed");
+    return;
+  }
+  
+  Serial.print("  connect: ");
+  Serial.print(client.getConnectElapsedMicros() / 1000.0, 1);
+  Serial.println(" ms");
+  
+  client.print("GET ");
+  client.print(PATH);
+  client.println(" HTTP/1.1");
+  client.print("Host: ");
+  client.println(SERVER);
+  client.println("Connection: close");
+  client.println();
+  
+  uint32_t beginMicros = micros();
+  uint32_t lastReadTime = beginMicros;
+  uint32_t byteCount = 0;
+  uint8_t buffer[1024];
+  
+  while (client.connected() && micros() - lastReadTime < IDLE_THRESHOLD_MICROS) {
+    int len = client.read(buffer, sizeof(buffer));
+    if (len > 0) {
+      byteCount += len;
+      lastReadTime = micros();
+    }
+  }
+  client.stop();
+  
+  float seconds = (float)(lastReadTime - beginMicros) / 1000000.0;
+  Serial.print("  received ");
+  Serial.print(byteCount);
+  Serial.print(" bytes in ");
+  Serial.print(seconds, 4);
+  Serial.print(", rate = ");
+  Serial.print((float)byteCount / seconds / 1000.0);
+  Serial.println(" kbytes/second");
+}
+
+void setup() {
+  // Open serial communications and wait for port to open:
+  Serial.begin(9600);
+  while (!Serial) {
+    ; // wait for serial port to connect. Needed for native USB port only
+  }
+  Serial.println("Network TLS Benchmark Example");
+  
+  // Connect the network hub
+  connectNetworkHub();
+  
+  runBenchmark("Plain TCP", false);
+  
+  if (networkHub.getSecureConnectSupport() == NETWORK_SECURE_OFFLOAD) {
+    runBenchmark("TLS on the network coprocessor", true);
+  } else {
+    Serial.println("This hub can't offload TLS");
+  }
+
+#if defined(USE_SSLCLIENT)
+  networkHub.setTLSProvider(&tlsProvider);
+  runBenchmark("TLS in software (SSLClient)", true);
+#endif
+}
+
+void loop() {
+  // do nothing forevermore
+  delay(1);
+}
@@ -0,0 +1,100 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+/*
+  WebSocket plot
+
+ Streams the value of analog input A0 to a browser at 50 Hz over a
+ WebSocket, and plots it. Browse to the address printed at startup.
+
+ The page is served on port 80 by a NetworkAssetServer, and the
+ WebSocket is on port 81. Compare with the WebServer example, which
+ needs a new connection and a full HTTP response for every update.
+
+ Circuit:
+ * Analog input attached to pin A0 (optional)
+
+ */
+
+// See this file for implementation spcific settings
+#include "connect_network_hub.h"
+
+#include <NetworkAssetServer.h>
+#include <NetworkWebSocketServer.h>
+
+//***** ALL OF THE CODE BELOW HERE IS COMMON AND NETWORK AGNOSTIC
+
+// Time between updates
+#define UPDATE_INTERVAL_MILLIS 20  // 50 Hz
+
+const char INDEX_HTML[] =
+  "<!DOCTYPE html><html><body>"
+  "<canvas id='plot' width='600' height='256'></canvas><div id='rate'></div>"
+  "<script>"
+  "var canvas = document.getElementById('plot'), context = canvas.getContext('2d');"
+  "var values = [], count = 0;"
+  "var socket = new WebSocket('ws://' + location.hostname + ':81/');"
+  "socket.onmessage = function(event) {"
+  "  values.push(parseInt(event.data)); count++;"
+  "  if (values.length > canvas.width) values.shift();"
+  "  context.clearRect(0, 0, canvas.width, canvas.height); context.beginPath();"
+  "  values.forEach(function(v, x) { context.lineTo(x, canvas.height - v / 4); });"
+  "  context.stroke();"
+  "};"
+  "setInterval(function() {"
+  "  document.getElementById('rate').textContent = count + ' updates/second'; count = 0;"
+  "}, 1000);"
+  "</script></body></html>";
+
+const NetworkAsset ASSETS[] = {
+  { "/index.html", "text/html", "\"plot1\"", (const uint8_t*)INDEX_HTML, sizeof(INDEX_HTML) - 1, false }
+};
+
+NetworkAssetServer assetServer(ASSETS, 1);
+NetworkWebSocketServer webSocketServer;
+
+uint32_t lastUpdateMillis = 0;
+
+void webSocketEvent(uint8_t clientId, bool connected) {
+  Serial.print("websocket client ");
+  Serial.print(clientId);
+  Serial.println(connected ? " connected" : " disconnected");
+}
+
+void setup() {
+  
+  // Open serial communications and wait for port to open:
+  Serial.begin(9600);
+  while (!Serial) {
+    ; // wait for serial port to connect. Needed for native USB port only
+  }
+  Serial.println("Network WebSocketPlot Example");
+  
+  // Connect the network hub
+  connectNetworkHub();
+  
+  // Print the status of the network hub
+  networkHub.printStatus((Print*)&Serial);
+  
+  // start the servers
+  assetServer.begin(networkHub.getServer(80));
+  webSocketServer.setEventCallback(webSocketEvent);
+  webSocketServer.begin(networkHub.getServer(81));
+  Serial.print("browse to http://");
+  Serial.println(networkHub.getLocalIPAddress());
+}
+
+void loop() {
+  assetServer.poll();
+  webSocketServer.poll();
+  
+  if (millis() - lastUpdateMillis >= UPDATE_INTERVAL_MILLIS) {
+    lastUpdateMillis = millis();
+    
+    char value[8];
+    itoa(analogRead(A0), value, 10);
+    webSocketServer.broadcastText(value);
+  }
+}
@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+#
+# Licensed under the MIT license.
+# See accompanying LICENSE file for details.
+#
+
+# Host side responder for NetworkClockSyncClient. It answers each
+# request with its receive and transmit times from the host clock,
+# in microseconds since the Unix epoch, so the device can convert
+# its own timestamps to host time.
+#
+# Usage: clock_sync_responder.py [port]   (default port 8123)
+
+import socket
+import struct
+import sys
+import time
+
+MAGIC = 0x544E4353  # 'TNCS'
+VERSION = 1
+TYPE_REQUEST = 1
+TYPE_RESPONSE = 2
+PACKET = struct.Struct(">IBBHQQQ")
+
+
+def now_micros():
+    return time.time_ns() // 1000
+
+
+def main():
+    port = int(sys.argv[1]) if len(sys.argv) > 1 else 8123
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("", port))
+    print("Answering clock sync requests on port %d" % port)
+
+    while True:
+        data, address = sock.recvfrom(64)
+        receive_time = now_micros()
+        if len(data) < PACKET.size:
+            continue
+
+        magic, version, kind, seq, t1, _, _ = PACKET.unpack_from(data)
+        if magic != MAGIC or version != VERSION or kind != TYPE_REQUEST:
+            continue
+
+        response = PACKET.pack(MAGIC, VERSION, TYPE_RESPONSE, seq, t1,
+                               receive_time, now_micros())
+        sock.sendto(response, address)
+
+
+if __name__ == "__main__":
+    main()
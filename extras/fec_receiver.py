@@ -0,0 +1,235 @@
+#!/usr/bin/env python3
+#
+# Licensed under the MIT license.
+# See accompanying LICENSE file for details.
+#
+
+# Host side decoder for a NetworkFECEncoder stream. It rebuilds lost
+# datagrams from the parity, as NetworkFECDecoder does on a Teensy,
+# and prints every few seconds how many datagrams were received,
+# rebuilt and lost, and the time taken to decode each one.
+#
+# Usage: fec_receiver.py [port]   (default port 5010)
+#
+# Payloads are written to stdout as hex with --dump, and can be taken
+# from decode() by any other host tool that imports this file. With
+# --test it checks the decoder against datagrams made up here, lost,
+# repeated and malformed, and exits with 1 if it goes wrong.
+
+import socket
+import struct
+import sys
+import time
+
+MAGIC = 0x5446  # 'TF'
+VERSION = 1
+TYPE_DATA = 1
+TYPE_PARITY = 2
+HEADER = struct.Struct(">HBBHBBH")
+GROUPS = 2
+MAX_GROUP_SIZE = 32  # NETWORKHUB_FEC_MAX_GROUP_SIZE
+
+
+def group_diff(a, b):
+    return ((a - b + 0x8000) & 0xFFFF) - 0x8000
+
+
+def xor_into(target, source):
+    for x, value in enumerate(source):
+        target[x] ^= value
+
+
+class Group:
+    def __init__(self, group_id):
+        self.id = group_id
+        self.size = 0
+        self.received = set()
+        self.has_parity = False
+        self.length_parity = 0
+        self.parity = bytearray()
+
+    def received_count(self):
+        return len([index for index in self.received if index < self.size])
+
+
+class Decoder:
+    def __init__(self):
+        self.groups = []
+        self.received = 0
+        self.recovered = 0
+        self.lost = 0
+
+    def find_group(self, group_id):
+        for group in self.groups:
+            if group.id == group_id:
+                return group
+        # A new group takes the place of the oldest one
+        if len(self.groups) >= GROUPS:
+            oldest = min(self.groups, key=lambda g: group_diff(g.id, group_id))
+            if group_diff(group_id, oldest.id) < 0:
+                return None
+            self.lost += oldest.size - oldest.received_count()
+            self.groups.remove(oldest)
+        group = Group(group_id)
+        self.groups.append(group)
+        return group
+
+    def add(self, group, payload):
+        if len(group.parity) < len(payload):
+            group.parity.extend(bytes(len(payload) - len(group.parity)))
+        xor_into(group.parity, payload)
+
+    def decode(self, datagram):
+        """Returns the payloads the datagram gives, received or rebuilt."""
+        if len(datagram) < HEADER.size:
+            return []
+        magic, version, kind, group_id, index, size, length = HEADER.unpack_from(datagram)
+        payload = datagram[HEADER.size:]
+        if magic != MAGIC or version != VERSION:
+            return []
+        size = min(size, MAX_GROUP_SIZE)
+
+        payloads = []
+        if kind == TYPE_DATA:
+            if length != len(payload) or length == 0:
+                return []
+            if size > 0:
+                group = self.find_group(group_id)
+                if group is not None:
+                    # The index comes off the network. A duplicate would
+                    # spoil the parity.
+                    if index >= size or index in group.received:
+                        return []
+                    group.received.add(index)
+                    if not group.has_parity:
+                        group.size = size
+                    self.add(group, payload)
+                    group.length_parity ^= length
+                    payloads.extend(self.recover(group))
+            self.received += 1
+            payloads.insert(0, bytes(payload))
+        elif kind == TYPE_PARITY and size > 0:
+            group = self.find_group(group_id)
+            if group is not None and not group.has_parity:
+                group.has_parity = True
+                group.size = size
+                self.add(group, payload)
+                group.length_parity ^= length
+                payloads.extend(self.recover(group))
+        return payloads
+
+    def recover(self, group):
+        if not group.has_parity or group.received_count() != group.size - 1:
+            return []
+        if group.length_parity == 0 or group.length_parity > len(group.parity):
+            return []
+        group.received = set(range(group.size))
+        self.recovered += 1
+        return [bytes(group.parity[:group.length_parity])]
+
+
+def encode_group(group_id, payloads):
+    """The datagrams a NetworkFECEncoder sends for a group, parity last."""
+    size = len(payloads)
+    datagrams = []
+    parity = bytearray()
+    length_parity = 0
+    for index, payload in enumerate(payloads):
+        datagrams.append(HEADER.pack(MAGIC, VERSION, TYPE_DATA, group_id, index, size, len(payload)) + payload)
+        if len(parity) < len(payload):
+            parity.extend(bytes(len(payload) - len(parity)))
+        xor_into(parity, payload)
+        length_parity ^= len(payload)
+    datagrams.append(HEADER.pack(MAGIC, VERSION, TYPE_PARITY, group_id, size, size, length_parity) + bytes(parity))
+    return datagrams
+
+
+def test():
+    failures = []
+
+    def check(name, passed):
+        print("%s: %s" % ("ok" if passed else "FAILED", name), file=sys.stderr)
+        if not passed:
+            failures.append(name)
+
+    payloads = [b"first", b"second!", b"3", b"the fourth one"]
+
+    # A lost datagram is rebuilt from the parity
+    decoder = Decoder()
+    datagrams = encode_group(1, payloads)
+    out = []
+    for x, datagram in enumerate(datagrams):
+        if x != 2:
+            out.extend(decoder.decode(datagram))
+    check("lost datagram rebuilt", sorted(out) == sorted(payloads) and decoder.recovered == 1)
+
+    # An index past the group size is dropped, and spoils nothing
+    decoder = Decoder()
+    datagrams = encode_group(2, payloads)
+    hostile = HEADER.pack(MAGIC, VERSION, TYPE_DATA, 2, 200, 4, 3) + b"bad"
+    out = decoder.decode(hostile)
+    for x, datagram in enumerate(datagrams):
+        if x != 0:
+            out.extend(decoder.decode(datagram))
+    check("index past group size dropped", sorted(out) == sorted(payloads) and decoder.recovered == 1)
+
+    # A group size past the largest is cut to it
+    decoder = Decoder()
+    oversized = HEADER.pack(MAGIC, VERSION, TYPE_DATA, 3, 40, 255, 3) + b"big"
+    check("index past largest group size dropped", decoder.decode(oversized) == [])
+
+    # A repeated datagram is dropped, so the parity still works
+    decoder = Decoder()
+    datagrams = encode_group(4, payloads)
+    out = decoder.decode(datagrams[0]) + decoder.decode(datagrams[0])
+    for datagram in datagrams[2:]:
+        out.extend(decoder.decode(datagram))
+    check("repeat dropped", sorted(out) == sorted(payloads))
+
+    # Short, foreign and mislabelled datagrams are dropped
+    decoder = Decoder()
+    check("short datagram dropped", decoder.decode(b"\x54\x46") == [])
+    check("wrong magic dropped", decoder.decode(HEADER.pack(0x1234, VERSION, TYPE_DATA, 5, 0, 4, 1) + b"x") == [])
+    check("wrong length dropped", decoder.decode(HEADER.pack(MAGIC, VERSION, TYPE_DATA, 5, 0, 4, 9) + b"x") == [])
+
+    return not failures
+
+
+def main():
+    if "--test" in sys.argv:
+        sys.exit(0 if test() else 1)
+
+    args = [arg for arg in sys.argv[1:] if not arg.startswith("--")]
+    dump = "--dump" in sys.argv
+    port = int(args[0]) if args else 5010
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("", port))
+    print("Decoding FEC datagrams on port %d" % port, file=sys.stderr)
+
+    decoder = Decoder()
+    datagrams = 0
+    decode_seconds = 0.0
+    report_time = time.monotonic()
+    while True:
+        datagram, _ = sock.recvfrom(2048)
+        start = time.perf_counter()
+        payloads = decoder.decode(datagram)
+        decode_seconds += time.perf_counter() - start
+        datagrams += 1
+
+        if dump:
+            for payload in payloads:
+                print(payload.hex())
+
+        if time.monotonic() - report_time >= 5:
+            report_time = time.monotonic()
+            missing = decoder.recovered + decoder.lost
+            rate = 100.0 * decoder.recovered / missing if missing else 100.0
+            print("%d received, %d rebuilt, %d lost, %.1f%% of losses rebuilt, %.1f us per datagram"
+                  % (decoder.received, decoder.recovered, decoder.lost, rate,
+                     1e6 * decode_seconds / datagrams), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+#
+# Licensed under the MIT license.
+# See accompanying LICENSE file for details.
+#
+
+# Packs a directory of web files into a header for NetworkAssetServer.
+# Each file is gzipped (unless that doesn't make it smaller), stored
+# as a constexpr array, and given an ETag from a hash of its contents,
+# so the device does no compression or hashing at run time. The table
+# is constexpr too, so nothing is built at startup. The arrays are
+# also PROGMEM, which on a Teensy 4 keeps them in flash rather than
+# copied into RAM with the other constants.
+#
+# Usage: pack_assets.py <directory> [output]   (default network_assets.h)
+
+import gzip
+import hashlib
+import mimetypes
+import os
+import sys
+
+CONTENT_TYPES = {
+    ".html": "text/html",
+    ".htm": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".json": "application/json",
+    ".svg": "image/svg+xml",
+    ".png": "image/png",
+    ".jpg": "image/jpeg",
+    ".jpeg": "image/jpeg",
+    ".gif": "image/gif",
+    ".ico": "image/x-icon",
+    ".txt": "text/plain",
+    ".woff2": "font/woff2",
+}
+
+# Already compressed, gzip only costs the client time
+NO_GZIP = {".png", ".jpg", ".jpeg", ".gif", ".woff2"}
+
+
+def content_type(path):
+    extension = os.path.splitext(path)[1].lower()
+    if extension in CONTENT_TYPES:
+        return CONTENT_TYPES[extension]
+    guessed = mimetypes.guess_type(path)[0]
+    return guessed if guessed else "application/octet-stream"
+
+
+def compress(data):
+    # mtime=0 keeps the output, and so the ETag, the same between builds
+    return gzip.compress(data, compresslevel=9, mtime=0)
+
+
+def main():
+    if len(sys.argv) < 2:
+        print("Usage: pack_assets.py <directory> [output]")
+        sys.exit(1)
+
+    root = sys.argv[1]
+    output = sys.argv[2] if len(sys.argv) > 2 else "network_assets.h"
+
+    assets = []
+    for directory, _, files in sorted(os.walk(root)):
+        for name in sorted(files):
+            filename = os.path.join(directory, name)
+            with open(filename, "rb") as f:
+                data = f.read()
+
+            path = "/" + os.path.relpath(filename, root).replace(os.sep, "/")
+            gzipped = False
+            if os.path.splitext(name)[1].lower() not in NO_GZIP:
+                compressed = compress(data)
+                if len(compressed) < len(data):
+                    data = compressed
+                    gzipped = True
+
+            etag = hashlib.sha1(data).hexdigest()[:16]
+            assets.append((path, content_type(name), etag, data, gzipped))
+
+    lines = []
+    lines.append("// Generated by pack_assets.py, do not edit.")
+    lines.append("")
+    lines.append("#ifndef NETWORK_ASSETS_H")
+    lines.append("#define NETWORK_ASSETS_H")
+    lines.append("")
+    lines.append("#include <NetworkAssetServer.h>")
+    lines.append("")
+
+    for index, (path, _, _, data, gzipped) in enumerate(assets):
+        lines.append("// %s, %d bytes%s" % (path, len(data), " gzipped" if gzipped else ""))
+        lines.append("static constexpr uint8_t NETWORK_ASSET_DATA_%d[] PROGMEM = {" % index)
+        for offset in range(0, len(data), 16):
+            chunk = data[offset:offset + 16]
+            lines.append("  " + ", ".join("0x%02x" % b for b in chunk) + ",")
+        lines.append("};")
+        lines.append("")
+
+    lines.append("static constexpr NetworkAsset NETWORK_ASSETS[] = {")
+    for index, (path, kind, etag, data, gzipped) in enumerate(assets):
+        lines.append("  { \"%s\", \"%s\", \"\\\"%s\\\"\", NETWORK_ASSET_DATA_%d, %d, %s }," %
+                     (path, kind, etag, index, len(data), "true" if gzipped else "false"))
+    lines.append("};")
+    lines.append("static constexpr size_t NETWORK_ASSET_COUNT = %d;" % len(assets))
+    lines.append("")
+    lines.append("#endif // NETWORK_ASSETS_H")
+
+    with open(output, "w") as f:
+        f.write("\n".join(lines) + "\n")
+
+    total = sum(len(asset[3]) for asset in assets)
+    print("Packed %d files, %d bytes, into %s" % (len(assets), total, output))
+
+
+if __name__ == "__main__":
+    main()
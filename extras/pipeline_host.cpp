@@ -0,0 +1,74 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+// Host build of NetworkStreamPipeline, to check it without a Teensy.
+// It sends a file of random bytes through the pipeline into another
+// file, with the sink's window limited to simulate a slow network,
+// checks the copy matches, and prints the pipeline's numbers.
+//
+// Build and run from the top of the library:
+//
+//   g++ -std=gnu++17 -O2 -Isrc extras/pipeline_host.cpp -o pipeline_host
+//   ./pipeline_host [length] [window]   (default 1000000 bytes, 1460)
+//
+// It exits with 1 if the copy doesn't match.
+
+#include <stdlib.h>
+
+#include "NetworkStreamPipeline.h"
+
+// Same as the default pipeline on the Teensy
+static NetworkStreamPipeline<NetworkFileSource, NetworkFileSink> pipeline;
+
+static bool sameContents(FILE* a, FILE* b) {
+  uint8_t bufferA[4096];
+  uint8_t bufferB[4096];
+  rewind(a);
+  rewind(b);
+  while (true) {
+    size_t lengthA = fread(bufferA, 1, sizeof(bufferA), a);
+    size_t lengthB = fread(bufferB, 1, sizeof(bufferB), b);
+    if (lengthA != lengthB || memcmp(bufferA, bufferB, lengthA) != 0) {
+      return false;
+    }
+    if (lengthA == 0) {
+      return true;
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  size_t length = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  int window = argc > 2 ? atoi(argv[2]) : 1460;
+  
+  FILE* input = tmpfile();
+  FILE* output = tmpfile();
+  if (input == NULL || output == NULL) {
+    perror("tmpfile");
+    return 1;
+  }
+  
+  srand(1);
+  for (size_t x = 0; x < length; x++) {
+    fputc(rand() & 0xFF, input);
+  }
+  rewind(input);
+  
+  NetworkFileSource source(input);
+  NetworkFileSink sink(output, window);
+  size_t sent = pipeline.send(source, sink, length);
+  fflush(output);
+  
+  bool same = pipeline.isComplete() && sameContents(input, output);
+  printf("Sent %zu of %zu bytes in %u us, %u bytes/s\n", sent, length, pipeline.getElapsedMicros(),
+    pipeline.getThroughput());
+  printf("Read %u us, write %u us, network stalls %u, source stalls %u\n", pipeline.getReadMicros(),
+    pipeline.getWriteMicros(), pipeline.getNetworkStallCount(), pipeline.getSourceStallCount());
+  printf("Copy %s\n", same ? "OK" : "FAILED");
+  
+  fclose(input);
+  fclose(output);
+  return same ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+#
+# Licensed under the MIT license.
+# See accompanying LICENSE file for details.
+#
+
+# Host side peer for the ReliableBenchmark example. On the same port
+# it acknowledges the messages of a NetworkReliableChannel over UDP,
+# and echoes whatever a TCP client sends, so the device can time its
+# commands both ways.
+#
+# To see how each copes with loss, drop packets on the host with
+# netem, ie for 5% each way:
+#
+#   sudo tc qdisc add dev eth0 root netem loss 5%
+#   sudo tc qdisc del dev eth0 root
+#
+# Usage: reliable_echo.py [port]   (default port 8124)
+
+import socket
+import struct
+import sys
+import threading
+
+MAGIC = 0x5452  # 'TR'
+VERSION = 1
+TYPE_DATA = 1
+TYPE_ACK = 2
+DATA_HEADER = struct.Struct(">HBBHHHI")
+ACK = struct.Struct(">HBBHHII")
+WINDOW = 32
+
+
+def seq_diff(a, b):
+    return ((a - b + 0x8000) & 0xFFFF) - 0x8000
+
+
+class Receiver:
+    def __init__(self):
+        self.session = None
+        self.receive_next = 0
+        self.received = set()
+        self.messages = 0
+
+    def on_data(self, session, seq, first):
+        if session != self.session:
+            self.session = session
+            self.receive_next = 0
+            self.received = set()
+
+        # Forget messages the sender has given up on
+        while seq_diff(first, self.receive_next) > 0:
+            self.received.discard(self.receive_next)
+            self.receive_next = (self.receive_next + 1) & 0xFFFF
+
+        offset = seq_diff(seq, self.receive_next)
+        if 0 <= offset < WINDOW and seq not in self.received:
+            self.received.add(seq)
+            self.messages += 1
+        while self.receive_next in self.received:
+            self.received.discard(self.receive_next)
+            self.receive_next = (self.receive_next + 1) & 0xFFFF
+
+        sack = 0
+        for bit in range(32):
+            if ((self.receive_next + 1 + bit) & 0xFFFF) in self.received:
+                sack |= 1 << bit
+        return self.receive_next, sack
+
+
+def serve_udp(port):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("", port))
+    receivers = {}
+
+    while True:
+        data, address = sock.recvfrom(2048)
+        if len(data) < DATA_HEADER.size:
+            continue
+
+        magic, version, kind, session, seq, first, sent = DATA_HEADER.unpack_from(data)
+        if magic != MAGIC or version != VERSION or kind != TYPE_DATA:
+            continue
+
+        receiver = receivers.setdefault(address, Receiver())
+        ack, sack = receiver.on_data(session, seq, first)
+        # Notices of given up messages are acked too, or they are resent
+        sock.sendto(ACK.pack(MAGIC, VERSION, TYPE_ACK, session, ack, sack, sent), address)
+
+
+def echo(connection):
+    connection.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    with connection:
+        while True:
+            data = connection.recv(2048)
+            if not data:
+                return
+            connection.sendall(data)
+
+
+def serve_tcp(port):
+    server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    server.bind(("", port))
+    server.listen()
+
+    while True:
+        connection, _ = server.accept()
+        threading.Thread(target=echo, args=(connection,), daemon=True).start()
+
+
+def main():
+    port = int(sys.argv[1]) if len(sys.argv) > 1 else 8124
+
+    threading.Thread(target=serve_tcp, args=(port,), daemon=True).start()
+    print("Acknowledging reliable messages and echoing TCP on port %d" % port)
+    serve_udp(port)
+
+
+if __name__ == "__main__":
+    main()
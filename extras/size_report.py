@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+#
+# Licensed under the MIT license.
+# See accompanying LICENSE file for details.
+#
+
+# Prints the flash and RAM a small sketch takes for each hub, built
+# with every backend compiled (the default) and with only that
+# backend selected (see src/NetworkHubConfig.h), so the saving can be
+# tracked from release to release.
+#
+# It needs arduino-cli with the board's core and the network
+# libraries of all three hubs installed, and this library on the
+# library path (it is passed with --library).
+#
+# Usage: size_report.py [fqbn]   (default teensy:avr:teensy41)
+
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+LIBRARY = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+BACKENDS = {
+    "QNEthernet": ("NETWORKHUB_BACKEND_QNETHERNET", """
+#include <QNEthernetNetworkHub.h>
+QNEthernetNetworkHub networkHub = QNEthernetNetworkHub::getInstance();
+bool begin() { return networkHub.begin(&Serial); }
+"""),
+    "NativeEthernet": ("NETWORKHUB_BACKEND_NATIVEETHERNET", """
+#include <NativeEthernetNetworkHub.h>
+NativeEthernetNetworkHub networkHub = NativeEthernetNetworkHub::getInstance();
+byte mac[] = { 0xDE, 0xAD, 0xBE, 0xEF, 0xFE, 0xED };
+bool begin() { return networkHub.begin(mac, &Serial); }
+"""),
+    "WiFiNINA": ("NETWORKHUB_BACKEND_WIFININA", """
+#include <WiFiNINANetworkHub.h>
+WiFiNINANetworkHub networkHub = WiFiNINANetworkHub::getInstance();
+bool begin() {
+  networkHub.setPins(11, 12, 13, 10, 9, 8);
+  return networkHub.begin("ssid", "password", &Serial);
+}
+"""),
+}
+
+# Uses a client and a UDP, so their wrappers are linked
+SKETCH = """
+void setup() {
+  Serial.begin(9600);
+  if (!begin()) {
+    return;
+  }
+  NetworkClient client = networkHub.getClient();
+  client.connect(IPAddress(192, 168, 1, 2), 80);
+  NetworkUDP* udp = networkHub.getUDP();
+  udp->begin(5000);
+}
+
+void loop() {
+}
+"""
+
+
+def build_property(fqbn, flags):
+    # The Teensy core has no extra_flags hook, but passes the
+    # optimization flags to every compile
+    if fqbn.startswith("teensy:"):
+        return "build.flags.optimize=-O2 " + flags
+    return "compiler.cpp.extra_flags=" + flags
+
+
+def parse_sizes(output):
+    """Returns (flash, ram) in bytes from the compile output."""
+    # teensy_size, for the Teensy 4.x
+    flash = re.search(r"FLASH: code:(\d+), data:(\d+), headers:(\d+)", output)
+    ram1 = re.search(r"RAM1: variables:(\d+), code:(\d+), padding:(\d+)", output)
+    ram2 = re.search(r"RAM2: variables:(\d+)", output)
+    if flash and ram1:
+        ram = sum(int(value) for value in ram1.groups())
+        if ram2:
+            ram += int(ram2.group(1))
+        return sum(int(value) for value in flash.groups()), ram
+
+    # Every other core
+    flash = re.search(r"Sketch uses (\d+) bytes", output)
+    ram = re.search(r"Global variables use (\d+) bytes", output)
+    if flash and ram:
+        return int(flash.group(1)), int(ram.group(1))
+    return None
+
+
+def compile_sketch(fqbn, backend, flags):
+    source = BACKENDS[backend][1]
+    with tempfile.TemporaryDirectory() as directory:
+        sketch = os.path.join(directory, "SizeReport")
+        os.mkdir(sketch)
+        with open(os.path.join(sketch, "SizeReport.ino"), "w") as file:
+            file.write(source + SKETCH)
+
+        command = ["arduino-cli", "compile", "--fqbn", fqbn, "--library", LIBRARY,
+                   "--build-property", build_property(fqbn, flags), sketch]
+        result = subprocess.run(command, capture_output=True, text=True)
+        if result.returncode != 0:
+            sys.stderr.write(result.stdout + result.stderr)
+            return None
+        return parse_sizes(result.stdout)
+
+
+def main():
+    fqbn = sys.argv[1] if len(sys.argv) > 1 else "teensy:avr:teensy41"
+    if shutil.which("arduino-cli") is None:
+        sys.exit("arduino-cli was not found on the PATH")
+
+    print("%-16s %-14s %10s %10s" % ("Hub", "Backends", "Flash", "RAM"))
+    for backend, (macro, _) in BACKENDS.items():
+        sizes = {}
+        for label, flags in (("all", ""), ("only this", "-D" + macro)):
+            sizes[label] = compile_sketch(fqbn, backend, flags)
+            if sizes[label] is None:
+                print("%-16s %-14s %21s" % (backend, label, "failed"))
+            else:
+                print("%-16s %-14s %10d %10d" % ((backend, label) + sizes[label]))
+
+        if sizes["all"] and sizes["only this"]:
+            print("%-16s %-14s %10d %10d" % (backend, "saved",
+                  sizes["all"][0] - sizes["only this"][0], sizes["all"][1] - sizes["only this"][1]))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,447 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+// Local includes
+#include "CompositeNetworkHub.h"
+#include "NetworkFactory.h"
+#include "NetworkClient.h"
+#include "NetworkClientWrapper.h"
+#include "NetworkUDP.h"
+#include "NetworkUDPWrapper.h"
+#include "NetworkServer.h"
+#include "NetworkServerWrapper.h"
+
+// NetworkClientWrapper that creates its client on whichever hub is
+// active for its traffic class at the time it connects.
+//
+class CompositeClientWrapper : public NetworkClientWrapper {
+  public:
+    int connect(IPAddress ip, uint16_t port) { selectClient(); return _client.connect(ip, port); };
+    int connect(const char *host, uint16_t port) { selectClient(); return _client.connect(host, port); };
+    size_t write(uint8_t b) { return _client.write(b); };
+    size_t write(const uint8_t *buf, size_t size) { return _client.write(buf, size); };
+    int available() { return _client.available(); };
+    int read() { return _client.read(); };
+    int read(uint8_t *buf, size_t size) { return _client.read(buf, size); };
+    int peek() { return _client.peek(); };
+    void flush() { _client.flush(); };
+    void stop() { _client.stop(); };
+    uint8_t connected() { return _client.connected(); };
+    operator bool() { return _client ? true : false; };
+    IPAddress remoteIP() { return _client.remoteIP(); };
+    uint16_t remotePort() { return _client.remotePort(); };
+    int availableForWrite() { return _client.availableForWrite(); };
+    bool hasNonBlockingWrite() { return _client.hasNonBlockingWrite(); };
+    
+    NetworkClientWrapper* clone() {
+      CompositeClientWrapper* clientWrapper = new CompositeClientWrapper(_compositeHub, _trafficClass, _client);
+      clientWrapper->_connectTimeoutMs = _connectTimeoutMs;
+      clientWrapper->_selected = _selected;
+      return clientWrapper;
+    }
+    
+    // The underlying client keeps its own deadlines
+    void setConnectionTimeout(uint32_t timeoutMs) { _connectTimeoutMs = timeoutMs; };
+    void setConnectWaits(bool waits) { _connectWaits = waits; };
+    bool hasNonBlockingConnect() { return selectedClient().hasNonBlockingConnect(); };
+    int startConnect(IPAddress ip, uint16_t port) {
+      selectClient();
+      return _client.connectStart(ip, port) == NETWORK_CONNECT_FAILED ? 0 : 1;
+    };
+    int startConnect(const char *host, uint16_t port) {
+      selectClient();
+      return _client.connectStart(host, port) == NETWORK_CONNECT_FAILED ? 0 : 1;
+    };
+    int pollConnect() { return _client.connectStatus(); };
+    
+    bool hasSecureConnect() { return selectedClient().hasSecureConnect(); };
+    int connectSecure(IPAddress ip, uint16_t port) { selectClient(); return _client.connectSecure(ip, port); };
+    int connectSecure(const char *host, uint16_t port) { selectClient(); return _client.connectSecure(host, port); };
+    
+  private:
+    friend class CompositeNetworkHub;
+    
+    // The client is created when it is first needed, on the hub
+    // that is active then
+    CompositeClientWrapper(CompositeNetworkHub* compositeHub, uint8_t trafficClass) {
+      _compositeHub = compositeHub;
+      _trafficClass = trafficClass;
+    };
+    
+    CompositeClientWrapper(CompositeNetworkHub* compositeHub, uint8_t trafficClass, NetworkClient& client) {
+      _compositeHub = compositeHub;
+      _trafficClass = trafficClass;
+      _client = client;
+      _selected = true;
+    };
+    
+    // Replace the client with one from the active hub
+    void selectClient() {
+      int8_t index = _compositeHub->selectHub(_trafficClass);
+      if (index >= 0) {
+        _client.stop();
+        _client = _compositeHub->getHub(index)->getClient();
+        _client.setConnectTimeout(_connectTimeoutMs);
+        _selected = true;
+      }
+      _client._connectWaits = _connectWaits;
+    };
+    
+    // The client, for asking what it can do before it connects
+    NetworkClient& selectedClient() {
+      if (!_selected) {
+        selectClient();
+      }
+      return _client;
+    };
+    
+    CompositeNetworkHub* _compositeHub;
+    uint8_t _trafficClass;
+    uint32_t _connectTimeoutMs = 0;
+    bool _connectWaits = false;
+    // Whether _client came from a hub yet
+    bool _selected = false;
+    NetworkClient _client;
+};
+
+// NetworkServerWrapper that listens on every hub.
+//
+class CompositeServerWrapper : public NetworkServerWrapper {
+  public:
+    // Take turns so a busy interface can't starve the others
+    NetworkClient available() {
+      for (uint8_t x = 0; x < _serverCount; x++) {
+        _nextServer = (_nextServer + 1) % _serverCount;
+        if (_servers[_nextServer] != NULL) {
+          NetworkClient client = _servers[_nextServer]->available();
+          if (client) {
+            return client;
+          }
+        }
+      }
+      return NetworkClient();
+    };
+    
+    void begin() {
+      for (uint8_t x = 0; x < _serverCount; x++) {
+        if (_servers[x] != NULL) {
+          _servers[x]->begin();
+        }
+      }
+    };
+    
+    size_t write(uint8_t b) { return write(&b, 1); };
+    
+    size_t write(const uint8_t *buf, size_t size) {
+      size_t written = 0;
+      for (uint8_t x = 0; x < _serverCount; x++) {
+        if (_servers[x] != NULL) {
+          written = max(written, _servers[x]->write(buf, size));
+        }
+      }
+      return written;
+    };
+    
+    ~CompositeServerWrapper() {
+      for (uint8_t x = 0; x < _serverCount; x++) {
+        delete _servers[x];
+      }
+    };
+    
+  private:
+    friend class CompositeNetworkHub;
+    
+    CompositeServerWrapper(CompositeNetworkHub* compositeHub, uint32_t portNum) {
+      _serverCount = compositeHub->getHubCount();
+      for (uint8_t x = 0; x < NETWORKHUB_COMPOSITE_MAX_HUBS; x++) {
+        _servers[x] = x < _serverCount ? compositeHub->getHub(x)->getServer(portNum) : NULL;
+      }
+    };
+    
+    NetworkServer* _servers[NETWORKHUB_COMPOSITE_MAX_HUBS];
+    uint8_t _serverCount;
+    uint8_t _nextServer = 0;
+};
+
+// NetworkUDPWrapper that listens on every hub, and sends each
+// packet over the hub active for its traffic class.
+//
+class CompositeUDPWrapper : public NetworkUDPWrapper {
+  public:
+    
+    uint8_t begin(uint16_t port) {
+      uint8_t result = 0;
+      for (uint8_t x = 0; x < _udpCount; x++) {
+        if (_udps[x] != NULL && _udps[x]->begin(port) == 1) {
+          result = 1;
+        }
+      }
+      return result;
+    };
+    
+    uint8_t beginMulticast(IPAddress ip, uint16_t port) {
+      uint8_t result = 0;
+      for (uint8_t x = 0; x < _udpCount; x++) {
+        if (_udps[x] != NULL && _udps[x]->beginMulticast(ip, port) == 1) {
+          result = 1;
+        }
+      }
+      return result;
+    };
+    
+    void stop() {
+      for (uint8_t x = 0; x < _udpCount; x++) {
+        if (_udps[x] != NULL) {
+          _udps[x]->stop();
+        }
+      }
+    };
+    
+    int beginPacket(IPAddress ip, uint16_t port) {
+      return selectSend() ? _udps[_sendIndex]->beginPacket(ip, port) : 0;
+    };
+    int beginPacket(const char *host, uint16_t port) {
+      return selectSend() ? _udps[_sendIndex]->beginPacket(host, port) : 0;
+    };
+    int endPacket() { return _sendIndex >= 0 ? _udps[_sendIndex]->endPacket() : 0; };
+    size_t write(uint8_t b) { return _sendIndex >= 0 ? _udps[_sendIndex]->write(b) : 0; };
+    size_t write(const uint8_t *buffer, size_t size) { return _sendIndex >= 0 ? _udps[_sendIndex]->write(buffer, size) : 0; };
+    uint8_t* reserve(size_t size) { return _sendIndex >= 0 ? _udps[_sendIndex]->reserve(size) : NULL; };
+    size_t commit(size_t used) { return _sendIndex >= 0 ? _udps[_sendIndex]->commit(used) : 0; };
+    
+    // Take turns so a busy interface can't starve the others
+    int parsePacket() {
+      for (uint8_t x = 0; x < _udpCount; x++) {
+        _receiveIndex = (_receiveIndex + 1) % _udpCount;
+        if (_udps[_receiveIndex] != NULL) {
+          int size = _udps[_receiveIndex]->parsePacket();
+          if (size > 0) {
+            return size;
+          }
+        }
+      }
+      return 0;
+    };
+    
+    int available() { return receiver() != NULL ? receiver()->available() : 0; };
+    int read() { return receiver() != NULL ? receiver()->read() : -1; };
+    int read(unsigned char* buffer, size_t len) { return receiver() != NULL ? receiver()->read(buffer, len) : 0; };
+    int read(char* buffer, size_t len) { return receiver() != NULL ? receiver()->read(buffer, len) : 0; };
+    int peek() { return receiver() != NULL ? receiver()->peek() : -1; };
+    void flush() { if (receiver() != NULL) { receiver()->flush(); } };
+    IPAddress remoteIP() { return receiver() != NULL ? receiver()->remoteIP() : IPAddress(0,0,0,0); };
+    uint16_t remotePort() { return receiver() != NULL ? receiver()->remotePort() : 0; };
+    
+    ~CompositeUDPWrapper() {
+      for (uint8_t x = 0; x < _udpCount; x++) {
+        delete _udps[x];
+      }
+    };
+    
+  private:
+    friend class CompositeNetworkHub;
+    
+    CompositeUDPWrapper(CompositeNetworkHub* compositeHub, uint8_t trafficClass) {
+      _compositeHub = compositeHub;
+      _trafficClass = trafficClass;
+      _udpCount = compositeHub->getHubCount();
+      for (uint8_t x = 0; x < NETWORKHUB_COMPOSITE_MAX_HUBS; x++) {
+        _udps[x] = x < _udpCount ? compositeHub->getHub(x)->getUDP() : NULL;
+      }
+    };
+    
+    bool selectSend() {
+      _sendIndex = _compositeHub->selectHub(_trafficClass);
+      if (_sendIndex >= 0 && _udps[_sendIndex] == NULL) {
+        _sendIndex = -1;
+      }
+      return _sendIndex >= 0;
+    };
+    
+    NetworkUDP* receiver() { return _udps[_receiveIndex]; };
+    
+    CompositeNetworkHub* _compositeHub;
+    uint8_t _trafficClass;
+    NetworkUDP* _udps[NETWORKHUB_COMPOSITE_MAX_HUBS];
+    uint8_t _udpCount;
+    int8_t _sendIndex = -1;
+    uint8_t _receiveIndex = 0;
+};
+
+#if defined(NETWORKHUB_STATIC_ALLOC)
+static_assert(sizeof(CompositeClientWrapper) <= NETWORKHUB_CLIENT_WRAPPER_SIZE, "Increase NETWORKHUB_CLIENT_WRAPPER_SIZE");
+static_assert(sizeof(CompositeServerWrapper) <= NETWORKHUB_SERVER_WRAPPER_SIZE, "Increase NETWORKHUB_SERVER_WRAPPER_SIZE");
+static_assert(sizeof(CompositeUDPWrapper) <= NETWORKHUB_UDP_WRAPPER_SIZE, "Increase NETWORKHUB_UDP_WRAPPER_SIZE");
+#endif
+
+bool CompositeNetworkHub::addHub(NetworkHub* hub, uint8_t trafficClasses) {
+  if (hub == NULL || _hubCount >= NETWORKHUB_COMPOSITE_MAX_HUBS) {
+    return false;
+  }
+  
+  _hubs[_hubCount].hub = hub;
+  _hubs[_hubCount].trafficClasses = trafficClasses;
+  _hubs[_hubCount].linkUp = false;
+  _hubs[_hubCount].lastSeenUpMicros = micros();
+  _hubs[_hubCount].foundDownMicros = micros();
+  _hubCount++;
+  
+  // Check all of the links on the next use
+  _linksChecked = false;
+  return true;
+}
+
+void CompositeNetworkHub::poll() {
+  if (!_linksChecked || millis() - _lastLinkCheckMillis >= _linkCheckIntervalMs) {
+    checkLinks();
+  }
+}
+
+void CompositeNetworkHub::service() {
+  poll();
+  for (uint8_t x = 0; x < _hubCount; x++) {
+    _hubs[x].hub->service();
+  }
+  NetworkHub::service();
+}
+
+void CompositeNetworkHub::readStatus(NetworkHubStatus& status) {
+  NetworkHub* hub = getActiveHub();
+  if (hub == NULL) {
+    status.linkState = NETWORK_LINK_DOWN;
+    status.hardwareType = NETWORK_HARDWARE_COMPOSITE;
+    return;
+  }
+  status = hub->getStatus();
+}
+
+void CompositeNetworkHub::checkLinks() {
+  _lastLinkCheckMillis = millis();
+  _linksChecked = true;
+  
+  for (uint8_t x = 0; x < _hubCount; x++) {
+    bool wasUp = _hubs[x].linkUp;
+    _hubs[x].linkUp = _hubs[x].hub->isLinkUp();
+    if (_hubs[x].linkUp) {
+      _hubs[x].lastSeenUpMicros = micros();
+    } else if (wasUp) {
+      _hubs[x].foundDownMicros = micros();
+    }
+  }
+  
+  // Only a live link takes over. With every link down traffic falls
+  // back on the first hub, but that is no failover.
+  int8_t activeIndex = findHub(NETWORK_TRAFFIC_DEFAULT);
+  if (activeIndex < 0 || !_hubs[activeIndex].linkUp || activeIndex == _activeIndex) {
+    return;
+  }
+  
+  // The first selection is not a failover
+  if (_activeIndex >= 0) {
+    // Away from a link that went down, timed from the last check
+    // that saw it up; back to a preferred link that recovered, timed
+    // from the check that found it down
+    HubEntry& from = _hubs[_activeIndex];
+    HubEntry& to = _hubs[activeIndex];
+    uint32_t failoverMicros = from.linkUp ? micros() - to.foundDownMicros : micros() - from.lastSeenUpMicros;
+    _failoverCount++;
+    _lastFailoverMicros = failoverMicros;
+    _maxFailoverMicros = max(_maxFailoverMicros, failoverMicros);
+    
+    if (_failoverCallback != NULL) {
+      _failoverCallback(from.hub, to.hub, failoverMicros);
+    }
+  }
+  _activeIndex = activeIndex;
+}
+
+int8_t CompositeNetworkHub::selectHub(uint8_t trafficClass) {
+  poll();
+  return findHub(trafficClass);
+}
+
+int8_t CompositeNetworkHub::findHub(uint8_t trafficClass) {
+  int8_t firstLive = -1;
+  for (uint8_t x = 0; x < _hubCount; x++) {
+    if (!_hubs[x].linkUp) {
+      continue;
+    }
+    if (_hubs[x].trafficClasses & NETWORK_TRAFFIC_BIT(trafficClass)) {
+      return x;
+    }
+    if (firstLive < 0) {
+      firstLive = x;
+    }
+  }
+  
+  // With every link down, fall back on the first hub
+  if (firstLive < 0 && _hubCount > 0) {
+    firstLive = 0;
+  }
+  return firstLive;
+}
+
+NetworkHub* CompositeNetworkHub::getActiveHub(uint8_t trafficClass) {
+  int8_t index = selectHub(trafficClass);
+  return index >= 0 ? _hubs[index].hub : NULL;
+}
+
+IPAddress CompositeNetworkHub::getLocalIPAddress() {
+  NetworkHub* hub = getActiveHub();
+  return hub != NULL ? hub->getLocalIPAddress() : IPAddress(0,0,0,0);
+}
+
+NetworkClient CompositeNetworkHub::getClient(uint8_t trafficClass) {
+  CompositeClientWrapper* clientWrapper = new CompositeClientWrapper(this, trafficClass);
+  
+  return NetworkFactory::createNetworkClient(addTLSProvider(clientWrapper));
+}
+
+NetworkServer* CompositeNetworkHub::getServer(uint32_t portNum) {
+  CompositeServerWrapper* serverWrapper = new CompositeServerWrapper(this, portNum);
+  
+  return NetworkFactory::createNetworkServer(serverWrapper);
+}
+
+NetworkUDP* CompositeNetworkHub::getUDP(uint8_t trafficClass) {
+  CompositeUDPWrapper* udpWrapper = new CompositeUDPWrapper(this, trafficClass);
+  
+  return NetworkFactory::createNetworkUDP(udpWrapper);
+}
+
+bool CompositeNetworkHub::isLinkUp() {
+  poll();
+  
+  for (uint8_t x = 0; x < _hubCount; x++) {
+    if (_hubs[x].linkUp) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void CompositeNetworkHub::printStatus(Print* printer) {
+  poll();
+  
+  for (uint8_t x = 0; x < _hubCount; x++) {
+    printer->print("Hub ");
+    printer->print(x);
+    printer->print(": link ");
+    printer->print(_hubs[x].linkUp ? "up" : "down");
+    if (x == _activeIndex) {
+      printer->print(", active");
+    }
+    printer->println();
+    _hubs[x].hub->printStatus(printer);
+  }
+  
+  printer->print("Failovers: ");
+  printer->print(_failoverCount);
+  printer->print(", last ");
+  printer->print(_lastFailoverMicros);
+  printer->print(" us, max ");
+  printer->print(_maxFailoverMicros);
+  printer->println(" us");
+}
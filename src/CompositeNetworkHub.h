@@ -0,0 +1,131 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef COMPOSITENETWORKHUB_H
+#define COMPOSITENETWORKHUB_H
+
+#include <Arduino.h>
+
+#include "NetworkHub.h"
+
+// Maximum number of hubs a CompositeNetworkHub can combine.
+#ifndef NETWORKHUB_COMPOSITE_MAX_HUBS
+#define NETWORKHUB_COMPOSITE_MAX_HUBS 4
+#endif
+
+// Default time between link checks, in milliseconds.
+#ifndef NETWORKHUB_COMPOSITE_LINK_CHECK_INTERVAL
+#define NETWORKHUB_COMPOSITE_LINK_CHECK_INTERVAL 100
+#endif
+
+// The kinds of traffic a CompositeNetworkHub can steer to
+// different interfaces.
+enum NetworkTrafficClass {
+  NETWORK_TRAFFIC_DEFAULT,
+  NETWORK_TRAFFIC_BULK,     // high rate streams, ie telemetry over UDP
+  NETWORK_TRAFFIC_CONTROL   // low rate commands and status
+};
+
+// Bits for the traffic classes a hub is preferred for.
+#define NETWORK_TRAFFIC_BIT(trafficClass) (1 << (trafficClass))
+#define NETWORK_TRAFFIC_ALL 0xFF
+
+// Called when default traffic moves from one live interface to
+// another. Away from a link that went down, failoverMicros is the
+// time from the last check that saw it up until the switch, so it
+// includes the time taken to notice. Back to a preferred link that
+// recovered, it is the time from the check that found that link
+// down, the length of the outage.
+typedef void (*NetworkFailoverCallback)(NetworkHub* fromHub, NetworkHub* toHub, uint32_t failoverMicros);
+
+// A network hub that combines several other hubs, for instance a
+// QNEthernetNetworkHub and a WiFiNINANetworkHub on the same robot.
+// Each hub must be started with its own begin() first.
+//
+// New clients and UDP packets go out over the first live hub that
+// is preferred for their traffic class, or the first live hub if
+// none is, so traffic fails over when a link goes down and comes
+// back when it recovers. UDPs and servers listen on every hub.
+// Connected TCP clients stay on the interface they started on;
+// connect again after a failover to move them.
+//
+class CompositeNetworkHub : public NetworkHub {
+  public:
+    CompositeNetworkHub() { /* Nothing to see here, move along. */ };
+    
+    // Add a hub. Hubs added first are preferred. trafficClasses is
+    // a mask of NETWORK_TRAFFIC_BIT() values this hub should carry
+    // when it is up. Returns false if there is no room.
+    bool addHub(NetworkHub* hub, uint8_t trafficClasses = NETWORK_TRAFFIC_ALL);
+    
+    // Check the links if the interval has passed, and fail over if
+    // needed. This is also done when traffic is steered, but call
+    // it from loop() so failovers are noticed promptly.
+    void poll();
+    
+    void setLinkCheckInterval(uint32_t intervalMs) { _linkCheckIntervalMs = intervalMs; };
+    void setFailoverCallback(NetworkFailoverCallback callback) { _failoverCallback = callback; };
+    
+    // Returns the hub currently used for the given traffic class.
+    NetworkHub* getActiveHub(uint8_t trafficClass = NETWORK_TRAFFIC_DEFAULT);
+    
+    // Failover measurements for the default traffic class. Only
+    // switches between live links count: with every link down,
+    // traffic falls back on the first hub without a failover.
+    uint32_t getFailoverCount() { return _failoverCount; };
+    uint32_t getLastFailoverMicros() { return _lastFailoverMicros; };
+    uint32_t getMaxFailoverMicros() { return _maxFailoverMicros; };
+    
+    // Create a client or UDP for a specific traffic class.
+    NetworkClient getClient(uint8_t trafficClass);
+    NetworkUDP* getUDP(uint8_t trafficClass);
+    
+    // NetworkHub methods
+    IPAddress getLocalIPAddress();
+    NetworkClient getClient() { return getClient(NETWORK_TRAFFIC_DEFAULT); };
+    NetworkServer* getServer(uint32_t portNum);
+    NetworkUDP* getUDP() { return getUDP(NETWORK_TRAFFIC_DEFAULT); };
+    void printStatus(Print* printer);
+    bool isLinkUp();
+    // Also polls, and services the hubs it combines.
+    void service();
+    
+    // Used by the composite wrappers
+    uint8_t getHubCount() { return _hubCount; };
+    NetworkHub* getHub(uint8_t index) { return _hubs[index].hub; };
+    int8_t selectHub(uint8_t trafficClass);
+    
+  protected:
+    struct HubEntry {
+      NetworkHub* hub;
+      uint8_t trafficClasses;
+      bool linkUp;
+      uint32_t lastSeenUpMicros;
+      uint32_t foundDownMicros;
+    };
+    
+    // The status of the hub in use for default traffic
+    void readStatus(NetworkHubStatus& status);
+    
+    void checkLinks();
+    // Same as selectHub() but uses the link states as they are
+    int8_t findHub(uint8_t trafficClass);
+    
+    HubEntry _hubs[NETWORKHUB_COMPOSITE_MAX_HUBS];
+    uint8_t _hubCount = 0;
+    
+    uint32_t _linkCheckIntervalMs = NETWORKHUB_COMPOSITE_LINK_CHECK_INTERVAL;
+    uint32_t _lastLinkCheckMillis = 0;
+    bool _linksChecked = false;
+    
+    // The live hub last used for default traffic
+    int8_t _activeIndex = -1;
+    NetworkFailoverCallback _failoverCallback = NULL;
+    uint32_t _failoverCount = 0;
+    uint32_t _lastFailoverMicros = 0;
+    uint32_t _maxFailoverMicros = 0;
+};
+
+#endif // COMPOSITENETWORKHUB_H
@@ -0,0 +1,97 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+// Local includes
+#include "DecoratedNetworkHub.h"
+#include "NetworkFactory.h"
+#include "NetworkServer.h"
+#include "NetworkServerWrapper.h"
+
+// NetworkServerWrapper that decorates the clients its server accepts.
+//
+class DecoratedServerWrapper : public NetworkServerWrapper {
+  public:
+    NetworkClient available() {
+      NetworkClient client = _server->available();
+      return client ? _decoratedHub->decorate(client, _portNum) : client;
+    };
+    void begin() { _server->begin(); };
+    size_t write(uint8_t b) { return _server->write(b); };
+    size_t write(const uint8_t *buf, size_t size) { return _server->write(buf, size); };
+    
+    ~DecoratedServerWrapper() {
+      delete _server;
+    };
+    
+  private:
+    friend class DecoratedNetworkHub;
+    
+    DecoratedServerWrapper(DecoratedNetworkHub* decoratedHub, NetworkServer* server, uint16_t portNum) {
+      _decoratedHub = decoratedHub;
+      _server = server;
+      _portNum = portNum;
+    };
+    
+    DecoratedNetworkHub* _decoratedHub;
+    NetworkServer* _server;
+    uint16_t _portNum;
+};
+
+#if defined(NETWORKHUB_STATIC_ALLOC)
+static_assert(sizeof(DecoratedServerWrapper) <= NETWORKHUB_SERVER_WRAPPER_SIZE, "Increase NETWORKHUB_SERVER_WRAPPER_SIZE");
+#endif
+
+bool DecoratedNetworkHub::addDecorator(NetworkDecorator* decorator) {
+  if (decorator == NULL || _decoratorCount >= NETWORKHUB_MAX_DECORATORS) {
+    return false;
+  }
+  
+  _decorators[_decoratorCount++] = decorator;
+  decorator->attach(this);
+  return true;
+}
+
+NetworkClient DecoratedNetworkHub::decorate(NetworkClient client, uint16_t localPort) {
+  for (uint8_t x = 0; x < _decoratorCount; x++) {
+    // If a wrapper can't be allocated the client goes on without it
+    NetworkClientWrapper* clientWrapper = _decorators[x]->decorateClient(client, localPort);
+    if (clientWrapper != NULL) {
+      client = NetworkFactory::createNetworkClient(clientWrapper);
+    }
+  }
+  return client;
+}
+
+NetworkUDP* DecoratedNetworkHub::decorate(NetworkUDP* udp) {
+  for (uint8_t x = 0; x < _decoratorCount && udp != NULL; x++) {
+    NetworkUDPWrapper* udpWrapper = _decorators[x]->decorateUDP(udp);
+    if (udpWrapper != NULL) {
+      // The decorator owns udp now, if this fails both are deleted
+      udp = NetworkFactory::createNetworkUDP(udpWrapper);
+    }
+  }
+  return udp;
+}
+
+NetworkServer* DecoratedNetworkHub::getServer(uint32_t portNum) {
+  NetworkServer* server = _networkHub->getServer(portNum);
+  for (uint8_t x = 0; x < _decoratorCount && server != NULL; x++) {
+    NetworkServerWrapper* serverWrapper = _decorators[x]->decorateServer(server, portNum);
+    if (serverWrapper != NULL) {
+      // The decorator owns server now, if this fails both are deleted
+      server = NetworkFactory::createNetworkServer(serverWrapper);
+    }
+  }
+  if (server == NULL) {
+    return NULL;
+  }
+  
+  DecoratedServerWrapper* serverWrapper = new DecoratedServerWrapper(this, server, portNum);
+  if (serverWrapper == NULL) {
+    delete server;
+    return NULL;
+  }
+  return NetworkFactory::createNetworkServer(serverWrapper);
+}
@@ -0,0 +1,69 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef DECORATEDNETWORKHUB_H
+#define DECORATEDNETWORKHUB_H
+
+#include <Arduino.h>
+
+#include "NetworkHub.h"
+#include "NetworkDecorator.h"
+
+// Maximum number of decorators on a DecoratedNetworkHub.
+#ifndef NETWORKHUB_MAX_DECORATORS
+#define NETWORKHUB_MAX_DECORATORS 4
+#endif
+
+// A network hub that hands out the clients, servers and UDPs of
+// another hub with NetworkDecorators in front of them, for instance
+// a NetworkCapture. The other hub must be started with its own
+// begin() first. Use it in place of that hub:
+//
+//   QNEthernetNetworkHub& qnHub = QNEthernetNetworkHub::getInstance();
+//   DecoratedNetworkHub networkHub(&qnHub);
+//   NetworkCapture capture;
+//   networkHub.addDecorator(&capture);
+//
+// Decorators are applied in the order they are added, so the last
+// one added sees the application's calls first. Clients accepted
+// by its servers are decorated too. Each decorator adds a wrapper
+// to every socket, which counts against the pools when
+// NETWORKHUB_STATIC_ALLOC is defined.
+//
+class DecoratedNetworkHub : public NetworkHub {
+  public:
+    DecoratedNetworkHub(NetworkHub* networkHub) { _networkHub = networkHub; };
+    
+    // Returns false if there is no room for it.
+    bool addDecorator(NetworkDecorator* decorator);
+    
+    // Put the decorators in front of a client or UDP from elsewhere,
+    // ie one created before the decorators were added.
+    NetworkClient decorate(NetworkClient client, uint16_t localPort = 0);
+    NetworkUDP* decorate(NetworkUDP* udp);
+    
+    NetworkHub* getDecoratedHub() { return _networkHub; };
+    
+    // NetworkHub methods
+    IPAddress getLocalIPAddress() { return _networkHub->getLocalIPAddress(); };
+    NetworkClient getClient() { return decorate(_networkHub->getClient()); };
+    NetworkServer* getServer(uint32_t portNum);
+    NetworkUDP* getUDP() { return decorate(_networkHub->getUDP()); };
+    void printStatus(Print* printer) { _networkHub->printStatus(printer); };
+    bool isLinkUp() { return _networkHub->isLinkUp(); };
+    int getSecureConnectSupport() { return _networkHub->getSecureConnectSupport(); };
+    uint8_t getSocketLimit(uint8_t type) { return _networkHub->getSocketLimit(type); };
+    uint8_t getTotalSocketLimit() { return _networkHub->getTotalSocketLimit(); };
+    void service() { _networkHub->service(); NetworkHub::service(); };
+    
+  protected:
+    void readStatus(NetworkHubStatus& status) { status = _networkHub->getStatus(); };
+    
+    NetworkHub* _networkHub;
+    NetworkDecorator* _decorators[NETWORKHUB_MAX_DECORATORS];
+    uint8_t _decoratorCount = 0;
+};
+
+#endif // DECORATEDNETWORKHUB_H
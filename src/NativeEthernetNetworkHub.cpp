@@ -3,6 +3,11 @@
 // See accompanying LICENSE file for details.
 //
 
+// Backend selection
+#include "NetworkHubConfig.h"
+
+#if defined(NETWORKHUB_BACKEND_NATIVEETHERNET)
+
 // Third-party includes
 #include <NativeEthernet.h>  // https://github.com/vjmuzik/NativeEthernet
 
@@ -16,6 +21,9 @@
 #include "NetworkServer.h"
 #include "NetworkServerWrapper.h"
 
+// EthernetClient's own connection timeout, in milliseconds
+static const uint16_t DEFAULT_CONNECTION_TIMEOUT = 1000;
+
 // NetworkClientWrapper implementation for NativeEthernet EthernetClient.
 //
 class NativeEthernetClientWrapper : public NetworkClientWrapper {
@@ -34,11 +42,18 @@ class NativeEthernetClientWrapper : public NetworkClientWrapper {
     operator bool() { return _ethernetClient ? true : false; };
     IPAddress remoteIP() { return _ethernetClient.remoteIP(); };
     uint16_t remotePort() { return _ethernetClient.remotePort(); };
+    int availableForWrite() { return _ethernetClient.availableForWrite(); };
     
     NetworkClientWrapper* clone() {
       return new NativeEthernetClientWrapper(_ethernetClient);
     }
     
+    // NativeEthernet can only connect by blocking, but the wait
+    // can be capped.
+    void setConnectionTimeout(uint32_t timeoutMs) {
+      _ethernetClient.setConnectionTimeout(timeoutMs > 0 ? min(timeoutMs, (uint32_t)UINT16_MAX) : DEFAULT_CONNECTION_TIMEOUT);
+    };
+    
   private:
     friend class NativeEthernetNetworkHub;
     friend class NativeEthernetServerWrapper;
@@ -110,6 +125,12 @@ class NativeEthernetUDPWrapper : public NetworkUDPWrapper {
     EthernetUDP _ethernetUDP;
 };
 
+#if defined(NETWORKHUB_STATIC_ALLOC)
+static_assert(sizeof(NativeEthernetClientWrapper) <= NETWORKHUB_CLIENT_WRAPPER_SIZE, "Increase NETWORKHUB_CLIENT_WRAPPER_SIZE");
+static_assert(sizeof(NativeEthernetServerWrapper) <= NETWORKHUB_SERVER_WRAPPER_SIZE, "Increase NETWORKHUB_SERVER_WRAPPER_SIZE");
+static_assert(sizeof(NativeEthernetUDPWrapper) <= NETWORKHUB_UDP_WRAPPER_SIZE, "Increase NETWORKHUB_UDP_WRAPPER_SIZE");
+#endif
+
 bool NativeEthernetNetworkHub::begin(uint8_t *macAddress, Print* printer) {
 
   bool hadError = false;
@@ -150,7 +171,7 @@ IPAddress NativeEthernetNetworkHub::getLocalIPAddress() {
 NetworkClient NativeEthernetNetworkHub::getClient() {
   NativeEthernetClientWrapper* clientWrapper = new NativeEthernetClientWrapper();
   
-  return NetworkFactory::createNetworkClient(clientWrapper);
+  return NetworkFactory::createNetworkClient(addTLSProvider(clientWrapper));
 }
 
 NetworkServer* NativeEthernetNetworkHub::getServer(uint32_t portNum) {
@@ -170,66 +191,61 @@ NetworkUDP* NativeEthernetNetworkHub::getUDP() {
 }
 
 
-void NativeEthernetNetworkHub::printStatus(Print* printer) {
-  printer->print("Hardware Status: ");
+bool NativeEthernetNetworkHub::isLinkUp() {
+  return Ethernet.linkStatus() == LinkON;
+}
+
+uint8_t NativeEthernetNetworkHub::getTotalSocketLimit() {
+  // NativeEthernet drives the Teensy 4.1's own Ethernet PHY through
+  // FNET, with one pool of sockets for every kind. Sketches that
+  // change its size with Ethernet.setSocketNum() should set the
+  // budget's limit to match.
+#if defined(MAX_SOCK_NUM)
+  return MAX_SOCK_NUM;
+#else
+  return 8;
+#endif
+}
+
+void NativeEthernetNetworkHub::readStatus(NetworkHubStatus& status) {
   switch(Ethernet.hardwareStatus()) {
     case EthernetNoHardware:
-      printer->println("No Hardware");
+      status.hardwareType = NETWORK_HARDWARE_NONE;
       break;
       
     case EthernetW5100:
-      printer->println("EthernetW5100");
+      status.hardwareType = NETWORK_HARDWARE_W5100;
       break;
       
     case EthernetW5200:
-      printer->println("EthernetW5200");
+      status.hardwareType = NETWORK_HARDWARE_W5200;
       break;
       
     case EthernetW5500:
-      printer->println("EthernetW5500");
+      status.hardwareType = NETWORK_HARDWARE_W5500;
       break;
   }
   
-  printer->print("Link Status: ");
   switch (Ethernet.linkStatus()) {
     case Unknown:
-      printer->println("Unknown");
+      status.linkState = NETWORK_LINK_UNKNOWN;
       break;
       
     case LinkON:
-      printer->println("Connected");
+      status.linkState = NETWORK_LINK_UP;
       break;
-
+    
     case LinkOFF:
-      printer->println("Not connected");
+      status.linkState = NETWORK_LINK_DOWN;
       break;
   }
   
-  uint8_t macAddress[6];
-  Ethernet.MACAddress(macAddress);
-  printer->print("MAC Address: ");
-  for (size_t x = 0; x < sizeof(macAddress); x++) {
-    printer->print(macAddress[x], HEX);
-    if (x < sizeof(macAddress) - 1) {
-      printer->print(":");
-    }
-  }
-  printer->println();
-  
-  printer->print("IP Address: ");
-  printer->println(Ethernet.localIP());
-  
-  printer->print("Subnet Mask: ");
-  printer->println(Ethernet.subnetMask());
-  
-  printer->print("Gateway IP: ");
-  printer->println(Ethernet.gatewayIP());
-  
-  printer->print("DHCP Server IP: ");
-  printer->println(Ethernet.dhcpServerIP());
-  
-  printer->print("DNS Server IP: ");
-  printer->println(Ethernet.dnsServerIP());
+  Ethernet.MACAddress(status.macAddress);
+  status.localIP = Ethernet.localIP();
+  status.subnetMask = Ethernet.subnetMask();
+  status.gatewayIP = Ethernet.gatewayIP();
+  status.dhcpServerIP = Ethernet.dhcpServerIP();
+  status.dnsServerIP = Ethernet.dnsServerIP();
 }
 
 // Static members and methods
@@ -239,8 +255,14 @@ NativeEthernetNetworkHub* NativeEthernetNetworkHub::_nativeEthernetNetworkHub =
 // Returns the instance of NativeEthernetNetworkHub
 NativeEthernetNetworkHub NativeEthernetNetworkHub::getInstance() {
   if (_nativeEthernetNetworkHub == NULL) {
+#if defined(NETWORKHUB_STATIC_ALLOC)
+    static NativeEthernetNetworkHub nativeEthernetNetworkHub;
+    _nativeEthernetNetworkHub = &nativeEthernetNetworkHub;
+#else
     _nativeEthernetNetworkHub = new NativeEthernetNetworkHub();
+#endif
   }
   return *_nativeEthernetNetworkHub;
 };
-    
+
+#endif // NETWORKHUB_BACKEND_NATIVEETHERNET
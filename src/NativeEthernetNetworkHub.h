@@ -9,6 +9,11 @@
 #include <Arduino.h>
 
 #include "NetworkHub.h"
+#include "NetworkHubConfig.h"
+
+#if !defined(NETWORKHUB_BACKEND_NATIVEETHERNET)
+#error "NativeEthernetNetworkHub is not compiled, see NetworkHubConfig.h"
+#endif
 
 // A network hub based on an ethernet connection
 // implemented by NativeEthernet library.
@@ -24,7 +29,8 @@ class NativeEthernetNetworkHub : public NetworkHub {
     NetworkClient getClient();
     NetworkServer* getServer(uint32_t portNum);
     NetworkUDP* getUDP();
-    void printStatus(Print* printer);
+    bool isLinkUp();
+    uint8_t getTotalSocketLimit();
     
     // Returns the singleton instance of EthernetNetworkHub
     static NativeEthernetNetworkHub getInstance();
@@ -32,6 +38,8 @@ class NativeEthernetNetworkHub : public NetworkHub {
   protected:
     NativeEthernetNetworkHub() { /* Nothing to see here, move along. */ };
     
+    void readStatus(NetworkHubStatus& status);
+    
     static NativeEthernetNetworkHub* _nativeEthernetNetworkHub;
 };
 
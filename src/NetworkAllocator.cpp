@@ -0,0 +1,53 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+// Local includes
+#include "NetworkAllocator.h"
+
+#if defined(NETWORKHUB_STATIC_ALLOC)
+
+#include "NetworkServer.h"
+#include "NetworkUDP.h"
+
+static_assert(sizeof(NetworkServer) <= NETWORKHUB_SERVER_SIZE, "Increase NETWORKHUB_SERVER_SIZE");
+static_assert(sizeof(NetworkUDP) <= NETWORKHUB_UDP_SIZE, "Increase NETWORKHUB_UDP_SIZE");
+
+NetworkAllocator::ClientWrapperPool NetworkAllocator::clientWrappers;
+NetworkAllocator::ServerWrapperPool NetworkAllocator::serverWrappers;
+NetworkAllocator::UDPWrapperPool NetworkAllocator::udpWrappers;
+NetworkAllocator::ServerPool NetworkAllocator::servers;
+NetworkAllocator::UDPPool NetworkAllocator::udps;
+NetworkAllocator::TLSSharedPool NetworkAllocator::tlsShared;
+
+template <class Pool>
+static void printPool(Print* printer, const char* name, Pool& pool) {
+  printer->print(name);
+  printer->print(": ");
+  printer->print(pool.getInUseCount());
+  printer->print(" of ");
+  printer->print(pool.getCapacity());
+  printer->print(" in use, high water ");
+  printer->print(pool.getHighWaterCount());
+  printer->print(", failed ");
+  printer->print(pool.getFailedCount());
+  printer->print(", ");
+  printer->print(sizeof(Pool));
+  printer->println(" bytes");
+}
+
+void NetworkAllocator::printStatus(Print* printer) {
+  printPool(printer, "Client wrappers", clientWrappers);
+  printPool(printer, "Server wrappers", serverWrappers);
+  printPool(printer, "UDP wrappers", udpWrappers);
+  printPool(printer, "Servers", servers);
+  printPool(printer, "UDPs", udps);
+  printPool(printer, "TLS connections", tlsShared);
+  
+  printer->print("Static footprint: ");
+  printer->print(getStaticFootprint());
+  printer->println(" bytes");
+}
+
+#endif // NETWORKHUB_STATIC_ALLOC
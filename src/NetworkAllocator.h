@@ -0,0 +1,159 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef NETWORKALLOCATOR_H
+#define NETWORKALLOCATOR_H
+
+#include <Arduino.h>
+
+// Define NETWORKHUB_STATIC_ALLOC in the build flags to take every
+// object the hubs hand out from fixed, statically sized pools
+// instead of the heap. Once a pool is used up further requests
+// fail: getServer() and getUDP() return NULL, and getClient() or
+// NetworkServer.available() return a client that is never
+// connected. The capacities below can be overridden the same way.
+//
+// The third-party network stacks may still allocate internally
+// (QNEthernet's UDP packet buffers, for instance); this mode only
+// covers the allocations made by this library.
+#if defined(NETWORKHUB_STATIC_ALLOC)
+
+// Number of NetworkClients that can exist at the same time,
+// including copies and the ones returned by NetworkServer.available().
+#ifndef NETWORKHUB_MAX_CLIENTS
+#define NETWORKHUB_MAX_CLIENTS 8
+#endif
+
+#ifndef NETWORKHUB_MAX_SERVERS
+#define NETWORKHUB_MAX_SERVERS 4
+#endif
+
+#ifndef NETWORKHUB_MAX_UDPS
+#define NETWORKHUB_MAX_UDPS 4
+#endif
+
+// Number of connections that can run over a NetworkTLSProvider at
+// the same time. Copies of a client share one.
+#ifndef NETWORKHUB_MAX_TLS_CLIENTS
+#define NETWORKHUB_MAX_TLS_CLIENTS 4
+#endif
+
+// Slot sizes for the backend specific wrappers. Each backend
+// checks its wrappers fit at compile time.
+#ifndef NETWORKHUB_CLIENT_WRAPPER_SIZE
+#define NETWORKHUB_CLIENT_WRAPPER_SIZE 96
+#endif
+
+#ifndef NETWORKHUB_SERVER_WRAPPER_SIZE
+#define NETWORKHUB_SERVER_WRAPPER_SIZE 64
+#endif
+
+#ifndef NETWORKHUB_UDP_WRAPPER_SIZE
+#define NETWORKHUB_UDP_WRAPPER_SIZE 256
+#endif
+
+// Slot sizes for the NetworkServer and NetworkUDP objects
+// themselves. A NetworkServer holds its subscriber table, so its
+// slot grows with NETWORKHUB_MAX_SUBSCRIBERS.
+#ifndef NETWORKHUB_SERVER_SIZE
+#define NETWORKHUB_SERVER_SIZE 192
+#endif
+
+#ifndef NETWORKHUB_UDP_SIZE
+#define NETWORKHUB_UDP_SIZE 32
+#endif
+
+#ifndef NETWORKHUB_TLS_SHARED_SIZE
+#define NETWORKHUB_TLS_SHARED_SIZE 32
+#endif
+
+// A fixed number of fixed size slots. It is only ever used with
+// static storage, where it is zero initialized before any
+// constructors run, so it has no constructor of its own.
+//
+template <size_t SLOT_SIZE, size_t SLOT_COUNT>
+class NetworkStaticPool {
+  public:
+    // Returns a free slot, or NULL if size is too large or all of
+    // the slots are in use.
+    void* allocate(size_t size) {
+      if (size <= SLOT_SIZE) {
+        for (size_t x = 0; x < SLOT_COUNT; x++) {
+          if (!_inUse[x]) {
+            _inUse[x] = true;
+            _inUseCount++;
+            if (_inUseCount > _highWaterCount) {
+              _highWaterCount = _inUseCount;
+            }
+            return _slots[x].bytes;
+          }
+        }
+      }
+      
+      _failedCount++;
+      return NULL;
+    };
+    
+    void release(void* slot) {
+      size_t x = (Slot*)slot - _slots;
+      if (slot != NULL && x < SLOT_COUNT && _inUse[x]) {
+        _inUse[x] = false;
+        _inUseCount--;
+      }
+    };
+    
+    size_t getCapacity() { return SLOT_COUNT; };
+    size_t getSlotSize() { return SLOT_SIZE; };
+    size_t getInUseCount() { return _inUseCount; };
+    size_t getHighWaterCount() { return _highWaterCount; };
+    uint32_t getFailedCount() { return _failedCount; };
+    
+  private:
+    struct alignas(8) Slot {
+      uint8_t bytes[SLOT_SIZE];
+    };
+    
+    Slot _slots[SLOT_COUNT];
+    bool _inUse[SLOT_COUNT];
+    size_t _inUseCount;
+    size_t _highWaterCount;
+    uint32_t _failedCount;
+};
+
+// The pools used by the library in static allocation mode.
+//
+class NetworkAllocator {
+  public:
+    typedef NetworkStaticPool<NETWORKHUB_CLIENT_WRAPPER_SIZE, NETWORKHUB_MAX_CLIENTS> ClientWrapperPool;
+    typedef NetworkStaticPool<NETWORKHUB_SERVER_WRAPPER_SIZE, NETWORKHUB_MAX_SERVERS> ServerWrapperPool;
+    typedef NetworkStaticPool<NETWORKHUB_UDP_WRAPPER_SIZE, NETWORKHUB_MAX_UDPS> UDPWrapperPool;
+    typedef NetworkStaticPool<NETWORKHUB_SERVER_SIZE, NETWORKHUB_MAX_SERVERS> ServerPool;
+    typedef NetworkStaticPool<NETWORKHUB_UDP_SIZE, NETWORKHUB_MAX_UDPS> UDPPool;
+    typedef NetworkStaticPool<NETWORKHUB_TLS_SHARED_SIZE, NETWORKHUB_MAX_TLS_CLIENTS> TLSSharedPool;
+    
+    static ClientWrapperPool clientWrappers;
+    static ServerWrapperPool serverWrappers;
+    static UDPWrapperPool udpWrappers;
+    static ServerPool servers;
+    static UDPPool udps;
+    static TLSSharedPool tlsShared;
+    
+    // Total RAM reserved by the pools for this configuration.
+    static constexpr size_t getStaticFootprint() {
+      return sizeof(ClientWrapperPool) + sizeof(ServerWrapperPool) + sizeof(UDPWrapperPool)
+        + sizeof(ServerPool) + sizeof(UDPPool) + sizeof(TLSSharedPool);
+    };
+    
+    // Print the capacity and usage of each pool, and the total
+    // footprint, to the given Print object (ie Serial).
+    static void printStatus(Print* printer);
+    
+  private:
+    NetworkAllocator() {};
+};
+
+#endif // NETWORKHUB_STATIC_ALLOC
+
+#endif // NETWORKALLOCATOR_H
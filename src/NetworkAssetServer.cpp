@@ -0,0 +1,315 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#include <stdio.h>
+#include <strings.h>
+
+// Local includes
+#include "NetworkAssetServer.h"
+#include "NetworkHTTP.h"
+
+// The headers and the start of the body go out in one block
+static_assert(NETWORKHUB_ASSET_HEADER_SIZE <= NETWORKHUB_ASSET_BLOCK_SIZE,
+  "NETWORKHUB_ASSET_HEADER_SIZE is at most NETWORKHUB_ASSET_BLOCK_SIZE");
+// Room for a status response
+static_assert(NETWORKHUB_ASSET_HEADER_SIZE >= 128, "NETWORKHUB_ASSET_HEADER_SIZE is at least 128");
+
+void NetworkAssetServer::begin(NetworkServer* server) {
+  _server = server;
+  _server->begin();
+}
+
+void NetworkAssetServer::poll() {
+  if (_server == NULL) {
+    return;
+  }
+  
+  NetworkClient client = _server->available();
+  if (client) {
+    bool known = false;
+    int8_t freeSlot = -1;
+    for (uint8_t x = 0; x < NETWORKHUB_ASSET_MAX_CLIENTS; x++) {
+      if (!_connections[x].inUse) {
+        if (freeSlot < 0) {
+          freeSlot = x;
+        }
+      } else if (_connections[x].client.remotePort() == client.remotePort()
+          && _connections[x].client.remoteIP() == client.remoteIP()) {
+        known = true;
+      }
+    }
+    
+    if (!known) {
+      if (freeSlot >= 0) {
+        Connection& connection = _connections[freeSlot];
+        connection.client = client;
+        connection.inUse = true;
+        connection.lastRequestMillis = millis();
+        connection.length = 0;
+        connection.matched = 0;
+        connection.sending = false;
+      } else {
+        // No room to keep it, and waiting for its request would hold
+        // up the others. A new connection has room for the answer.
+        Response response;
+        setStatus(response, "503 Service Unavailable", false);
+        sendResponse(client, response);
+        client.stop();
+      }
+    }
+  }
+  
+  for (uint8_t x = 0; x < NETWORKHUB_ASSET_MAX_CLIENTS; x++) {
+    Connection& connection = _connections[x];
+    if (!connection.inUse) {
+      continue;
+    }
+    
+    // The next request is read once the last response is sent
+    bool keep = connection.client.connected();
+    if (keep && !connection.sending && connection.client.available() > 0
+        && readRequest(connection.client, connection.request, sizeof(connection.request),
+          connection.length, connection.matched)) {
+      connection.keepAlive = answerRequest(connection.client, connection.request, connection.response);
+      connection.sending = true;
+      connection.lastRequestMillis = millis();
+      connection.length = 0;
+      connection.matched = 0;
+    }
+    
+    if (keep && connection.sending) {
+      size_t sent = connection.response.sent;
+      if (sendResponse(connection.client, connection.response)) {
+        connection.sending = false;
+        keep = connection.keepAlive;
+        connection.lastRequestMillis = millis();
+      } else if (connection.response.sent != sent) {
+        connection.lastRequestMillis = millis();
+      }
+    }
+    
+    if (millis() - connection.lastRequestMillis >= NETWORKHUB_ASSET_IDLE_TIMEOUT) {
+      keep = false;
+    }
+    
+    if (!keep) {
+      connection.client.stop();
+      connection.client = NetworkClient();
+      connection.inUse = false;
+    }
+  }
+}
+
+bool NetworkAssetServer::handleRequest(NetworkClient& client) {
+  char request[NETWORKHUB_ASSET_REQUEST_SIZE];
+  size_t length = 0;
+  uint8_t matched = 0;
+  uint32_t startMillis = millis();
+  
+  while (!readRequest(client, request, sizeof(request), length, matched)) {
+    if (!client.connected() || millis() - startMillis >= NETWORKHUB_ASSET_IDLE_TIMEOUT) {
+      return false;
+    }
+    yield();
+  }
+  
+  Response response;
+  bool keepAlive = answerRequest(client, request, response);
+  uint32_t lastProgressMillis = millis();
+  size_t sent = 0;
+  while (!sendResponse(client, response)) {
+    if (response.sent != sent) {
+      sent = response.sent;
+      lastProgressMillis = millis();
+    } else if (!client.connected() || millis() - lastProgressMillis >= NETWORKHUB_ASSET_IDLE_TIMEOUT) {
+      return false;
+    }
+    yield();
+  }
+  return keepAlive;
+}
+
+bool NetworkAssetServer::answerRequest(NetworkClient& client, char* request, Response& response) {
+  response = Response();
+  
+  // Request line: METHOD SP PATH SP VERSION
+  char* method = request;
+  char* path = strchr(method, ' ');
+  if (path == NULL) {
+    setStatus(response, "400 Bad Request", false);
+    return false;
+  }
+  *path++ = '\0';
+  char* version = strchr(path, ' ');
+  if (version == NULL) {
+    setStatus(response, "400 Bad Request", false);
+    return false;
+  }
+  *version++ = '\0';
+  char* query = strchr(path, '?');
+  if (query != NULL) {
+    *query = '\0';
+  }
+  
+  // The headers follow the version's line
+  const char* headers = strstr(version, "\r\n");
+  if (headers == NULL) {
+    headers = "";
+  }
+  
+  char value[64];
+  bool keepAlive = strncmp(version, "HTTP/1.1", 8) == 0;
+  if (NetworkHTTP::getHeader(headers, "Connection", value, sizeof(value))) {
+    keepAlive = strcasecmp(value, "close") != 0
+      && (keepAlive || strcasecmp(value, "keep-alive") == 0);
+  }
+  
+  bool isGet = strcmp(method, "GET") == 0;
+  bool isHead = strcmp(method, "HEAD") == 0;
+  
+  const NetworkAsset* asset = (isGet || isHead) ? findAsset(path) : NULL;
+  if (asset == NULL) {
+    if (_fallback != NULL && _fallback(client, method, path)) {
+      return false;
+    }
+    _notFoundCount++;
+    setStatus(response, (isGet || isHead) ? "404 Not Found" : "405 Method Not Allowed", keepAlive);
+    return keepAlive;
+  }
+  
+  if (NetworkHTTP::getHeader(headers, "If-None-Match", value, sizeof(value)) && strstr(value, asset->etag) != NULL) {
+    _notModifiedCount++;
+    int length = snprintf(response.header, sizeof(response.header),
+      "HTTP/1.1 304 Not Modified\r\nETag: %s\r\nCache-Control: no-cache\r\nConnection: %s\r\n\r\n",
+      asset->etag, keepAlive ? "keep-alive" : "close");
+    if (length < 0 || (size_t)length >= sizeof(response.header)) {
+      setStatus(response, "500 Internal Server Error", keepAlive);
+    } else {
+      response.headerLength = length;
+    }
+    return keepAlive;
+  }
+  
+  setAsset(response, asset, isHead, keepAlive);
+  return keepAlive;
+}
+
+const NetworkAsset* NetworkAssetServer::findAsset(const char* path) {
+  if (strcmp(path, "/") == 0) {
+    path = "/index.html";
+  }
+  
+  for (size_t x = 0; x < _assetCount; x++) {
+    if (strcmp(_assets[x].path, path) == 0) {
+      return &_assets[x];
+    }
+  }
+  return NULL;
+}
+
+bool NetworkAssetServer::readRequest(NetworkClient& client, char* request, size_t size, size_t& length, uint8_t& matched) {
+  static const char END[] = "\r\n\r\n";
+  
+  int available;
+  while ((available = client.available()) > 0) {
+    uint8_t chunk[128];
+    int count = client.read(chunk, min((size_t)available, sizeof(chunk)));
+    if (count <= 0) {
+      return false;
+    }
+    
+    for (int x = 0; x < count; x++) {
+      char c = chunk[x];
+      if (length < size - 1) {
+        request[length++] = c;
+      }
+      
+      if (c == END[matched]) {
+        matched++;
+      } else {
+        matched = c == '\r' ? 1 : 0;
+      }
+      
+      if (matched == 4) {
+        request[length] = '\0';
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void NetworkAssetServer::setAsset(Response& response, const NetworkAsset* asset, bool headOnly, bool keepAlive) {
+  int length = snprintf(response.header, sizeof(response.header),
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: %s\r\n"
+    "Content-Length: %lu\r\n"
+    "%s"
+    "ETag: %s\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: %s\r\n\r\n",
+    asset->contentType, (unsigned long)asset->length,
+    asset->gzipped ? "Content-Encoding: gzip\r\n" : "",
+    asset->etag, keepAlive ? "keep-alive" : "close");
+  if (length < 0 || (size_t)length >= sizeof(response.header)) {
+    // The content type or ETag in the table is too long
+    setStatus(response, "500 Internal Server Error", keepAlive);
+    return;
+  }
+  
+  response.headerLength = length;
+  response.body = asset->data;
+  response.bodyLength = headOnly ? 0 : asset->length;
+  response.isAsset = true;
+}
+
+void NetworkAssetServer::setStatus(Response& response, const char* status, bool keepAlive) {
+  int length = snprintf(response.header, sizeof(response.header),
+    "HTTP/1.1 %s\r\nContent-Length: 0\r\nConnection: %s\r\n\r\n",
+    status, keepAlive ? "keep-alive" : "close");
+  response.headerLength = min((size_t)length, sizeof(response.header) - 1);
+  response.body = NULL;
+  response.bodyLength = 0;
+  response.isAsset = false;
+}
+
+bool NetworkAssetServer::sendResponse(NetworkClient& client, Response& response) {
+  // The headers and the start of the body go out in the same write
+  static uint8_t block[NETWORKHUB_ASSET_BLOCK_SIZE];
+  
+  size_t total = response.headerLength + response.bodyLength;
+  while (response.sent < total) {
+    const uint8_t* data;
+    size_t size;
+    if (response.sent < response.headerLength) {
+      size_t headerLeft = response.headerLength - response.sent;
+      size_t first = min(response.bodyLength, sizeof(block) - headerLeft);
+      memcpy(block, response.header + response.sent, headerLeft);
+      if (first > 0) {
+        memcpy(block + headerLeft, response.body, first);
+      }
+      data = block;
+      size = headerLeft + first;
+    } else {
+      // The rest straight from flash, a block at a time
+      size_t offset = response.sent - response.headerLength;
+      data = response.body + offset;
+      size = min(response.bodyLength - offset, (size_t)NETWORKHUB_ASSET_BLOCK_SIZE);
+    }
+    
+    size_t count = client.tryWrite(data, size);
+    response.sent += count;
+    _bytesSent += count;
+    if (count < size) {
+      return false;
+    }
+  }
+  
+  if (response.isAsset) {
+    _servedCount++;
+    response.isAsset = false;
+  }
+  return true;
+}
@@ -0,0 +1,163 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef NETWORKASSETSERVER_H
+#define NETWORKASSETSERVER_H
+
+#include <Arduino.h>
+
+#include "NetworkClient.h"
+#include "NetworkServer.h"
+
+// Largest request header block kept for parsing, for each
+// connection. Anything past it (long cookies, say) is read and
+// ignored.
+#ifndef NETWORKHUB_ASSET_REQUEST_SIZE
+#define NETWORKHUB_ASSET_REQUEST_SIZE 1024
+#endif
+
+// Size of each write of an asset's body.
+#ifndef NETWORKHUB_ASSET_BLOCK_SIZE
+#define NETWORKHUB_ASSET_BLOCK_SIZE 4096
+#endif
+
+// Largest response header block, for each connection. An asset whose
+// content type and ETag don't fit gets a 500.
+#ifndef NETWORKHUB_ASSET_HEADER_SIZE
+#define NETWORKHUB_ASSET_HEADER_SIZE 256
+#endif
+
+// Number of keep-alive connections served at the same time.
+#ifndef NETWORKHUB_ASSET_MAX_CLIENTS
+#define NETWORKHUB_ASSET_MAX_CLIENTS 4
+#endif
+
+// How long to wait for a whole request, or for the client to take
+// more of a response, in milliseconds, before closing the connection.
+#ifndef NETWORKHUB_ASSET_IDLE_TIMEOUT
+#define NETWORKHUB_ASSET_IDLE_TIMEOUT 5000
+#endif
+
+// A static file embedded in flash. Tables of these are generated by
+// extras/pack_assets.py, with the data already gzipped and the ETag
+// computed, so nothing is done per request but a lookup.
+struct NetworkAsset {
+  const char* path;         // ie "/index.html"
+  const char* contentType;
+  const char* etag;         // quoted, ie "\"3f2a9c0e\""
+  const uint8_t* data;
+  uint32_t length;
+  bool gzipped;
+};
+
+// Called for requests that don't match an asset. Return true if the
+// request was answered, otherwise a 404 is sent.
+typedef bool (*NetworkAssetFallback)(NetworkClient& client, const char* method, const char* path);
+
+// Serves a table of NetworkAssets over HTTP/1.1 from a NetworkServer.
+// Gzipped assets are sent with Content-Encoding: gzip as they are,
+// requests carrying a matching If-None-Match get a 304 with no body,
+// and connections are kept alive so a page's assets share one
+// connection.
+//
+//   #include "network_assets.h"  // from extras/pack_assets.py
+//   NetworkAssetServer assetServer(NETWORK_ASSETS, NETWORK_ASSET_COUNT);
+//   ...
+//   assetServer.begin(networkHub.getServer(80));
+//   ...
+//   assetServer.poll();  // in loop()
+//
+class NetworkAssetServer {
+  public:
+    NetworkAssetServer(const NetworkAsset* assets, size_t assetCount) {
+      _assets = assets;
+      _assetCount = assetCount;
+    };
+    
+    // Start serving on the given server.
+    void begin(NetworkServer* server);
+    
+    // Accept new connections and answer waiting requests. Call from
+    // loop(). Nothing waits on a client: a request that arrives slowly
+    // is gathered over several calls, and a response is sent as the
+    // client's send window takes it, over as many calls as it needs.
+    // New connections beyond NETWORKHUB_ASSET_MAX_CLIENTS get a 503
+    // and are closed.
+    void poll();
+    
+    // Answer one request on the client, waiting up to
+    // NETWORKHUB_ASSET_IDLE_TIMEOUT for it to arrive and for the
+    // client to take each part of the response. Returns true if the
+    // connection can be kept open for another.
+    bool handleRequest(NetworkClient& client);
+    
+    // Returns the asset for the path, or NULL. "/" finds "/index.html".
+    const NetworkAsset* findAsset(const char* path);
+    
+    void setFallback(NetworkAssetFallback fallback) { _fallback = fallback; };
+    
+    uint32_t getServedCount() { return _servedCount; };
+    uint32_t getNotModifiedCount() { return _notModifiedCount; };
+    uint32_t getNotFoundCount() { return _notFoundCount; };
+    uint32_t getBytesSent() { return _bytesSent; };
+    
+  protected:
+    // A response: its headers, then a body sent straight from flash
+    struct Response {
+      char header[NETWORKHUB_ASSET_HEADER_SIZE];
+      size_t headerLength = 0;
+      const uint8_t* body = NULL;
+      size_t bodyLength = 0;
+      // Of the headers and body
+      size_t sent = 0;
+      // Whether it counts as an asset served
+      bool isAsset = false;
+    };
+    
+    struct Connection {
+      NetworkClient client;
+      bool inUse = false;
+      // Time of the last request, or of progress sending a response
+      uint32_t lastRequestMillis = 0;
+      
+      // The request read so far
+      char request[NETWORKHUB_ASSET_REQUEST_SIZE];
+      size_t length = 0;
+      uint8_t matched = 0;
+      
+      // The response being sent, and whether to keep the connection
+      // open after it
+      Response response;
+      bool sending = false;
+      bool keepAlive = false;
+    };
+    
+    const NetworkAsset* _assets;
+    size_t _assetCount;
+    NetworkServer* _server = NULL;
+    NetworkAssetFallback _fallback = NULL;
+    
+    Connection _connections[NETWORKHUB_ASSET_MAX_CLIENTS];
+    
+    uint32_t _servedCount = 0;
+    uint32_t _notModifiedCount = 0;
+    uint32_t _notFoundCount = 0;
+    uint32_t _bytesSent = 0;
+    
+    // Read what has arrived of the request headers, carrying on from
+    // length and matched (how much of the blank line ending them has
+    // been seen). Returns true once the whole block is in request.
+    bool readRequest(NetworkClient& client, char* request, size_t size, size_t& length, uint8_t& matched);
+    // Make the response to a complete request. Returns true if the
+    // connection can be kept open for another.
+    bool answerRequest(NetworkClient& client, char* request, Response& response);
+    void setAsset(Response& response, const NetworkAsset* asset, bool headOnly, bool keepAlive);
+    void setStatus(Response& response, const char* status, bool keepAlive);
+    // Send what the client's send window will take of the response.
+    // Returns true once it is all sent.
+    bool sendResponse(NetworkClient& client, Response& response);
+};
+
+#endif // NETWORKASSETSERVER_H
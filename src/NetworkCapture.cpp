@@ -0,0 +1,479 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+// Local includes
+#include "NetworkCapture.h"
+#include "NetworkHub.h"
+
+// TCP payloads are split into records of at most this many bytes,
+// like the segments they would have gone out in
+#define CAPTURE_TCP_SEGMENT_SIZE 1460
+
+#define CAPTURE_FLAG_OUTGOING 0x01
+#define CAPTURE_FLAG_UDP      0x02
+
+// pcap link type for packets that start with the IP header
+#define PCAP_LINKTYPE_RAW 101
+
+// Captures the traffic of one client.
+//
+class CaptureClientWrapper : public NetworkClientDecorator {
+  public:
+    int connect(IPAddress ip, uint16_t port) { newConnection(); return NetworkClientDecorator::connect(ip, port); };
+    int connect(const char *host, uint16_t port) { newConnection(); return NetworkClientDecorator::connect(host, port); };
+    int startConnect(IPAddress ip, uint16_t port) { newConnection(); return NetworkClientDecorator::startConnect(ip, port); };
+    int startConnect(const char *host, uint16_t port) { newConnection(); return NetworkClientDecorator::startConnect(host, port); };
+    int connectSecure(IPAddress ip, uint16_t port) { newConnection(); return NetworkClientDecorator::connectSecure(ip, port); };
+    int connectSecure(const char *host, uint16_t port) { newConnection(); return NetworkClientDecorator::connectSecure(host, port); };
+    
+    size_t write(const uint8_t *buf, size_t size) {
+      size_t written = _client.write(buf, size);
+      if (written > 0) {
+        record(true, buf, written);
+        _sentCount += written;
+      }
+      return written;
+    };
+    
+    int read() {
+      int c = _client.read();
+      if (c >= 0) {
+        uint8_t b = c;
+        record(false, &b, 1);
+        _receivedCount++;
+      }
+      return c;
+    };
+    
+    int read(uint8_t *buf, size_t size) {
+      int count = _client.read(buf, size);
+      if (count > 0) {
+        record(false, buf, count);
+        _receivedCount += count;
+      }
+      return count;
+    };
+    
+    NetworkClientWrapper* clone() {
+      return new CaptureClientWrapper(*this);
+    };
+    
+  private:
+    friend class NetworkCapture;
+    
+    CaptureClientWrapper(NetworkCapture* capture, NetworkClient& client, uint16_t localPort) : NetworkClientDecorator(client) {
+      _capture = capture;
+      _localPort = localPort != 0 ? localPort : capture->nextLocalPort();
+    };
+    
+    void newConnection() {
+      _localPort = _capture->nextLocalPort();
+      _remotePort = 0;
+      _sentCount = 0;
+      _receivedCount = 0;
+    };
+    
+    void record(bool outgoing, const uint8_t* data, size_t length) {
+      if (_remotePort == 0) {
+        // Known once connected
+        _remoteIP = (uint32_t)_client.remoteIP();
+        _remotePort = _client.remotePort();
+      }
+      if (_capture->isWanted(_localPort, _remotePort)) {
+        // Sequence numbers start at 1 each way
+        uint32_t seq = 1 + (outgoing ? _sentCount : _receivedCount);
+        uint32_t ack = 1 + (outgoing ? _receivedCount : _sentCount);
+        _capture->record(outgoing, false, IPAddress(_remoteIP), _remotePort, _localPort, seq, ack, data, length, false);
+      }
+    };
+    
+    NetworkCapture* _capture;
+    uint32_t _remoteIP = 0;
+    uint16_t _remotePort = 0;
+    uint16_t _localPort;
+    uint32_t _sentCount = 0;
+    uint32_t _receivedCount = 0;
+};
+
+// Captures the datagrams of one UDP.
+//
+class CaptureUDPWrapper : public NetworkUDPDecorator {
+  public:
+    uint8_t begin(uint16_t port) { _localPort = port; return _udp->begin(port); };
+    uint8_t beginMulticast(IPAddress ip, uint16_t port) { _localPort = port; return _udp->beginMulticast(ip, port); };
+    
+    int beginPacket(IPAddress ip, uint16_t port) {
+      int result = _udp->beginPacket(ip, port);
+      _sending = result == 1 && _capture->isWanted(localPort(), port);
+      _sendIP = ip;
+      _sendPort = port;
+      if (_sending) {
+        _capture->record(true, true, ip, port, localPort(), 0, 0, NULL, 0, true);
+      }
+      return result;
+    };
+    
+    int beginPacket(const char *host, uint16_t port) {
+      // The address isn't known here, it is left empty
+      int result = _udp->beginPacket(host, port);
+      _sending = result == 1 && _capture->isWanted(localPort(), port);
+      _sendIP = IPAddress(0,0,0,0);
+      _sendPort = port;
+      if (_sending) {
+        _capture->record(true, true, _sendIP, port, localPort(), 0, 0, NULL, 0, true);
+      }
+      return result;
+    };
+    
+    size_t write(const uint8_t *buffer, size_t size) {
+      size_t written = _udp->write(buffer, size);
+      if (_sending && written > 0) {
+        _capture->record(true, true, _sendIP, _sendPort, localPort(), 0, 0, buffer, written, false);
+      }
+      return written;
+    };
+    
+    int endPacket() {
+      if (_sending) {
+        _capture->endPacket();
+        _sending = false;
+      }
+      return _udp->endPacket();
+    };
+    
+    int parsePacket() {
+      int size = _udp->parsePacket();
+      _receiving = size > 0 && _capture->isWanted(localPort(), _udp->remotePort());
+      if (_receiving) {
+        _capture->recordDatagram(_udp->remoteIP(), _udp->remotePort(), localPort(), size);
+      }
+      return size;
+    };
+    
+    int read() {
+      int c = _udp->read();
+      if (_receiving && c >= 0) {
+        uint8_t b = c;
+        _capture->record(false, true, _udp->remoteIP(), _udp->remotePort(), localPort(), 0, 0, &b, 1, false);
+      }
+      return c;
+    };
+    
+    int read(unsigned char* buffer, size_t len) {
+      int count = _udp->read(buffer, len);
+      if (_receiving && count > 0) {
+        _capture->record(false, true, _udp->remoteIP(), _udp->remotePort(), localPort(), 0, 0, buffer, count, false);
+      }
+      return count;
+    };
+    
+  private:
+    friend class NetworkCapture;
+    
+    CaptureUDPWrapper(NetworkCapture* capture, NetworkUDP* udp) : NetworkUDPDecorator(udp) {
+      _capture = capture;
+    };
+    
+    // Sends before begin() go out from an ephemeral port
+    uint16_t localPort() {
+      if (_localPort == 0) {
+        _localPort = _capture->nextLocalPort();
+      }
+      return _localPort;
+    };
+    
+    NetworkCapture* _capture;
+    uint16_t _localPort = 0;
+    bool _sending = false;
+    bool _receiving = false;
+    IPAddress _sendIP;
+    uint16_t _sendPort = 0;
+};
+
+#if defined(NETWORKHUB_STATIC_ALLOC)
+static_assert(sizeof(CaptureClientWrapper) <= NETWORKHUB_CLIENT_WRAPPER_SIZE, "Increase NETWORKHUB_CLIENT_WRAPPER_SIZE");
+static_assert(sizeof(CaptureUDPWrapper) <= NETWORKHUB_UDP_WRAPPER_SIZE, "Increase NETWORKHUB_UDP_WRAPPER_SIZE");
+#endif
+
+static void put16(uint8_t* p, uint16_t value) {
+  p[0] = value >> 8;
+  p[1] = value;
+}
+
+static void put32(uint8_t* p, uint32_t value) {
+  put16(p, value >> 16);
+  put16(p + 2, value);
+}
+
+// pcap headers are in the writer's byte order, little endian here
+static void put32le(uint8_t* p, uint32_t value) {
+  p[0] = value;
+  p[1] = value >> 8;
+  p[2] = value >> 16;
+  p[3] = value >> 24;
+}
+
+void NetworkCapture::clear() {
+  _head = 0;
+  _used = 0;
+  _open = false;
+  _recordCount = 0;
+  _overwrittenCount = 0;
+}
+
+void NetworkCapture::record(bool outgoing, bool isUDP, IPAddress remoteIP, uint16_t remotePort, uint16_t localPort,
+    uint32_t seq, uint32_t ack, const uint8_t* data, size_t length, bool newPacket) {
+  uint8_t flags = (outgoing ? CAPTURE_FLAG_OUTGOING : 0) | (isUDP ? CAPTURE_FLAG_UDP : 0);
+  bool sameFlow = _open && !newPacket && _openRecord.flags == flags
+    && _openRecord.remotePort == remotePort && _openRecord.localPort == localPort
+    && (isUDP || _openRecord.seq + _openRecord.originalLength == seq);
+  
+  // Received datagrams are started by recordDatagram(), so their
+  // size is right even if the application doesn't read all of it
+  bool receivedDatagram = isUDP && !outgoing;
+  if (receivedDatagram && !sameFlow) {
+    return;
+  }
+  
+  do {
+    if (!sameFlow || !_open || (!isUDP && _openRecord.originalLength >= CAPTURE_TCP_SEGMENT_SIZE)) {
+      Record record;
+      record.micros = micros();
+      record.seq = seq;
+      record.ack = ack;
+      for (uint8_t x = 0; x < 4; x++) {
+        record.remoteIP[x] = remoteIP[x];
+      }
+      record.remotePort = remotePort;
+      record.localPort = localPort;
+      record.originalLength = 0;
+      record.capturedLength = 0;
+      record.flags = flags;
+      openRecord(record);
+      if (!_open) {
+        return;
+      }
+      sameFlow = true;
+    }
+    
+    size_t take = isUDP ? length : min(length, (size_t)(CAPTURE_TCP_SEGMENT_SIZE - _openRecord.originalLength));
+    size_t keep = _openRecord.capturedLength < _snapLength ? min(take, (size_t)(_snapLength - _openRecord.capturedLength)) : 0;
+    // Never more than the ring holds with this record alone in it
+    keep = min(keep, sizeof(_buffer) - sizeof(Record) - _openRecord.capturedLength);
+    
+    if (keep > 0) {
+      makeRoom(keep);
+      if (!_open) {
+        // Can't happen given the limit above, but don't write a
+        // payload without its record
+        return;
+      }
+      copyIn((_head + _used) % sizeof(_buffer), data, keep);
+      _used += keep;
+    }
+    
+    if (!receivedDatagram) {
+      _openRecord.originalLength = min((size_t)0xFFFF, _openRecord.originalLength + take);
+    }
+    _openRecord.capturedLength += keep;
+    copyIn(_openStart, &_openRecord, sizeof(Record));
+    
+    data += take;
+    length -= take;
+    seq += take;
+  } while (length > 0);
+}
+
+void NetworkCapture::recordDatagram(IPAddress remoteIP, uint16_t remotePort, uint16_t localPort, size_t size) {
+  Record record;
+  record.micros = micros();
+  record.seq = 0;
+  record.ack = 0;
+  for (uint8_t x = 0; x < 4; x++) {
+    record.remoteIP[x] = remoteIP[x];
+  }
+  record.remotePort = remotePort;
+  record.localPort = localPort;
+  record.originalLength = min(size, (size_t)0xFFFF);
+  record.capturedLength = 0;
+  record.flags = CAPTURE_FLAG_UDP;
+  openRecord(record);
+}
+
+uint16_t NetworkCapture::nextLocalPort() {
+  uint16_t port = _nextLocalPort++;
+  if (_nextLocalPort == 0) {
+    _nextLocalPort = 49152;
+  }
+  return port;
+}
+
+NetworkClientWrapper* NetworkCapture::decorateClient(NetworkClient& client, uint16_t localPort) {
+  return new CaptureClientWrapper(this, client, localPort);
+}
+
+NetworkUDPWrapper* NetworkCapture::decorateUDP(NetworkUDP* udp) {
+  CaptureUDPWrapper* udpWrapper = new CaptureUDPWrapper(this, udp);
+  if (udpWrapper == NULL) {
+    delete udp;
+  }
+  return udpWrapper;
+}
+
+size_t NetworkCapture::writePcap(Print* printer) {
+  bool wasCapturing = _capturing;
+  _capturing = false;
+  _open = false;
+  
+  IPAddress localIP = _networkHub != NULL ? _networkHub->getLocalIPAddress() : IPAddress(0,0,0,0);
+  
+  uint8_t fileHeader[24];
+  put32le(fileHeader, 0xA1B2C3D4);
+  fileHeader[4] = 2;  // version 2.4
+  fileHeader[5] = 0;
+  fileHeader[6] = 4;
+  fileHeader[7] = 0;
+  put32le(fileHeader + 8, 0);        // GMT offset
+  put32le(fileHeader + 12, 0);       // timestamp accuracy
+  put32le(fileHeader + 16, 0xFFFF);  // snap length
+  put32le(fileHeader + 20, PCAP_LINKTYPE_RAW);
+  size_t written = printer->write(fileHeader, sizeof(fileHeader));
+  
+  uint16_t ipId = 0;
+  size_t position = _head;
+  size_t remaining = _used;
+  while (remaining > 0) {
+    Record record;
+    copyOut(position, &record, sizeof(record));
+    bool isUDP = record.flags & CAPTURE_FLAG_UDP;
+    bool outgoing = record.flags & CAPTURE_FLAG_OUTGOING;
+    
+    // pcap record header, IPv4 header, then a UDP or TCP header
+    uint8_t header[16 + 20 + 20];
+    size_t transportSize = isUDP ? 8 : 20;
+    size_t headerSize = 16 + 20 + transportSize;
+    uint32_t ipLength = 20 + transportSize + record.originalLength;
+    
+    put32le(header, record.micros / 1000000);
+    put32le(header + 4, record.micros % 1000000);
+    put32le(header + 8, 20 + transportSize + record.capturedLength);
+    put32le(header + 12, ipLength);
+    
+    uint8_t* ip = header + 16;
+    ip[0] = 0x45;
+    ip[1] = 0;
+    put16(ip + 2, min(ipLength, (uint32_t)0xFFFF));
+    put16(ip + 4, ipId++);
+    put16(ip + 6, 0x4000);  // don't fragment
+    ip[8] = 64;
+    ip[9] = isUDP ? 17 : 6;
+    put16(ip + 10, 0);
+    for (uint8_t x = 0; x < 4; x++) {
+      ip[12 + x] = outgoing ? localIP[x] : record.remoteIP[x];
+      ip[16 + x] = outgoing ? record.remoteIP[x] : localIP[x];
+    }
+    uint32_t sum = 0;
+    for (uint8_t x = 0; x < 20; x += 2) {
+      sum += (ip[x] << 8) | ip[x + 1];
+    }
+    while (sum >> 16) {
+      sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    put16(ip + 10, ~sum);
+    
+    uint8_t* transport = ip + 20;
+    put16(transport, outgoing ? record.localPort : record.remotePort);
+    put16(transport + 2, outgoing ? record.remotePort : record.localPort);
+    if (isUDP) {
+      put16(transport + 4, min(8 + (uint32_t)record.originalLength, (uint32_t)0xFFFF));
+      put16(transport + 6, 0);  // no checksum
+    } else {
+      put32(transport + 4, record.seq);
+      put32(transport + 8, record.ack);
+      transport[12] = 5 << 4;   // header length
+      transport[13] = 0x18;     // PSH, ACK
+      put16(transport + 14, 0xFFFF);
+      put16(transport + 16, 0);
+      put16(transport + 18, 0);
+    }
+    written += printer->write(header, headerSize);
+    
+    // The payload may wrap around the end of the ring
+    size_t payloadStart = (position + sizeof(Record)) % sizeof(_buffer);
+    size_t first = min((size_t)record.capturedLength, sizeof(_buffer) - payloadStart);
+    written += printer->write(_buffer + payloadStart, first);
+    if (first < record.capturedLength) {
+      written += printer->write(_buffer, record.capturedLength - first);
+    }
+    
+    size_t recordSize = sizeof(Record) + record.capturedLength;
+    position = (position + recordSize) % sizeof(_buffer);
+    remaining -= recordSize;
+  }
+  
+  _capturing = wasCapturing;
+  return written;
+}
+
+void NetworkCapture::printStatus(Print* printer) {
+  printer->print("Capture ");
+  printer->print(_capturing ? "on" : "off");
+  printer->print(", ");
+  printer->print(_recordCount);
+  printer->print(" records in ");
+  printer->print(_used);
+  printer->print(" of ");
+  printer->print(sizeof(_buffer));
+  printer->print(" bytes, ");
+  printer->print(_overwrittenCount);
+  printer->println(" overwritten");
+}
+
+void NetworkCapture::openRecord(const Record& record) {
+  _open = false;
+  if (!makeRoom(sizeof(Record))) {
+    return;
+  }
+  
+  _openStart = (_head + _used) % sizeof(_buffer);
+  _openRecord = record;
+  copyIn(_openStart, &_openRecord, sizeof(Record));
+  _used += sizeof(Record);
+  _recordCount++;
+  _open = true;
+}
+
+bool NetworkCapture::makeRoom(size_t size) {
+  if (size > sizeof(_buffer)) {
+    return false;
+  }
+  
+  while (sizeof(_buffer) - _used < size) {
+    Record oldest;
+    copyOut(_head, &oldest, sizeof(oldest));
+    if (_open && _head == _openStart) {
+      _open = false;
+    }
+    
+    size_t recordSize = sizeof(Record) + oldest.capturedLength;
+    _head = (_head + recordSize) % sizeof(_buffer);
+    _used -= recordSize;
+    _recordCount--;
+    _overwrittenCount++;
+  }
+  return true;
+}
+
+void NetworkCapture::copyIn(size_t position, const void* data, size_t size) {
+  size_t first = min(size, sizeof(_buffer) - position);
+  memcpy(_buffer + position, data, first);
+  memcpy(_buffer, (const uint8_t*)data + first, size - first);
+}
+
+void NetworkCapture::copyOut(size_t position, void* data, size_t size) {
+  size_t first = min(size, sizeof(_buffer) - position);
+  memcpy(data, _buffer + position, first);
+  memcpy((uint8_t*)data + first, _buffer, size - first);
+}
@@ -0,0 +1,135 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef NETWORKCAPTURE_H
+#define NETWORKCAPTURE_H
+
+#include <Arduino.h>
+
+#include "NetworkDecorator.h"
+
+// Size of the RAM ring the capture is kept in.
+#ifndef NETWORKHUB_CAPTURE_BUFFER_SIZE
+#define NETWORKHUB_CAPTURE_BUFFER_SIZE 8192
+#endif
+
+// Default number of payload bytes kept from each packet.
+#ifndef NETWORKHUB_CAPTURE_SNAP_LENGTH
+#define NETWORKHUB_CAPTURE_SNAP_LENGTH 128
+#endif
+
+// Records the payloads sent and received by the clients and UDPs of
+// a DecoratedNetworkHub into a fixed RAM ring, oldest records being
+// overwritten, and writes them out as a pcap file that Wireshark
+// can open. Each record keeps the time, the endpoints, the
+// direction, and up to the snap length of the payload.
+//
+// Only what the application writes and reads is seen, so IP, UDP
+// and TCP headers are made up on export: addresses and ports are
+// real (apart from the local ports of outgoing clients, which the
+// Client API doesn't give), TCP sequence numbers count the bytes
+// each way, and checksums are left empty. Timestamps are micros()
+// since the device started.
+//
+//   NetworkCapture capture;
+//   networkHub.addDecorator(&capture);  // a DecoratedNetworkHub
+//   capture.setPortFilter(5000);
+//   capture.start();
+//   ...
+//   capture.writePcap(&file);  // any Print: an SD File, a NetworkClient, Serial
+//
+class NetworkCapture : public NetworkDecorator {
+  public:
+    NetworkCapture() { /* Nothing to see here, move along. */ };
+    
+    void start() { _capturing = true; };
+    void stop() { _capturing = false; };
+    bool isCapturing() { return _capturing; };
+    // Throw away everything captured.
+    void clear();
+    
+    // Only capture traffic to or from this port, 0 for all ports.
+    void setPortFilter(uint16_t port) { _portFilter = port; };
+    // Payload bytes kept from each packet; the rest are counted but
+    // not stored.
+    void setSnapLength(uint16_t snapLength) { _snapLength = snapLength; };
+    
+    // Write the capture as a pcap file (raw IPv4 link type). Capture
+    // is paused while this runs, so it can be sent over a captured
+    // client. Returns the number of bytes written.
+    size_t writePcap(Print* printer);
+    
+    uint32_t getRecordCount() { return _recordCount; };
+    // Records overwritten because the ring was full.
+    uint32_t getOverwrittenCount() { return _overwrittenCount; };
+    size_t getBytesUsed() { return _used; };
+    void printStatus(Print* printer);
+    
+    // Used by the capture decorators
+    
+    // Returns true if traffic between these ports should be captured.
+    bool isWanted(uint16_t localPort, uint16_t remotePort) {
+      return _capturing && (_portFilter == 0 || _portFilter == localPort || _portFilter == remotePort);
+    };
+    // Add payload to the packet being recorded for these endpoints,
+    // or start a new packet. A new packet is always started when
+    // newPacket is set, and TCP packets are split at a typical
+    // segment size.
+    void record(bool outgoing, bool isUDP, IPAddress remoteIP, uint16_t remotePort, uint16_t localPort,
+      uint32_t seq, uint32_t ack, const uint8_t* data, size_t length, bool newPacket);
+    // Start a received datagram of the given size. Its payload is
+    // added as the application reads it.
+    void recordDatagram(IPAddress remoteIP, uint16_t remotePort, uint16_t localPort, size_t size);
+    // The packet being recorded is complete.
+    void endPacket() { _open = false; };
+    // A made up local port for outgoing clients and unbound UDPs.
+    uint16_t nextLocalPort();
+    
+    // NetworkDecorator methods
+    void attach(NetworkHub* networkHub) { _networkHub = networkHub; };
+    NetworkClientWrapper* decorateClient(NetworkClient& client, uint16_t localPort);
+    NetworkUDPWrapper* decorateUDP(NetworkUDP* udp);
+    
+  protected:
+    // Stored in the ring ahead of each record's payload
+    struct Record {
+      uint32_t micros;
+      uint32_t seq;
+      uint32_t ack;
+      uint8_t remoteIP[4];
+      uint16_t remotePort;
+      uint16_t localPort;
+      uint16_t originalLength;
+      uint16_t capturedLength;
+      uint8_t flags;
+    };
+    
+    NetworkHub* _networkHub = NULL;
+    bool _capturing = false;
+    uint16_t _portFilter = 0;
+    uint16_t _snapLength = NETWORKHUB_CAPTURE_SNAP_LENGTH;
+    uint16_t _nextLocalPort = 49152;
+    
+    uint8_t _buffer[NETWORKHUB_CAPTURE_BUFFER_SIZE];
+    size_t _head = 0;   // oldest record
+    size_t _used = 0;
+    
+    // The newest record, while more payload may be added to it
+    bool _open = false;
+    size_t _openStart;
+    Record _openRecord;
+    
+    uint32_t _recordCount = 0;
+    uint32_t _overwrittenCount = 0;
+    
+    void openRecord(const Record& record);
+    // Drop the oldest records until there are size bytes free.
+    // Returns false if the ring can't hold that much at all.
+    bool makeRoom(size_t size);
+    void copyIn(size_t position, const void* data, size_t size);
+    void copyOut(size_t position, void* data, size_t size);
+};
+
+#endif // NETWORKCAPTURE_H
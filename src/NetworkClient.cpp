@@ -0,0 +1,132 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#include <Arduino.h>
+
+// Local includes
+#include "NetworkClient.h"
+
+int NetworkClient::connect(IPAddress ip, uint16_t port) {
+  _connectWaits = true;
+  connectStart(ip, port);
+  _connectWaits = false;
+  return waitForConnect();
+}
+
+int NetworkClient::connect(const char *host, uint16_t port) {
+  _connectWaits = true;
+  connectStart(host, port);
+  _connectWaits = false;
+  return waitForConnect();
+}
+
+int NetworkClient::connectStart(IPAddress ip, uint16_t port) {
+  beginConnectAttempt();
+  if (_clientWrapper->startConnect(ip, port) != 1) {
+    endConnectAttempt(NETWORK_CONNECT_FAILED);
+  }
+  return connectStatus();
+}
+
+int NetworkClient::connectStart(const char *host, uint16_t port) {
+  beginConnectAttempt();
+  if (_clientWrapper->startConnect(host, port) != 1) {
+    endConnectAttempt(NETWORK_CONNECT_FAILED);
+  }
+  return connectStatus();
+}
+
+int NetworkClient::connectSecure(IPAddress ip, uint16_t port) {
+  beginConnectAttempt();
+  int result = _clientWrapper->connectSecure(ip, port);
+  endConnectAttempt(result == 1 ? NETWORK_CONNECT_SUCCESS : NETWORK_CONNECT_FAILED);
+  return result == 1 ? 1 : 0;
+}
+
+int NetworkClient::connectSecure(const char *host, uint16_t port) {
+  beginConnectAttempt();
+  int result = _clientWrapper->connectSecure(host, port);
+  endConnectAttempt(result == 1 ? NETWORK_CONNECT_SUCCESS : NETWORK_CONNECT_FAILED);
+  return result == 1 ? 1 : 0;
+}
+
+int NetworkClient::connectStatus() {
+  if (_connectStatus != NETWORK_CONNECT_IN_PROGRESS) {
+    return _connectStatus;
+  }
+  
+  int status = _clientWrapper->pollConnect();
+  
+  if (status == NETWORK_CONNECT_IN_PROGRESS) {
+    uint32_t timeoutMs = _connectTimeoutMs > 0 ? _connectTimeoutMs : NETWORKHUB_DEFAULT_CONNECT_TIMEOUT;
+    if ((micros() - _connectStartMicros) / 1000 >= timeoutMs) {
+      _clientWrapper->stop();
+      status = NETWORK_CONNECT_TIMED_OUT;
+    }
+  }
+  
+  if (status != NETWORK_CONNECT_IN_PROGRESS) {
+    endConnectAttempt(status);
+  }
+  
+  return _connectStatus;
+}
+
+size_t NetworkClient::write(const uint8_t *buf, size_t size) {
+  size_t written = _clientWrapper->write(buf, size);
+  if (_writeTimeoutMs == 0 || written >= size) {
+    return written;
+  }
+  
+  uint32_t startMillis = millis();
+  while (written < size && millis() - startMillis < _writeTimeoutMs && connected()) {
+    yield();
+    written += _clientWrapper->write(buf + written, size - written);
+  }
+  
+  return written;
+}
+
+size_t NetworkClient::tryWrite(const uint8_t *buf, size_t size) {
+  int window = _clientWrapper->availableForWrite();
+  if (window <= 0) {
+    return 0;
+  }
+  return _clientWrapper->write(buf, min(size, (size_t)window));
+}
+
+size_t NetworkClient::commit(size_t used) {
+  const uint8_t* staged = NetworkStagingBuffer::release(this, used);
+  return staged != NULL ? write(staged, used) : 0;
+}
+
+void NetworkClient::beginConnectAttempt() {
+  NetworkStagingBuffer::release(this);
+  _clientWrapper->setConnectionTimeout(_connectTimeoutMs);
+  _clientWrapper->setConnectWaits(_connectWaits);
+  _connectStatus = NETWORK_CONNECT_IN_PROGRESS;
+  _connectStartMicros = micros();
+  _connectElapsedMicros = 0;
+}
+
+void NetworkClient::endConnectAttempt(int status) {
+  _connectElapsedMicros = micros() - _connectStartMicros;
+  
+  // A blocking connect that gave up at the deadline timed out
+  // rather than failed.
+  if (status == NETWORK_CONNECT_FAILED && _connectTimeoutMs > 0
+      && _connectElapsedMicros / 1000 >= _connectTimeoutMs) {
+    status = NETWORK_CONNECT_TIMED_OUT;
+  }
+  
+  _connectStatus = status;
+}
+
+int NetworkClient::waitForConnect() {
+  while (connectStatus() == NETWORK_CONNECT_IN_PROGRESS) {
+    yield();
+  }
+  return _connectStatus == NETWORK_CONNECT_SUCCESS ? 1 : 0;
+}
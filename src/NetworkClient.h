@@ -8,6 +8,14 @@
 
 #include <Client.h>
 #include "NetworkClientWrapper.h"
+#include "NetworkStagingBuffer.h"
+
+// Connect timeout used when polling a non-blocking connect that
+// has no deadline of its own, so a lost SYN can't leave the
+// client waiting forever.
+#ifndef NETWORKHUB_DEFAULT_CONNECT_TIMEOUT
+#define NETWORKHUB_DEFAULT_CONNECT_TIMEOUT 10000
+#endif
 
 // The client used to interact with data sent to
 // a server. Instances of NetworkClient will be
@@ -16,20 +24,73 @@
 //
 class NetworkClient : public Client {
   public:
-    int connect(IPAddress ip, uint16_t port) { return _clientWrapper->connect(ip, port); };
-    int connect(const char *host, uint16_t port) { return _clientWrapper->connect(host, port); };
-    size_t write(uint8_t b) { return _clientWrapper->write(b); };
-    size_t write(const uint8_t *buf, size_t size) { return _clientWrapper->write(buf, size); };
+    int connect(IPAddress ip, uint16_t port);
+    int connect(const char *host, uint16_t port);
+    size_t write(uint8_t b) { return write(&b, 1); };
+    size_t write(const uint8_t *buf, size_t size);
     int available() { return _clientWrapper->available(); };
     int read() { return _clientWrapper->read(); };
     int read(uint8_t *buf, size_t size) { return _clientWrapper->read(buf, size); };
     int peek() { return _clientWrapper->peek(); };
     void flush() { _clientWrapper->flush(); };
-    void stop() { _clientWrapper->stop(); };
+    void stop() {
+      NetworkStagingBuffer::release(this);
+      _clientWrapper->stop();
+    };
     uint8_t connected() { return _clientWrapper->connected(); };
     operator bool() { return *_clientWrapper ? true : false; };
     IPAddress remoteIP() { return _clientWrapper->remoteIP(); };
     uint16_t remotePort() { return _clientWrapper->remotePort(); };
+    int availableForWrite() { return _clientWrapper->availableForWrite(); };
+    bool hasNonBlockingWrite() { return _clientWrapper->hasNonBlockingWrite(); };
+    
+    // Write as much of the buffer as the send window will take right
+    // now. Returns the number of bytes taken, which may be zero; the
+    // caller keeps the rest (see NetworkSendQueue). This never waits
+    // on backends with a real send window (see hasNonBlockingWrite()):
+    // on WiFiNINA the ESP32 has to confirm each write, which can take
+    // a while when its buffer is full.
+    size_t tryWrite(const uint8_t *buf, size_t size);
+    
+    // Return room for size bytes to be built in place, or NULL if
+    // there is none; write() instead. commit() writes the first used
+    // bytes, as write() does, and commit(0) abandons the reservation.
+    uint8_t* reserve(size_t size) { return NetworkStagingBuffer::reserve(this, size); };
+    size_t commit(size_t used);
+    
+    // Deadlines, all in milliseconds. A connect timeout of zero
+    // leaves the backend default, and it is capped at UINT32_MAX / 1000
+    // (about 71 minutes), the span micros() can time. The read timeout applies to the
+    // Stream helpers (readBytes, readString, find, parseInt...),
+    // read() itself never waits. A write timeout of zero leaves
+    // write() returning whatever the backend accepted; otherwise
+    // write() keeps retrying short writes until the deadline.
+    void setConnectTimeout(uint32_t timeoutMs) { _connectTimeoutMs = min(timeoutMs, (uint32_t)(UINT32_MAX / 1000)); };
+    void setReadTimeout(uint32_t timeoutMs) { setTimeout(timeoutMs); };
+    void setWriteTimeout(uint32_t timeoutMs) { _writeTimeoutMs = timeoutMs; };
+    
+    // Start connecting without waiting, on backends that support
+    // it (see hasNonBlockingConnect()). Elsewhere this connects
+    // right away, capped by the connect timeout. Poll
+    // connectStatus() until it is no longer
+    // NETWORK_CONNECT_IN_PROGRESS.
+    int connectStart(IPAddress ip, uint16_t port);
+    int connectStart(const char *host, uint16_t port);
+    // Returns a NetworkConnectStatus value.
+    int connectStatus();
+    bool hasNonBlockingConnect() { return _clientWrapper->hasNonBlockingConnect(); };
+    
+    // Connect and complete a TLS handshake, blocking until done.
+    // This uses the network coprocessor when it can do TLS itself
+    // (WiFiNINA), or the NetworkTLSProvider given to the hub;
+    // otherwise it returns 0. See NetworkHub.getSecureConnectSupport().
+    int connectSecure(IPAddress ip, uint16_t port);
+    int connectSecure(const char *host, uint16_t port);
+    bool hasSecureConnect() { return _clientWrapper->hasSecureConnect(); };
+    
+    // How long the last connect attempt took, in microseconds. For
+    // connectSecure() this includes the TLS handshake.
+    uint32_t getConnectElapsedMicros() { return _connectElapsedMicros; };
     
     // copy assignment
     NetworkClient& operator=(const NetworkClient& other) {
@@ -38,30 +99,77 @@ class NetworkClient : public Client {
           return *this;
       }
       
-      _clientWrapper = other._clientWrapper->clone();
+      releaseWrapper();
+      _clientWrapper = cloneWrapper(other._clientWrapper);
+      
+      _timeout = other._timeout;
+      _connectTimeoutMs = other._connectTimeoutMs;
+      _writeTimeoutMs = other._writeTimeoutMs;
       
       return *this;
     }
     
+    // copy constructor
+    NetworkClient(const NetworkClient& other) : Client() {
+      _clientWrapper = cloneWrapper(other._clientWrapper);
+      
+      _timeout = other._timeout;
+      _connectTimeoutMs = other._connectTimeoutMs;
+      _writeTimeoutMs = other._writeTimeoutMs;
+    }
+    
     // This constructor can be used to declare variables, but
     // NetworkHub.createClient() or NetworkServer.available() should be
     // used to assign a usable version.
     NetworkClient() {
-      _clientWrapper = new NullNetworkClientWrapper();
+      _clientWrapper = NullNetworkClientWrapper::getInstance();
     }
     
     ~NetworkClient() {
-      delete _clientWrapper;
+      NetworkStagingBuffer::release(this);
+      releaseWrapper();
     };
     
   protected:
     NetworkClientWrapper* _clientWrapper;
     
+    uint32_t _connectTimeoutMs = 0;
+    uint32_t _writeTimeoutMs = 0;
+    
+    // Set while connect() starts a connect it will wait for
+    bool _connectWaits = false;
+    int _connectStatus = NETWORK_CONNECT_IDLE;
+    uint32_t _connectStartMicros = 0;
+    uint32_t _connectElapsedMicros = 0;
+    
+    void beginConnectAttempt();
+    void endConnectAttempt(int status);
+    int waitForConnect();
+    
   private:
     friend class NetworkFactory;
+    friend class NetworkServer;
+    // Pass on whether a connect is waited for to the client they wrap
+    friend class NetworkClientDecorator;
+    friend class CompositeClientWrapper;
     
     NetworkClient(NetworkClientWrapper* clientWrapper) {
-      _clientWrapper = clientWrapper;
+      _clientWrapper = clientWrapper != NULL ? clientWrapper : NullNetworkClientWrapper::getInstance();
+    };
+    
+    // A wrapper that can't be cloned (no memory, or no free slot
+    // with NETWORKHUB_STATIC_ALLOC) leaves a client that is never
+    // connected rather than a NULL pointer.
+    static NetworkClientWrapper* cloneWrapper(NetworkClientWrapper* clientWrapper) {
+      NetworkClientWrapper* clone = clientWrapper->clone();
+      return clone != NULL ? clone : NullNetworkClientWrapper::getInstance();
+    };
+    
+    // The shared null wrapper is never deleted
+    void releaseWrapper() {
+      if (_clientWrapper != NullNetworkClientWrapper::getInstance()) {
+        delete _clientWrapper;
+      }
     };
 };
 
@@ -8,6 +8,16 @@
 
 #include <DebugMsgs.h>
 #include <Client.h>
+#include "NetworkAllocator.h"
+
+// States reported by NetworkClient::connectStatus().
+enum NetworkConnectStatus {
+  NETWORK_CONNECT_IDLE,
+  NETWORK_CONNECT_IN_PROGRESS,
+  NETWORK_CONNECT_SUCCESS,
+  NETWORK_CONNECT_FAILED,
+  NETWORK_CONNECT_TIMED_OUT
+};
 
 // This class defines a wrapper class for Client
 // that can be implemented by subclasses to "wrap"
@@ -31,13 +41,58 @@ class NetworkClientWrapper : public Client {
     virtual operator bool() = 0;
     virtual IPAddress remoteIP() = 0;
     virtual uint16_t remotePort() = 0;
+    // Number of bytes that can be written without blocking. Where
+    // the backend can't tell this is an estimate, and a write may
+    // still take less.
+    virtual int availableForWrite() = 0;
+    // Returns false if a write within availableForWrite() may still
+    // wait on the hardware.
+    virtual bool hasNonBlockingWrite() { return true; };
     
     virtual NetworkClientWrapper* clone() = 0;
+    
+    // Connection deadlines. The defaults suit backends that can
+    // only connect by blocking; backends that can start a
+    // connection and poll it should override all of these.
+    
+    // Limit how long a connect may take, in milliseconds. Zero
+    // restores the backend default.
+    virtual void setConnectionTimeout(uint32_t timeoutMs) {};
+    // Whether the connect about to start will be waited for, by
+    // NetworkClient.connect(), rather than polled.
+    virtual void setConnectWaits(bool waits) {};
+    // Returns true if startConnect returns without waiting for
+    // the connection to be established.
+    virtual bool hasNonBlockingConnect() { return false; };
+    // Start connecting. Returns 1 if the connection was started
+    // (or made), 0 if it failed right away.
+    virtual int startConnect(IPAddress ip, uint16_t port) { return connect(ip, port); };
+    virtual int startConnect(const char *host, uint16_t port) { return connect(host, port); };
+    // Returns NETWORK_CONNECT_IN_PROGRESS, NETWORK_CONNECT_SUCCESS
+    // or NETWORK_CONNECT_FAILED, or NETWORK_CONNECT_TIMED_OUT if
+    // the backend enforces the connection timeout itself.
+    virtual int pollConnect() { return connected() ? NETWORK_CONNECT_SUCCESS : NETWORK_CONNECT_FAILED; };
+    
+    // TLS. Backends that can secure a connection themselves (on a
+    // network coprocessor) override these, the others return 0
+    // unless the hub has a NetworkTLSProvider.
+    virtual bool hasSecureConnect() { return false; };
+    // Connect and complete the TLS handshake. Returns 1 if successful.
+    virtual int connectSecure(IPAddress ip, uint16_t port) { return 0; };
+    virtual int connectSecure(const char *host, uint16_t port) { return 0; };
+
+#if defined(NETWORKHUB_STATIC_ALLOC)
+    // Wrappers come from a fixed pool, new returns NULL when it is full
+    static void* operator new(size_t size) noexcept { return NetworkAllocator::clientWrappers.allocate(size); };
+    static void operator delete(void* wrapper) { NetworkAllocator::clientWrappers.release(wrapper); };
+#endif
 };
 
 // This is a 'null' NetworkClientWrapper that is used to allow
-// the creation of stack instances of NetworkClient. It should
-// not be used generally for anything else.
+// the creation of stack instances of NetworkClient, and stands in
+// for a client that could not be created. It has no state, so a
+// single shared instance is used and it is never deleted. It
+// should not be used generally for anything else.
 class NullNetworkClientWrapper : public NetworkClientWrapper {
   public:
     ~NullNetworkClientWrapper(){};
@@ -55,9 +110,19 @@ class NullNetworkClientWrapper : public NetworkClientWrapper {
     operator bool() { return false; };
     IPAddress remoteIP() { return IPAddress(0,0,0,0); };
     uint16_t remotePort() { return 0; };
+    int availableForWrite() { return 0; };
     NetworkClientWrapper* clone() {
-      return new NullNetworkClientWrapper();
+      return getInstance();
     }
+    
+    // Returns the shared instance of NullNetworkClientWrapper
+    static NullNetworkClientWrapper* getInstance() {
+      static NullNetworkClientWrapper nullClientWrapper;
+      return &nullClientWrapper;
+    };
+    
+  private:
+    NullNetworkClientWrapper(){};
 };
 
 #endif // NETWORKCLIENTWRAPPER_H
@@ -0,0 +1,292 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+// Local includes
+#include "NetworkClockSync.h"
+
+static void writeUInt16(uint8_t* buffer, uint16_t value) {
+  buffer[0] = value >> 8;
+  buffer[1] = value;
+}
+
+static void writeUInt32(uint8_t* buffer, uint32_t value) {
+  writeUInt16(buffer, value >> 16);
+  writeUInt16(buffer + 2, value);
+}
+
+static void writeUInt64(uint8_t* buffer, uint64_t value) {
+  writeUInt32(buffer, value >> 32);
+  writeUInt32(buffer + 4, value);
+}
+
+static uint16_t readUInt16(const uint8_t* buffer) {
+  return ((uint16_t)buffer[0] << 8) | buffer[1];
+}
+
+static uint32_t readUInt32(const uint8_t* buffer) {
+  return ((uint32_t)readUInt16(buffer) << 16) | readUInt16(buffer + 2);
+}
+
+static uint64_t readUInt64(const uint8_t* buffer) {
+  return ((uint64_t)readUInt32(buffer) << 32) | readUInt32(buffer + 4);
+}
+
+// NetworkClockSync
+
+uint64_t NetworkClockSync::localMicros() {
+  static uint32_t lastMicros = 0;
+  static uint32_t wraps = 0;
+  
+  uint32_t now = micros();
+  if (now < lastMicros) {
+    wraps++;
+  }
+  lastMicros = now;
+  
+  return ((uint64_t)wraps << 32) | now;
+}
+
+void NetworkClockSync::encode(const Packet& packet, uint8_t* buffer) {
+  writeUInt32(buffer, MAGIC);
+  buffer[4] = VERSION;
+  buffer[5] = packet.type;
+  writeUInt16(buffer + 6, packet.seq);
+  writeUInt64(buffer + 8, packet.t1);
+  writeUInt64(buffer + 16, packet.t2);
+  writeUInt64(buffer + 24, packet.t3);
+}
+
+bool NetworkClockSync::decode(const uint8_t* buffer, size_t length, Packet& packet) {
+  if (length < NETWORKHUB_CLOCK_SYNC_PACKET_SIZE
+      || readUInt32(buffer) != MAGIC || buffer[4] != VERSION) {
+    return false;
+  }
+  
+  packet.type = buffer[5];
+  packet.seq = readUInt16(buffer + 6);
+  packet.t1 = readUInt64(buffer + 8);
+  packet.t2 = readUInt64(buffer + 16);
+  packet.t3 = readUInt64(buffer + 24);
+  return true;
+}
+
+// NetworkClockSyncResponder
+
+void NetworkClockSyncResponder::poll() {
+  // Keeps the 64 bit clock from missing a wrap of micros() between
+  // requests
+  localMicros();
+  
+  while (_udp->parsePacket() > 0) {
+    // Take the receive time before anything else
+    uint64_t receiveTime = localMicros();
+    
+    uint8_t buffer[NETWORKHUB_CLOCK_SYNC_PACKET_SIZE];
+    int length = _udp->read(buffer, sizeof(buffer));
+    
+    Packet packet;
+    if (length <= 0 || !decode(buffer, length, packet) || packet.type != TYPE_REQUEST) {
+      continue;
+    }
+    
+    _requestCount++;
+    
+    packet.type = TYPE_RESPONSE;
+    packet.t2 = receiveTime;
+    
+    if (_udp->beginPacket(_udp->remoteIP(), _udp->remotePort()) != 1) {
+      continue;
+    }
+    
+    // Take the transmit time as late as possible, and encode it
+    // straight into the packet where the backend allows
+    uint8_t* out = _udp->reserve(sizeof(buffer));
+    packet.t3 = localMicros();
+    if (out != NULL) {
+      encode(packet, out);
+      _udp->commit(sizeof(buffer));
+    } else {
+      encode(packet, buffer);
+      _udp->write(buffer, sizeof(buffer));
+    }
+    _udp->endPacket();
+  }
+}
+
+// NetworkClockSyncClient
+
+bool NetworkClockSyncClient::begin(IPAddress responderIP, uint16_t responderPort, uint16_t localPort) {
+  _responderIP = responderIP;
+  _responderPort = responderPort;
+  
+  _started = _udp->begin(localPort) == 1;
+  if (_started) {
+    // Send the first request on the next poll
+    _lastRequestMillis = millis() - _intervalMs;
+  }
+  return _started;
+}
+
+void NetworkClockSyncClient::poll() {
+  if (!_started) {
+    return;
+  }
+  
+  // Keeps the 64 bit clock from missing a wrap of micros()
+  localMicros();
+  
+  processResponse();
+  
+  if (millis() - _lastRequestMillis >= _intervalMs) {
+    _lastRequestMillis = millis();
+    sendRequest();
+  }
+}
+
+void NetworkClockSyncClient::sendRequest() {
+  if (_awaitingResponse) {
+    // The previous request or its response never arrived
+    _lostCount++;
+  }
+  
+  if (_udp->beginPacket(_responderIP, _responderPort) != 1) {
+    return;
+  }
+  
+  Packet packet;
+  packet.type = TYPE_REQUEST;
+  packet.seq = ++_seq;
+  packet.t2 = 0;
+  packet.t3 = 0;
+  
+  uint8_t buffer[NETWORKHUB_CLOCK_SYNC_PACKET_SIZE];
+  uint8_t* out = _udp->reserve(sizeof(buffer));
+  
+  // Take the transmit time as late as possible
+  packet.t1 = localMicros();
+  
+  if (out != NULL) {
+    encode(packet, out);
+    _udp->commit(sizeof(buffer));
+  } else {
+    encode(packet, buffer);
+    _udp->write(buffer, sizeof(buffer));
+  }
+  _awaitingResponse = _udp->endPacket() == 1;
+}
+
+void NetworkClockSyncClient::processResponse() {
+  while (_udp->parsePacket() > 0) {
+    // Take the receive time before anything else
+    uint64_t t4 = localMicros();
+    
+    uint8_t buffer[NETWORKHUB_CLOCK_SYNC_PACKET_SIZE];
+    int length = _udp->read(buffer, sizeof(buffer));
+    
+    Packet packet;
+    if (length <= 0 || !decode(buffer, length, packet) || packet.type != TYPE_RESPONSE) {
+      continue;
+    }
+    
+    // Late responses to earlier requests are dropped, they were
+    // already counted as lost.
+    if (!_awaitingResponse || packet.seq != _seq) {
+      continue;
+    }
+    _awaitingResponse = false;
+    
+    int64_t outbound = (int64_t)(packet.t2 - packet.t1);
+    int64_t inbound = (int64_t)(packet.t3 - t4);
+    int64_t roundTrip = (int64_t)(t4 - packet.t1) - (int64_t)(packet.t3 - packet.t2);
+    if (roundTrip < 0) {
+      roundTrip = 0;
+    }
+    
+    // The offset is measured at the midpoint of the exchange
+    addSample((outbound + inbound) / 2, (uint32_t)roundTrip, packet.t1 + (t4 - packet.t1) / 2);
+  }
+}
+
+void NetworkClockSyncClient::addSample(int64_t offset, uint32_t roundTripTime, uint64_t localTime) {
+  _samples[_sampleCount % NETWORKHUB_CLOCK_SYNC_SAMPLES] = { offset, roundTripTime, localTime };
+  _sampleCount++;
+  
+  _lastRoundTripTime = roundTripTime;
+  if (_sampleCount == 1) {
+    _averageRoundTripTime = roundTripTime;
+    _roundTripJitter = roundTripTime / 2;
+  } else {
+    // Same smoothing TCP uses for its round trip estimate
+    int32_t error = (int32_t)(roundTripTime - _averageRoundTripTime);
+    _averageRoundTripTime += error / 8;
+    _roundTripJitter += ((error < 0 ? -error : error) - (int32_t)_roundTripJitter) / 4;
+  }
+  
+  // Pick the sample with the smallest round trip time, it has
+  // the least queuing delay and so the most accurate offset.
+  uint32_t count = min(_sampleCount, (uint32_t)NETWORKHUB_CLOCK_SYNC_SAMPLES);
+  const Sample* best = &_samples[0];
+  for (uint32_t x = 1; x < count; x++) {
+    if (_samples[x].roundTripTime < best->roundTripTime) {
+      best = &_samples[x];
+    }
+  }
+  
+  _offset = best->offset;
+  _offsetTime = best->localTime;
+  _roundTripTime = best->roundTripTime;
+  
+  // Only add to the drift history when the best sample changes,
+  // otherwise the same point would be weighted several times.
+  uint32_t last = (_historyCount + NETWORKHUB_CLOCK_SYNC_HISTORY - 1) % NETWORKHUB_CLOCK_SYNC_HISTORY;
+  if (_historyCount == 0 || _historyTime[last] != _offsetTime) {
+    uint32_t next = _historyCount % NETWORKHUB_CLOCK_SYNC_HISTORY;
+    _historyTime[next] = _offsetTime;
+    _historyOffset[next] = _offset;
+    _historyCount++;
+    updateDrift();
+  }
+}
+
+void NetworkClockSyncClient::updateDrift() {
+  uint32_t count = min(_historyCount, (uint32_t)NETWORKHUB_CLOCK_SYNC_HISTORY);
+  if (count < 2) {
+    return;
+  }
+  
+  // Least squares fit of offset against local time, relative to
+  // the first point to keep the doubles well conditioned.
+  uint32_t first = _historyCount <= NETWORKHUB_CLOCK_SYNC_HISTORY ? 0
+    : _historyCount % NETWORKHUB_CLOCK_SYNC_HISTORY;
+  uint64_t baseTime = _historyTime[first];
+  int64_t baseOffset = _historyOffset[first];
+  
+  double meanX = 0;
+  double meanY = 0;
+  for (uint32_t x = 0; x < count; x++) {
+    meanX += (double)(_historyTime[x] - baseTime);
+    meanY += (double)(_historyOffset[x] - baseOffset);
+  }
+  meanX /= count;
+  meanY /= count;
+  
+  double covariance = 0;
+  double variance = 0;
+  for (uint32_t x = 0; x < count; x++) {
+    double dx = (double)(_historyTime[x] - baseTime) - meanX;
+    double dy = (double)(_historyOffset[x] - baseOffset) - meanY;
+    covariance += dx * dy;
+    variance += dx * dx;
+  }
+  
+  if (variance > 0) {
+    _drift = covariance / variance;
+  }
+}
+
+uint64_t NetworkClockSyncClient::toRemoteMicros(uint64_t localTime) {
+  double elapsed = (double)(int64_t)(localTime - _offsetTime);
+  return localTime + _offset + (int64_t)(_drift * elapsed);
+}
@@ -0,0 +1,181 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef NETWORKCLOCKSYNC_H
+#define NETWORKCLOCKSYNC_H
+
+#include <Arduino.h>
+
+#include "NetworkUDP.h"
+
+// Number of request/response samples kept by the client filter.
+// The estimate comes from the sample with the smallest round trip
+// time in this window, since it has the least queuing error.
+#ifndef NETWORKHUB_CLOCK_SYNC_SAMPLES
+#define NETWORKHUB_CLOCK_SYNC_SAMPLES 8
+#endif
+
+// Number of filtered offsets used to fit the drift between the
+// two clocks.
+#ifndef NETWORKHUB_CLOCK_SYNC_HISTORY
+#define NETWORKHUB_CLOCK_SYNC_HISTORY 16
+#endif
+
+// Size of a clock sync packet on the wire. All fields are big-endian:
+//   magic   uint32  'TNCS'
+//   version uint8
+//   type    uint8   1 = request, 2 = response
+//   seq     uint16
+//   t1      uint64  client transmit time, client clock (microseconds)
+//   t2      uint64  server receive time, server clock (microseconds)
+//   t3      uint64  server transmit time, server clock (microseconds)
+#define NETWORKHUB_CLOCK_SYNC_PACKET_SIZE 32
+
+// Common pieces shared by the responder and the client.
+//
+class NetworkClockSync {
+  public:
+    // Returns the local clock in microseconds, extended to 64 bits
+    // so it does not wrap every 71 minutes like micros(). On the
+    // Teensy 4.x micros() is interpolated from the cycle counter,
+    // so this has 1 microsecond resolution. It must be called at
+    // least once per wrap of micros(), which poll() takes care of.
+    static uint64_t localMicros();
+    
+  protected:
+    static const uint32_t MAGIC = 0x544E4353; // 'TNCS'
+    static const uint8_t VERSION = 1;
+    static const uint8_t TYPE_REQUEST = 1;
+    static const uint8_t TYPE_RESPONSE = 2;
+    
+    struct Packet {
+      uint8_t type;
+      uint16_t seq;
+      uint64_t t1;
+      uint64_t t2;
+      uint64_t t3;
+    };
+    
+    static void encode(const Packet& packet, uint8_t* buffer);
+    static bool decode(const uint8_t* buffer, size_t length, Packet& packet);
+};
+
+// Answers clock sync requests with its own receive and transmit
+// timestamps. Run this on whichever side should be the reference
+// clock (the host PC usually, see extras/clock_sync_responder.py,
+// but a Teensy can serve other devices too).
+//
+class NetworkClockSyncResponder : public NetworkClockSync {
+  public:
+    NetworkClockSyncResponder(NetworkUDP* udp) {
+      _udp = udp;
+    };
+    
+    // Start listening on the given port. Returns true if successful.
+    bool begin(uint16_t port) { return _udp->begin(port) == 1; };
+    
+    // Answer any pending requests. Call this as often as possible,
+    // since time spent waiting here is counted as network latency.
+    void poll();
+    
+    uint32_t getRequestCount() { return _requestCount; };
+    
+  protected:
+    NetworkUDP* _udp;
+    uint32_t _requestCount = 0;
+};
+
+// Measures the round trip time and clock offset to a responder,
+// filters them over many samples, and estimates the drift between
+// the two clocks. Remote time = local time + offset.
+//
+class NetworkClockSyncClient : public NetworkClockSync {
+  public:
+    NetworkClockSyncClient(NetworkUDP* udp) {
+      _udp = udp;
+    };
+    
+    // Start exchanging samples with the responder at the given
+    // address. localPort is the port to receive responses on.
+    bool begin(IPAddress responderIP, uint16_t responderPort, uint16_t localPort);
+    
+    // Time between requests, in milliseconds. Defaults to 1000.
+    void setInterval(uint32_t intervalMs) { _intervalMs = intervalMs; };
+    
+    // Send requests and process responses. Call from loop().
+    void poll();
+    
+    // True once enough samples have been collected for the
+    // estimate to be useful.
+    bool isSynchronized() { return _sampleCount >= (NETWORKHUB_CLOCK_SYNC_SAMPLES / 2); };
+    
+    // Current filtered offset of the remote clock from the local
+    // clock, in microseconds.
+    int64_t getOffset() { return _offset; };
+    
+    // Round trip time of the sample the offset was taken from.
+    uint32_t getRoundTripTime() { return _roundTripTime; };
+    
+    // Round trip time of the most recent sample.
+    uint32_t getLastRoundTripTime() { return _lastRoundTripTime; };
+    
+    // Smoothed round trip time and its mean deviation, over all samples.
+    uint32_t getAverageRoundTripTime() { return _averageRoundTripTime; };
+    uint32_t getRoundTripJitter() { return _roundTripJitter; };
+    
+    // Rate at which the remote clock gains on the local clock, in
+    // parts per million.
+    double getDrift() { return _drift * 1e6; };
+    
+    // Converts a local timestamp (from localMicros()) to the remote
+    // clock, applying both the offset and the drift.
+    uint64_t toRemoteMicros(uint64_t localTime);
+    
+    // Current time on the remote clock.
+    uint64_t remoteMicros() { return toRemoteMicros(localMicros()); };
+    
+    uint32_t getSampleCount() { return _sampleCount; };
+    uint32_t getLostCount() { return _lostCount; };
+    
+  protected:
+    struct Sample {
+      int64_t offset;
+      uint32_t roundTripTime;
+      uint64_t localTime;
+    };
+    
+    void sendRequest();
+    void processResponse();
+    void addSample(int64_t offset, uint32_t roundTripTime, uint64_t localTime);
+    void updateDrift();
+    
+    NetworkUDP* _udp;
+    IPAddress _responderIP;
+    uint16_t _responderPort = 0;
+    uint32_t _intervalMs = 1000;
+    uint32_t _lastRequestMillis = 0;
+    bool _started = false;
+    
+    uint16_t _seq = 0;
+    bool _awaitingResponse = false;
+    
+    Sample _samples[NETWORKHUB_CLOCK_SYNC_SAMPLES];
+    uint32_t _sampleCount = 0;
+    uint32_t _lostCount = 0;
+    
+    uint64_t _historyTime[NETWORKHUB_CLOCK_SYNC_HISTORY];
+    int64_t _historyOffset[NETWORKHUB_CLOCK_SYNC_HISTORY];
+    uint32_t _historyCount = 0;
+    
+    int64_t _offset = 0;
+    uint64_t _offsetTime = 0;
+    double _drift = 0;
+    uint32_t _roundTripTime = 0;
+    uint32_t _lastRoundTripTime = 0;
+    uint32_t _averageRoundTripTime = 0;
+    uint32_t _roundTripJitter = 0;
+};
+
+#endif // NETWORKCLOCKSYNC_H
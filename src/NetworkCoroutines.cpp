@@ -0,0 +1,92 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+// Local includes
+#include "NetworkCoroutines.h"
+
+#if defined(NETWORKHUB_COROUTINES)
+
+// NetworkTaskArena
+
+NetworkTaskArena::Frame NetworkTaskArena::_frames[NETWORKHUB_MAX_TASKS];
+uint32_t NetworkTaskArena::_inUse = 0;
+size_t NetworkTaskArena::_inUseCount = 0;
+size_t NetworkTaskArena::_highWaterCount = 0;
+uint32_t NetworkTaskArena::_failedCount = 0;
+
+void* NetworkTaskArena::allocate(size_t size) {
+  if (size <= sizeof(Frame)) {
+    for (size_t x = 0; x < NETWORKHUB_MAX_TASKS; x++) {
+      if ((_inUse & (1UL << x)) == 0) {
+        _inUse |= (1UL << x);
+        _inUseCount++;
+        if (_inUseCount > _highWaterCount) {
+          _highWaterCount = _inUseCount;
+        }
+        return &_frames[x];
+      }
+    }
+  }
+  
+  _failedCount++;
+  return NULL;
+}
+
+void NetworkTaskArena::release(void* frame) {
+  // Only frames from the arena are released, and only once; the
+  // address is checked before it is turned into an index
+  uintptr_t address = (uintptr_t)frame;
+  uintptr_t start = (uintptr_t)_frames;
+  if (frame == NULL || address < start || address >= start + sizeof(_frames)) {
+    return;
+  }
+  
+  size_t x = (address - start) / sizeof(Frame);
+  if ((_inUse & (1UL << x)) != 0) {
+    _inUse &= ~(1UL << x);
+    _inUseCount--;
+  }
+}
+
+// NetworkAwaitable
+
+void NetworkAwaitable::await_suspend(std::coroutine_handle<> handle) {
+  NetworkScheduler::getInstance().wait(this, handle);
+}
+
+// NetworkScheduler
+
+void NetworkScheduler::wait(NetworkAwaitable* awaitable, std::coroutine_handle<> handle) {
+  _waiters[_waitingCount].awaitable = awaitable;
+  _waiters[_waitingCount].handle = handle;
+  _waitingCount++;
+}
+
+void NetworkScheduler::run() {
+  size_t x = 0;
+  while (x < _waitingCount) {
+    if (!_waiters[x].awaitable->poll()) {
+      x++;
+      continue;
+    }
+    
+    // Remove the waiter before resuming, the task may wait again
+    std::coroutine_handle<> handle = _waiters[x].handle;
+    _waitingCount--;
+    _waiters[x] = _waiters[_waitingCount];
+    
+    handle.resume();
+  }
+}
+
+// Static members and methods
+
+// Returns the instance of NetworkScheduler
+NetworkScheduler& NetworkScheduler::getInstance() {
+  static NetworkScheduler scheduler;
+  return scheduler;
+};
+
+#endif // NETWORKHUB_COROUTINES
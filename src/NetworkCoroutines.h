@@ -0,0 +1,301 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef NETWORKCOROUTINES_H
+#define NETWORKCOROUTINES_H
+
+// Coroutines need C++20 (-std=gnu++20 in the build flags). With
+// older standards this header defines nothing, so the library
+// still builds with the default Teensyduino settings.
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <Arduino.h>
+#include <coroutine>
+
+#include "NetworkClient.h"
+#include "NetworkServer.h"
+#include "NetworkUDP.h"
+
+#define NETWORKHUB_COROUTINES 1
+
+// Maximum number of network tasks alive at the same time. Each
+// one takes a frame from a fixed arena, so no heap is used.
+#ifndef NETWORKHUB_MAX_TASKS
+#define NETWORKHUB_MAX_TASKS 8
+#endif
+
+// Size of each coroutine frame in the arena. A task whose frame
+// (its locals plus compiler bookkeeping) is larger than this will
+// fail to start, see NetworkTask::isValid().
+#ifndef NETWORKHUB_TASK_FRAME_SIZE
+#define NETWORKHUB_TASK_FRAME_SIZE 512
+#endif
+
+// Fixed arena that holds the frames of all network tasks.
+//
+class NetworkTaskArena {
+  public:
+    static void* allocate(size_t size);
+    static void release(void* frame);
+    
+    static size_t getInUseCount() { return _inUseCount; };
+    static size_t getHighWaterCount() { return _highWaterCount; };
+    static uint32_t getFailedCount() { return _failedCount; };
+    
+  private:
+    static_assert(NETWORKHUB_MAX_TASKS <= 32, "NETWORKHUB_MAX_TASKS can be at most 32");
+    
+    struct alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) Frame {
+      uint8_t bytes[NETWORKHUB_TASK_FRAME_SIZE];
+    };
+    
+    static Frame _frames[NETWORKHUB_MAX_TASKS];
+    static uint32_t _inUse;
+    static size_t _inUseCount;
+    static size_t _highWaterCount;
+    static uint32_t _failedCount;
+};
+
+// Return type for a network coroutine. A task starts running
+// as soon as it is called, runs until its first co_await that
+// can't complete immediately, and is then resumed by the
+// NetworkScheduler. Its frame is returned to the arena when
+// it finishes. Tasks can't co_await other tasks.
+//
+//   NetworkTask echo(NetworkClient& client) {
+//     uint8_t buffer[64];
+//     int length;
+//     while ((length = co_await NetworkReadSome(client, buffer, sizeof(buffer))) > 0) {
+//       client.write(buffer, length);
+//     }
+//     client.stop();
+//   }
+//
+class NetworkTask {
+  public:
+    struct promise_type {
+      static void* operator new(size_t size) noexcept { return NetworkTaskArena::allocate(size); };
+      static void operator delete(void* frame) { NetworkTaskArena::release(frame); };
+      static NetworkTask get_return_object_on_allocation_failure() { return NetworkTask(false); };
+      
+      NetworkTask get_return_object() { return NetworkTask(true); };
+      std::suspend_never initial_suspend() noexcept { return {}; };
+      std::suspend_never final_suspend() noexcept { return {}; };
+      void return_void() {};
+      void unhandled_exception() {};
+    };
+    
+    // Returns false if the task could not be started because the
+    // arena was full or its frame was too large.
+    bool isValid() { return _valid; };
+    
+  private:
+    NetworkTask(bool valid) {
+      _valid = valid;
+    };
+    
+    bool _valid;
+};
+
+// Base class for operations a task can co_await. poll() is called
+// once when the operation is awaited and then on every
+// NetworkScheduler::run() until it returns true.
+//
+class NetworkAwaitable {
+  public:
+    // Returns true when the operation has finished, successfully
+    // or not.
+    virtual bool poll() = 0;
+    
+    bool await_ready() { return poll(); };
+    void await_suspend(std::coroutine_handle<> handle);
+};
+
+// Resumes waiting tasks when their operations finish. Everything
+// runs on the thread that calls run(), normally from loop().
+//
+class NetworkScheduler {
+  public:
+    // Poll every waiting operation and resume the tasks whose
+    // operation finished.
+    void run();
+    
+    size_t getWaitingCount() { return _waitingCount; };
+    
+    // Returns the singleton instance of NetworkScheduler
+    static NetworkScheduler& getInstance();
+    
+  private:
+    friend class NetworkAwaitable;
+    
+    NetworkScheduler() { /* Nothing to see here, move along. */ };
+    
+    void wait(NetworkAwaitable* awaitable, std::coroutine_handle<> handle);
+    
+    struct Waiter {
+      NetworkAwaitable* awaitable;
+      std::coroutine_handle<> handle;
+    };
+    
+    // Each task waits on at most one operation at a time, so this
+    // can't overflow.
+    Waiter _waiters[NETWORKHUB_MAX_TASKS];
+    size_t _waitingCount = 0;
+};
+
+// co_await NetworkReadSome(client, buffer, size, timeoutMs)
+// Waits for data and reads whatever is available, up to size bytes.
+// Returns the number of bytes read, 0 if the connection closed,
+// or -1 if the timeout expired. A timeout of 0 waits forever.
+//
+class NetworkReadSome : public NetworkAwaitable {
+  public:
+    NetworkReadSome(NetworkClient& client, uint8_t* buffer, size_t size, uint32_t timeoutMs = 0)
+      : _client(client) {
+      _buffer = buffer;
+      _size = size;
+      _timeoutMs = timeoutMs;
+      _startMillis = millis();
+    };
+    
+    bool poll() {
+      if (_client.available() > 0) {
+        _result = _client.read(_buffer, _size);
+        return true;
+      }
+      if (!_client.connected()) {
+        _result = 0;
+        return true;
+      }
+      if (_timeoutMs > 0 && millis() - _startMillis >= _timeoutMs) {
+        _result = -1;
+        return true;
+      }
+      return false;
+    };
+    
+    int await_resume() { return _result; };
+    
+  private:
+    NetworkClient& _client;
+    uint8_t* _buffer;
+    size_t _size;
+    uint32_t _timeoutMs;
+    uint32_t _startMillis;
+    int _result = 0;
+};
+
+// co_await NetworkAccept(server, client)
+// Waits for the server to have a client with data available and
+// assigns it to client. Always returns true.
+//
+class NetworkAccept : public NetworkAwaitable {
+  public:
+    NetworkAccept(NetworkServer* server, NetworkClient& client)
+      : _client(client) {
+      _server = server;
+    };
+    
+    bool poll() {
+      NetworkClient candidate = _server->available();
+      if (candidate) {
+        _client = candidate;
+        return true;
+      }
+      return false;
+    };
+    
+    bool await_resume() { return true; };
+    
+  private:
+    NetworkServer* _server;
+    NetworkClient& _client;
+};
+
+// co_await NetworkReceive(udp, timeoutMs)
+// Waits for the next packet on udp. Returns its size, or 0 if the
+// timeout expired. The packet is then read from udp as usual.
+// A timeout of 0 waits forever.
+//
+class NetworkReceive : public NetworkAwaitable {
+  public:
+    NetworkReceive(NetworkUDP* udp, uint32_t timeoutMs = 0) {
+      _udp = udp;
+      _timeoutMs = timeoutMs;
+      _startMillis = millis();
+    };
+    
+    bool poll() {
+      _result = _udp->parsePacket();
+      return _result > 0 || (_timeoutMs > 0 && millis() - _startMillis >= _timeoutMs);
+    };
+    
+    int await_resume() { return _result > 0 ? _result : 0; };
+    
+  private:
+    NetworkUDP* _udp;
+    uint32_t _timeoutMs;
+    uint32_t _startMillis;
+    int _result = 0;
+};
+
+// co_await NetworkConnect(client, ip, port, timeoutMs)
+// Connects the client. Returns 1 if connected, 0 otherwise. A
+// timeout of 0 keeps the client's own connect timeout. Backends
+// without a non-blocking connect finish in a single step, capped
+// by the timeout.
+//
+class NetworkConnect : public NetworkAwaitable {
+  public:
+    NetworkConnect(NetworkClient& client, IPAddress ip, uint16_t port, uint32_t timeoutMs = 0)
+      : _client(client) {
+      _ip = ip;
+      _port = port;
+      _timeoutMs = timeoutMs;
+    };
+    
+    bool poll() {
+      if (!_started) {
+        if (_timeoutMs > 0) {
+          _client.setConnectTimeout(_timeoutMs);
+        }
+        _client.connectStart(_ip, _port);
+        _started = true;
+      }
+      return _client.connectStatus() != NETWORK_CONNECT_IN_PROGRESS;
+    };
+    
+    int await_resume() { return _client.connectStatus() == NETWORK_CONNECT_SUCCESS ? 1 : 0; };
+    
+  private:
+    NetworkClient& _client;
+    IPAddress _ip;
+    uint16_t _port;
+    uint32_t _timeoutMs;
+    bool _started = false;
+};
+
+// co_await NetworkSleep(ms)
+// Gives the other tasks a chance to run for at least ms milliseconds.
+//
+class NetworkSleep : public NetworkAwaitable {
+  public:
+    NetworkSleep(uint32_t ms) {
+      _ms = ms;
+      _startMillis = millis();
+    };
+    
+    bool poll() { return millis() - _startMillis >= _ms; };
+    
+    void await_resume() {};
+    
+  private:
+    uint32_t _ms;
+    uint32_t _startMillis;
+};
+
+#endif // __cpp_impl_coroutine
+
+#endif // NETWORKCOROUTINES_H
@@ -0,0 +1,123 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef NETWORKDECORATOR_H
+#define NETWORKDECORATOR_H
+
+#include <Arduino.h>
+
+#include "NetworkClient.h"
+#include "NetworkClientWrapper.h"
+#include "NetworkServer.h"
+#include "NetworkServerWrapper.h"
+#include "NetworkUDP.h"
+#include "NetworkUDPWrapper.h"
+
+class NetworkHub;
+
+// NetworkClientWrapper that sits in front of another client and
+// forwards every call to it. Subclasses override the calls they
+// want to watch or change (capture, fault injection, shaping), and
+// clone().
+//
+class NetworkClientDecorator : public NetworkClientWrapper {
+  public:
+    int connect(IPAddress ip, uint16_t port) { return _client.connect(ip, port); };
+    int connect(const char *host, uint16_t port) { return _client.connect(host, port); };
+    size_t write(uint8_t b) { return write(&b, 1); };
+    size_t write(const uint8_t *buf, size_t size) { return _client.write(buf, size); };
+    int available() { return _client.available(); };
+    int read() { return _client.read(); };
+    int read(uint8_t *buf, size_t size) { return _client.read(buf, size); };
+    int peek() { return _client.peek(); };
+    void flush() { _client.flush(); };
+    void stop() { _client.stop(); };
+    uint8_t connected() { return _client.connected(); };
+    operator bool() { return _client ? true : false; };
+    IPAddress remoteIP() { return _client.remoteIP(); };
+    uint16_t remotePort() { return _client.remotePort(); };
+    int availableForWrite() { return _client.availableForWrite(); };
+    bool hasNonBlockingWrite() { return _client.hasNonBlockingWrite(); };
+    
+    // The underlying client keeps its own deadlines
+    void setConnectionTimeout(uint32_t timeoutMs) { _client.setConnectTimeout(timeoutMs); };
+    void setConnectWaits(bool waits) { _client._connectWaits = waits; };
+    bool hasNonBlockingConnect() { return _client.hasNonBlockingConnect(); };
+    int startConnect(IPAddress ip, uint16_t port) {
+      return _client.connectStart(ip, port) == NETWORK_CONNECT_FAILED ? 0 : 1;
+    };
+    int startConnect(const char *host, uint16_t port) {
+      return _client.connectStart(host, port) == NETWORK_CONNECT_FAILED ? 0 : 1;
+    };
+    int pollConnect() { return _client.connectStatus(); };
+    
+    bool hasSecureConnect() { return _client.hasSecureConnect(); };
+    int connectSecure(IPAddress ip, uint16_t port) { return _client.connectSecure(ip, port); };
+    int connectSecure(const char *host, uint16_t port) { return _client.connectSecure(host, port); };
+    
+  protected:
+    NetworkClientDecorator(NetworkClient& client) : _client(client) {};
+    
+    NetworkClient _client;
+};
+
+// NetworkUDPWrapper that sits in front of another UDP and forwards
+// every call to it. It owns the UDP.
+//
+class NetworkUDPDecorator : public NetworkUDPWrapper {
+  public:
+    uint8_t begin(uint16_t port) { return _udp->begin(port); };
+    uint8_t beginMulticast(IPAddress ip, uint16_t port) { return _udp->beginMulticast(ip, port); };
+    void stop() { _udp->stop(); };
+    
+    int beginPacket(IPAddress ip, uint16_t port) { return _udp->beginPacket(ip, port); };
+    int beginPacket(const char *host, uint16_t port) { return _udp->beginPacket(host, port); };
+    int endPacket() { return _udp->endPacket(); };
+    size_t write(uint8_t b) { return write(&b, 1); };
+    size_t write(const uint8_t *buffer, size_t size) { return _udp->write(buffer, size); };
+    
+    int parsePacket() { return _udp->parsePacket(); };
+    int available() { return _udp->available(); };
+    int read() { return _udp->read(); };
+    int read(unsigned char* buffer, size_t len) { return _udp->read(buffer, len); };
+    int read(char* buffer, size_t len) { return read((unsigned char*)buffer, len); };
+    int peek() { return _udp->peek(); };
+    void flush() { _udp->flush(); };
+    IPAddress remoteIP() { return _udp->remoteIP(); };
+    uint16_t remotePort() { return _udp->remotePort(); };
+    
+    ~NetworkUDPDecorator() {
+      delete _udp;
+    };
+    
+  protected:
+    NetworkUDPDecorator(NetworkUDP* udp) { _udp = udp; };
+    
+    NetworkUDP* _udp;
+};
+
+// Creates the decorators for a DecoratedNetworkHub. Return NULL
+// from any of the methods to leave that kind of socket as it is.
+//
+class NetworkDecorator {
+  public:
+    virtual ~NetworkDecorator() {};
+    
+    // Called when the decorator is added to a hub.
+    virtual void attach(NetworkHub* networkHub) {};
+    
+    // Returns a wrapper in front of the client. localPort is the
+    // server's port for clients accepted by a server, otherwise 0.
+    virtual NetworkClientWrapper* decorateClient(NetworkClient& client, uint16_t localPort) { return NULL; };
+    
+    // Returns a wrapper in front of the UDP, which it then owns.
+    virtual NetworkUDPWrapper* decorateUDP(NetworkUDP* udp) { return NULL; };
+    
+    // Returns a wrapper in front of the server, which it then owns.
+    // The clients the server accepts go through decorateClient().
+    virtual NetworkServerWrapper* decorateServer(NetworkServer* server, uint16_t portNum) { return NULL; };
+};
+
+#endif // NETWORKDECORATOR_H
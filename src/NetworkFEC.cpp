@@ -0,0 +1,328 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+// Local includes
+#include "NetworkFEC.h"
+
+static const uint16_t MAGIC = 0x5446; // 'TF'
+static const uint8_t VERSION = 1;
+static const uint8_t TYPE_DATA = 1;
+static const uint8_t TYPE_PARITY = 2;
+
+static void writeUInt16(uint8_t* buffer, uint16_t value) {
+  buffer[0] = value >> 8;
+  buffer[1] = value;
+}
+
+static uint16_t readUInt16(const uint8_t* buffer) {
+  return ((uint16_t)buffer[0] << 8) | buffer[1];
+}
+
+static void writeHeader(uint8_t* datagram, uint8_t type, uint16_t group, uint8_t index, uint8_t size, uint16_t length) {
+  writeUInt16(datagram, MAGIC);
+  datagram[2] = VERSION;
+  datagram[3] = type;
+  writeUInt16(datagram + 4, group);
+  datagram[6] = index;
+  datagram[7] = size;
+  writeUInt16(datagram + 8, length);
+}
+
+// A word at a time where it can, which is most of the cost of both
+// sides
+static void xorInto(uint8_t* target, const uint8_t* source, size_t length) {
+  size_t x = 0;
+  for (; x + 4 <= length; x += 4) {
+    uint32_t a;
+    uint32_t b;
+    memcpy(&a, target + x, 4);
+    memcpy(&b, source + x, 4);
+    a ^= b;
+    memcpy(target + x, &a, 4);
+  }
+  for (; x < length; x++) {
+    target[x] ^= source[x];
+  }
+}
+
+// The datagrams of a group are tracked in a 32 bit mask
+static_assert(NETWORKHUB_FEC_MAX_GROUP_SIZE <= 32, "NETWORKHUB_FEC_MAX_GROUP_SIZE can't be more than 32");
+
+static uint32_t groupMask(uint8_t size) {
+  return size >= 32 ? 0xFFFFFFFF : ((uint32_t)1 << size) - 1;
+}
+
+// NetworkFECEncoder
+
+bool NetworkFECEncoder::begin(uint16_t localPort, IPAddress ip, uint16_t port) {
+  _ip = ip;
+  _port = port;
+  
+  memset(_parity, 0, _maxLength);
+  _lengthParity = 0;
+  _maxLength = 0;
+  _index = 0;
+  
+  return _udp->begin(localPort) == 1;
+}
+
+bool NetworkFECEncoder::send(const uint8_t* payload, size_t length) {
+  if (length == 0 || length > NETWORKHUB_FEC_PAYLOAD_SIZE) {
+    return false;
+  }
+  
+  bool sent = sendDatagram(payload, length, false);
+  if (_groupSize > 0 && _index >= _groupSize) {
+    sendDatagram(NULL, 0, true);
+  }
+  return sent;
+}
+
+bool NetworkFECEncoder::flush() {
+  if (_groupSize == 0 || _index == 0) {
+    return true;
+  }
+  return sendDatagram(NULL, 0, true);
+}
+
+size_t NetworkFECEncoder::encode(const uint8_t* payload, size_t length, uint8_t* datagram) {
+  if (length == 0 || length > NETWORKHUB_FEC_PAYLOAD_SIZE) {
+    return 0;
+  }
+  
+  if (_index == 0) {
+    _groupSize = _nextGroupSize;
+  }
+  
+  writeHeader(datagram, TYPE_DATA, _group, _index, _groupSize, length);
+  memcpy(datagram + NETWORKHUB_FEC_HEADER_SIZE, payload, length);
+  _dataCount++;
+  
+  if (_groupSize == 0) {
+    _group++;
+  } else {
+    xorInto(_parity, payload, length);
+    _lengthParity ^= length;
+    _maxLength = max(_maxLength, (uint16_t)length);
+    _index++;
+  }
+  return NETWORKHUB_FEC_HEADER_SIZE + length;
+}
+
+size_t NetworkFECEncoder::encodeParity(uint8_t* datagram, bool flush) {
+  if (_groupSize == 0 || _index == 0 || (_index < _groupSize && !flush)) {
+    return 0;
+  }
+  
+  // A flushed group is as big as it got
+  writeHeader(datagram, TYPE_PARITY, _group, _index, _index, _lengthParity);
+  memcpy(datagram + NETWORKHUB_FEC_HEADER_SIZE, _parity, _maxLength);
+  size_t length = NETWORKHUB_FEC_HEADER_SIZE + _maxLength;
+  _parityCount++;
+  
+  memset(_parity, 0, _maxLength);
+  _lengthParity = 0;
+  _maxLength = 0;
+  _index = 0;
+  _group++;
+  return length;
+}
+
+bool NetworkFECEncoder::sendDatagram(const uint8_t* payload, size_t length, bool parity) {
+  bool started = _udp->beginPacket(_ip, _port) == 1;
+  size_t size = parity ? getParityLength() : NETWORKHUB_FEC_HEADER_SIZE + length;
+  
+  // Encode straight into the packet where the backend allows
+  uint8_t* datagram = started ? _udp->reserve(size) : NULL;
+  uint8_t buffer[NETWORKHUB_FEC_HEADER_SIZE + NETWORKHUB_FEC_PAYLOAD_SIZE];
+  uint8_t* target = datagram != NULL ? datagram : buffer;
+  size = parity ? encodeParity(target, true) : encode(payload, length, target);
+  
+  // Data that couldn't be sent is still in the parity, so the
+  // decoder can rebuild it
+  if (!started) {
+    return false;
+  }
+  
+  if (datagram != NULL) {
+    _udp->commit(size);
+  } else {
+    _udp->write(buffer, size);
+  }
+  return _udp->endPacket() == 1;
+}
+
+// NetworkFECDecoder
+
+size_t NetworkFECDecoder::receive(uint8_t* buffer, size_t size) {
+  size_t length = takeRecovered(buffer, size);
+  if (length > 0 || _udp == NULL) {
+    return length;
+  }
+  
+  int packetSize;
+  while ((packetSize = _udp->parsePacket()) > 0) {
+    uint8_t datagram[NETWORKHUB_FEC_HEADER_SIZE + NETWORKHUB_FEC_PAYLOAD_SIZE];
+    if (packetSize > (int)sizeof(datagram)) {
+      continue;
+    }
+    
+    int datagramLength = _udp->read(datagram, sizeof(datagram));
+    if (datagramLength <= 0) {
+      continue;
+    }
+    
+    length = decode(datagram, datagramLength, buffer, size);
+    if (length == 0) {
+      length = takeRecovered(buffer, size);
+    }
+    if (length > 0) {
+      return length;
+    }
+  }
+  return 0;
+}
+
+size_t NetworkFECDecoder::decode(const uint8_t* datagram, size_t length, uint8_t* buffer, size_t size) {
+  if (length < NETWORKHUB_FEC_HEADER_SIZE || length > NETWORKHUB_FEC_HEADER_SIZE + NETWORKHUB_FEC_PAYLOAD_SIZE
+      || readUInt16(datagram) != MAGIC || datagram[2] != VERSION) {
+    return 0;
+  }
+  
+  uint8_t type = datagram[3];
+  uint16_t id = readUInt16(datagram + 4);
+  uint8_t index = datagram[6];
+  uint8_t groupSize = min(datagram[7], (uint8_t)NETWORKHUB_FEC_MAX_GROUP_SIZE);
+  uint16_t payloadLength = readUInt16(datagram + 8);
+  const uint8_t* payload = datagram + NETWORKHUB_FEC_HEADER_SIZE;
+  length -= NETWORKHUB_FEC_HEADER_SIZE;
+  
+  if (type == TYPE_PARITY) {
+    Group* group = findGroup(id);
+    if (group != NULL && !group->hasParity && groupSize > 0) {
+      group->hasParity = true;
+      group->size = groupSize;
+      xorInto(group->parity, payload, length);
+      group->lengthParity ^= payloadLength;
+      group->maxLength = max(group->maxLength, (uint16_t)length);
+      _parityCount++;
+      checkRecovery(*group);
+    }
+    return 0;
+  }
+  
+  if (type != TYPE_DATA || payloadLength != length || length == 0) {
+    return 0;
+  }
+  
+  if (groupSize > 0) {
+    Group* group = findGroup(id);
+    if (group != NULL) {
+      // The index comes off the network, so check it before it is
+      // used as a shift. A duplicate would spoil the parity.
+      if (index >= groupSize || (group->received & ((uint32_t)1 << index)) != 0) {
+        return 0;
+      }
+      group->received |= (uint32_t)1 << index;
+      if (!group->hasParity) {
+        group->size = groupSize;
+      }
+      xorInto(group->parity, payload, length);
+      group->lengthParity ^= length;
+      group->maxLength = max(group->maxLength, (uint16_t)length);
+      checkRecovery(*group);
+    }
+    // Too late for its group, but still worth having
+  }
+  
+  _receivedCount++;
+  size_t copied = min(size, length);
+  memcpy(buffer, payload, copied);
+  return copied;
+}
+
+size_t NetworkFECDecoder::takeRecovered(uint8_t* buffer, size_t size) {
+  for (uint8_t x = 0; x < NETWORKHUB_FEC_GROUPS; x++) {
+    Group& group = _groups[x];
+    if (group.recovered) {
+      group.recovered = false;
+      size_t copied = min(size, (size_t)group.lengthParity);
+      memcpy(buffer, group.parity, copied);
+      return copied;
+    }
+  }
+  return 0;
+}
+
+void NetworkFECDecoder::printStatus(Print* printer) {
+  printer->print("FEC: ");
+  printer->print(_receivedCount);
+  printer->print(" received, ");
+  printer->print(_recoveredCount);
+  printer->print(" recovered, ");
+  printer->print(_lostCount);
+  printer->print(" lost, ");
+  printer->print(_parityCount);
+  printer->println(" parity");
+}
+
+NetworkFECDecoder::Group* NetworkFECDecoder::findGroup(uint16_t id) {
+  for (uint8_t x = 0; x < NETWORKHUB_FEC_GROUPS; x++) {
+    if (_groups[x].active && _groups[x].id == id) {
+      return &_groups[x];
+    }
+  }
+  
+  // A new group takes a free slot, or the oldest one
+  Group* oldest = NULL;
+  for (uint8_t x = 0; x < NETWORKHUB_FEC_GROUPS; x++) {
+    Group& group = _groups[x];
+    if (!group.active) {
+      oldest = &group;
+      break;
+    }
+    if (oldest == NULL || (int16_t)(group.id - oldest->id) < 0) {
+      oldest = &group;
+    }
+  }
+  if (oldest->active && (int16_t)(id - oldest->id) < 0) {
+    return NULL;
+  }
+  
+  closeGroup(*oldest);
+  memset(oldest->parity, 0, oldest->maxLength);
+  oldest->active = true;
+  oldest->hasParity = false;
+  oldest->recovered = false;
+  oldest->id = id;
+  oldest->size = 0;
+  oldest->received = 0;
+  oldest->lengthParity = 0;
+  oldest->maxLength = 0;
+  return oldest;
+}
+
+void NetworkFECDecoder::closeGroup(Group& group) {
+  if (group.active) {
+    uint32_t mask = groupMask(group.size);
+    _lostCount += group.size - __builtin_popcount(group.received & mask);
+  }
+  group.active = false;
+}
+
+void NetworkFECDecoder::checkRecovery(Group& group) {
+  uint32_t mask = groupMask(group.size);
+  if (!group.hasParity || (uint8_t)__builtin_popcount(group.received & mask) != group.size - 1) {
+    return;
+  }
+  
+  // Everything else is in the parity, so it holds the missing one
+  if (group.lengthParity == 0 || group.lengthParity > group.maxLength) {
+    return;
+  }
+  group.received |= mask;
+  group.recovered = true;
+  _recoveredCount++;
+}
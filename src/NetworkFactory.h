@@ -24,12 +24,30 @@ class NetworkFactory {
       return NetworkClient(clientWrapper);
     };
     
+    // Both of these return NULL if the wrapper or the object itself
+    // could not be allocated, in which case the wrapper is deleted.
     static NetworkUDP* createNetworkUDP(NetworkUDPWrapper* udpWrapper) {
-      return new NetworkUDP(udpWrapper);
+      if (udpWrapper == NULL) {
+        return NULL;
+      }
+      
+      NetworkUDP* udp = new NetworkUDP(udpWrapper);
+      if (udp == NULL) {
+        delete udpWrapper;
+      }
+      return udp;
     };
     
     static NetworkServer* createNetworkServer(NetworkServerWrapper* serverWrapper) {
-      return new NetworkServer(serverWrapper);
+      if (serverWrapper == NULL) {
+        return NULL;
+      }
+      
+      NetworkServer* server = new NetworkServer(serverWrapper);
+      if (server == NULL) {
+        delete serverWrapper;
+      }
+      return server;
     };
   
   private:
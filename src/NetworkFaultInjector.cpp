@@ -0,0 +1,504 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+// Local includes
+#include "NetworkFaultInjector.h"
+
+// How far ahead of the capped link a client transfer may get
+#define FAULT_BURST_MICROS 5000
+
+// Number of separate arrivals a client's read side keeps delaying
+#define FAULT_ARRIVAL_COUNT 2
+
+// Delays, cuts short and caps the traffic of one client.
+//
+class FaultClientWrapper : public NetworkClientDecorator {
+  public:
+    size_t write(const uint8_t *buf, size_t size) {
+      size = _injector->limitTransfer(true, size);
+      return size > 0 ? _client.write(buf, size) : 0;
+    };
+    
+    int available() { return readableCount(); };
+    
+    int read() {
+      if (readableCount() == 0 || _injector->takeBandwidth(false, 1) == 0) {
+        return -1;
+      }
+      int c = _client.read();
+      if (c >= 0 && _readyCount > 0) {
+        _readyCount--;
+      }
+      return c;
+    };
+    
+    int read(uint8_t *buf, size_t size) {
+      int readable = readableCount();
+      if (readable <= 0) {
+        return -1;
+      }
+      size = _injector->limitTransfer(false, min(size, (size_t)readable));
+      if (size == 0) {
+        return -1;
+      }
+      int count = _client.read(buf, size);
+      if (count > 0) {
+        _readyCount -= min((uint32_t)count, _readyCount);
+      }
+      return count;
+    };
+    
+    int peek() { return readableCount() > 0 ? _client.peek() : -1; };
+    
+    NetworkClientWrapper* clone() {
+      return new FaultClientWrapper(*this);
+    };
+    
+  private:
+    friend class NetworkFaultInjector;
+    
+    FaultClientWrapper(NetworkFaultInjector* injector, NetworkClient& client) : NetworkClientDecorator(client) {
+      _injector = injector;
+    };
+    
+    // Data that arrives is held back as a chunk, which becomes
+    // readable once it has waited out its own delay and the chunks
+    // before it are readable. Returns how much can be read.
+    int readableCount() {
+      int available = _client.available();
+      if (_injector->_delayMicros == 0 && _injector->_jitterMicros == 0) {
+        _readyCount = 0;
+        _arrivalCount = 0;
+        return available;
+      }
+      
+      uint32_t held = _readyCount;
+      for (uint8_t x = 0; x < _arrivalCount; x++) {
+        held += _arrivals[x].count;
+      }
+      if (available <= 0 || (uint32_t)available < held) {
+        // The client dropped what it had, start over
+        _readyCount = 0;
+        _arrivalCount = 0;
+        held = 0;
+      }
+      
+      uint32_t now = micros();
+      while (_arrivalCount > 0 && (int32_t)(now - _arrivals[0].dueMicros) >= 0) {
+        _readyCount += _arrivals[0].count;
+        _arrivalCount--;
+        for (uint8_t x = 0; x < _arrivalCount; x++) {
+          _arrivals[x] = _arrivals[x + 1];
+        }
+      }
+      
+      // Anything new arrived since the last look. With no chunk free
+      // it joins the newest one, which then waits for the later of
+      // the two, so nothing is delayed less than asked.
+      if (available > 0 && (uint32_t)available > held) {
+        uint32_t due = now + _injector->_delayMicros + random(_injector->_jitterMicros + 1);
+        _injector->_delayedCount++;
+        if (_arrivalCount < FAULT_ARRIVAL_COUNT) {
+          _arrivals[_arrivalCount].count = available - held;
+          _arrivals[_arrivalCount].dueMicros = due;
+          _arrivalCount++;
+        } else {
+          Arrival& newest = _arrivals[_arrivalCount - 1];
+          newest.count += available - held;
+          if ((int32_t)(due - newest.dueMicros) > 0) {
+            newest.dueMicros = due;
+          }
+        }
+      }
+      return _readyCount;
+    };
+    
+    struct Arrival {
+      uint32_t count;
+      uint32_t dueMicros;
+    };
+    
+    NetworkFaultInjector* _injector;
+    uint32_t _readyCount = 0;
+    Arrival _arrivals[FAULT_ARRIVAL_COUNT];
+    uint8_t _arrivalCount = 0;
+};
+
+// Holds back, drops and duplicates the datagrams of one UDP.
+//
+class FaultUDPWrapper : public NetworkUDPDecorator {
+  public:
+    int beginPacket(IPAddress ip, uint16_t port) {
+      abandonPacket();
+      if (_injector->chance(_injector->_lossPercent)) {
+        _injector->_droppedCount++;
+        _sendMode = SEND_DROPPED;
+        return 1;
+      }
+      if (!_injector->isHolding()) {
+        _sendMode = SEND_DIRECT;
+        return _udp->beginPacket(ip, port);
+      }
+      
+      _sendPacket = _injector->allocatePacket(this);
+      if (_sendPacket == NULL) {
+        _injector->_overflowCount++;
+        _sendMode = SEND_DROPPED;
+        return 1;
+      }
+      _sendPacket->state = NetworkFaultInjector::PACKET_FILLING;
+      _sendPacket->ip = (uint32_t)ip;
+      _sendPacket->port = port;
+      _sendMode = SEND_HELD;
+      return 1;
+    };
+    
+    int beginPacket(const char *host, uint16_t port) {
+      // The address isn't known here, so these can't be held
+      abandonPacket();
+      if (_injector->chance(_injector->_lossPercent)) {
+        _injector->_droppedCount++;
+        _sendMode = SEND_DROPPED;
+        return 1;
+      }
+      _sendMode = SEND_DIRECT;
+      return _udp->beginPacket(host, port);
+    };
+    
+    size_t write(const uint8_t *buffer, size_t size) {
+      switch (_sendMode) {
+        case SEND_DIRECT:
+          return _udp->write(buffer, size);
+        
+        case SEND_HELD:
+          if (_sendPacket->length + size > NETWORKHUB_FAULT_PACKET_SIZE) {
+            _injector->_overflowCount++;
+            abandonPacket();
+            _sendMode = SEND_DROPPED;
+          } else {
+            memcpy(_sendPacket->data + _sendPacket->length, buffer, size);
+            _sendPacket->length += size;
+          }
+          return size;
+        
+        case SEND_DROPPED:
+          return size;
+        
+        default:
+          return 0;
+      }
+    };
+    
+    int endPacket() {
+      int result = 0;
+      switch (_sendMode) {
+        case SEND_DIRECT:
+          result = _udp->endPacket();
+          break;
+        
+        case SEND_HELD:
+          _injector->queuePacket(_sendPacket, true);
+          _sendPacket = NULL;
+          result = 1;
+          break;
+        
+        case SEND_DROPPED:
+          // Lost on the way, as far as the application can tell
+          result = 1;
+          break;
+        
+        default:
+          break;
+      }
+      _sendMode = SEND_NONE;
+      _injector->poll();
+      return result;
+    };
+    
+    int parsePacket() {
+      releaseCurrent();
+      _injector->poll();
+      
+      int size;
+      while ((size = _udp->parsePacket()) > 0) {
+        if (_injector->chance(_injector->_lossPercent)) {
+          _injector->_droppedCount++;
+          continue;
+        }
+        if (!_injector->isHolding()) {
+          // Read straight from the UDP
+          return size;
+        }
+        if (size > NETWORKHUB_FAULT_PACKET_SIZE) {
+          _injector->_overflowCount++;
+          continue;
+        }
+        
+        NetworkFaultInjector::Packet* packet = _injector->allocatePacket(this);
+        if (packet == NULL) {
+          _injector->_overflowCount++;
+          continue;
+        }
+        int length = _udp->read(packet->data, size);
+        packet->length = length > 0 ? length : 0;
+        packet->ip = (uint32_t)_udp->remoteIP();
+        packet->port = _udp->remotePort();
+        _injector->queuePacket(packet, false);
+      }
+      
+      _current = _injector->nextIncoming(this);
+      if (_current == NULL) {
+        return 0;
+      }
+      _current->state = NetworkFaultInjector::PACKET_CURRENT;
+      _readPosition = 0;
+      return _current->length;
+    };
+    
+    int available() {
+      return _current != NULL ? _current->length - _readPosition : _udp->available();
+    };
+    
+    int read() {
+      if (_current == NULL) {
+        return _udp->read();
+      }
+      return _readPosition < _current->length ? _current->data[_readPosition++] : -1;
+    };
+    
+    int read(unsigned char* buffer, size_t len) {
+      if (_current == NULL) {
+        return _udp->read(buffer, len);
+      }
+      size_t count = min(len, (size_t)(_current->length - _readPosition));
+      memcpy(buffer, _current->data + _readPosition, count);
+      _readPosition += count;
+      return count;
+    };
+    
+    int peek() {
+      if (_current == NULL) {
+        return _udp->peek();
+      }
+      return _readPosition < _current->length ? _current->data[_readPosition] : -1;
+    };
+    
+    void flush() {
+      if (_current == NULL) {
+        _udp->flush();
+      } else {
+        _readPosition = _current->length;
+      }
+    };
+    
+    IPAddress remoteIP() { return _current != NULL ? IPAddress(_current->ip) : _udp->remoteIP(); };
+    uint16_t remotePort() { return _current != NULL ? _current->port : _udp->remotePort(); };
+    
+    ~FaultUDPWrapper() {
+      _injector->releasePackets(this);
+    };
+    
+  private:
+    friend class NetworkFaultInjector;
+    
+    enum SendMode {
+      SEND_NONE,
+      SEND_DIRECT,   // straight to the UDP
+      SEND_HELD,     // into _sendPacket
+      SEND_DROPPED,  // nowhere
+    };
+    
+    FaultUDPWrapper(NetworkFaultInjector* injector, NetworkUDP* udp) : NetworkUDPDecorator(udp) {
+      _injector = injector;
+    };
+    
+    // A packet begun and never ended goes nowhere
+    void abandonPacket() {
+      if (_sendPacket != NULL) {
+        _sendPacket->state = NetworkFaultInjector::PACKET_FREE;
+        _sendPacket = NULL;
+      }
+    };
+    
+    void releaseCurrent() {
+      if (_current != NULL) {
+        _current->state = NetworkFaultInjector::PACKET_FREE;
+        _current = NULL;
+      }
+    };
+    
+    NetworkFaultInjector* _injector;
+    SendMode _sendMode = SEND_NONE;
+    NetworkFaultInjector::Packet* _sendPacket = NULL;
+    NetworkFaultInjector::Packet* _current = NULL;
+    uint16_t _readPosition = 0;
+};
+
+#if defined(NETWORKHUB_STATIC_ALLOC)
+static_assert(sizeof(FaultClientWrapper) <= NETWORKHUB_CLIENT_WRAPPER_SIZE, "Increase NETWORKHUB_CLIENT_WRAPPER_SIZE");
+static_assert(sizeof(FaultUDPWrapper) <= NETWORKHUB_UDP_WRAPPER_SIZE, "Increase NETWORKHUB_UDP_WRAPPER_SIZE");
+#endif
+
+void NetworkFaultInjector::clearFaults() {
+  _delayMicros = 0;
+  _jitterMicros = 0;
+  _lossPercent = 0;
+  _duplicatePercent = 0;
+  _reorderPercent = 0;
+  _bytesPerSecond = 0;
+  _shortPercent = 0;
+}
+
+void NetworkFaultInjector::poll() {
+  uint32_t now = micros();
+  while (true) {
+    // Send the due datagrams in the order they fell due
+    Packet* next = NULL;
+    for (uint8_t x = 0; x < NETWORKHUB_FAULT_QUEUE_SIZE; x++) {
+      Packet* packet = &_packets[x];
+      if (packet->state == PACKET_OUTGOING && (int32_t)(now - packet->dueMicros) >= 0
+          && packet->owner->_sendMode != FaultUDPWrapper::SEND_DIRECT
+          && (next == NULL || (int32_t)(packet->dueMicros - next->dueMicros) < 0)) {
+        next = packet;
+      }
+    }
+    if (next == NULL) {
+      return;
+    }
+    
+    NetworkUDP* udp = next->owner->_udp;
+    if (udp->beginPacket(IPAddress(next->ip), next->port) == 1) {
+      udp->write(next->data, next->length);
+      udp->endPacket();
+    }
+    next->state = PACKET_FREE;
+  }
+}
+
+void NetworkFaultInjector::printStatus(Print* printer) {
+  printer->print("Faults: ");
+  printer->print(_droppedCount);
+  printer->print(" dropped, ");
+  printer->print(_duplicatedCount);
+  printer->print(" duplicated, ");
+  printer->print(_reorderedCount);
+  printer->print(" reordered, ");
+  printer->print(_delayedCount);
+  printer->print(" delayed, ");
+  printer->print(_shortenedCount);
+  printer->print(" shortened, ");
+  printer->print(_overflowCount);
+  printer->println(" overflowed");
+}
+
+NetworkClientWrapper* NetworkFaultInjector::decorateClient(NetworkClient& client, uint16_t localPort) {
+  return new FaultClientWrapper(this, client);
+}
+
+NetworkUDPWrapper* NetworkFaultInjector::decorateUDP(NetworkUDP* udp) {
+  FaultUDPWrapper* udpWrapper = new FaultUDPWrapper(this, udp);
+  if (udpWrapper == NULL) {
+    delete udp;
+  }
+  return udpWrapper;
+}
+
+size_t NetworkFaultInjector::takeBandwidth(bool outgoing, size_t size) {
+  if (_bytesPerSecond == 0) {
+    return size;
+  }
+  
+  uint32_t now = micros();
+  uint32_t& linkFree = _linkFreeMicros[outgoing ? 0 : 1];
+  if ((int32_t)(now - linkFree) > 0) {
+    // An idle link doesn't save up
+    linkFree = now;
+  }
+  int32_t room = (int32_t)(now + FAULT_BURST_MICROS - linkFree);
+  if (room <= 0) {
+    return 0;
+  }
+  
+  // At least a byte at a time, however low the cap
+  size_t allowed = min(size, max((size_t)1, (size_t)((uint64_t)room * _bytesPerSecond / 1000000)));
+  linkFree += (uint64_t)allowed * 1000000 / _bytesPerSecond;
+  return allowed;
+}
+
+size_t NetworkFaultInjector::limitTransfer(bool outgoing, size_t size) {
+  if (size > 1 && chance(_shortPercent)) {
+    size = random(1, size);
+    _shortenedCount++;
+  }
+  return takeBandwidth(outgoing, size);
+}
+
+NetworkFaultInjector::Packet* NetworkFaultInjector::allocatePacket(FaultUDPWrapper* owner) {
+  for (uint8_t x = 0; x < NETWORKHUB_FAULT_QUEUE_SIZE; x++) {
+    if (_packets[x].state == PACKET_FREE) {
+      _packets[x].owner = owner;
+      _packets[x].length = 0;
+      _packets[x].state = PACKET_FILLING;
+      return &_packets[x];
+    }
+  }
+  return NULL;
+}
+
+void NetworkFaultInjector::queuePacket(Packet* packet, bool outgoing) {
+  uint32_t now = micros();
+  uint32_t due = now;
+  if (_bytesPerSecond > 0) {
+    // Wait for the packets ahead of it to get through the link
+    uint32_t& linkFree = _linkFreeMicros[outgoing ? 0 : 1];
+    if ((int32_t)(now - linkFree) > 0) {
+      linkFree = now;
+    }
+    linkFree += (uint64_t)packet->length * 1000000 / _bytesPerSecond;
+    due = linkFree;
+  }
+  due += _delayMicros + random(_jitterMicros + 1);
+  if (chance(_reorderPercent)) {
+    due += _reorderMicros;
+    _reorderedCount++;
+  }
+  if (due != now) {
+    _delayedCount++;
+  }
+  
+  packet->dueMicros = due;
+  packet->state = outgoing ? PACKET_OUTGOING : PACKET_INCOMING;
+  
+  if (chance(_duplicatePercent)) {
+    // If there's no room the copy is just not made
+    Packet* copy = allocatePacket(packet->owner);
+    if (copy != NULL) {
+      memcpy(copy, packet, sizeof(Packet));
+      copy->dueMicros = due + 1;
+      _duplicatedCount++;
+    }
+  }
+}
+
+NetworkFaultInjector::Packet* NetworkFaultInjector::nextIncoming(FaultUDPWrapper* owner) {
+  uint32_t now = micros();
+  Packet* next = NULL;
+  for (uint8_t x = 0; x < NETWORKHUB_FAULT_QUEUE_SIZE; x++) {
+    Packet* packet = &_packets[x];
+    if (packet->state == PACKET_INCOMING && packet->owner == owner && (int32_t)(now - packet->dueMicros) >= 0
+        && (next == NULL || (int32_t)(packet->dueMicros - next->dueMicros) < 0)) {
+      next = packet;
+    }
+  }
+  return next;
+}
+
+void NetworkFaultInjector::releasePackets(FaultUDPWrapper* owner) {
+  for (uint8_t x = 0; x < NETWORKHUB_FAULT_QUEUE_SIZE; x++) {
+    if (_packets[x].owner == owner) {
+      _packets[x].state = PACKET_FREE;
+    }
+  }
+}
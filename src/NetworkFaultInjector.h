@@ -0,0 +1,154 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef NETWORKFAULTINJECTOR_H
+#define NETWORKFAULTINJECTOR_H
+
+#include <Arduino.h>
+
+#include "NetworkDecorator.h"
+
+// Number of datagrams that can be held back for delay, duplication
+// and reordering, across all the UDPs of the hub.
+#ifndef NETWORKHUB_FAULT_QUEUE_SIZE
+#define NETWORKHUB_FAULT_QUEUE_SIZE 8
+#endif
+
+// Largest datagram that can be held back. Larger ones are dropped
+// when they would need to be held.
+#ifndef NETWORKHUB_FAULT_PACKET_SIZE
+#define NETWORKHUB_FAULT_PACKET_SIZE 512
+#endif
+
+class FaultUDPWrapper;
+
+// Makes the link of a DecoratedNetworkHub worse on purpose, to see
+// how a protocol copes: datagrams are delayed, dropped, duplicated
+// and reordered, the bandwidth is capped, and client reads and
+// writes are cut short. All the settings can be changed at any time
+// and start out off.
+//
+// Datagrams are impaired both ways. Ones held back in either
+// direction are released from the UDP's own calls and from poll(),
+// so call poll() from loop(). Client traffic is only delayed on the
+// receiving side (each arrival is not readable until it has been
+// waiting for the delay), and is never dropped, since TCP would
+// hide that.
+// Datagrams sent to a host name are only subject to loss.
+//
+//   NetworkFaultInjector faults;
+//   networkHub.addDecorator(&faults);  // a DecoratedNetworkHub
+//   faults.setDelay(50, 20);
+//   faults.setLoss(5);
+//
+// Draws come from random(), so seed it with randomSeed() for a
+// repeatable run.
+//
+class NetworkFaultInjector : public NetworkDecorator {
+  public:
+    NetworkFaultInjector() { /* Nothing to see here, move along. */ };
+    
+    // Delay each datagram and client data by delayMs plus up to
+    // jitterMs more. Jitter on its own reorders datagrams too.
+    void setDelay(uint32_t delayMs, uint32_t jitterMs = 0) { _delayMicros = delayMs * 1000; _jitterMicros = jitterMs * 1000; };
+    // Percentage of datagrams dropped.
+    void setLoss(uint8_t percent) { _lossPercent = percent; };
+    // Percentage of datagrams delivered twice.
+    void setDuplication(uint8_t percent) { _duplicatePercent = percent; };
+    // Percentage of datagrams held back by an extra holdMs, so the
+    // ones after them overtake them.
+    void setReordering(uint8_t percent, uint32_t holdMs = 20) { _reorderPercent = percent; _reorderMicros = holdMs * 1000; };
+    // Cap the bandwidth each way, in bytes per second, 0 for no cap.
+    // Datagrams queue behind each other, client reads and writes
+    // come up short.
+    void setBandwidth(uint32_t bytesPerSecond) { _bytesPerSecond = bytesPerSecond; };
+    // Percentage of client reads and writes that move only part of
+    // what they could.
+    void setShortTransfers(uint8_t percent) { _shortPercent = percent; };
+    // Turn all the impairments off. Held datagrams are still
+    // released when due.
+    void clearFaults();
+    
+    // Release the held datagrams that are due.
+    void poll();
+    
+    uint32_t getDroppedCount() { return _droppedCount; };
+    uint32_t getDuplicatedCount() { return _duplicatedCount; };
+    uint32_t getReorderedCount() { return _reorderedCount; };
+    uint32_t getDelayedCount() { return _delayedCount; };
+    uint32_t getShortenedCount() { return _shortenedCount; };
+    // Datagrams dropped because the queue was full or they were too
+    // large to hold, on top of the ones dropped on purpose.
+    uint32_t getOverflowCount() { return _overflowCount; };
+    void printStatus(Print* printer);
+    
+    // NetworkDecorator methods
+    NetworkClientWrapper* decorateClient(NetworkClient& client, uint16_t localPort);
+    NetworkUDPWrapper* decorateUDP(NetworkUDP* udp);
+    
+  protected:
+    friend class FaultClientWrapper;
+    friend class FaultUDPWrapper;
+    
+    enum PacketState {
+      PACKET_FREE,
+      PACKET_FILLING,   // being written by the application
+      PACKET_OUTGOING,  // waiting to be sent
+      PACKET_INCOMING,  // waiting to be received
+      PACKET_CURRENT,   // being read by the application
+    };
+    
+    struct Packet {
+      FaultUDPWrapper* owner = NULL;
+      uint32_t dueMicros;
+      uint32_t ip;
+      uint16_t port;
+      uint16_t length;
+      uint8_t state = PACKET_FREE;
+      uint8_t data[NETWORKHUB_FAULT_PACKET_SIZE];
+    };
+    
+    uint32_t _delayMicros = 0;
+    uint32_t _jitterMicros = 0;
+    uint8_t _lossPercent = 0;
+    uint8_t _duplicatePercent = 0;
+    uint8_t _reorderPercent = 0;
+    uint32_t _reorderMicros = 0;
+    uint32_t _bytesPerSecond = 0;
+    uint8_t _shortPercent = 0;
+    
+    // When the capped link is next free, sending and receiving
+    uint32_t _linkFreeMicros[2] = { 0, 0 };
+    
+    Packet _packets[NETWORKHUB_FAULT_QUEUE_SIZE];
+    
+    uint32_t _droppedCount = 0;
+    uint32_t _duplicatedCount = 0;
+    uint32_t _reorderedCount = 0;
+    uint32_t _delayedCount = 0;
+    uint32_t _shortenedCount = 0;
+    uint32_t _overflowCount = 0;
+    
+    bool chance(uint8_t percent) { return percent > 0 && random(100) < percent; };
+    // Returns true if datagrams have to be held rather than passed
+    // straight through.
+    bool isHolding() {
+      return _delayMicros > 0 || _jitterMicros > 0 || _duplicatePercent > 0 || _reorderPercent > 0 || _bytesPerSecond > 0;
+    };
+    // Bytes of the given size that the capped link can move now.
+    size_t takeBandwidth(bool outgoing, size_t size);
+    // Reduce a client transfer for short transfers and the bandwidth cap.
+    size_t limitTransfer(bool outgoing, size_t size);
+    
+    Packet* allocatePacket(FaultUDPWrapper* owner);
+    // Queue a complete datagram, applying all the impairments.
+    void queuePacket(Packet* packet, bool outgoing);
+    // The incoming datagram for owner that is due soonest, or NULL.
+    Packet* nextIncoming(FaultUDPWrapper* owner);
+    // Forget all the datagrams of a UDP that is going away.
+    void releasePackets(FaultUDPWrapper* owner);
+};
+
+#endif // NETWORKFAULTINJECTOR_H
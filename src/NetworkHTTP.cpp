@@ -0,0 +1,33 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#include <strings.h>
+
+// Local includes
+#include "NetworkHTTP.h"
+
+bool NetworkHTTP::getHeader(const char* request, const char* name, char* value, size_t size) {
+  size_t nameLength = strlen(name);
+  
+  // Headers start on the line after the request line
+  const char* line = strstr(request, "\r\n");
+  while (line != NULL && line[2] != '\r' && line[2] != '\0') {
+    line += 2;
+    if (strncasecmp(line, name, nameLength) == 0 && line[nameLength] == ':') {
+      const char* start = line + nameLength + 1;
+      while (*start == ' ') {
+        start++;
+      }
+      const char* end = strstr(start, "\r\n");
+      size_t length = end != NULL ? (size_t)(end - start) : strlen(start);
+      length = min(length, size - 1);
+      memcpy(value, start, length);
+      value[length] = '\0';
+      return true;
+    }
+    line = strstr(line, "\r\n");
+  }
+  return false;
+}
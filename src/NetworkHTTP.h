@@ -0,0 +1,26 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef NETWORKHTTP_H
+#define NETWORKHTTP_H
+
+#include <Arduino.h>
+
+// Helpers for the HTTP requests read by NetworkAssetServer and
+// NetworkWebSocketServer.
+//
+class NetworkHTTP {
+  public:
+    // Copies the value of the named header, matched without regard
+    // to case, into value, cutting it short to fit size. The request
+    // starts with the request line (or just its line end). Returns
+    // false if the request doesn't have it.
+    static bool getHeader(const char* request, const char* name, char* value, size_t size);
+    
+  private:
+    NetworkHTTP() {};
+};
+
+#endif // NETWORKHTTP_H
@@ -11,6 +11,17 @@
 #include "NetworkClient.h"
 #include "NetworkServer.h"
 #include "NetworkUDP.h"
+#include "NetworkTLS.h"
+#include "NetworkTransmitScheduler.h"
+#include "NetworkHubStatus.h"
+
+// The kinds of socket a network stack has to find room for.
+enum NetworkSocketType {
+  NETWORK_SOCKET_CLIENT,  // TCP connections, made or accepted
+  NETWORK_SOCKET_SERVER,  // listening TCP ports
+  NETWORK_SOCKET_UDP,
+  NETWORK_SOCKET_TYPE_COUNT
+};
 
 // Generic interface for the network hub. Implementations
 // must implement the methods. The objects used to interact
@@ -42,6 +53,84 @@ class NetworkHub {
       _hasSubnetMask = true;
     };
     
+    // Use a software TLS stack for NetworkClient.connectSecure().
+    // Clients created by getClient() after this call use it, even
+    // when the backend could offload TLS, so the two can be
+    // compared. Pass NULL to go back to the backend's own support.
+    void setTLSProvider(NetworkTLSProvider* tlsProvider) {
+      _tlsProvider = tlsProvider;
+    };
+    
+    // Send the flows of this scheduler from service().
+    void setTransmitScheduler(NetworkTransmitScheduler* transmitScheduler) {
+      _transmitScheduler = transmitScheduler;
+    };
+    
+    NetworkTransmitScheduler* getTransmitScheduler() { return _transmitScheduler; };
+    
+    // Do the hub's periodic work, including sending the queued data
+    // of its transmit scheduler, if it has one. Call from loop().
+    virtual void service() {
+      if (_transmitScheduler != NULL) {
+        _transmitScheduler->service();
+      }
+    };
+    
+    // Returns a NetworkSecureSupport value describing how clients
+    // from getClient() will handle connectSecure().
+    virtual int getSecureConnectSupport() {
+      return _tlsProvider != NULL ? NETWORK_SECURE_SOFTWARE : NETWORK_SECURE_UNSUPPORTED;
+    };
+    
+    // Returns a snapshot of the hub's status. It is only read from
+    // the hardware again once the refresh interval has passed, so
+    // it is cheap enough to check every loop().
+    const NetworkHubStatus& getStatus() {
+      if (!_statusValid || millis() - _status.refreshedMillis >= _statusRefreshIntervalMs) {
+        refreshStatus();
+      }
+      return _status;
+    };
+    
+    void setStatusRefreshInterval(uint32_t intervalMs) { _statusRefreshIntervalMs = intervalMs; };
+    
+    // Read the status from the hardware now.
+    void refreshStatus() {
+      NetworkHubStatus status;
+      readStatus(status);
+      
+      status.refreshedMillis = millis();
+      if (status.isLinkUp()) {
+        if (!_status.isLinkUp() || !_statusValid) {
+          _linkUpMillis = status.refreshedMillis;
+        }
+        status.linkUptimeMillis = status.refreshedMillis - _linkUpMillis;
+      }
+      _status = status;
+      _statusValid = true;
+    };
+    
+    // Print the status of the hub to the given
+    // Print object (ie Serial).
+    virtual void printStatus(Print* printer) {
+      refreshStatus();
+      _status.print(printer);
+    };
+    
+    // Returns true if the link to the network is up. This may
+    // talk to the network hardware, so avoid calling it in a
+    // tight loop; getStatus().isLinkUp() is the cached answer.
+    // Hubs that can't tell assume it is up.
+    virtual bool isLinkUp() { return true; };
+    
+    // Returns how many sockets of a NetworkSocketType the network
+    // stack has, or 0 if it doesn't say or they come from a shared
+    // pool. See NetworkSocketBudget.
+    virtual uint8_t getSocketLimit(uint8_t type) { return 0; };
+    // Returns how many sockets of all types the stack has between
+    // them, or 0 if there is no shared limit.
+    virtual uint8_t getTotalSocketLimit() { return 0; };
+    
     // These methods must be implemented by subclasses
     
     virtual IPAddress getLocalIPAddress() = 0;
@@ -58,9 +147,6 @@ class NetworkHub {
     // Returns a pointer to a NetworkUDP for use.
     virtual NetworkUDP* getUDP() = 0;
     
-    // Print the status of the hub to the given
-    // Print object (ie Serial).
-    virtual void printStatus(Print* printer) = 0;
     
   protected:
     NetworkHub() { /* Nothing to see here, move along. */ }
@@ -73,9 +159,34 @@ class NetworkHub {
     IPAddress _gatewayIPAddress;
     bool _hasSubnetMask = false;
     IPAddress _subnetMask;
+    NetworkTLSProvider* _tlsProvider = NULL;
+    NetworkTransmitScheduler* _transmitScheduler = NULL;
+    NetworkHubStatus _status;
+    bool _statusValid = false;
+    uint32_t _statusRefreshIntervalMs = NETWORKHUB_STATUS_REFRESH_INTERVAL;
+    uint32_t _linkUpMillis = 0;
     
     // Common methods for all subclasses
     
+    // Fill in the status from the hardware. Subclasses fill in what
+    // they know; this fills in the link state and local address.
+    virtual void readStatus(NetworkHubStatus& status) {
+      status.linkState = isLinkUp() ? NETWORK_LINK_UP : NETWORK_LINK_DOWN;
+      status.localIP = getLocalIPAddress();
+    };
+    
+    // Subclasses pass the wrappers for getClient() through this, so
+    // they run over the TLS provider if one is set. If that can't be
+    // allocated the client is returned without it.
+    NetworkClientWrapper* addTLSProvider(NetworkClientWrapper* clientWrapper) {
+      if (clientWrapper == NULL || _tlsProvider == NULL) {
+        return clientWrapper;
+      }
+      
+      NetworkClientWrapper* tlsClientWrapper = NetworkTLSClientWrapper::create(clientWrapper, _tlsProvider);
+      return tlsClientWrapper != NULL ? tlsClientWrapper : clientWrapper;
+    };
+    
     bool hasConfiguredLocalIPAddress() {
       return _hasLocalIPAddress;
     };
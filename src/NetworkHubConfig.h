@@ -0,0 +1,46 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef NETWORKHUBCONFIG_H
+#define NETWORKHUBCONFIG_H
+
+// The hub implementations compiled into the library. Each one pulls
+// in its network library, with that library's code, buffers and
+// static constructors, so by default a sketch needs all three
+// installed and carries all three.
+//
+// Define one or more of these in the build flags to compile only
+// those hubs, and only their network libraries are then looked for
+// and linked:
+//
+//   NETWORKHUB_BACKEND_QNETHERNET      QNEthernetNetworkHub
+//   NETWORKHUB_BACKEND_NATIVEETHERNET  NativeEthernetNetworkHub
+//   NETWORKHUB_BACKEND_WIFININA        WiFiNINANetworkHub
+//
+// ie in platformio.ini:
+//   build_flags = -DNETWORKHUB_BACKEND_QNETHERNET
+//
+// or with arduino-cli (the Teensy core has no extra_flags hook, so
+// the define rides along with the optimization flags):
+//   --build-property "build.flags.optimize=-O2 -DNETWORKHUB_BACKEND_QNETHERNET"
+//
+// The Arduino IDE can't pass build flags per sketch, and a #define
+// in the sketch doesn't reach the library's sources. There, add the
+// define to the board's flags in a boards.local.txt next to the
+// core's boards.txt, rather than editing this file, which a library
+// update would overwrite.
+//
+// With none defined all three are compiled. See
+// extras/size_report.py for the flash and RAM each configuration
+// takes.
+
+#if !defined(NETWORKHUB_BACKEND_QNETHERNET) && !defined(NETWORKHUB_BACKEND_NATIVEETHERNET) \
+    && !defined(NETWORKHUB_BACKEND_WIFININA)
+#define NETWORKHUB_BACKEND_QNETHERNET
+#define NETWORKHUB_BACKEND_NATIVEETHERNET
+#define NETWORKHUB_BACKEND_WIFININA
+#endif
+
+#endif // NETWORKHUBCONFIG_H
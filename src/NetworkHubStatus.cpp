@@ -0,0 +1,109 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+// Local includes
+#include "NetworkHubStatus.h"
+
+static const char* hardwareName(uint8_t hardwareType) {
+  switch (hardwareType) {
+    case NETWORK_HARDWARE_NONE:
+      return "No Hardware";
+    
+    case NETWORK_HARDWARE_W5100:
+      return "EthernetW5100";
+    
+    case NETWORK_HARDWARE_W5200:
+      return "EthernetW5200";
+    
+    case NETWORK_HARDWARE_W5500:
+      return "EthernetW5500";
+    
+    case NETWORK_HARDWARE_NATIVE:
+      return "Native Ethernet";
+    
+    case NETWORK_HARDWARE_WIFININA:
+      return "WiFiNINA";
+    
+    case NETWORK_HARDWARE_COMPOSITE:
+      return "Composite";
+    
+    default:
+      return "Unknown hardware";
+  }
+}
+
+const char* NetworkHubStatus::getHardwareName() const {
+  return hardwareName(hardwareType);
+}
+
+void NetworkHubStatus::print(Print* printer) const {
+  printer->print("Hardware Status: ");
+  printer->println(hardwareName(hardwareType));
+  
+  printer->print("Link Status: ");
+  switch (linkState) {
+    case NETWORK_LINK_UP:
+      printer->print("Connected, up ");
+      printer->print(linkUptimeMillis / 1000);
+      printer->println(" s");
+      break;
+    
+    case NETWORK_LINK_DOWN:
+      printer->println("Not Connected");
+      break;
+    
+    default:
+      printer->println("Unknown");
+      break;
+  }
+  
+  if (isLinkUp() && linkSpeed > 0) {
+    printer->print("Link Speed: ");
+    printer->println(linkSpeed);
+    
+    printer->print("Duplex mode: ");
+    printer->println(fullDuplex ? "Full" : "Half");
+    
+    printer->print("Crossover: ");
+    printer->println(crossover ? "TRUE" : "FALSE");
+  }
+  
+  if (ssid[0] != 0) {
+    printer->print("SSID: ");
+    printer->println(ssid);
+    
+    printer->print("Signal Strength (RSSI): ");
+    printer->print((long)rssi);
+    printer->println(" dBm");
+  }
+  
+  printer->print("MAC Address: ");
+  for (size_t x = 0; x < sizeof(macAddress); x++) {
+    printer->print(macAddress[x], HEX);
+    if (x < sizeof(macAddress) - 1) {
+      printer->print(":");
+    }
+  }
+  printer->println();
+  
+  printer->print("IP Address: ");
+  printer->println(localIP);
+  
+  printer->print("Subnet Mask: ");
+  printer->println(subnetMask);
+  
+  printer->print("Gateway IP: ");
+  printer->println(gatewayIP);
+  
+  if ((uint32_t)dhcpServerIP != 0) {
+    printer->print("DHCP Server IP: ");
+    printer->println(dhcpServerIP);
+  }
+  
+  if ((uint32_t)dnsServerIP != 0) {
+    printer->print("DNS Server IP: ");
+    printer->println(dnsServerIP);
+  }
+}
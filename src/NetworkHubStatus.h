@@ -0,0 +1,67 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef NETWORKHUBSTATUS_H
+#define NETWORKHUBSTATUS_H
+
+#include <Arduino.h>
+
+// Default time a status snapshot is reused for, in milliseconds.
+#ifndef NETWORKHUB_STATUS_REFRESH_INTERVAL
+#define NETWORKHUB_STATUS_REFRESH_INTERVAL 1000
+#endif
+
+enum NetworkLinkState {
+  NETWORK_LINK_UNKNOWN,
+  NETWORK_LINK_DOWN,
+  NETWORK_LINK_UP
+};
+
+enum NetworkHardwareType {
+  NETWORK_HARDWARE_UNKNOWN,
+  NETWORK_HARDWARE_NONE,
+  NETWORK_HARDWARE_W5100,
+  NETWORK_HARDWARE_W5200,
+  NETWORK_HARDWARE_W5500,
+  NETWORK_HARDWARE_NATIVE,    // ie the Teensy 4.1 ethernet
+  NETWORK_HARDWARE_WIFININA,
+  NETWORK_HARDWARE_COMPOSITE
+};
+
+// A snapshot of a hub's state, as returned by NetworkHub::getStatus().
+// Fields a hub doesn't know are left zero.
+//
+struct NetworkHubStatus {
+  uint8_t linkState = NETWORK_LINK_UNKNOWN;  // a NetworkLinkState
+  uint8_t hardwareType = NETWORK_HARDWARE_UNKNOWN;  // a NetworkHardwareType
+  uint16_t linkSpeed = 0;  // Mbps
+  bool fullDuplex = false;
+  bool crossover = false;
+  
+  // Wireless hubs only
+  int32_t rssi = 0;  // dBm
+  char ssid[33] = "";
+  
+  uint8_t macAddress[6] = { 0 };
+  IPAddress localIP;
+  IPAddress subnetMask;
+  IPAddress gatewayIP;
+  IPAddress dhcpServerIP;
+  IPAddress dnsServerIP;
+  
+  // How long the link has been up, as of the snapshot
+  uint32_t linkUptimeMillis = 0;
+  // millis() when the snapshot was taken
+  uint32_t refreshedMillis = 0;
+  
+  bool isLinkUp() const { return linkState == NETWORK_LINK_UP; };
+  // ie "EthernetW5500"
+  const char* getHardwareName() const;
+  
+  // Render the status as text, as printStatus() does.
+  void print(Print* printer) const;
+};
+
+#endif // NETWORKHUBSTATUS_H
@@ -0,0 +1,512 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+// Local includes
+#include "NetworkMQTTClient.h"
+
+// Packet types, in the high nibble of the fixed header
+#define MQTT_CONNECT     0x10
+#define MQTT_CONNACK     0x20
+#define MQTT_PUBLISH     0x30
+#define MQTT_PUBACK      0x40
+#define MQTT_SUBSCRIBE   0x82  // with the required flags
+#define MQTT_UNSUBSCRIBE 0xA2
+#define MQTT_PINGREQ     0xC0
+#define MQTT_PINGRESP    0xD0
+#define MQTT_DISCONNECT  0xE0
+
+#define MQTT_PUBLISH_DUP 0x08
+
+void NetworkMQTTClient::begin() {
+  _reconnect = true;
+  startConnect();
+}
+
+bool NetworkMQTTClient::connect(uint32_t timeoutMs) {
+  begin();
+  
+  uint32_t startMillis = millis();
+  while (_state != MQTT_CONNECTED && millis() - startMillis < timeoutMs) {
+    poll();
+    yield();
+  }
+  return connected();
+}
+
+void NetworkMQTTClient::disconnect() {
+  _reconnect = false;
+  
+  if (_state == MQTT_CONNECTED) {
+    beginPacket(MQTT_DISCONNECT, 0);
+    flush();
+  }
+  connectionLost();
+}
+
+void NetworkMQTTClient::poll() {
+  switch (_state) {
+    case MQTT_DISCONNECTED:
+      if (_reconnect && millis() - _lastAttemptMillis >= NETWORKHUB_MQTT_RECONNECT_INTERVAL) {
+        _reconnectCount++;
+        startConnect();
+      }
+      break;
+    
+    case MQTT_CONNECTING_TCP: {
+      int status = _client.connectStatus();
+      if (status == NETWORK_CONNECT_SUCCESS) {
+        sendConnect();
+      } else if (status != NETWORK_CONNECT_IN_PROGRESS) {
+        connectionLost();
+      }
+      break;
+    }
+    
+    default:
+      if (!_client.connected()) {
+        connectionLost();
+        break;
+      }
+      readPackets();
+      checkKeepAlive();
+      flush();
+      break;
+  }
+}
+
+bool NetworkMQTTClient::publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos, bool retain) {
+  if (_state != MQTT_CONNECTED) {
+    return false;
+  }
+  
+  // QoS 2 isn't supported, the broker is fine with less
+  qos = min(qos, (uint8_t)1);
+  size_t remainingLength = stringSize(topic) + (qos > 0 ? 2 : 0) + length;
+  
+  Inflight* inflight = NULL;
+  if (qos > 0) {
+    for (uint8_t x = 0; x < NETWORKHUB_MQTT_MAX_INFLIGHT && inflight == NULL; x++) {
+      if (!_inflight[x].inUse) {
+        inflight = &_inflight[x];
+      }
+    }
+    if (inflight == NULL || packetSize(remainingLength) > NETWORKHUB_MQTT_INFLIGHT_SIZE) {
+      _refusedCount++;
+      return false;
+    }
+  }
+  
+  uint8_t* p = beginPacket(MQTT_PUBLISH | (qos << 1) | (retain ? 1 : 0), remainingLength);
+  if (p == NULL) {
+    _refusedCount++;
+    return false;
+  }
+  
+  p = putString(p, topic);
+  uint16_t packetId = 0;
+  if (qos > 0) {
+    packetId = nextPacketId();
+    *p++ = packetId >> 8;
+    *p++ = packetId;
+  }
+  memcpy(p, payload, length);
+  
+  if (inflight != NULL) {
+    // Keep a copy to send again if the connection drops before the PUBACK
+    size_t size = packetSize(remainingLength);
+    memcpy(inflight->packet, _txBuffer + _txLength - size, size);
+    inflight->length = size;
+    inflight->packetId = packetId;
+    inflight->inUse = true;
+  }
+  
+  _publishedCount++;
+  return true;
+}
+
+bool NetworkMQTTClient::subscribe(const char* topic, uint8_t qos) {
+  qos = min(qos, (uint8_t)1);
+  
+  int8_t index = -1;
+  for (uint8_t x = 0; x < _subscriptionCount; x++) {
+    if (strcmp(_subscriptions[x].topic, topic) == 0) {
+      index = x;
+    }
+  }
+  if (index < 0) {
+    if (_subscriptionCount >= NETWORKHUB_MQTT_MAX_SUBSCRIPTIONS) {
+      return false;
+    }
+    index = _subscriptionCount++;
+  }
+  _subscriptions[index].topic = topic;
+  _subscriptions[index].qos = qos;
+  
+  if (_state == MQTT_CONNECTED) {
+    sendSubscribe(topic, qos);
+  }
+  return true;
+}
+
+bool NetworkMQTTClient::unsubscribe(const char* topic) {
+  for (uint8_t x = 0; x < _subscriptionCount; x++) {
+    if (strcmp(_subscriptions[x].topic, topic) == 0) {
+      _subscriptions[x] = _subscriptions[--_subscriptionCount];
+      
+      if (_state == MQTT_CONNECTED) {
+        uint8_t* p = beginPacket(MQTT_UNSUBSCRIBE, 2 + stringSize(topic));
+        if (p != NULL) {
+          uint16_t packetId = nextPacketId();
+          *p++ = packetId >> 8;
+          *p++ = packetId;
+          putString(p, topic);
+        }
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+void NetworkMQTTClient::flush() {
+  if (_txLength == 0 || (_state != MQTT_CONNECTING && _state != MQTT_CONNECTED)) {
+    return;
+  }
+  
+  size_t sent = _client.tryWrite(_txBuffer, _txLength);
+  if (sent > 0) {
+    memmove(_txBuffer, _txBuffer + sent, _txLength - sent);
+    _txLength -= sent;
+    _writeCount++;
+    _lastSendMillis = millis();
+  }
+}
+
+uint8_t NetworkMQTTClient::getInflightCount() {
+  uint8_t count = 0;
+  for (uint8_t x = 0; x < NETWORKHUB_MQTT_MAX_INFLIGHT; x++) {
+    if (_inflight[x].inUse) {
+      count++;
+    }
+  }
+  return count;
+}
+
+void NetworkMQTTClient::printStatus(Print* printer) {
+  static const char* STATES[] = { "disconnected", "connecting (tcp)", "connecting", "connected" };
+  
+  printer->print("MQTT ");
+  printer->print(STATES[_state]);
+  printer->print(", published ");
+  printer->print(_publishedCount);
+  printer->print(" in ");
+  printer->print(_writeCount);
+  printer->print(" writes, received ");
+  printer->println(_receivedCount);
+  printer->print("Inflight ");
+  printer->print(getInflightCount());
+  printer->print(", refused ");
+  printer->print(_refusedCount);
+  printer->print(", skipped ");
+  printer->print(_skippedCount);
+  printer->print(", reconnects ");
+  printer->println(_reconnectCount);
+}
+
+void NetworkMQTTClient::startConnect() {
+  _lastAttemptMillis = millis();
+  
+  // A new client each time, so a CompositeNetworkHub can pick the interface
+  _client = _networkHub->getClient();
+  int status = _host != NULL ? _client.connectStart(_host, _port) : _client.connectStart(_ip, _port);
+  
+  if (status == NETWORK_CONNECT_SUCCESS) {
+    sendConnect();
+  } else if (status == NETWORK_CONNECT_IN_PROGRESS) {
+    _state = MQTT_CONNECTING_TCP;
+  } else {
+    connectionLost();
+  }
+}
+
+void NetworkMQTTClient::sendConnect() {
+  // CONNECT must be the first packet on the connection
+  _txLength = 0;
+  _rxStage = 0;
+  _pingOutstanding = false;
+  _state = MQTT_CONNECTING;
+  
+  size_t remainingLength = 10 + stringSize(_clientId) + stringSize(_username) + stringSize(_password);
+  uint8_t* p = beginPacket(MQTT_CONNECT, remainingLength);
+  if (p == NULL) {
+    connectionLost();
+    return;
+  }
+  
+  p = putString(p, "MQTT");
+  *p++ = 4;  // protocol level 3.1.1
+  *p++ = 0x02 | (_username != NULL ? 0x80 : 0) | (_password != NULL ? 0x40 : 0);  // clean session
+  *p++ = _keepAliveSeconds >> 8;
+  *p++ = _keepAliveSeconds;
+  p = putString(p, _clientId);
+  if (_username != NULL) {
+    p = putString(p, _username);
+  }
+  if (_password != NULL) {
+    putString(p, _password);
+  }
+  
+  flush();
+}
+
+void NetworkMQTTClient::connectionLost() {
+  _client.stop();
+  _state = MQTT_DISCONNECTED;
+  _lastAttemptMillis = millis();
+  
+  // QoS 0 publishes still queued are lost, QoS 1 ones are sent
+  // again from their inflight copies after the reconnect
+  _txLength = 0;
+  _rxStage = 0;
+  _pingOutstanding = false;
+}
+
+void NetworkMQTTClient::readPackets() {
+  while (_state == MQTT_CONNECTING || _state == MQTT_CONNECTED) {
+    if (_rxStage < 2) {
+      int b = _client.read();
+      if (b < 0) {
+        return;
+      }
+      
+      if (_rxStage == 0) {
+        _rxHeader = b;
+        _rxLength = 0;
+        _rxMultiplier = 1;
+        _rxStage = 1;
+        continue;
+      }
+      
+      // Remaining length, seven bits at a time
+      _rxLength += (b & 0x7F) * _rxMultiplier;
+      _rxMultiplier *= 128;
+      if (b & 0x80) {
+        if (_rxMultiplier > 128UL * 128 * 128) {
+          connectionLost();
+          return;
+        }
+        continue;
+      }
+      _rxReceived = 0;
+      _rxStage = 2;
+    }
+    
+    if (_rxReceived < _rxLength) {
+      int available = _client.available();
+      if (available <= 0) {
+        return;
+      }
+      
+      size_t remaining = min((size_t)available, (size_t)(_rxLength - _rxReceived));
+      int count;
+      if (_rxLength > sizeof(_rxBuffer)) {
+        // Too big to keep, read it into the void
+        uint8_t discard[64];
+        count = _client.read(discard, min(remaining, sizeof(discard)));
+      } else {
+        count = _client.read(_rxBuffer + _rxReceived, remaining);
+      }
+      if (count <= 0) {
+        return;
+      }
+      _rxReceived += count;
+      if (_rxReceived < _rxLength) {
+        continue;
+      }
+    }
+    
+    _rxStage = 0;
+    if (_rxLength > sizeof(_rxBuffer)) {
+      _skippedCount++;
+    } else {
+      handlePacket();
+    }
+  }
+}
+
+void NetworkMQTTClient::handlePacket() {
+  switch (_rxHeader & 0xF0) {
+    case MQTT_CONNACK:
+      if (_state != MQTT_CONNECTING || _rxLength < 2) {
+        break;
+      }
+      _lastReturnCode = _rxBuffer[1];
+      if (_lastReturnCode != 0) {
+        connectionLost();
+        break;
+      }
+      _state = MQTT_CONNECTED;
+      
+      // The session is clean, so subscribe again and resend
+      // anything that wasn't acknowledged
+      for (uint8_t x = 0; x < _subscriptionCount; x++) {
+        sendSubscribe(_subscriptions[x].topic, _subscriptions[x].qos);
+      }
+      for (uint8_t x = 0; x < NETWORKHUB_MQTT_MAX_INFLIGHT; x++) {
+        Inflight& inflight = _inflight[x];
+        if (!inflight.inUse) {
+          continue;
+        }
+        if (_txLength + inflight.length > sizeof(_txBuffer)) {
+          flush();
+        }
+        if (_txLength + inflight.length <= sizeof(_txBuffer)) {
+          inflight.packet[0] |= MQTT_PUBLISH_DUP;
+          memcpy(_txBuffer + _txLength, inflight.packet, inflight.length);
+          _txLength += inflight.length;
+        }
+      }
+      break;
+    
+    case MQTT_PUBLISH: {
+      uint8_t qos = (_rxHeader >> 1) & 0x03;
+      if (_rxLength < 2) {
+        break;
+      }
+      size_t topicLength = ((size_t)_rxBuffer[0] << 8) | _rxBuffer[1];
+      size_t offset = 2 + topicLength + (qos > 0 ? 2 : 0);
+      if (offset > _rxLength) {
+        break;
+      }
+      
+      uint16_t packetId = 0;
+      if (qos > 0) {
+        packetId = ((uint16_t)_rxBuffer[2 + topicLength] << 8) | _rxBuffer[3 + topicLength];
+      }
+      
+      // Slide the topic over its length so it can be null terminated
+      memmove(_rxBuffer, _rxBuffer + 2, topicLength);
+      _rxBuffer[topicLength] = '\0';
+      
+      _receivedCount++;
+      if (_messageCallback != NULL) {
+        _messageCallback((const char*)_rxBuffer, _rxBuffer + offset, _rxLength - offset);
+      }
+      
+      if (qos == 1) {
+        uint8_t* p = beginPacket(MQTT_PUBACK, 2);
+        if (p != NULL) {
+          *p++ = packetId >> 8;
+          *p = packetId;
+        }
+      }
+      break;
+    }
+    
+    case MQTT_PUBACK:
+      if (_rxLength >= 2) {
+        uint16_t packetId = ((uint16_t)_rxBuffer[0] << 8) | _rxBuffer[1];
+        for (uint8_t x = 0; x < NETWORKHUB_MQTT_MAX_INFLIGHT; x++) {
+          if (_inflight[x].inUse && _inflight[x].packetId == packetId) {
+            _inflight[x].inUse = false;
+          }
+        }
+      }
+      break;
+    
+    case MQTT_PINGRESP:
+      _pingOutstanding = false;
+      break;
+    
+    default:
+      // SUBACK and UNSUBACK need nothing
+      break;
+  }
+}
+
+void NetworkMQTTClient::checkKeepAlive() {
+  if (_state == MQTT_CONNECTING) {
+    if (millis() - _lastAttemptMillis >= NETWORKHUB_DEFAULT_CONNECT_TIMEOUT) {
+      connectionLost();
+    }
+    return;
+  }
+  
+  uint32_t keepAliveMillis = _keepAliveSeconds * 1000UL;
+  if (_state != MQTT_CONNECTED || keepAliveMillis == 0) {
+    return;
+  }
+  
+  if (_pingOutstanding) {
+    if (millis() - _pingSentMillis >= keepAliveMillis) {
+      connectionLost();
+    }
+  } else if (millis() - _lastSendMillis >= keepAliveMillis) {
+    // The broker only needs to hear something within the keep alive,
+    // so a busy publisher never pings
+    if (beginPacket(MQTT_PINGREQ, 0) != NULL) {
+      _pingOutstanding = true;
+      _pingSentMillis = millis();
+    }
+  }
+}
+
+void NetworkMQTTClient::sendSubscribe(const char* topic, uint8_t qos) {
+  uint8_t* p = beginPacket(MQTT_SUBSCRIBE, 2 + stringSize(topic) + 1);
+  if (p == NULL) {
+    return;
+  }
+  
+  uint16_t packetId = nextPacketId();
+  *p++ = packetId >> 8;
+  *p++ = packetId;
+  p = putString(p, topic);
+  *p = qos;
+}
+
+uint8_t* NetworkMQTTClient::beginPacket(uint8_t header, size_t remainingLength) {
+  size_t size = packetSize(remainingLength);
+  if (_txLength + size > sizeof(_txBuffer)) {
+    flush();
+    if (_txLength + size > sizeof(_txBuffer)) {
+      return NULL;
+    }
+  }
+  
+  uint8_t* p = _txBuffer + _txLength;
+  *p++ = header;
+  do {
+    uint8_t b = remainingLength % 128;
+    remainingLength /= 128;
+    *p++ = remainingLength > 0 ? (b | 0x80) : b;
+  } while (remainingLength > 0);
+  
+  _txLength += size;
+  return p;
+}
+
+uint16_t NetworkMQTTClient::nextPacketId() {
+  uint16_t packetId = _nextPacketId++;
+  if (_nextPacketId == 0) {
+    _nextPacketId = 1;
+  }
+  return packetId;
+}
+
+size_t NetworkMQTTClient::packetSize(size_t remainingLength) {
+  size_t lengthBytes = 1;
+  for (size_t x = remainingLength; x >= 128; x /= 128) {
+    lengthBytes++;
+  }
+  return 1 + lengthBytes + remainingLength;
+}
+
+uint8_t* NetworkMQTTClient::putString(uint8_t* p, const char* s) {
+  size_t length = strlen(s);
+  *p++ = length >> 8;
+  *p++ = length;
+  memcpy(p, s, length);
+  return p + length;
+}
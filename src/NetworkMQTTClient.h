@@ -0,0 +1,213 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef NETWORKMQTTCLIENT_H
+#define NETWORKMQTTCLIENT_H
+
+#include <Arduino.h>
+
+#include "NetworkHub.h"
+#include "NetworkClient.h"
+
+// Size of the transmit buffer that packets are batched in.
+#ifndef NETWORKHUB_MQTT_BUFFER_SIZE
+#define NETWORKHUB_MQTT_BUFFER_SIZE 1024
+#endif
+
+// Largest packet that can be received. Bigger ones are skipped.
+#ifndef NETWORKHUB_MQTT_RECEIVE_SIZE
+#define NETWORKHUB_MQTT_RECEIVE_SIZE 512
+#endif
+
+// Number of QoS 1 publishes that can wait for their PUBACK, and the
+// largest of them. They are kept to be sent again after a reconnect.
+#ifndef NETWORKHUB_MQTT_MAX_INFLIGHT
+#define NETWORKHUB_MQTT_MAX_INFLIGHT 4
+#endif
+#ifndef NETWORKHUB_MQTT_INFLIGHT_SIZE
+#define NETWORKHUB_MQTT_INFLIGHT_SIZE 128
+#endif
+
+// Number of subscriptions that are restored after a reconnect.
+#ifndef NETWORKHUB_MQTT_MAX_SUBSCRIPTIONS
+#define NETWORKHUB_MQTT_MAX_SUBSCRIPTIONS 8
+#endif
+
+// Default keep alive, in seconds.
+#ifndef NETWORKHUB_MQTT_KEEPALIVE
+#define NETWORKHUB_MQTT_KEEPALIVE 15
+#endif
+
+// Time between reconnect attempts, in milliseconds.
+#ifndef NETWORKHUB_MQTT_RECONNECT_INTERVAL
+#define NETWORKHUB_MQTT_RECONNECT_INTERVAL 2000
+#endif
+
+enum NetworkMQTTState {
+  MQTT_DISCONNECTED,
+  MQTT_CONNECTING_TCP,
+  MQTT_CONNECTING,      // CONNECT sent, waiting for CONNACK
+  MQTT_CONNECTED
+};
+
+// Called with each message received on a subscribed topic.
+typedef void (*NetworkMQTTMessageCallback)(const char* topic, const uint8_t* payload, size_t length);
+
+// An MQTT 3.1.1 client on a NetworkClient from a NetworkHub, with
+// QoS 0 and 1 publishes and subscriptions. All buffers are fixed,
+// nothing is allocated per message.
+//
+// publish() and subscribe() only add packets to a transmit buffer,
+// which poll() (or flush()) sends with as few writes as possible, so
+// publishes made together go out in one TCP segment. poll() never
+// waits: it connects, sends the keep alive, and reconnects, restoring
+// the subscriptions and sending unacknowledged QoS 1 publishes
+// again, as it goes.
+//
+//   NetworkMQTTClient mqtt(&networkHub);
+//   mqtt.setServer(IPAddress(192, 168, 1, 10));
+//   mqtt.setClientId("robot");
+//   mqtt.begin();
+//   ...
+//   mqtt.publish("robot/battery", "12.6");  // in loop()
+//   mqtt.poll();
+//
+class NetworkMQTTClient {
+  public:
+    NetworkMQTTClient(NetworkHub* networkHub) { _networkHub = networkHub; };
+    
+    void setServer(IPAddress ip, uint16_t port = 1883) { _ip = ip; _host = NULL; _port = port; };
+    void setServer(const char* host, uint16_t port = 1883) { _host = host; _port = port; };
+    // The strings must stay valid while the client is used.
+    void setClientId(const char* clientId) { _clientId = clientId; };
+    void setCredentials(const char* username, const char* password) { _username = username; _password = password; };
+    void setKeepAlive(uint16_t seconds) { _keepAliveSeconds = seconds; };
+    void setMessageCallback(NetworkMQTTMessageCallback callback) { _messageCallback = callback; };
+    
+    // Start connecting, and reconnect from poll() whenever the
+    // connection is lost.
+    void begin();
+    // begin() and poll until connected, or the timeout passes.
+    bool connect(uint32_t timeoutMs = 10000);
+    // Send DISCONNECT and close, and stop reconnecting.
+    void disconnect();
+    
+    // Connect, read packets, send the keep alive and the transmit
+    // buffer. Call from loop().
+    void poll();
+    
+    // Add a PUBLISH to the transmit buffer. Returns false if not
+    // connected, or there is no room for it (or, for QoS 1, no free
+    // inflight slot).
+    bool publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos = 0, bool retain = false);
+    bool publish(const char* topic, const char* payload, uint8_t qos = 0, bool retain = false) {
+      return publish(topic, (const uint8_t*)payload, strlen(payload), qos, retain);
+    };
+    
+    // Subscribe now if connected, and again after every reconnect.
+    // The topic string must stay valid. Returns false if the table
+    // is full.
+    bool subscribe(const char* topic, uint8_t qos = 0);
+    bool unsubscribe(const char* topic);
+    
+    // Send what the client's send window takes of the transmit buffer.
+    void flush();
+    
+    NetworkMQTTState getState() { return _state; };
+    bool connected() { return _state == MQTT_CONNECTED; };
+    // The CONNACK return code of the last refused connect.
+    uint8_t getLastReturnCode() { return _lastReturnCode; };
+    
+    uint8_t getInflightCount();
+    size_t getQueuedCount() { return _txLength; };
+    uint32_t getPublishedCount() { return _publishedCount; };
+    uint32_t getReceivedCount() { return _receivedCount; };
+    // Number of TCP writes, compare with getPublishedCount() to see
+    // how well publishes are being batched.
+    uint32_t getWriteCount() { return _writeCount; };
+    uint32_t getReconnectCount() { return _reconnectCount; };
+    // Publishes refused because the buffer or inflight slots were full.
+    uint32_t getRefusedCount() { return _refusedCount; };
+    // Received packets skipped because they were too large.
+    uint32_t getSkippedCount() { return _skippedCount; };
+    
+    void printStatus(Print* printer);
+    
+  protected:
+    struct Inflight {
+      bool inUse = false;
+      uint16_t packetId;
+      uint16_t length;
+      uint8_t packet[NETWORKHUB_MQTT_INFLIGHT_SIZE];
+    };
+    
+    struct Subscription {
+      const char* topic;
+      uint8_t qos;
+    };
+    
+    NetworkHub* _networkHub;
+    NetworkClient _client;
+    NetworkMQTTState _state = MQTT_DISCONNECTED;
+    bool _reconnect = false;
+    
+    IPAddress _ip;
+    const char* _host = NULL;
+    uint16_t _port = 1883;
+    const char* _clientId = "";
+    const char* _username = NULL;
+    const char* _password = NULL;
+    uint16_t _keepAliveSeconds = NETWORKHUB_MQTT_KEEPALIVE;
+    NetworkMQTTMessageCallback _messageCallback = NULL;
+    
+    uint8_t _txBuffer[NETWORKHUB_MQTT_BUFFER_SIZE];
+    size_t _txLength = 0;
+    
+    // Packet being received
+    uint8_t _rxBuffer[NETWORKHUB_MQTT_RECEIVE_SIZE];
+    uint8_t _rxHeader;
+    uint8_t _rxStage = 0;       // 0 header, 1 length, 2 body
+    uint32_t _rxLength;
+    uint32_t _rxMultiplier;
+    uint32_t _rxReceived;
+    
+    Inflight _inflight[NETWORKHUB_MQTT_MAX_INFLIGHT];
+    Subscription _subscriptions[NETWORKHUB_MQTT_MAX_SUBSCRIPTIONS];
+    uint8_t _subscriptionCount = 0;
+    uint16_t _nextPacketId = 1;
+    
+    uint32_t _lastAttemptMillis = 0;
+    uint32_t _lastSendMillis = 0;
+    uint32_t _pingSentMillis = 0;
+    bool _pingOutstanding = false;
+    uint8_t _lastReturnCode = 0;
+    
+    uint32_t _publishedCount = 0;
+    uint32_t _receivedCount = 0;
+    uint32_t _writeCount = 0;
+    uint32_t _reconnectCount = 0;
+    uint32_t _refusedCount = 0;
+    uint32_t _skippedCount = 0;
+    
+    void startConnect();
+    void sendConnect();
+    void connectionLost();
+    void readPackets();
+    void handlePacket();
+    void checkKeepAlive();
+    void sendSubscribe(const char* topic, uint8_t qos);
+    
+    // Reserve a packet in the transmit buffer and write its fixed
+    // header. Returns where the rest of it goes, or NULL if there
+    // is no room even after a flush.
+    uint8_t* beginPacket(uint8_t header, size_t remainingLength);
+    uint16_t nextPacketId();
+    
+    static size_t packetSize(size_t remainingLength);
+    static uint8_t* putString(uint8_t* p, const char* s);
+    static size_t stringSize(const char* s) { return s != NULL ? strlen(s) + 2 : 0; };
+};
+
+#endif // NETWORKMQTTCLIENT_H
@@ -0,0 +1,304 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef NETWORKMESSAGECODEC_H
+#define NETWORKMESSAGECODEC_H
+
+// The codec needs C++17 (the default with current Teensyduino).
+// With older standards this header defines nothing.
+#if __cplusplus >= 201703L
+
+#include <Arduino.h>
+#include <string.h>
+#include <type_traits>
+#include <utility>
+
+#include "NetworkClient.h"
+#include "NetworkUDP.h"
+
+#define NETWORKHUB_MESSAGE_CODEC 1
+
+// The type a value is sent as when the field doesn't say: enums as
+// their underlying type, bools as a byte, everything else as itself.
+template <typename T, bool IS_ENUM = std::is_enum<T>::value>
+struct NetworkWireTypeOf {
+  using type = T;
+};
+
+template <typename T>
+struct NetworkWireTypeOf<T, true> {
+  using type = typename std::underlying_type<T>::type;
+};
+
+template <>
+struct NetworkWireTypeOf<bool, false> {
+  using type = uint8_t;
+};
+
+// Splits a pointer to member into its struct and member types.
+template <typename T>
+struct NetworkMemberTraits;
+
+template <typename S, typename M>
+struct NetworkMemberTraits<M S::*> {
+  using Struct = S;
+  using Member = M;
+};
+
+// Big-endian loads and stores. The bytes are spelled out one by one
+// rather than looped over, so the compiler merges them into a single
+// load or store and a byte swap (rev on the Teensy).
+//
+class NetworkWire {
+  public:
+    template <typename U>
+    static void store(uint8_t* buffer, U value) {
+      static_assert(std::is_unsigned<U>::value, "NetworkWire stores unsigned values");
+      storeBytes(buffer, value, std::make_index_sequence<sizeof(U)>());
+    };
+    
+    template <typename U>
+    static U load(const uint8_t* buffer) {
+      static_assert(std::is_unsigned<U>::value, "NetworkWire loads unsigned values");
+      return loadBytes<U>(buffer, std::make_index_sequence<sizeof(U)>());
+    };
+    
+  private:
+    template <typename U, size_t... BYTES>
+    static void storeBytes(uint8_t* buffer, U value, std::index_sequence<BYTES...>) {
+      ((buffer[BYTES] = (uint8_t)(value >> (8 * (sizeof(U) - 1 - BYTES)))), ...);
+    };
+    
+    template <typename U, size_t... BYTES>
+    static U loadBytes(const uint8_t* buffer, std::index_sequence<BYTES...>) {
+      return (U)((((U)buffer[BYTES]) << (8 * (sizeof(U) - 1 - BYTES))) | ...);
+    };
+    
+    NetworkWire() {};
+};
+
+// One field of a message: a member of the struct, and optionally the
+// type it is sent as, ie to send an int32_t member as an int16_t.
+// Arrays of numbers are sent element by element.
+//
+//   NetworkField<&Telemetry::speed>
+//   NetworkField<&Telemetry::heading, uint16_t>
+//
+template <auto MEMBER, typename WIRE = void>
+class NetworkField {
+  public:
+    using Struct = typename NetworkMemberTraits<decltype(MEMBER)>::Struct;
+    using Member = typename NetworkMemberTraits<decltype(MEMBER)>::Member;
+    using Element = typename std::remove_extent<Member>::type;
+    using Wire = typename std::conditional<std::is_void<WIRE>::value,
+      typename NetworkWireTypeOf<Element>::type, WIRE>::type;
+    
+    static_assert(std::rank<Member>::value <= 1, "NetworkField arrays must have one dimension");
+    static_assert(std::is_arithmetic<Wire>::value && !std::is_same<Wire, bool>::value
+      && !std::is_same<Wire, long double>::value, "NetworkField wire type must be an integer, float or double");
+    
+    static constexpr size_t COUNT = std::is_array<Member>::value ? std::extent<Member>::value : 1;
+    static constexpr size_t SIZE = sizeof(Wire) * COUNT;
+    // Describes the wire type in the schema hash
+    static constexpr uint32_t CODE = ((std::is_floating_point<Wire>::value ? 3 : std::is_signed<Wire>::value ? 2 : 1) << 24)
+      | (sizeof(Wire) << 16) | COUNT;
+    
+    static void encode(const Struct& message, uint8_t* buffer) {
+      const Element* elements = elementsOf(message.*MEMBER);
+      for (size_t x = 0; x < COUNT; x++) {
+        NetworkWire::store(buffer + x * sizeof(Wire), toBits(static_cast<Wire>(elements[x])));
+      }
+    };
+    
+    static void decode(const uint8_t* buffer, Struct& message) {
+      Element* elements = elementsOf(message.*MEMBER);
+      for (size_t x = 0; x < COUNT; x++) {
+        elements[x] = static_cast<Element>(fromBits(NetworkWire::load<Bits>(buffer + x * sizeof(Wire))));
+      }
+    };
+    
+  private:
+    // The unsigned integer holding the wire value's bits
+    using Bits = typename std::conditional<sizeof(Wire) == 1, uint8_t,
+      typename std::conditional<sizeof(Wire) == 2, uint16_t,
+      typename std::conditional<sizeof(Wire) == 4, uint32_t, uint64_t>::type>::type>::type;
+    
+    static Bits toBits(Wire value) {
+      Bits bits;
+      memcpy(&bits, &value, sizeof(bits));
+      return bits;
+    };
+    
+    static Wire fromBits(Bits bits) {
+      Wire value;
+      memcpy(&value, &bits, sizeof(value));
+      return value;
+    };
+    
+    static const Element* elementsOf(const Element& element) { return &element; };
+    static Element* elementsOf(Element& element) { return &element; };
+    static const Element* elementsOf(const Element (&elements)[COUNT]) { return elements; };
+    static Element* elementsOf(Element (&elements)[COUNT]) { return elements; };
+};
+
+// The schema hash: FNV-1a over the id, version and field codes.
+//
+class NetworkSchemaHash {
+  public:
+    template <typename... CODES>
+    static constexpr uint32_t of(uint16_t id, uint8_t version, CODES... codes) {
+      uint32_t hash = word(word(FNV_OFFSET, id), version);
+      ((hash = word(hash, codes)), ...);
+      return hash;
+    };
+    
+  private:
+    static constexpr uint32_t FNV_OFFSET = 2166136261u;
+    static constexpr uint32_t FNV_PRIME = 16777619u;
+    
+    static constexpr uint32_t word(uint32_t hash, uint32_t value) {
+      for (size_t x = 0; x < 4; x++) {
+        hash = (hash ^ ((value >> (8 * x)) & 0xFF)) * FNV_PRIME;
+      }
+      return hash;
+    };
+    
+    NetworkSchemaHash() {};
+};
+
+// The layout of a message, declared once, from which the encoder and
+// decoder are generated. Every field is at an offset known at compile
+// time, so encode() and decode() come down to a load, byte swap and
+// store per field, with no loops or tables left at run time.
+//
+// On the wire a message is a 32 bit hash of the schema followed by
+// its fields, big-endian, with no padding. The hash covers the id,
+// the version and the type of every field, so decode() refuses a
+// message from a sender built with a different layout instead of
+// misreading it.
+//
+//   struct Telemetry {
+//     uint32_t millis;
+//     int16_t speed;
+//     float heading;
+//     uint8_t flags[4];
+//   };
+//
+//   typedef NetworkSchema<Telemetry, 1, 2,  // id 1, version 2
+//     NetworkField<&Telemetry::millis>,
+//     NetworkField<&Telemetry::speed>,
+//     NetworkField<&Telemetry::heading>,
+//     NetworkField<&Telemetry::flags>> TelemetrySchema;
+//
+//   TelemetrySchema::send(udp, hostIP, 5000, telemetry);
+//
+template <typename STRUCT, uint16_t ID, uint8_t VERSION, typename... FIELDS>
+class NetworkSchema {
+  static_assert(sizeof...(FIELDS) > 0, "NetworkSchema needs at least one field");
+  static_assert((std::is_same<typename FIELDS::Struct, STRUCT>::value && ...),
+    "NetworkSchema fields must all be members of its struct");
+    
+  public:
+    static constexpr size_t HEADER_SIZE = 4;
+    static constexpr size_t PAYLOAD_SIZE = (FIELDS::SIZE + ...);
+    // Bytes of an encoded message
+    static constexpr size_t SIZE = HEADER_SIZE + PAYLOAD_SIZE;
+    static constexpr uint32_t HASH = NetworkSchemaHash::of(ID, VERSION, FIELDS::CODE...);
+    
+    // Encode into buffer, which must hold SIZE bytes. Returns SIZE.
+    static size_t encode(const STRUCT& message, uint8_t* buffer) {
+      NetworkWire::store(buffer, HASH);
+      encodeFields<HEADER_SIZE, FIELDS...>(message, buffer);
+      return SIZE;
+    };
+    
+    // Returns false, leaving message alone, if buffer is too short
+    // or holds a different schema.
+    static bool decode(const uint8_t* buffer, size_t length, STRUCT& message) {
+      if (!matches(buffer, length)) {
+        return false;
+      }
+      decodeFields<HEADER_SIZE, FIELDS...>(buffer, message);
+      return true;
+    };
+    
+    // Returns true if buffer holds a message of this schema, ie to
+    // pick which schema to decode a datagram with.
+    static bool matches(const uint8_t* buffer, size_t length) {
+      return length >= SIZE && NetworkWire::load<uint32_t>(buffer) == HASH;
+    };
+    
+    // Send a message as one datagram, encoding it straight into the
+    // packet where the backend allows (see NetworkUDP.reserve()).
+    static bool send(NetworkUDP* udp, IPAddress ip, uint16_t port, const STRUCT& message) {
+      if (udp->beginPacket(ip, port) != 1) {
+        return false;
+      }
+      uint8_t* out = udp->reserve(SIZE);
+      if (out != NULL) {
+        encode(message, out);
+        udp->commit(SIZE);
+      } else {
+        uint8_t buffer[SIZE];
+        encode(message, buffer);
+        udp->write(buffer, SIZE);
+      }
+      return udp->endPacket() == 1;
+    };
+    
+    // Decode the datagram found by udp->parsePacket().
+    static bool receive(NetworkUDP* udp, STRUCT& message) {
+      uint8_t buffer[SIZE];
+      if (udp->read(buffer, SIZE) != (int)SIZE) {
+        return false;
+      }
+      return decode(buffer, SIZE, message);
+    };
+    
+    // Write a message to a client. Returns false if it wasn't all
+    // written.
+    static bool write(NetworkClient& client, const STRUCT& message) {
+      uint8_t* out = client.reserve(SIZE);
+      if (out != NULL) {
+        encode(message, out);
+        return client.commit(SIZE) == SIZE;
+      }
+      uint8_t buffer[SIZE];
+      encode(message, buffer);
+      return client.write(buffer, SIZE) == SIZE;
+    };
+    
+    // Read a message from a client once all of it has arrived.
+    // Returns false, reading nothing, until then, and also after
+    // reading a message of another schema.
+    static bool read(NetworkClient& client, STRUCT& message) {
+      if (client.available() < (int)SIZE) {
+        return false;
+      }
+      uint8_t buffer[SIZE];
+      return client.read(buffer, SIZE) == (int)SIZE && decode(buffer, SIZE, message);
+    };
+    
+  private:
+    template <size_t OFFSET, typename FIELD, typename... REST>
+    static void encodeFields(const STRUCT& message, uint8_t* buffer) {
+      FIELD::encode(message, buffer + OFFSET);
+      if constexpr (sizeof...(REST) > 0) {
+        encodeFields<OFFSET + FIELD::SIZE, REST...>(message, buffer);
+      }
+    };
+    
+    template <size_t OFFSET, typename FIELD, typename... REST>
+    static void decodeFields(const uint8_t* buffer, STRUCT& message) {
+      FIELD::decode(buffer + OFFSET, message);
+      if constexpr (sizeof...(REST) > 0) {
+        decodeFields<OFFSET + FIELD::SIZE, REST...>(buffer, message);
+      }
+    };
+};
+
+#endif // __cplusplus >= 201703L
+
+#endif // NETWORKMESSAGECODEC_H
@@ -0,0 +1,538 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#include <stdio.h>
+
+// Local includes
+#include "NetworkMetrics.h"
+#include "NetworkAllocator.h"
+#include "NetworkSocketBudget.h"
+
+// A chunk's length is at most four hex digits
+static_assert(NETWORKHUB_METRICS_BUFFER_SIZE <= 0xffff, "NETWORKHUB_METRICS_BUFFER_SIZE is at most 65535");
+
+void NetworkMetricsWriter::metric(const char* name, const char* type, const char* help) {
+  endMetric();
+  if (_client != NULL) {
+    uint16_t index = _metricCount++;
+    _skipping = index < _firstMetric;
+    if (_length == 0 && !_stopped) {
+      _resumeMetric = index;
+      _frontWritten = false;
+    }
+    _metricStart = _length;
+  }
+  _name = name;
+  _hasSample = false;
+  
+  if (_format == NETWORK_METRICS_JSON) {
+    append(_started ? ",\"" : "{\"");
+    append(name);
+    append("\":");
+  } else {
+    append("# HELP ");
+    append(name);
+    append(' ');
+    append(help);
+    append("\n# TYPE ");
+    append(name);
+    append(' ');
+    append(type);
+    append('\n');
+  }
+  _started = true;
+}
+
+void NetworkMetricsWriter::sample(int64_t value, const char* labelName, const char* labelValue) {
+  if (!beginSample(labelName, labelValue)) {
+    return;
+  }
+  appendInteger(value);
+  if (_format != NETWORK_METRICS_JSON) {
+    append('\n');
+  }
+}
+
+void NetworkMetricsWriter::sampleFloat(float value, const char* labelName, const char* labelValue) {
+  if (!beginSample(labelName, labelValue)) {
+    return;
+  }
+  if (isnan(value) || isinf(value)) {
+    // Neither format has a way to say this that the other reads
+    append(_format == NETWORK_METRICS_JSON ? "null" : "NaN");
+  } else {
+    // Three decimals, rounded
+    int64_t thousandths = (int64_t)(value * 1000 + (value < 0 ? -0.5f : 0.5f));
+    if (thousandths < 0) {
+      append('-');
+      thousandths = -thousandths;
+    }
+    appendInteger(thousandths / 1000);
+    char fraction[5] = { '.', (char)('0' + thousandths / 100 % 10), (char)('0' + thousandths / 10 % 10),
+      (char)('0' + thousandths % 10), '\0' };
+    append(fraction);
+  }
+  if (_format != NETWORK_METRICS_JSON) {
+    append('\n');
+  }
+}
+
+bool NetworkMetricsWriter::finish() {
+  endMetric();
+  _skipping = false;
+  if (_client != NULL && _length == 0 && !_stopped) {
+    _resumeMetric = _metricCount;
+    _frontWritten = false;
+  }
+  if (_format == NETWORK_METRICS_JSON) {
+    append(_started ? "}\n" : "{}\n");
+  }
+  flush(true);
+  return !_failed;
+}
+
+bool NetworkMetricsWriter::beginSample(const char* labelName, const char* labelValue) {
+  if (_format == NETWORK_METRICS_JSON) {
+    // A metric is one value or an object of labelled values, decided
+    // by its first sample. Samples that don't fit are left out.
+    if (_hasSample && (labelName == NULL || !_inObject)) {
+      return false;
+    }
+    // Labelled samples are keyed by their label value
+    if (labelName != NULL) {
+      append(_inObject ? ',' : '{');
+      appendQuoted(labelValue);
+      append(':');
+      _inObject = true;
+    }
+  } else {
+    append(_name);
+    if (labelName != NULL) {
+      append('{');
+      append(labelName);
+      append('=');
+      appendQuoted(labelValue);
+      append('}');
+    }
+    append(' ');
+  }
+  _hasSample = true;
+  return true;
+}
+
+void NetworkMetricsWriter::endMetric() {
+  if (_format == NETWORK_METRICS_JSON && _name != NULL) {
+    if (_inObject) {
+      append('}');
+    } else if (!_hasSample) {
+      append("null");
+    }
+  }
+  _name = NULL;
+  _inObject = false;
+}
+
+void NetworkMetricsWriter::append(const char* text) {
+  while (*text != '\0') {
+    append(*text++);
+  }
+}
+
+void NetworkMetricsWriter::append(char c) {
+  if (_skipping || _stopped || _failed) {
+    return;
+  }
+  if (_length == NETWORKHUB_METRICS_BUFFER_SIZE) {
+    flush();
+    if (_stopped || _failed) {
+      return;
+    }
+  }
+  _buffer[CHUNK_HEADER_SIZE + _length++] = c;
+}
+
+void NetworkMetricsWriter::appendQuoted(const char* text) {
+  // Prometheus escapes just these three, JSON all control characters
+  append('"');
+  for (; *text != '\0'; text++) {
+    if (*text == '"' || *text == '\\') {
+      append('\\');
+      append(*text);
+    } else if (*text == '\n') {
+      append("\\n");
+    } else if (_format == NETWORK_METRICS_JSON && (uint8_t)*text < 0x20) {
+      char escape[7];
+      snprintf(escape, sizeof(escape), "\\u%04x", (uint8_t)*text);
+      append(escape);
+    } else {
+      append(*text);
+    }
+  }
+  append('"');
+}
+
+void NetworkMetricsWriter::appendInteger(int64_t value) {
+  char digits[21];
+  size_t count = 0;
+  uint64_t magnitude = value < 0 ? -(uint64_t)value : value;
+  do {
+    digits[count++] = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude > 0);
+  
+  if (value < 0) {
+    append('-');
+  }
+  while (count > 0) {
+    append(digits[--count]);
+  }
+}
+
+void NetworkMetricsWriter::flush(bool last) {
+  const uint8_t* data = (const uint8_t*)_buffer + CHUNK_HEADER_SIZE;
+  if (_client == NULL) {
+    size_t written = 0;
+    while (written < _length && !_failed) {
+      size_t count = _printer->write(data + written, _length - written);
+      if (count == 0) {
+        _failed = true;
+      }
+      written += count;
+    }
+    _bytesWritten += written;
+    _length = 0;
+    return;
+  }
+  if (_stopped || _failed) {
+    return;
+  }
+  
+  // Whole metrics, unless the one being rendered fills the buffer
+  size_t count = !last && _metricStart > 0 ? _metricStart : _length;
+  if (writeChunk(count, last)) {
+    memmove(_buffer + CHUNK_HEADER_SIZE, data + count, _length - count);
+    _length -= count;
+    if (_metricStart > 0) {
+      _resumeMetric = _metricCount - 1;
+      _frontWritten = false;
+    } else {
+      _frontWritten = true;
+    }
+    _metricStart = 0;
+  } else if (_frontWritten) {
+    // Half a metric can't be taken back
+    _failed = true;
+  } else {
+    // Carry on from the front of the buffer next time
+    _stopped = true;
+    _length = 0;
+  }
+}
+
+bool NetworkMetricsWriter::writeChunk(size_t count, bool last) {
+  static const char HEX_DIGITS[] = "0123456789abcdef";
+  if (count == 0 && !last) {
+    return true;
+  }
+  
+  // SIZE CRLF DATA CRLF, then 0 CRLF CRLF to end the body, in one write
+  char* data = _buffer + CHUNK_HEADER_SIZE;
+  char* start = data;
+  char trailer[CHUNK_TRAILER_SIZE + 1] = "";
+  if (count > 0) {
+    *--start = '\n';
+    *--start = '\r';
+    for (size_t value = count; value > 0; value >>= 4) {
+      *--start = HEX_DIGITS[value & 0xf];
+    }
+    strcat(trailer, "\r\n");
+  }
+  if (last) {
+    strcat(trailer, "0\r\n\r\n");
+  }
+  size_t trailerLength = strlen(trailer);
+  char saved[CHUNK_TRAILER_SIZE];
+  memcpy(saved, data + count, trailerLength);
+  memcpy(data + count, trailer, trailerLength);
+  
+  size_t size = data + count + trailerLength - start;
+  bool fits = _client->availableForWrite() >= (int)size;
+  if (fits) {
+    size_t written = _client->tryWrite((const uint8_t*)start, size);
+    _bytesWritten += written;
+    if (written < size) {
+      _failed = true;
+    }
+  }
+  memcpy(data + count, saved, trailerLength);
+  return fits;
+}
+
+void NetworkMetricsServer::begin(NetworkServer* server) {
+  _server = server;
+  _server->begin();
+}
+
+bool NetworkMetricsServer::addSource(NetworkMetricsCallback source) {
+  if (source == NULL || _sourceCount >= NETWORKHUB_METRICS_MAX_SOURCES) {
+    return false;
+  }
+  _sources[_sourceCount++] = source;
+  return true;
+}
+
+void NetworkMetricsServer::poll() {
+  if (_server == NULL) {
+    return;
+  }
+  
+  // One scrape at a time, others wait in the server's backlog
+  if (!_client) {
+    _client = _server->available();
+    if (!_client) {
+      return;
+    }
+    _requestLength = 0;
+    _matched = 0;
+    _answering = false;
+    _startMillis = millis();
+  }
+  
+  if (!_answering) {
+    if (readRequest()) {
+      _answering = answer();
+      if (!_answering) {
+        closeClient();
+      }
+    } else if (!_client.connected() || millis() - _startMillis >= NETWORKHUB_METRICS_TIMEOUT) {
+      closeClient();
+    }
+    return;
+  }
+  
+  if (sendBody()) {
+    closeClient();
+  } else if (!_client.connected() || millis() - _startMillis >= NETWORKHUB_METRICS_TIMEOUT) {
+    // The scraper stopped reading, or went away
+    _droppedCount++;
+    closeClient();
+  }
+}
+
+size_t NetworkMetricsServer::writeMetrics(Print* printer, uint8_t format) {
+  NetworkMetricsWriter writer(printer, format);
+  render(writer);
+  return writer.getBytesWritten();
+}
+
+bool NetworkMetricsServer::sendBody() {
+  uint32_t startMicros = micros();
+  NetworkMetricsWriter writer(&_client, _format, _nextMetric);
+  render(writer);
+  _renderMicros += micros() - startMicros;
+  
+  if (writer._failed) {
+    _droppedCount++;
+    return true;
+  }
+  if (writer.getBytesWritten() > 0) {
+    _startMillis = millis();
+  }
+  if (writer._stopped) {
+    _nextMetric = writer._resumeMetric;
+    return false;
+  }
+  
+  _scrapeCount++;
+  _lastRenderMicros = _renderMicros;
+  _maxRenderMicros = max(_maxRenderMicros, _lastRenderMicros);
+  return true;
+}
+
+void NetworkMetricsServer::render(NetworkMetricsWriter& writer) {
+  const NetworkHubStatus& status = _networkHub->getStatus();
+  writer.gauge("networkhub_link_up", "Whether the network link is up.", status.isLinkUp() ? 1 : 0);
+  writer.gauge("networkhub_link_uptime_seconds", "How long the link has been up.", status.linkUptimeMillis / 1000);
+  // Written whatever the link, so the metrics keep their order
+  writer.gauge("networkhub_link_speed_mbps", "Link speed in megabits per second, 0 if unknown.", status.linkSpeed);
+  writer.gauge("networkhub_link_full_duplex", "Whether the link is full duplex.", status.fullDuplex ? 1 : 0);
+  if (status.hardwareType == NETWORK_HARDWARE_WIFININA || status.ssid[0] != '\0') {
+    writer.gauge("networkhub_rssi_dbm", "Received signal strength.", status.rssi);
+  }
+  writer.metric("networkhub_hardware_info", "gauge", "The network hardware in use.");
+  writer.sample(1, "hardware", status.getHardwareName());
+  
+  NetworkTransmitScheduler* scheduler = _networkHub->getTransmitScheduler();
+  if (scheduler != NULL) {
+    static const char* PRIORITY_NAMES[NETWORK_PRIORITY_COUNT] = { "critical", "high", "normal", "bulk" };
+    writer.metric("networkhub_transmit_flows", "gauge", "Flows scheduled, by priority.");
+    for (uint8_t priority = 0; priority < NETWORK_PRIORITY_COUNT; priority++) {
+      writer.sample(scheduler->getFlowCount(priority), "priority", PRIORITY_NAMES[priority]);
+    }
+    writer.metric("networkhub_transmit_queued_bytes", "gauge", "Bytes waiting to be sent, by priority.");
+    for (uint8_t priority = 0; priority < NETWORK_PRIORITY_COUNT; priority++) {
+      writer.sample(scheduler->getQueuedCount(priority), "priority", PRIORITY_NAMES[priority]);
+    }
+    writer.counter("networkhub_transmit_budget_overruns_total", "Transmit services that ran out of time.",
+      scheduler->getBudgetOverrunCount());
+  }
+  
+  if (_budget != NULL) {
+    static const char* SOCKET_NAMES[NETWORK_SOCKET_TYPE_COUNT] = { "client", "server", "udp" };
+    writer.metric("networkhub_sockets_in_use", "gauge", "Sockets held, by type.");
+    for (uint8_t type = 0; type < NETWORK_SOCKET_TYPE_COUNT; type++) {
+      writer.sample(_budget->getInUseCount(type), "type", SOCKET_NAMES[type]);
+    }
+    writer.metric("networkhub_sockets_limit", "gauge", "Sockets that can be held, by type, 0 for no limit.");
+    for (uint8_t type = 0; type < NETWORK_SOCKET_TYPE_COUNT; type++) {
+      writer.sample(_budget->getLimit(type), "type", SOCKET_NAMES[type]);
+    }
+    writer.metric("networkhub_sockets_high_water", "gauge", "Most sockets ever held, by type.");
+    for (uint8_t type = 0; type < NETWORK_SOCKET_TYPE_COUNT; type++) {
+      writer.sample(_budget->getHighWaterCount(type), "type", SOCKET_NAMES[type]);
+    }
+    writer.metric("networkhub_sockets_refused_total", "counter", "Sockets refused, by type.");
+    for (uint8_t type = 0; type < NETWORK_SOCKET_TYPE_COUNT; type++) {
+      writer.sample(_budget->getRefusedCount(type), "type", SOCKET_NAMES[type]);
+    }
+    writer.gauge("networkhub_sockets_total_in_use", "Sockets held in all.", _budget->getTotalInUseCount());
+    writer.gauge("networkhub_sockets_total_limit", "Sockets that can be held in all, 0 for no limit.",
+      _budget->getTotalLimit());
+    writer.gauge("networkhub_sockets_queued_connects", "Connects waiting for a socket.", _budget->getQueuedCount());
+  }
+
+#if defined(NETWORKHUB_STATIC_ALLOC)
+  struct PoolMetrics {
+    const char* name;
+    size_t capacity;
+    size_t inUse;
+    size_t highWater;
+    uint32_t failed;
+  };
+  PoolMetrics pools[] = {
+    { "client_wrappers", NetworkAllocator::clientWrappers.getCapacity(), NetworkAllocator::clientWrappers.getInUseCount(),
+      NetworkAllocator::clientWrappers.getHighWaterCount(), NetworkAllocator::clientWrappers.getFailedCount() },
+    { "server_wrappers", NetworkAllocator::serverWrappers.getCapacity(), NetworkAllocator::serverWrappers.getInUseCount(),
+      NetworkAllocator::serverWrappers.getHighWaterCount(), NetworkAllocator::serverWrappers.getFailedCount() },
+    { "udp_wrappers", NetworkAllocator::udpWrappers.getCapacity(), NetworkAllocator::udpWrappers.getInUseCount(),
+      NetworkAllocator::udpWrappers.getHighWaterCount(), NetworkAllocator::udpWrappers.getFailedCount() },
+    { "servers", NetworkAllocator::servers.getCapacity(), NetworkAllocator::servers.getInUseCount(),
+      NetworkAllocator::servers.getHighWaterCount(), NetworkAllocator::servers.getFailedCount() },
+    { "udps", NetworkAllocator::udps.getCapacity(), NetworkAllocator::udps.getInUseCount(),
+      NetworkAllocator::udps.getHighWaterCount(), NetworkAllocator::udps.getFailedCount() },
+  };
+  const size_t poolCount = sizeof(pools) / sizeof(pools[0]);
+  writer.metric("networkhub_pool_capacity", "gauge", "Slots in each static pool.");
+  for (size_t x = 0; x < poolCount; x++) {
+    writer.sample(pools[x].capacity, "pool", pools[x].name);
+  }
+  writer.metric("networkhub_pool_in_use", "gauge", "Slots in use in each static pool.");
+  for (size_t x = 0; x < poolCount; x++) {
+    writer.sample(pools[x].inUse, "pool", pools[x].name);
+  }
+  writer.metric("networkhub_pool_high_water", "gauge", "Most slots ever in use in each static pool.");
+  for (size_t x = 0; x < poolCount; x++) {
+    writer.sample(pools[x].highWater, "pool", pools[x].name);
+  }
+  writer.metric("networkhub_pool_failures_total", "counter", "Allocations refused by each static pool.");
+  for (size_t x = 0; x < poolCount; x++) {
+    writer.sample(pools[x].failed, "pool", pools[x].name);
+  }
+#endif
+  
+  for (uint8_t x = 0; x < _sourceCount; x++) {
+    _sources[x](writer);
+  }
+  
+  // Up to the previous scrape, this one isn't finished yet
+  writer.counter("networkhub_metrics_scrapes_total", "Scrapes answered.", _scrapeCount);
+  writer.counter("networkhub_metrics_dropped_total", "Scrapes dropped because the client stopped reading.", _droppedCount);
+  writer.gauge("networkhub_metrics_render_microseconds", "Time taken to render the previous scrape.", _lastRenderMicros);
+  writer.gauge("networkhub_metrics_render_max_microseconds", "Longest time taken to render a scrape.", _maxRenderMicros);
+  writer.finish();
+}
+
+bool NetworkMetricsServer::readRequest() {
+  static const char END[] = "\r\n\r\n";
+  
+  int available = _client.available();
+  while (available > 0) {
+    uint8_t chunk[64];
+    int count = _client.read(chunk, min((size_t)available, sizeof(chunk)));
+    if (count <= 0) {
+      break;
+    }
+    available -= count;
+    
+    for (int x = 0; x < count; x++) {
+      char c = chunk[x];
+      // Only the request line is needed
+      if (_requestLength < sizeof(_request) - 1 && c != '\r' && c != '\n' && _matched == 0) {
+        _request[_requestLength++] = c;
+      } else if (_requestLength < sizeof(_request)) {
+        _request[_requestLength] = '\0';
+        _requestLength = sizeof(_request);
+      }
+      
+      if (c == END[_matched]) {
+        if (++_matched == 4) {
+          _request[min(_requestLength, sizeof(_request) - 1)] = '\0';
+          return true;
+        }
+      } else {
+        _matched = c == END[0] ? 1 : 0;
+      }
+    }
+  }
+  return false;
+}
+
+bool NetworkMetricsServer::answer() {
+  // Request line: METHOD SP PATH SP VERSION
+  char* path = strchr(_request, ' ');
+  char* version = path != NULL ? strchr(path + 1, ' ') : NULL;
+  if (version == NULL) {
+    _client.print("HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    return false;
+  }
+  *path++ = '\0';
+  *version = '\0';
+  char* query = strchr(path, '?');
+  if (query != NULL) {
+    *query = '\0';
+  }
+  
+  if (strcmp(_request, "GET") != 0) {
+    _client.print("HTTP/1.1 405 Method Not Allowed\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    return false;
+  }
+  
+  const char* contentType;
+  if (strcmp(path, "/metrics") == 0) {
+    _format = NETWORK_METRICS_PROMETHEUS;
+    contentType = "text/plain; version=0.0.4";
+  } else if (strcmp(path, "/metrics.json") == 0) {
+    _format = NETWORK_METRICS_JSON;
+    contentType = "application/json";
+  } else {
+    _client.print("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    return false;
+  }
+  
+  // Chunked, so a scraper can tell a body cut short from a whole one
+  _client.print("HTTP/1.1 200 OK\r\nContent-Type: ");
+  _client.print(contentType);
+  _client.print("\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n");
+  _nextMetric = 0;
+  _renderMicros = 0;
+  _startMillis = millis();
+  return true;
+}
+
+void NetworkMetricsServer::closeClient() {
+  _client.flush();
+  _client.stop();
+  _client = NetworkClient();
+}
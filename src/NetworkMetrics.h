@@ -0,0 +1,239 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef NETWORKMETRICS_H
+#define NETWORKMETRICS_H
+
+#include <Arduino.h>
+
+#include "NetworkClient.h"
+#include "NetworkHub.h"
+
+// Size of the buffer metrics are rendered through. Each full buffer
+// is one write to the client, made once the client's send window has
+// room for all of it, so keep it smaller than that window. A scrape
+// only stops to wait between metrics, so each metric should fit.
+#ifndef NETWORKHUB_METRICS_BUFFER_SIZE
+#define NETWORKHUB_METRICS_BUFFER_SIZE 512
+#endif
+
+// Largest request line kept. The rest of the request is read and
+// ignored.
+#ifndef NETWORKHUB_METRICS_REQUEST_SIZE
+#define NETWORKHUB_METRICS_REQUEST_SIZE 128
+#endif
+
+// How long a scrape may take to send its request, or go without the
+// client taking any of the response, in milliseconds.
+#ifndef NETWORKHUB_METRICS_TIMEOUT
+#define NETWORKHUB_METRICS_TIMEOUT 1000
+#endif
+
+// Number of extra sources a NetworkMetricsServer can hold.
+#ifndef NETWORKHUB_METRICS_MAX_SOURCES
+#define NETWORKHUB_METRICS_MAX_SOURCES 4
+#endif
+
+class NetworkSocketBudget;
+
+enum NetworkMetricsFormat {
+  NETWORK_METRICS_PROMETHEUS,  // the Prometheus text format, version 0.0.4
+  NETWORK_METRICS_JSON
+};
+
+// Renders metrics straight to a Print (a NetworkClient, Serial...)
+// through a small buffer, in either format. Start each metric with
+// metric(), then give it one or more samples; a metric with labelled
+// samples becomes an object in JSON. Label values are escaped.
+//
+//   writer.metric("robot_battery_volts", "gauge", "Battery voltage.");
+//   writer.sample(batteryVolts);
+//   writer.counter("robot_estops_total", "Emergency stops.", estopCount);
+//
+// A NetworkMetricsServer renders a scrape a few metrics at a time,
+// across calls to poll(), so a source must write the same metrics in
+// the same order each time it is called.
+//
+class NetworkMetricsWriter {
+  public:
+    NetworkMetricsWriter(Print* printer, uint8_t format) {
+      _printer = printer;
+      _format = format;
+    };
+    
+    // Start a metric of the given Prometheus type ("gauge", "counter").
+    void metric(const char* name, const char* type, const char* help);
+    // Add a sample to the metric, with an optional label. In JSON a
+    // metric holds either one unlabelled sample or labelled ones.
+    void sample(int64_t value, const char* labelName = NULL, const char* labelValue = NULL);
+    void sampleFloat(float value, const char* labelName = NULL, const char* labelValue = NULL);
+    
+    // A metric with a single sample.
+    void gauge(const char* name, const char* help, int64_t value) {
+      metric(name, "gauge", help);
+      sample(value);
+    };
+    void counter(const char* name, const char* help, int64_t value) {
+      metric(name, "counter", help);
+      sample(value);
+    };
+    
+    // Write out what is buffered, ending the JSON object. Returns
+    // false if the printer stopped taking bytes.
+    bool finish();
+    
+    size_t getBytesWritten() { return _bytesWritten; };
+    
+  private:
+    friend class NetworkMetricsServer;
+    
+    // Room for a chunk's length ahead of the buffer, and its end and
+    // the end of the body after it
+    static const size_t CHUNK_HEADER_SIZE = 6;
+    static const size_t CHUNK_TRAILER_SIZE = 7;
+    
+    Print* _printer;
+    uint8_t _format;
+    char _buffer[CHUNK_HEADER_SIZE + NETWORKHUB_METRICS_BUFFER_SIZE + CHUNK_TRAILER_SIZE];
+    size_t _length = 0;
+    size_t _bytesWritten = 0;
+    bool _failed = false;
+    
+    // JSON punctuation still owed
+    bool _started = false;
+    bool _hasSample = false;
+    bool _inObject = false;
+    const char* _name = NULL;
+    
+    // Writing a scrape to a client: the body is chunked, and metrics
+    // are written whole, only once the send window has room for them.
+    // When it hasn't the rest are left for the next render, which
+    // skips the ones already sent.
+    NetworkClient* _client = NULL;
+    uint16_t _metricCount = 0;
+    uint16_t _firstMetric = 0;
+    // The metric at the front of the buffer, where the next render
+    // starts if this one stops, and whether part of it has been
+    // written already, so it can't
+    uint16_t _resumeMetric = 0;
+    bool _frontWritten = false;
+    // Where the metric being rendered starts in the buffer
+    size_t _metricStart = 0;
+    bool _skipping = false;
+    bool _stopped = false;
+    
+    NetworkMetricsWriter(NetworkClient* client, uint8_t format, uint16_t firstMetric) {
+      _printer = client;
+      _client = client;
+      _format = format;
+      _firstMetric = firstMetric;
+      _resumeMetric = firstMetric;
+      _started = firstMetric > 0;
+    };
+    
+    // Returns false if the sample is to be left out.
+    bool beginSample(const char* labelName, const char* labelValue);
+    void endMetric();
+    void append(const char* text);
+    void append(char c);
+    // Append a label value as a quoted string
+    void appendQuoted(const char* text);
+    void appendInteger(int64_t value);
+    void flush(bool last = false);
+    // Write the start of the buffer to the client as a chunk, if the
+    // send window has room for all of it. Returns false if it hasn't.
+    bool writeChunk(size_t count, bool last);
+};
+
+// Adds metrics to a scrape, for instance the counters of a
+// NetworkMQTTClient or NetworkShaper.
+typedef void (*NetworkMetricsCallback)(NetworkMetricsWriter& writer);
+
+// Serves the status of a hub as metrics over HTTP, for Prometheus
+// or anything that reads JSON: GET /metrics returns the Prometheus
+// text format and GET /metrics.json returns JSON. The response is
+// rendered straight into the client, and nothing waits for a slow
+// scraper: each poll() sends the metrics the client's send window
+// has room for, and the next one carries on from there. The body is
+// chunked, so a scrape cut short by NETWORKHUB_METRICS_TIMEOUT can
+// be told from a complete one. The time spent rendering each scrape,
+// and the scrapes dropped, are themselves metrics.
+//
+//   NetworkMetricsServer metrics(&networkHub);
+//   metrics.addSource(writeRobotMetrics);
+//   metrics.setSocketBudget(&budget);  // optional
+//   metrics.begin(networkHub.getServer(9100));
+//   ...
+//   metrics.poll();  // in loop()
+//
+// Metrics included: link state, speed, uptime and RSSI, hardware,
+// the transmit scheduler's flows and queues, the sockets counted by
+// a NetworkSocketBudget, the NETWORKHUB_STATIC_ALLOC pools, and the
+// scrape count and render time.
+//
+class NetworkMetricsServer {
+  public:
+    NetworkMetricsServer(NetworkHub* networkHub) { _networkHub = networkHub; };
+    
+    // Start serving on the given server.
+    void begin(NetworkServer* server);
+    
+    // Accept a scrape, read its request, and send what the client
+    // will take of the answer. Call from loop().
+    void poll();
+    
+    // Returns false if there is no room for it.
+    bool addSource(NetworkMetricsCallback source);
+    
+    // Include the socket counts of a budget.
+    void setSocketBudget(NetworkSocketBudget* budget) { _budget = budget; };
+    
+    // Render the metrics to any Print, ie for a benchmark, or from
+    // a NetworkAssetFallback. Returns the bytes written. This isn't
+    // counted as a scrape.
+    size_t writeMetrics(Print* printer, uint8_t format);
+    
+    uint32_t getScrapeCount() { return _scrapeCount; };
+    // Scrapes given up because the client stopped taking them.
+    uint32_t getDroppedCount() { return _droppedCount; };
+    // Time spent rendering a scrape, over all the polls it took.
+    uint32_t getLastRenderMicros() { return _lastRenderMicros; };
+    uint32_t getMaxRenderMicros() { return _maxRenderMicros; };
+    
+  protected:
+    NetworkHub* _networkHub;
+    NetworkServer* _server = NULL;
+    NetworkSocketBudget* _budget = NULL;
+    NetworkMetricsCallback _sources[NETWORKHUB_METRICS_MAX_SOURCES];
+    uint8_t _sourceCount = 0;
+    
+    // The scrape being read, then answered
+    NetworkClient _client;
+    char _request[NETWORKHUB_METRICS_REQUEST_SIZE];
+    size_t _requestLength = 0;
+    uint8_t _matched = 0;
+    uint32_t _startMillis = 0;
+    bool _answering = false;
+    uint8_t _format = NETWORK_METRICS_PROMETHEUS;
+    uint16_t _nextMetric = 0;
+    uint32_t _renderMicros = 0;
+    
+    uint32_t _scrapeCount = 0;
+    uint32_t _droppedCount = 0;
+    uint32_t _lastRenderMicros = 0;
+    uint32_t _maxRenderMicros = 0;
+    
+    // Read what has arrived of the request. Returns true once it
+    // is all there.
+    bool readRequest();
+    // Answer the request. Returns true if there is a body to send.
+    bool answer();
+    // Send what the client will take. Returns true once it is done.
+    bool sendBody();
+    void render(NetworkMetricsWriter& writer);
+    void closeClient();
+};
+
+#endif // NETWORKMETRICS_H
@@ -0,0 +1,212 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef NETWORKRECORDQUEUE_H
+#define NETWORKRECORDQUEUE_H
+
+#include <Arduino.h>
+#include <atomic>
+
+#include "NetworkClient.h"
+#include "NetworkUDP.h"
+
+// Size of the buffer used to batch records into a single
+// NetworkClient write when draining.
+#ifndef NETWORKHUB_RECORD_QUEUE_BATCH_SIZE
+#define NETWORKHUB_RECORD_QUEUE_BATCH_SIZE 1024
+#endif
+
+// A lock-free single-producer/single-consumer queue of fixed size
+// records. The producer (usually an IntervalTimer or other ISR)
+// calls push(), and loop() drains the queue into a NetworkUDP or
+// NetworkClient, batching as many records as fit into each send.
+// No interrupts are disabled and nothing is allocated.
+//
+// There must be only one producer: if several ISRs push into the
+// same queue they must not be able to preempt each other.
+//
+template <size_t RECORD_SIZE, size_t CAPACITY>
+class NetworkRecordQueue {
+  static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0,
+    "NetworkRecordQueue capacity must be a power of two");
+  static_assert(RECORD_SIZE > 0, "NetworkRecordQueue record size must not be zero");
+  
+  public:
+    // When dropOldest is true a full queue discards its oldest
+    // record to make room, otherwise the new record is rejected.
+    NetworkRecordQueue(bool dropOldest = false) {
+      _dropOldest = dropOldest;
+    };
+    
+    // Producer side, safe to call from an ISR.
+    // Returns true if the record was queued.
+    bool push(const void* record) {
+      uint32_t head = _head.load(std::memory_order_relaxed);
+      uint32_t tail = _tail.load(std::memory_order_acquire);
+      
+      if (head - tail >= CAPACITY) {
+        if (!_dropOldest) {
+          _overflowCount++;
+          return false;
+        }
+        // The consumer may be taking the same record, whoever
+        // moves the tail first wins.
+        if (_tail.compare_exchange_strong(tail, tail + 1, std::memory_order_acq_rel)) {
+          _droppedOldestCount++;
+        }
+      }
+      
+      memcpy(_records[head & MASK], record, RECORD_SIZE);
+      _head.store(head + 1, std::memory_order_release);
+      _enqueuedCount++;
+      return true;
+    };
+    
+    // Consumer side. Copies the oldest record into the given
+    // buffer. Returns false if the queue is empty.
+    bool pop(void* record) {
+      while (true) {
+        uint32_t tail = _tail.load(std::memory_order_acquire);
+        if (tail == _head.load(std::memory_order_acquire)) {
+          return false;
+        }
+        
+        memcpy(record, _records[tail & MASK], RECORD_SIZE);
+        
+        // If the producer dropped this record while it was being
+        // copied the copy may be torn, so try the next one.
+        if (_tail.compare_exchange_strong(tail, tail + 1, std::memory_order_acq_rel)) {
+          return true;
+        }
+      }
+    };
+    
+    // Number of records waiting to be sent.
+    size_t size() {
+      return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    };
+    
+    bool isEmpty() { return size() == 0; };
+    
+    // Send all queued records to the given address, packing as
+    // many records as fit in maxDatagramSize into each datagram.
+    // Returns the number of records sent.
+    size_t drain(NetworkUDP* udp, IPAddress ip, uint16_t port, size_t maxDatagramSize = 1472) {
+      size_t perDatagram = max(maxDatagramSize / RECORD_SIZE, (size_t)1);
+      size_t sent = 0;
+      uint8_t record[RECORD_SIZE];
+      
+      while (!isEmpty()) {
+        if (udp->beginPacket(ip, port) != 1) {
+          _sendFailedCount++;
+          break;
+        }
+        
+        size_t count = 0;
+        while (count < perDatagram && pop(record)) {
+          udp->write(record, RECORD_SIZE);
+          count++;
+        }
+        
+        if (udp->endPacket() == 1) {
+          sent += count;
+          _sentRecordCount += count;
+          _sendCount++;
+        } else {
+          _sendFailedCount++;
+          _lostRecordCount += count;
+        }
+      }
+      
+      return sent;
+    };
+    
+    // Send all queued records over the given client, packing as
+    // many records as fit in the batch buffer into each write. When
+    // the client takes only part of a batch the rest is kept and
+    // sent first by the next drain, so a record is never cut short
+    // on the stream; if the client has disconnected it is dropped.
+    // Returns the number of records sent.
+    size_t drain(NetworkClient& client) {
+      static_assert(RECORD_SIZE <= NETWORKHUB_RECORD_QUEUE_BATCH_SIZE,
+        "NetworkRecordQueue record size is larger than NETWORKHUB_RECORD_QUEUE_BATCH_SIZE");
+      
+      size_t sent = 0;
+      if (_batchLength > 0 && !writeBatch(client, sent)) {
+        return sent;
+      }
+      
+      while (!isEmpty()) {
+        size_t count = 0;
+        while (count < PER_WRITE && pop(&_batch[count * RECORD_SIZE])) {
+          count++;
+        }
+        
+        _batchLength = count * RECORD_SIZE;
+        _batchOffset = 0;
+        if (!writeBatch(client, sent)) {
+          break;
+        }
+      }
+      
+      return sent;
+    };
+    
+    // Counters. The producer side ones are only written by push().
+    uint32_t getEnqueuedCount() { return _enqueuedCount; };
+    uint32_t getOverflowCount() { return _overflowCount; };
+    uint32_t getDroppedOldestCount() { return _droppedOldestCount; };
+    uint32_t getSentRecordCount() { return _sentRecordCount; };
+    uint32_t getSendCount() { return _sendCount; };
+    uint32_t getSendFailedCount() { return _sendFailedCount; };
+    uint32_t getLostRecordCount() { return _lostRecordCount; };
+    
+  private:
+    static const uint32_t MASK = CAPACITY - 1;
+    static const size_t PER_WRITE = RECORD_SIZE <= NETWORKHUB_RECORD_QUEUE_BATCH_SIZE
+      ? NETWORKHUB_RECORD_QUEUE_BATCH_SIZE / RECORD_SIZE : 1;
+    
+    uint8_t _records[CAPACITY][RECORD_SIZE];
+    std::atomic<uint32_t> _head { 0 };
+    std::atomic<uint32_t> _tail { 0 };
+    bool _dropOldest;
+    
+    volatile uint32_t _enqueuedCount = 0;
+    volatile uint32_t _overflowCount = 0;
+    volatile uint32_t _droppedOldestCount = 0;
+    uint32_t _sentRecordCount = 0;
+    uint32_t _sendCount = 0;
+    uint32_t _sendFailedCount = 0;
+    uint32_t _lostRecordCount = 0;
+    
+    // The batch being written to a client, and how much of it went
+    uint8_t _batch[PER_WRITE * RECORD_SIZE];
+    size_t _batchLength = 0;
+    size_t _batchOffset = 0;
+    
+    // Returns true once the whole batch is written.
+    bool writeBatch(NetworkClient& client, size_t& sent) {
+      size_t written = client.write(&_batch[_batchOffset], _batchLength - _batchOffset);
+      size_t records = (_batchOffset + written) / RECORD_SIZE - _batchOffset / RECORD_SIZE;
+      _batchOffset += written;
+      sent += records;
+      _sentRecordCount += records;
+      
+      if (_batchOffset < _batchLength) {
+        _sendFailedCount++;
+        if (!client.connected()) {
+          _lostRecordCount += _batchLength / RECORD_SIZE - _batchOffset / RECORD_SIZE;
+          _batchLength = 0;
+        }
+        return false;
+      }
+      
+      _sendCount++;
+      _batchLength = 0;
+      return true;
+    };
+};
+
+#endif // NETWORKRECORDQUEUE_H
@@ -0,0 +1,398 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+// Local includes
+#include "NetworkReliableChannel.h"
+
+static void writeUInt16(uint8_t* buffer, uint16_t value) {
+  buffer[0] = value >> 8;
+  buffer[1] = value;
+}
+
+static void writeUInt32(uint8_t* buffer, uint32_t value) {
+  writeUInt16(buffer, value >> 16);
+  writeUInt16(buffer + 2, value);
+}
+
+static uint16_t readUInt16(const uint8_t* buffer) {
+  return ((uint16_t)buffer[0] << 8) | buffer[1];
+}
+
+static uint32_t readUInt32(const uint8_t* buffer) {
+  return ((uint32_t)readUInt16(buffer) << 16) | readUInt16(buffer + 2);
+}
+
+// How far sequence number a is after b, negative if before
+static int16_t seqDiff(uint16_t a, uint16_t b) {
+  return (int16_t)(a - b);
+}
+
+bool NetworkReliableChannel::begin(uint16_t localPort, IPAddress peerIP, uint16_t peerPort) {
+  _peerIP = peerIP;
+  _peerPort = peerPort;
+  
+  // A new session tells the peer to forget what it had from before
+  _session = (uint16_t)(micros() ^ (micros() >> 16) ^ _session);
+  if (_session == 0) {
+    _session = 1;
+  }
+  _sendBase = 0;
+  _sendNext = 0;
+  _noticePending = false;
+  
+  _peerSession = 0;
+  _receiveNext = 0;
+  _deliverNext = 0;
+  for (uint8_t x = 0; x < NETWORKHUB_RELIABLE_WINDOW; x++) {
+    _receiveSlots[x].state = RECEIVE_EMPTY;
+  }
+  
+  _smoothedRTT = 0;
+  _rttVariance = 0;
+  _rto = NETWORKHUB_RELIABLE_INITIAL_RTO * 1000;
+  
+  return _udp->begin(localPort) == 1;
+}
+
+bool NetworkReliableChannel::send(const uint8_t* buffer, size_t length) {
+  if (length == 0 || length > NETWORKHUB_RELIABLE_MESSAGE_SIZE || _peerPort == 0 || !canSend()) {
+    return false;
+  }
+  
+  SendSlot& slot = _sendSlots[_sendNext & WINDOW_MASK];
+  memcpy(slot.data, buffer, length);
+  slot.length = length;
+  slot.transmissions = 0;
+  slot.acked = false;
+  
+  transmit(_sendNext++);
+  _sentCount++;
+  return true;
+}
+
+size_t NetworkReliableChannel::receive(uint8_t* buffer, size_t size) {
+  freeDelivered();
+  
+  // In order only the next message will do, otherwise any that has
+  // arrived
+  uint8_t count = _ordered ? 1 : NETWORKHUB_RELIABLE_WINDOW;
+  for (uint8_t x = 0; x < count; x++) {
+    ReceiveSlot& slot = _receiveSlots[(_deliverNext + x) & WINDOW_MASK];
+    if (slot.state == RECEIVE_READY) {
+      size_t length = min(size, (size_t)slot.length);
+      memcpy(buffer, slot.data, length);
+      slot.state = RECEIVE_DELIVERED;
+      freeDelivered();
+      return length;
+    }
+  }
+  return 0;
+}
+
+void NetworkReliableChannel::poll() {
+  int size;
+  while ((size = _udp->parsePacket()) > 0) {
+    uint8_t buffer[NETWORKHUB_RELIABLE_DATA_HEADER_SIZE + NETWORKHUB_RELIABLE_MESSAGE_SIZE];
+    if (size > (int)sizeof(buffer)) {
+      continue;
+    }
+    
+    int length = _udp->read(buffer, sizeof(buffer));
+    if (length < 4 || readUInt16(buffer) != MAGIC || buffer[2] != VERSION) {
+      continue;
+    }
+    
+    if (_peerPort == 0) {
+      _peerIP = _udp->remoteIP();
+      _peerPort = _udp->remotePort();
+    } else if (_udp->remoteIP() != _peerIP || _udp->remotePort() != _peerPort) {
+      continue;
+    }
+    
+    if (buffer[3] == TYPE_DATA) {
+      processData(buffer, length);
+    } else if (buffer[3] == TYPE_ACK) {
+      processAck(buffer, length);
+    }
+  }
+  
+  checkTimeouts();
+}
+
+void NetworkReliableChannel::printStatus(Print* printer) {
+  printer->print("Reliable channel: ");
+  printer->print(_sentCount);
+  printer->print(" sent, ");
+  printer->print(_retransmitCount);
+  printer->print(" retransmitted, ");
+  printer->print(_fastRetransmitCount);
+  printer->print(" fast retransmitted, ");
+  printer->print(_failedCount);
+  printer->print(" failed, ");
+  printer->print(_receivedCount);
+  printer->print(" received, ");
+  printer->print(_duplicateCount);
+  printer->print(" duplicates, ");
+  printer->print(_skippedCount);
+  printer->print(" skipped, RTT ");
+  printer->print(_smoothedRTT);
+  printer->print(" us, RTO ");
+  printer->print(_rto);
+  printer->println(" us");
+}
+
+void NetworkReliableChannel::transmit(uint16_t seq) {
+  SendSlot& slot = _sendSlots[seq & WINDOW_MASK];
+  slot.sentMicros = micros();
+  slot.transmissions++;
+  sendData(seq, slot.sentMicros, slot.data, slot.length);
+}
+
+void NetworkReliableChannel::sendNotice() {
+  _noticeMicros = micros();
+  _noticeTransmissions++;
+  sendData(_sendNext, _noticeMicros, NULL, 0);
+}
+
+void NetworkReliableChannel::sendData(uint16_t seq, uint32_t sentMicros, const uint8_t* payload, size_t length) {
+  uint8_t buffer[NETWORKHUB_RELIABLE_DATA_HEADER_SIZE + NETWORKHUB_RELIABLE_MESSAGE_SIZE];
+  writeUInt16(buffer, MAGIC);
+  buffer[2] = VERSION;
+  buffer[3] = TYPE_DATA;
+  writeUInt16(buffer + 4, _session);
+  writeUInt16(buffer + 6, seq);
+  writeUInt16(buffer + 8, _sendBase);
+  writeUInt32(buffer + 10, sentMicros);
+  if (length > 0) {
+    memcpy(buffer + NETWORKHUB_RELIABLE_DATA_HEADER_SIZE, payload, length);
+  }
+  
+  // A lost datagram is resent like any other loss
+  if (_udp->beginPacket(_peerIP, _peerPort) == 1) {
+    _udp->write(buffer, NETWORKHUB_RELIABLE_DATA_HEADER_SIZE + length);
+    _udp->endPacket();
+  }
+}
+
+void NetworkReliableChannel::sendAck(uint32_t echoMicros) {
+  uint32_t sack = 0;
+  for (uint8_t x = 0; x < 32; x++) {
+    uint16_t seq = _receiveNext + 1 + x;
+    if (seqDiff(seq, _deliverNext) >= NETWORKHUB_RELIABLE_WINDOW) {
+      break;
+    }
+    if (_receiveSlots[seq & WINDOW_MASK].state != RECEIVE_EMPTY) {
+      sack |= (uint32_t)1 << x;
+    }
+  }
+  
+  uint8_t buffer[NETWORKHUB_RELIABLE_ACK_SIZE];
+  writeUInt16(buffer, MAGIC);
+  buffer[2] = VERSION;
+  buffer[3] = TYPE_ACK;
+  writeUInt16(buffer + 4, _peerSession);
+  writeUInt16(buffer + 6, _receiveNext);
+  writeUInt32(buffer + 8, sack);
+  writeUInt32(buffer + 12, echoMicros);
+  
+  if (_udp->beginPacket(_peerIP, _peerPort) == 1) {
+    _udp->write(buffer, sizeof(buffer));
+    _udp->endPacket();
+  }
+}
+
+void NetworkReliableChannel::processData(const uint8_t* buffer, size_t length) {
+  if (length < NETWORKHUB_RELIABLE_DATA_HEADER_SIZE) {
+    return;
+  }
+  
+  uint16_t session = readUInt16(buffer + 4);
+  uint16_t seq = readUInt16(buffer + 6);
+  uint16_t first = readUInt16(buffer + 8);
+  uint32_t sentMicros = readUInt32(buffer + 10);
+  
+  // The peer started over
+  if (session != _peerSession) {
+    _peerSession = session;
+    _receiveNext = 0;
+    _deliverNext = 0;
+    for (uint8_t x = 0; x < NETWORKHUB_RELIABLE_WINDOW; x++) {
+      _receiveSlots[x].state = RECEIVE_EMPTY;
+    }
+  }
+  
+  // Stop waiting for messages the peer has given up on
+  while (seqDiff(first, _receiveNext) > 0 && seqDiff(_receiveNext, _deliverNext) < NETWORKHUB_RELIABLE_WINDOW) {
+    ReceiveSlot& slot = _receiveSlots[_receiveNext & WINDOW_MASK];
+    if (slot.state == RECEIVE_EMPTY) {
+      slot.state = RECEIVE_DELIVERED;
+      _skippedCount++;
+    }
+    _receiveNext++;
+  }
+  advanceReceiveNext();
+  freeDelivered();
+  
+  // Just the news that messages were given up on, acked so the
+  // sender can stop repeating it
+  if (length == NETWORKHUB_RELIABLE_DATA_HEADER_SIZE) {
+    sendAck(sentMicros);
+    return;
+  }
+  
+  int16_t offset = seqDiff(seq, _deliverNext);
+  if (offset < 0) {
+    _duplicateCount++;
+  } else if (offset < NETWORKHUB_RELIABLE_WINDOW) {
+    ReceiveSlot& slot = _receiveSlots[seq & WINDOW_MASK];
+    if (slot.state != RECEIVE_EMPTY) {
+      _duplicateCount++;
+    } else {
+      slot.length = min(length - NETWORKHUB_RELIABLE_DATA_HEADER_SIZE, (size_t)NETWORKHUB_RELIABLE_MESSAGE_SIZE);
+      memcpy(slot.data, buffer + NETWORKHUB_RELIABLE_DATA_HEADER_SIZE, slot.length);
+      slot.state = RECEIVE_READY;
+      _receivedCount++;
+      advanceReceiveNext();
+    }
+  }
+  // Past the window the message is dropped, and sent again later
+  
+  // Duplicates are acked too, the last ack may have been lost
+  sendAck(sentMicros);
+}
+
+void NetworkReliableChannel::processAck(const uint8_t* buffer, size_t length) {
+  if (length < NETWORKHUB_RELIABLE_ACK_SIZE || readUInt16(buffer + 4) != _session) {
+    return;
+  }
+  
+  uint16_t ack = readUInt16(buffer + 6);
+  uint32_t sack = readUInt32(buffer + 8);
+  uint32_t echoMicros = readUInt32(buffer + 12);
+  if (seqDiff(ack, _sendBase) < 0 || seqDiff(ack, _sendNext) > 0) {
+    return;
+  }
+  
+  // The echoed time belongs to whichever transmission got through,
+  // so resent messages give good samples too
+  uint32_t now = micros();
+  updateRoundTripTime(now - echoMicros);
+  
+  if (_noticePending && seqDiff(ack, _noticeFirst) >= 0) {
+    _noticePending = false;
+  }
+  
+  uint16_t highestAcked = _sendBase;
+  bool anyAcked = false;
+  for (uint16_t seq = _sendNext; seq != _sendBase; ) {
+    seq--;
+    int16_t offset = seqDiff(seq, ack);
+    if (offset < 0 || (offset > 0 && offset <= 32 && (sack & ((uint32_t)1 << (offset - 1))) != 0)) {
+      _sendSlots[seq & WINDOW_MASK].acked = true;
+      if (!anyAcked) {
+        highestAcked = seq;
+        anyAcked = true;
+      }
+    }
+  }
+  
+  // A message sent before one that has been acked, and overdue by a
+  // quarter of a round trip, was most likely lost
+  if (anyAcked && _smoothedRTT > 0) {
+    uint32_t overdue = _smoothedRTT + _smoothedRTT / 4;
+    for (uint16_t seq = _sendBase; seq != highestAcked; seq++) {
+      SendSlot& slot = _sendSlots[seq & WINDOW_MASK];
+      if (!slot.acked && now - slot.sentMicros >= overdue && slot.transmissions <= _maxRetries) {
+        transmit(seq);
+        _fastRetransmitCount++;
+      }
+    }
+  }
+  
+  advanceSendBase();
+}
+
+void NetworkReliableChannel::checkTimeouts() {
+  uint32_t now = micros();
+  bool failed = false;
+  for (uint16_t seq = _sendBase; seq != _sendNext; seq++) {
+    SendSlot& slot = _sendSlots[seq & WINDOW_MASK];
+    if (slot.acked) {
+      continue;
+    }
+    
+    // Back off on each resend, as TCP does
+    uint32_t timeout = min(_rto << min(slot.transmissions - 1, 6), (uint32_t)NETWORKHUB_RELIABLE_MAX_RTO * 1000);
+    if (now - slot.sentMicros < timeout) {
+      continue;
+    }
+    
+    if (slot.transmissions > _maxRetries) {
+      slot.acked = true;
+      _failedCount++;
+      failed = true;
+    } else {
+      transmit(seq);
+      _retransmitCount++;
+    }
+  }
+  
+  advanceSendBase();
+  
+  // Messages behind the failed one would otherwise wait for it at
+  // the peer until something else is sent, so the peer is told, and
+  // told again until it acks or the retries run out
+  if (failed) {
+    _noticePending = true;
+    _noticeFirst = _sendBase;
+    _noticeTransmissions = 0;
+    sendNotice();
+  } else if (_noticePending) {
+    uint32_t timeout = min(_rto << min(_noticeTransmissions - 1, 6), (uint32_t)NETWORKHUB_RELIABLE_MAX_RTO * 1000);
+    if (now - _noticeMicros >= timeout) {
+      if (_noticeTransmissions > _maxRetries) {
+        _noticePending = false;
+      } else {
+        sendNotice();
+      }
+    }
+  }
+}
+
+void NetworkReliableChannel::updateRoundTripTime(uint32_t sample) {
+  // RFC 6298
+  if (_smoothedRTT == 0) {
+    _smoothedRTT = max(sample, (uint32_t)1);
+    _rttVariance = sample / 2;
+  } else {
+    uint32_t error = sample > _smoothedRTT ? sample - _smoothedRTT : _smoothedRTT - sample;
+    _rttVariance = (3 * _rttVariance + error) / 4;
+    _smoothedRTT = max((7 * _smoothedRTT + sample) / 8, (uint32_t)1);
+  }
+  
+  _rto = _smoothedRTT + 4 * _rttVariance;
+  _rto = max(_rto, (uint32_t)NETWORKHUB_RELIABLE_MIN_RTO * 1000);
+  _rto = min(_rto, (uint32_t)NETWORKHUB_RELIABLE_MAX_RTO * 1000);
+}
+
+void NetworkReliableChannel::advanceSendBase() {
+  while (_sendBase != _sendNext && _sendSlots[_sendBase & WINDOW_MASK].acked) {
+    _sendBase++;
+  }
+}
+
+void NetworkReliableChannel::advanceReceiveNext() {
+  while (seqDiff(_receiveNext, _deliverNext) < NETWORKHUB_RELIABLE_WINDOW
+      && _receiveSlots[_receiveNext & WINDOW_MASK].state != RECEIVE_EMPTY) {
+    _receiveNext++;
+  }
+}
+
+void NetworkReliableChannel::freeDelivered() {
+  while (_deliverNext != _receiveNext && _receiveSlots[_deliverNext & WINDOW_MASK].state == RECEIVE_DELIVERED) {
+    _receiveSlots[_deliverNext & WINDOW_MASK].state = RECEIVE_EMPTY;
+    _deliverNext++;
+  }
+}
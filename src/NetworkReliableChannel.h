@@ -0,0 +1,218 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef NETWORKRELIABLECHANNEL_H
+#define NETWORKRELIABLECHANNEL_H
+
+#include <Arduino.h>
+
+#include "NetworkUDP.h"
+
+// Number of messages that can be unacknowledged at once, and that
+// can be held for the application on the receiving side. A power
+// of two, at most 32 (the size of the selective ack).
+#ifndef NETWORKHUB_RELIABLE_WINDOW
+#define NETWORKHUB_RELIABLE_WINDOW 16
+#endif
+
+// Largest message that can be sent.
+#ifndef NETWORKHUB_RELIABLE_MESSAGE_SIZE
+#define NETWORKHUB_RELIABLE_MESSAGE_SIZE 128
+#endif
+
+// Bounds of the retransmit timeout, in milliseconds, and where it
+// starts before a round trip has been measured. The floor is above
+// the round trip on a LAN so that a peer whose loop() is busy for a
+// few milliseconds isn't sent spurious retransmits.
+#ifndef NETWORKHUB_RELIABLE_MIN_RTO
+#define NETWORKHUB_RELIABLE_MIN_RTO 20
+#endif
+
+#ifndef NETWORKHUB_RELIABLE_MAX_RTO
+#define NETWORKHUB_RELIABLE_MAX_RTO 1000
+#endif
+
+#ifndef NETWORKHUB_RELIABLE_INITIAL_RTO
+#define NETWORKHUB_RELIABLE_INITIAL_RTO 100
+#endif
+
+// Packets on the wire, all fields big-endian:
+//   magic    uint16  'TR'
+//   version  uint8
+//   type     uint8   1 = data, 2 = ack
+// data:
+//   session  uint16  picked by the sender in begin()
+//   seq      uint16
+//   first    uint16  oldest message the sender hasn't given up on
+//   sent     uint32  sender's micros()
+//   payload          none when only telling of messages given up,
+//                    which is acked and resent like a message
+// ack:
+//   session  uint16  of the data being acknowledged
+//   ack      uint16  every message before this has arrived
+//   sack     uint32  bit n set if message ack + 1 + n has arrived
+//   echo     uint32  sent time of the data that caused the ack
+#define NETWORKHUB_RELIABLE_DATA_HEADER_SIZE 14
+#define NETWORKHUB_RELIABLE_ACK_SIZE 16
+
+// Reliable messages over a NetworkUDP, for commands that have to
+// arrive but can't wait behind TCP's head-of-line blocking and
+// retransmit timers on a lossy link. Each message is one datagram;
+// the receiver acknowledges every one straight away, with a
+// selective ack of the rest of its window, so a lost message is
+// resent as soon as a later one is acknowledged and it is a quarter
+// of a round trip overdue, or else when the retransmit timeout
+// (from the measured round trip, as TCP does) runs out. Duplicates
+// are dropped, and messages are handed over in order unless
+// setOrdered(false), in which case each is handed over as soon as
+// it arrives.
+//
+// All buffers are fixed: send() refuses a message when the window
+// is full, and the receiver takes no more than it holds until the
+// application reads them. A message retried too many times is
+// given up on and counted, so a dead peer can't stall the channel.
+//
+//   NetworkReliableChannel channel(networkHub.getUDP());
+//   channel.begin(5005, robotIP, 5005);
+//   ...
+//   channel.poll();  // in loop()
+//   channel.send(command, sizeof(command));
+//   while ((length = channel.receive(buffer, sizeof(buffer))) > 0) { ... }
+//
+// One channel talks to one peer, over a UDP of its own. See
+// extras/reliable_echo.py for a host side peer.
+//
+class NetworkReliableChannel {
+  static_assert(NETWORKHUB_RELIABLE_WINDOW > 0 && NETWORKHUB_RELIABLE_WINDOW <= 32
+    && (NETWORKHUB_RELIABLE_WINDOW & (NETWORKHUB_RELIABLE_WINDOW - 1)) == 0,
+    "NETWORKHUB_RELIABLE_WINDOW must be a power of two, at most 32");
+    
+  public:
+    NetworkReliableChannel(NetworkUDP* udp) { _udp = udp; };
+    
+    // Listen on localPort and talk to the given peer. Returns true
+    // if successful.
+    bool begin(uint16_t localPort, IPAddress peerIP, uint16_t peerPort);
+    // Listen on localPort and talk to whichever peer sends first.
+    bool begin(uint16_t localPort) { return begin(localPort, IPAddress(0, 0, 0, 0), 0); };
+    
+    // Hand messages over in order (the default), or as they arrive.
+    void setOrdered(bool ordered) { _ordered = ordered; };
+    // Number of times a message is resent before it is given up.
+    void setMaxRetries(uint8_t maxRetries) { _maxRetries = maxRetries; };
+    
+    // Send a message, right away. Returns false if it is empty or
+    // too long, there is no peer yet, or the window is full.
+    bool send(const uint8_t* buffer, size_t length);
+    
+    // Copy the next message into buffer, cutting it short if it
+    // doesn't fit. Returns its length, or 0 if there is none.
+    size_t receive(uint8_t* buffer, size_t size);
+    
+    // Read acks and messages, and resend what is overdue. Call this
+    // as often as possible, since time spent waiting here is counted
+    // as network latency.
+    void poll();
+    
+    // Messages sent but not yet acknowledged, or given up on.
+    uint8_t getPendingCount() { return (uint16_t)(_sendNext - _sendBase); };
+    bool canSend() { return getPendingCount() < NETWORKHUB_RELIABLE_WINDOW; };
+    
+    // Round trip estimates, in microseconds.
+    uint32_t getSmoothedRoundTripTime() { return _smoothedRTT; };
+    uint32_t getRoundTripVariance() { return _rttVariance; };
+    uint32_t getRetransmitTimeout() { return _rto; };
+    
+    uint32_t getSentCount() { return _sentCount; };
+    // Resends from the timeout, and from later acks.
+    uint32_t getRetransmitCount() { return _retransmitCount; };
+    uint32_t getFastRetransmitCount() { return _fastRetransmitCount; };
+    // Messages given up on, here and by the peer.
+    uint32_t getFailedCount() { return _failedCount; };
+    uint32_t getSkippedCount() { return _skippedCount; };
+    uint32_t getReceivedCount() { return _receivedCount; };
+    uint32_t getDuplicateCount() { return _duplicateCount; };
+    void printStatus(Print* printer);
+    
+  protected:
+    static const uint16_t MAGIC = 0x5452; // 'TR'
+    static const uint8_t VERSION = 1;
+    static const uint8_t TYPE_DATA = 1;
+    static const uint8_t TYPE_ACK = 2;
+    
+    static const uint8_t WINDOW_MASK = NETWORKHUB_RELIABLE_WINDOW - 1;
+    
+    enum ReceiveState {
+      RECEIVE_EMPTY,
+      RECEIVE_READY,     // waiting for the application
+      RECEIVE_DELIVERED  // handed over, or given up by the peer
+    };
+    
+    struct SendSlot {
+      uint8_t data[NETWORKHUB_RELIABLE_MESSAGE_SIZE];
+      uint16_t length;
+      uint8_t transmissions;
+      bool acked;
+      uint32_t sentMicros;
+    };
+    
+    struct ReceiveSlot {
+      uint8_t data[NETWORKHUB_RELIABLE_MESSAGE_SIZE];
+      uint16_t length;
+      uint8_t state;  // a ReceiveState
+    };
+    
+    NetworkUDP* _udp;
+    IPAddress _peerIP;
+    uint16_t _peerPort = 0;
+    bool _ordered = true;
+    uint8_t _maxRetries = 10;
+    
+    // Sending: _sendBase is the oldest message not yet acknowledged
+    uint16_t _session = 0;
+    uint16_t _sendBase = 0;
+    uint16_t _sendNext = 0;
+    SendSlot _sendSlots[NETWORKHUB_RELIABLE_WINDOW];
+    
+    // Telling the peer that messages before _noticeFirst were given
+    // up on, until it acks that far
+    bool _noticePending = false;
+    uint16_t _noticeFirst = 0;
+    uint8_t _noticeTransmissions = 0;
+    uint32_t _noticeMicros = 0;
+    
+    // Receiving: everything before _receiveNext has arrived, and
+    // everything before _deliverNext has been handed over
+    uint16_t _peerSession = 0;
+    uint16_t _receiveNext = 0;
+    uint16_t _deliverNext = 0;
+    ReceiveSlot _receiveSlots[NETWORKHUB_RELIABLE_WINDOW];
+    
+    uint32_t _smoothedRTT = 0;
+    uint32_t _rttVariance = 0;
+    uint32_t _rto = NETWORKHUB_RELIABLE_INITIAL_RTO * 1000;
+    
+    uint32_t _sentCount = 0;
+    uint32_t _retransmitCount = 0;
+    uint32_t _fastRetransmitCount = 0;
+    uint32_t _failedCount = 0;
+    uint32_t _skippedCount = 0;
+    uint32_t _receivedCount = 0;
+    uint32_t _duplicateCount = 0;
+    
+    void transmit(uint16_t seq);
+    void sendNotice();
+    void sendData(uint16_t seq, uint32_t sentMicros, const uint8_t* payload, size_t length);
+    void sendAck(uint32_t echoMicros);
+    void processData(const uint8_t* buffer, size_t length);
+    void processAck(const uint8_t* buffer, size_t length);
+    void checkTimeouts();
+    void updateRoundTripTime(uint32_t sample);
+    void advanceSendBase();
+    void advanceReceiveNext();
+    void freeDelivered();
+};
+
+#endif // NETWORKRELIABLECHANNEL_H
@@ -0,0 +1,63 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+// Local includes
+#include "NetworkSendQueue.h"
+
+bool NetworkSendQueue::write(const uint8_t* buf, size_t size) {
+  // Anything already queued has to go first
+  if (_count > 0) {
+    poll();
+  }
+  
+  // Refuse the whole write up front unless the queue could hold all
+  // of it. The client's send window is only a hint (an estimate on
+  // some backends), so once part of the write is sent the rest must
+  // be certain to fit, or the stream would be torn.
+  if (size > availableForWrite()) {
+    _refusedCount++;
+    return false;
+  }
+  
+  size_t sent = 0;
+  if (_count == 0) {
+    sent = _client.tryWrite(buf, size);
+  }
+  if (sent < size) {
+    enqueue(buf + sent, size - sent);
+  }
+  return true;
+}
+
+size_t NetworkSendQueue::poll() {
+  while (_count > 0) {
+    // Send the contiguous run at the head
+    size_t run = min(_count, _capacity - _head);
+    size_t sent = _client.tryWrite(_buffer + _head, run);
+    if (sent == 0) {
+      break;
+    }
+    
+    _head = (_head + sent) % _capacity;
+    _count -= sent;
+  }
+  
+  if (_count == 0) {
+    _head = 0;
+  }
+  return _count;
+}
+
+void NetworkSendQueue::enqueue(const uint8_t* buf, size_t size) {
+  // write() has checked it fits
+  size_t tail = (_head + _count) % _capacity;
+  
+  size_t first = min(size, _capacity - tail);
+  memcpy(_buffer + tail, buf, first);
+  memcpy(_buffer, buf + first, size - first);
+  
+  _count += size;
+  _highWaterCount = max(_highWaterCount, _count);
+}
@@ -0,0 +1,69 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef NETWORKSENDQUEUE_H
+#define NETWORKSENDQUEUE_H
+
+#include <Arduino.h>
+
+#include "NetworkClient.h"
+
+// A bounded send queue for a NetworkClient, over storage supplied
+// by the caller. Writes go straight to the client while its send
+// window allows and are queued otherwise; poll() pushes the queued
+// bytes out from loop(). A write that doesn't fit in the queue is
+// refused whole, even if the client could have sent part of it, so
+// producers see the back-pressure instead of the sketch stalling
+// inside the network stack, and the stream is never torn. The
+// buffer must be as large as the largest write.
+//
+//   uint8_t sendBuffer[4096];
+//   NetworkSendQueue sendQueue(client, sendBuffer, sizeof(sendBuffer));
+//
+class NetworkSendQueue {
+  public:
+    // Without a buffer (NULL or zero capacity) every write is refused.
+    NetworkSendQueue(NetworkClient& client, uint8_t* buffer, size_t capacity) : _client(client) {
+      _buffer = buffer;
+      _capacity = buffer != NULL ? capacity : 0;
+    };
+    
+    // Send or queue all of the bytes. Returns false, and takes none
+    // of them, if they don't fit in the queue.
+    bool write(const uint8_t* buf, size_t size);
+    
+    // Send as much of the queue as the client will take without
+    // blocking. Call from loop(). Returns the number of bytes still
+    // queued.
+    size_t poll();
+    
+    // Throw away anything queued, ie after the client disconnects.
+    void clear() { _head = 0; _count = 0; };
+    
+    // Number of bytes write() will accept right now.
+    size_t availableForWrite() { return _capacity - _count; };
+    size_t getQueuedCount() { return _count; };
+    bool isEmpty() { return _count == 0; };
+    size_t getCapacity() { return _capacity; };
+    size_t getHighWaterCount() { return _highWaterCount; };
+    // Number of writes refused because the queue was full.
+    uint32_t getRefusedCount() { return _refusedCount; };
+    
+  protected:
+    NetworkClient& _client;
+    uint8_t* _buffer;
+    size_t _capacity;
+    
+    // Oldest queued byte and number queued
+    size_t _head = 0;
+    size_t _count = 0;
+    
+    size_t _highWaterCount = 0;
+    uint32_t _refusedCount = 0;
+    
+    void enqueue(const uint8_t* buf, size_t size);
+};
+
+#endif // NETWORKSENDQUEUE_H
@@ -0,0 +1,113 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+// Local includes
+#include "NetworkServer.h"
+
+NetworkServer::~NetworkServer() {
+  while (_subscriberCount > 0) {
+    removeSubscriber(_subscriberCount - 1);
+  }
+  delete _serverWrapper;
+}
+
+bool NetworkServer::subscribe(NetworkClient& client, uint32_t groups) {
+  int index = findSubscriber(client);
+  if (index >= 0) {
+    _subscribers[index].groups = groups;
+    return true;
+  }
+  
+  if (_subscriberCount >= NETWORKHUB_MAX_SUBSCRIBERS || !client.connected()) {
+    return false;
+  }
+  
+  // Keep our own copy of the connection
+  NetworkClientWrapper* clientWrapper = client._clientWrapper->clone();
+  if (clientWrapper == NULL) {
+    return false;
+  }
+  
+  _subscribers[_subscriberCount].clientWrapper = clientWrapper;
+  _subscribers[_subscriberCount].groups = groups;
+  _subscribers[_subscriberCount].skippedCount = 0;
+  _subscriberCount++;
+  return true;
+}
+
+void NetworkServer::unsubscribe(NetworkClient& client) {
+  int index = findSubscriber(client);
+  if (index >= 0) {
+    removeSubscriber(index);
+  }
+}
+
+uint8_t NetworkServer::publish(uint32_t groups, const uint8_t* buf, size_t len) {
+  uint8_t published = 0;
+  
+  uint8_t x = 0;
+  while (x < _subscriberCount) {
+    Subscriber& subscriber = _subscribers[x];
+    
+    if (!subscriber.clientWrapper->connected()) {
+      // The last subscriber moves into this slot
+      removeSubscriber(x);
+      continue;
+    }
+    
+    if (subscriber.groups & groups) {
+      // A partial message would corrupt the stream, so only write
+      // to subscribers that can take all of it.
+      size_t written = 0;
+      if ((size_t)subscriber.clientWrapper->availableForWrite() >= len) {
+        written = subscriber.clientWrapper->write(buf, len);
+      }
+      
+      if (written == len) {
+        published++;
+      } else if (written == 0) {
+        subscriber.skippedCount++;
+        _skippedCount++;
+      } else {
+        // Part of the message is out, the rest of the stream would
+        // be misframed
+        subscriber.clientWrapper->stop();
+        removeSubscriber(x);
+        _droppedCount++;
+        continue;
+      }
+    }
+    x++;
+  }
+  
+  return published;
+}
+
+uint32_t NetworkServer::getSkippedCount(NetworkClient& client) {
+  int index = findSubscriber(client);
+  return index >= 0 ? _subscribers[index].skippedCount : 0;
+}
+
+int NetworkServer::findSubscriber(NetworkClient& client) {
+  // Copies of a client are separate objects, so match on the
+  // connection instead.
+  IPAddress remoteIP = client.remoteIP();
+  uint16_t remotePort = client.remotePort();
+  
+  for (uint8_t x = 0; x < _subscriberCount; x++) {
+    if (_subscribers[x].clientWrapper->remotePort() == remotePort
+        && _subscribers[x].clientWrapper->remoteIP() == remoteIP) {
+      return x;
+    }
+  }
+  return -1;
+}
+
+void NetworkServer::removeSubscriber(uint8_t index) {
+  delete _subscribers[index].clientWrapper;
+  
+  _subscriberCount--;
+  _subscribers[index] = _subscribers[_subscriberCount];
+}
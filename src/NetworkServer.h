@@ -7,9 +7,15 @@
 #define NETWORKSERVER_H
 
 #include <Server.h>
+#include "NetworkAllocator.h"
 #include "NetworkServerWrapper.h"
 #include "NetworkClient.h"
 
+// Number of clients that can be subscribed to a server's groups.
+#ifndef NETWORKHUB_MAX_SUBSCRIBERS
+#define NETWORKHUB_MAX_SUBSCRIBERS 8
+#endif
+
 // A network server that will listen and write
 // to specific port on the hub. Instances of
 // NetworkServer are created by calls to the
@@ -22,13 +28,60 @@ class NetworkServer : public Print {
     size_t write(uint8_t b) { return _serverWrapper->write(b); };
     size_t write(const uint8_t *buf, size_t size) { return _serverWrapper->write(buf, size); };
     
-    ~NetworkServer() {
-      delete _serverWrapper;
-    };
+    // Subscriber groups. Clients returned by available() can be
+    // subscribed to one or more groups, given as a bit mask, and
+    // publish() then writes a message to just those clients.
+    
+    // Subscribe the client to the groups, replacing any groups it
+    // already had. Returns false if the subscriber table is full.
+    bool subscribe(NetworkClient& client, uint32_t groups);
+    void unsubscribe(NetworkClient& client);
+    uint8_t getSubscriberCount() { return _subscriberCount; };
+    
+    // Write the message to every connected subscriber in any of the
+    // groups. The message is only written to subscribers that can
+    // take all of it without blocking; the others are skipped and
+    // counted, so a slow subscriber never holds up the rest. A
+    // subscriber that takes only part of it anyway (the send window
+    // is an estimate on some backends) has a broken stream, so it is
+    // disconnected and dropped. Disconnected subscribers are
+    // removed. Returns the number of subscribers that took the
+    // whole message.
+    uint8_t publish(uint32_t groups, const uint8_t* buf, size_t len);
+    
+    // Number of times the client, or any subscriber, was skipped
+    // because its send window was full.
+    uint32_t getSkippedCount(NetworkClient& client);
+    uint32_t getSkippedCount() { return _skippedCount; };
+    // Number of subscribers dropped after a short write.
+    uint32_t getDroppedCount() { return _droppedCount; };
+    
+    ~NetworkServer();
     
+#if defined(NETWORKHUB_STATIC_ALLOC)
+    // Servers come from a fixed pool, new returns NULL when it is full
+    static void* operator new(size_t size) noexcept { return NetworkAllocator::servers.allocate(size); };
+    static void operator delete(void* server) { NetworkAllocator::servers.release(server); };
+#endif
+
   protected:
     NetworkServerWrapper* _serverWrapper;
     
+    struct Subscriber {
+      NetworkClientWrapper* clientWrapper;
+      uint32_t groups;
+      uint32_t skippedCount;
+    };
+    
+    Subscriber _subscribers[NETWORKHUB_MAX_SUBSCRIBERS];
+    uint8_t _subscriberCount = 0;
+    uint32_t _skippedCount = 0;
+    uint32_t _droppedCount = 0;
+    
+    // Returns the index of the client's subscription, or -1
+    int findSubscriber(NetworkClient& client);
+    void removeSubscriber(uint8_t index);
+    
   private:
     friend class NetworkFactory;
     
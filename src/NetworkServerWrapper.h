@@ -7,6 +7,7 @@
 #define NETWORKSERVERWRAPPER_H
 
 #include <Server.h>
+#include "NetworkAllocator.h"
 #include "NetworkClient.h"
 
 // This class defines a wrapper class for Server
@@ -21,6 +22,12 @@ class NetworkServerWrapper : public Print {
     virtual void begin() = 0;
     virtual size_t write(uint8_t b) = 0;
     virtual size_t write(const uint8_t *buf, size_t size) = 0;
+
+#if defined(NETWORKHUB_STATIC_ALLOC)
+    // Wrappers come from a fixed pool, new returns NULL when it is full
+    static void* operator new(size_t size) noexcept { return NetworkAllocator::serverWrappers.allocate(size); };
+    static void operator delete(void* wrapper) { NetworkAllocator::serverWrappers.release(wrapper); };
+#endif
 };
 
 #endif // NETWORKSERVERWRAPPER_H
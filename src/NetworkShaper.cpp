@@ -0,0 +1,196 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+// Local includes
+#include "NetworkShaper.h"
+
+// Shapes what one client sends.
+//
+class ShapedClientWrapper : public NetworkClientDecorator {
+  public:
+    size_t write(const uint8_t *buf, size_t size) {
+      _bucket->bucket.setRate(_shaper->_clientRate, _shaper->_clientBurst);
+      size_t allowed = min(size, _shaper->allowance(_bucket->bucket));
+      if (allowed < size) {
+        _shaper->_throttledCount++;
+      }
+      if (allowed == 0) {
+        return 0;
+      }
+      
+      size_t written = _client.write(buf, allowed);
+      _shaper->consume(_bucket->bucket, written);
+      return written;
+    };
+    
+    int availableForWrite() {
+      _bucket->bucket.setRate(_shaper->_clientRate, _shaper->_clientBurst);
+      return min((size_t)max(_client.availableForWrite(), 0), _shaper->allowance(_bucket->bucket));
+    };
+    
+    NetworkClientWrapper* clone() {
+      return new ShapedClientWrapper(*this);
+    };
+    
+    ShapedClientWrapper(const ShapedClientWrapper& other) : NetworkClientDecorator(other) {
+      _shaper = other._shaper;
+      _bucket = other._bucket;
+      _bucket->references++;
+    };
+    
+    ~ShapedClientWrapper() {
+      _bucket->references--;
+    };
+    
+  private:
+    friend class NetworkShaper;
+    
+    ShapedClientWrapper(NetworkShaper* shaper, NetworkClient& client, NetworkShaper::ClientBucket* bucket)
+        : NetworkClientDecorator(client) {
+      _shaper = shaper;
+      _bucket = bucket;
+    };
+    
+    NetworkShaper* _shaper;
+    NetworkShaper::ClientBucket* _bucket;
+};
+
+// Shapes what one UDP sends. Datagrams are paid for when they are
+// sent, so one may take the buckets into debt.
+//
+class ShapedUDPWrapper : public NetworkUDPDecorator {
+  public:
+    int beginPacket(IPAddress ip, uint16_t port) {
+      if (!startPacket()) {
+        return 0;
+      }
+      return _udp->beginPacket(ip, port);
+    };
+    
+    int beginPacket(const char *host, uint16_t port) {
+      if (!startPacket()) {
+        return 0;
+      }
+      return _udp->beginPacket(host, port);
+    };
+    
+    size_t write(const uint8_t *buffer, size_t size) {
+      if (_refused) {
+        return 0;
+      }
+      size_t written = _udp->write(buffer, size);
+      _length += written;
+      return written;
+    };
+    
+    int endPacket() {
+      if (_refused) {
+        _refused = false;
+        return 0;
+      }
+      _shaper->consume(_bucket, _length);
+      _length = 0;
+      return _udp->endPacket();
+    };
+    
+  private:
+    friend class NetworkShaper;
+    
+    ShapedUDPWrapper(NetworkShaper* shaper, NetworkUDP* udp) : NetworkUDPDecorator(udp) {
+      _shaper = shaper;
+    };
+    
+    bool startPacket() {
+      _bucket.setRate(_shaper->_udpRate, _shaper->_udpBurst);
+      _length = 0;
+      _refused = _shaper->allowance(_bucket) == 0;
+      if (_refused) {
+        _shaper->_deferredCount++;
+      }
+      return !_refused;
+    };
+    
+    NetworkShaper* _shaper;
+    NetworkTokenBucket _bucket;
+    size_t _length = 0;
+    bool _refused = false;
+};
+
+#if defined(NETWORKHUB_STATIC_ALLOC)
+static_assert(sizeof(ShapedClientWrapper) <= NETWORKHUB_CLIENT_WRAPPER_SIZE, "Increase NETWORKHUB_CLIENT_WRAPPER_SIZE");
+static_assert(sizeof(ShapedUDPWrapper) <= NETWORKHUB_UDP_WRAPPER_SIZE, "Increase NETWORKHUB_UDP_WRAPPER_SIZE");
+#endif
+
+void NetworkShaper::printStatus(Print* printer) {
+  printer->print("Shaper: ");
+  printer->print(_sentBytes);
+  printer->print(" bytes sent, ");
+  printer->print(_throttledCount);
+  printer->print(" writes throttled, ");
+  printer->print(_deferredCount);
+  printer->println(" datagrams deferred");
+}
+
+NetworkClientWrapper* NetworkShaper::decorateClient(NetworkClient& client, uint16_t localPort) {
+  // If there's no room the client goes on unshaped
+  ClientBucket* bucket = getClientBucket(client, localPort);
+  if (bucket == NULL) {
+    return NULL;
+  }
+  
+  ShapedClientWrapper* clientWrapper = new ShapedClientWrapper(this, client, bucket);
+  if (clientWrapper == NULL) {
+    bucket->references--;
+  }
+  return clientWrapper;
+}
+
+NetworkUDPWrapper* NetworkShaper::decorateUDP(NetworkUDP* udp) {
+  ShapedUDPWrapper* udpWrapper = new ShapedUDPWrapper(this, udp);
+  if (udpWrapper == NULL) {
+    delete udp;
+  }
+  return udpWrapper;
+}
+
+NetworkShaper::ClientBucket* NetworkShaper::getClientBucket(NetworkClient& client, uint16_t localPort) {
+  IPAddress remoteIP;
+  uint16_t remotePort = 0;
+  if (localPort > 0) {
+    // available() hands out the same connection again and again
+    remoteIP = client.remoteIP();
+    remotePort = client.remotePort();
+    for (uint8_t x = 0; x < NETWORKHUB_SHAPER_CLIENTS; x++) {
+      ClientBucket* bucket = &_clientBuckets[x];
+      if (bucket->references > 0 && bucket->port == remotePort && bucket->ip == remoteIP) {
+        bucket->references++;
+        return bucket;
+      }
+    }
+  }
+  
+  for (uint8_t x = 0; x < NETWORKHUB_SHAPER_CLIENTS; x++) {
+    ClientBucket* bucket = &_clientBuckets[x];
+    if (bucket->references == 0) {
+      *bucket = ClientBucket();
+      bucket->references = 1;
+      bucket->ip = remoteIP;
+      bucket->port = remotePort;
+      return bucket;
+    }
+  }
+  return NULL;
+}
+
+size_t NetworkShaper::allowance(NetworkTokenBucket& socketBucket) {
+  int32_t tokens = min(socketBucket.available(), _hubBucket.available());
+  return tokens > 0 ? tokens : 0;
+}
+
+void NetworkShaper::consume(NetworkTokenBucket& socketBucket, size_t size) {
+  socketBucket.consume(size);
+  _hubBucket.consume(size);
+  _sentBytes += size;
+}
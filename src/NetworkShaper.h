@@ -0,0 +1,105 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef NETWORKSHAPER_H
+#define NETWORKSHAPER_H
+
+#include <Arduino.h>
+
+#include "NetworkDecorator.h"
+#include "NetworkTokenBucket.h"
+
+// Number of clients a NetworkShaper can shape at once. Copies of a
+// client share one bucket, and clients past the limit go unshaped.
+#ifndef NETWORKHUB_SHAPER_CLIENTS
+#define NETWORKHUB_SHAPER_CLIENTS 8
+#endif
+
+// Limits how fast the clients and UDPs of a DecoratedNetworkHub can
+// send, with token buckets: one shared by all of them, and one of
+// each socket's own. Rates and bursts can be changed at any time; a
+// rate of 0 means no limit, which is where they all start.
+//
+// Nothing waits for tokens. Client writes come up short (or write
+// nothing) and availableForWrite() shrinks to what the buckets
+// allow, so tryWrite() and NetworkSendQueue hold the rest back.
+// beginPacket() returns 0 while the buckets are empty, and the
+// datagram should be sent later. Only sending is shaped.
+//
+// To keep bulk traffic from starving other traffic on the same
+// link, shape only the hub the bulk sockets come from:
+//
+//   DecoratedNetworkHub bulkHub(&airLiftHub);
+//   NetworkShaper shaper;
+//   shaper.setHubRate(200000);
+//   bulkHub.addDecorator(&shaper);
+//   NetworkClient upload = bulkHub.getClient();  // shaped
+//   NetworkUDP* control = airLiftHub.getUDP();   // not shaped
+//
+class NetworkShaper : public NetworkDecorator {
+  public:
+    NetworkShaper() { /* Nothing to see here, move along. */ };
+    
+    // Limit everything the hub sends together. A burst of 0 is a
+    // tenth of a second's worth.
+    void setHubRate(uint32_t bytesPerSecond, uint32_t burstBytes = 0) { _hubBucket.setRate(bytesPerSecond, burstBytes); };
+    // Limit each client on its own.
+    void setClientRate(uint32_t bytesPerSecond, uint32_t burstBytes = 0) {
+      _clientRate = bytesPerSecond;
+      _clientBurst = burstBytes;
+    };
+    // Limit each UDP on its own.
+    void setUDPRate(uint32_t bytesPerSecond, uint32_t burstBytes = 0) {
+      _udpRate = bytesPerSecond;
+      _udpBurst = burstBytes;
+    };
+    
+    // Bytes sent through the shaper.
+    uint32_t getSentBytes() { return _sentBytes; };
+    // Client writes cut short or refused for lack of tokens.
+    uint32_t getThrottledCount() { return _throttledCount; };
+    // Datagrams refused by beginPacket() for lack of tokens.
+    uint32_t getDeferredCount() { return _deferredCount; };
+    void printStatus(Print* printer);
+    
+    // NetworkDecorator methods
+    NetworkClientWrapper* decorateClient(NetworkClient& client, uint16_t localPort);
+    NetworkUDPWrapper* decorateUDP(NetworkUDP* udp);
+    
+  protected:
+    friend class ShapedClientWrapper;
+    friend class ShapedUDPWrapper;
+    
+    NetworkTokenBucket _hubBucket;
+    uint32_t _clientRate = 0;
+    uint32_t _clientBurst = 0;
+    uint32_t _udpRate = 0;
+    uint32_t _udpBurst = 0;
+    
+    // Shared by a client and its copies, so copying a client
+    // doesn't get it a fresh bucket
+    struct ClientBucket {
+      uint8_t references = 0;
+      // Where an accepted client came from
+      IPAddress ip;
+      uint16_t port = 0;
+      NetworkTokenBucket bucket;
+    };
+    
+    ClientBucket _clientBuckets[NETWORKHUB_SHAPER_CLIENTS];
+    
+    uint32_t _sentBytes = 0;
+    uint32_t _throttledCount = 0;
+    uint32_t _deferredCount = 0;
+    
+    ClientBucket* getClientBucket(NetworkClient& client, uint16_t localPort);
+    
+    // Bytes a socket with this bucket may send now.
+    size_t allowance(NetworkTokenBucket& socketBucket);
+    // Pay for bytes sent by a socket with this bucket.
+    void consume(NetworkTokenBucket& socketBucket, size_t size);
+};
+
+#endif // NETWORKSHAPER_H
@@ -0,0 +1,493 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+// Local includes
+#include "NetworkSocketBudget.h"
+
+// Counts the socket of one client, and its copies.
+//
+class BudgetClientWrapper : public NetworkClientDecorator {
+  public:
+    // A connect() waiting on the queue would spin until it timed out,
+    // as nothing releases a socket while it does, so only a polled
+    // connect is queued
+    void setConnectWaits(bool waits) {
+      _connectWaits = waits;
+      NetworkClientDecorator::setConnectWaits(waits);
+    };
+    
+    int startConnect(IPAddress ip, uint16_t port) {
+      _budget->dequeue(_lease);
+      if (!_lease->held && !_budget->acquireClient(_lease)) {
+        if (_lease->critical || _connectWaits || !_budget->enqueue(_lease)) {
+          _budget->_refused[NETWORK_SOCKET_CLIENT]++;
+          return 0;
+        }
+        // pollConnect() starts it when a socket is free
+        _lease->ip = ip;
+        _lease->port = port;
+        return 1;
+      }
+      return checkStart(NetworkClientDecorator::startConnect(ip, port));
+    };
+    
+    // Host names aren't kept for the queue
+    int startConnect(const char *host, uint16_t port) {
+      if (!takeSocket()) {
+        return 0;
+      }
+      return checkStart(NetworkClientDecorator::startConnect(host, port));
+    };
+    
+    int pollConnect() {
+      if (_lease->queued) {
+        if (!_budget->acquireClient(_lease)) {
+          return NETWORK_CONNECT_IN_PROGRESS;
+        }
+        _budget->dequeue(_lease);
+        if (checkStart(NetworkClientDecorator::startConnect(_lease->ip, _lease->port)) != 1) {
+          return NETWORK_CONNECT_FAILED;
+        }
+      }
+      
+      int status = _client.connectStatus();
+      if (status == NETWORK_CONNECT_FAILED || status == NETWORK_CONNECT_TIMED_OUT) {
+        _budget->releaseClient(_lease);
+      }
+      return status;
+    };
+    
+    int connectSecure(IPAddress ip, uint16_t port) {
+      if (!takeSocket()) {
+        return 0;
+      }
+      return checkStart(_client.connectSecure(ip, port));
+    };
+    
+    int connectSecure(const char *host, uint16_t port) {
+      if (!takeSocket()) {
+        return 0;
+      }
+      return checkStart(_client.connectSecure(host, port));
+    };
+    
+    void stop() {
+      _budget->releaseClient(_lease);
+      _client.stop();
+    };
+    
+    NetworkClientWrapper* clone() {
+      return new BudgetClientWrapper(*this);
+    };
+    
+    BudgetClientWrapper(const BudgetClientWrapper& other) : NetworkClientDecorator(other) {
+      _budget = other._budget;
+      _lease = other._lease;
+      _lease->references++;
+    };
+    
+    ~BudgetClientWrapper() {
+      if (--_lease->references == 0) {
+        _budget->releaseClient(_lease);
+      }
+    };
+    
+  private:
+    friend class NetworkSocketBudget;
+    
+    BudgetClientWrapper(NetworkSocketBudget* budget, NetworkClient& client, NetworkSocketBudget::Lease* lease)
+        : NetworkClientDecorator(client) {
+      _budget = budget;
+      _lease = lease;
+    };
+    
+    // Take a socket for a connect that can't be queued
+    bool takeSocket() {
+      _budget->dequeue(_lease);
+      if (!_lease->held && !_budget->acquireClient(_lease)) {
+        _budget->_refused[NETWORK_SOCKET_CLIENT]++;
+        return false;
+      }
+      return true;
+    };
+    
+    // Give the socket back if the connect didn't start
+    int checkStart(int result) {
+      if (result != 1) {
+        _budget->releaseClient(_lease);
+      }
+      return result;
+    };
+    
+    NetworkSocketBudget* _budget;
+    NetworkSocketBudget::Lease* _lease;
+    bool _connectWaits = false;
+};
+
+// Counts the listening socket of a server.
+//
+class BudgetServerWrapper : public NetworkServerWrapper {
+  public:
+    NetworkClient available() { return _server->available(); };
+    
+    void begin() {
+      if (!_held) {
+        if (!_budget->acquire(NETWORK_SOCKET_SERVER, _critical)) {
+          _budget->_refused[NETWORK_SOCKET_SERVER]++;
+          return;
+        }
+        _held = true;
+      }
+      _server->begin();
+    };
+    
+    size_t write(uint8_t b) { return _server->write(b); };
+    size_t write(const uint8_t *buf, size_t size) { return _server->write(buf, size); };
+    
+    ~BudgetServerWrapper() {
+      if (_held) {
+        _budget->release(NETWORK_SOCKET_SERVER, _critical);
+      }
+      delete _server;
+    };
+    
+  private:
+    friend class NetworkSocketBudget;
+    
+    BudgetServerWrapper(NetworkSocketBudget* budget, NetworkServer* server, bool critical) {
+      _budget = budget;
+      _server = server;
+      _critical = critical;
+    };
+    
+    NetworkSocketBudget* _budget;
+    NetworkServer* _server;
+    bool _critical;
+    bool _held = false;
+};
+
+// Counts the socket of a UDP.
+//
+class BudgetUDPWrapper : public NetworkUDPDecorator {
+  public:
+    uint8_t begin(uint16_t port) {
+      if (!takeSocket()) {
+        return 0;
+      }
+      return checkBegin(_udp->begin(port));
+    };
+    
+    uint8_t beginMulticast(IPAddress ip, uint16_t port) {
+      if (!takeSocket()) {
+        return 0;
+      }
+      return checkBegin(_udp->beginMulticast(ip, port));
+    };
+    
+    void stop() {
+      _udp->stop();
+      dropSocket();
+    };
+    
+    ~BudgetUDPWrapper() {
+      dropSocket();
+    };
+    
+  private:
+    friend class NetworkSocketBudget;
+    
+    BudgetUDPWrapper(NetworkSocketBudget* budget, NetworkUDP* udp, bool critical) : NetworkUDPDecorator(udp) {
+      _budget = budget;
+      _critical = critical;
+    };
+    
+    bool takeSocket() {
+      if (!_held) {
+        if (!_budget->acquire(NETWORK_SOCKET_UDP, _critical)) {
+          _budget->_refused[NETWORK_SOCKET_UDP]++;
+          return false;
+        }
+        _held = true;
+      }
+      return true;
+    };
+    
+    void dropSocket() {
+      if (_held) {
+        _held = false;
+        _budget->release(NETWORK_SOCKET_UDP, _critical);
+      }
+    };
+    
+    uint8_t checkBegin(uint8_t result) {
+      if (result == 0) {
+        dropSocket();
+      }
+      return result;
+    };
+    
+    NetworkSocketBudget* _budget;
+    bool _critical;
+    bool _held = false;
+};
+
+#if defined(NETWORKHUB_STATIC_ALLOC)
+static_assert(sizeof(BudgetClientWrapper) <= NETWORKHUB_CLIENT_WRAPPER_SIZE, "Increase NETWORKHUB_CLIENT_WRAPPER_SIZE");
+static_assert(sizeof(BudgetServerWrapper) <= NETWORKHUB_SERVER_WRAPPER_SIZE, "Increase NETWORKHUB_SERVER_WRAPPER_SIZE");
+static_assert(sizeof(BudgetUDPWrapper) <= NETWORKHUB_UDP_WRAPPER_SIZE, "Increase NETWORKHUB_UDP_WRAPPER_SIZE");
+#endif
+
+static const char* socketTypeName(uint8_t type) {
+  switch (type) {
+    case NETWORK_SOCKET_CLIENT:
+      return "clients";
+    
+    case NETWORK_SOCKET_SERVER:
+      return "servers";
+    
+    default:
+      return "UDPs";
+  }
+}
+
+NetworkClient NetworkSocketBudget::getCriticalClient() {
+  if (_networkHub == NULL) {
+    return NetworkClient();
+  }
+  
+  _nextCritical = true;
+  NetworkClient client = _networkHub->getClient();
+  _nextCritical = false;
+  return client;
+}
+
+NetworkServer* NetworkSocketBudget::getCriticalServer(uint32_t portNum) {
+  if (_networkHub == NULL) {
+    return NULL;
+  }
+  
+  _nextCritical = true;
+  NetworkServer* server = _networkHub->getServer(portNum);
+  _nextCritical = false;
+  return server;
+}
+
+NetworkUDP* NetworkSocketBudget::getCriticalUDP() {
+  if (_networkHub == NULL) {
+    return NULL;
+  }
+  
+  _nextCritical = true;
+  NetworkUDP* udp = _networkHub->getUDP();
+  _nextCritical = false;
+  return udp;
+}
+
+void NetworkSocketBudget::printStatus(Print* printer) {
+  printer->print("Sockets:");
+  for (uint8_t type = 0; type < NETWORK_SOCKET_TYPE_COUNT; type++) {
+    printer->print(" ");
+    printer->print(socketTypeName(type));
+    printer->print(" ");
+    printer->print(_inUse[type]);
+    if (_limits[type] > 0) {
+      printer->print("/");
+      printer->print(_limits[type]);
+    }
+    printer->print(" (high ");
+    printer->print(_highWater[type]);
+    printer->print(", refused ");
+    printer->print(_refused[type]);
+    printer->print("),");
+  }
+  printer->print(" total ");
+  printer->print(_totalInUse);
+  if (_totalLimit > 0) {
+    printer->print("/");
+    printer->print(_totalLimit);
+  }
+  printer->print(" (high ");
+  printer->print(_totalHighWater);
+  printer->print("), ");
+  printer->print(_queueCount);
+  printer->print(" queued, ");
+  printer->print(_waitedCount);
+  printer->println(" waited");
+}
+
+void NetworkSocketBudget::attach(NetworkHub* networkHub) {
+  _networkHub = networkHub;
+  for (uint8_t type = 0; type < NETWORK_SOCKET_TYPE_COUNT; type++) {
+    _limits[type] = networkHub->getSocketLimit(type);
+  }
+  _totalLimit = networkHub->getTotalSocketLimit();
+}
+
+NetworkClientWrapper* NetworkSocketBudget::decorateClient(NetworkClient& client, uint16_t localPort) {
+  Lease* lease = NULL;
+  if (localPort > 0) {
+    // available() hands out the same connection again and again
+    IPAddress remoteIP = client.remoteIP();
+    uint16_t remotePort = client.remotePort();
+    for (uint8_t x = 0; x < NETWORKHUB_SOCKET_BUDGET_CLIENTS && lease == NULL; x++) {
+      Lease* candidate = &_leases[x];
+      if (candidate->references > 0 && candidate->accepted && candidate->held
+          && candidate->port == remotePort && candidate->ip == remoteIP) {
+        lease = candidate;
+        lease->references++;
+      }
+    }
+    
+    // The connection is there already, so it is never refused, but
+    // it isn't critical either and must not use up the reservation
+    if (lease == NULL) {
+      lease = newLease(false);
+      if (lease == NULL) {
+        return NULL;
+      }
+      lease->accepted = true;
+      lease->ip = remoteIP;
+      lease->port = remotePort;
+      lease->held = acquire(NETWORK_SOCKET_CLIENT, false, true);
+    }
+  } else {
+    // If there's no room the client goes on uncounted
+    lease = newLease(_nextCritical);
+    if (lease == NULL) {
+      return NULL;
+    }
+  }
+  
+  BudgetClientWrapper* clientWrapper = new BudgetClientWrapper(this, client, lease);
+  if (clientWrapper == NULL && --lease->references == 0) {
+    releaseClient(lease);
+  }
+  return clientWrapper;
+}
+
+NetworkUDPWrapper* NetworkSocketBudget::decorateUDP(NetworkUDP* udp) {
+  BudgetUDPWrapper* udpWrapper = new BudgetUDPWrapper(this, udp, _nextCritical);
+  if (udpWrapper == NULL) {
+    delete udp;
+  }
+  return udpWrapper;
+}
+
+NetworkServerWrapper* NetworkSocketBudget::decorateServer(NetworkServer* server, uint16_t portNum) {
+  BudgetServerWrapper* serverWrapper = new BudgetServerWrapper(this, server, _nextCritical);
+  if (serverWrapper == NULL) {
+    delete server;
+  }
+  return serverWrapper;
+}
+
+uint8_t NetworkSocketBudget::getOwedCount(uint8_t type) {
+  return _reserved[type] > _criticalInUse[type] ? _reserved[type] - _criticalInUse[type] : 0;
+}
+
+bool NetworkSocketBudget::acquire(uint8_t type, bool critical, bool force) {
+  if (!force) {
+    // Critical users may take the sockets reserved for their own
+    // type, everyone else has to leave them
+    uint8_t owed = getOwedCount(type);
+    uint8_t totalOwed = 0;
+    for (uint8_t x = 0; x < NETWORK_SOCKET_TYPE_COUNT; x++) {
+      totalOwed += getOwedCount(x);
+    }
+    if (critical) {
+      totalOwed -= owed;
+      owed = 0;
+    }
+    
+    if (_limits[type] > 0 && _inUse[type] + owed >= _limits[type]) {
+      return false;
+    }
+    if (_totalLimit > 0 && _totalInUse + totalOwed >= _totalLimit) {
+      return false;
+    }
+  }
+  
+  _inUse[type]++;
+  if (critical) {
+    _criticalInUse[type]++;
+  }
+  _totalInUse++;
+  _highWater[type] = max(_highWater[type], _inUse[type]);
+  _totalHighWater = max(_totalHighWater, _totalInUse);
+  return true;
+}
+
+void NetworkSocketBudget::release(uint8_t type, bool critical) {
+  if (_inUse[type] > 0) {
+    _inUse[type]--;
+  }
+  if (critical && _criticalInUse[type] > 0) {
+    _criticalInUse[type]--;
+  }
+  if (_totalInUse > 0) {
+    _totalInUse--;
+  }
+}
+
+bool NetworkSocketBudget::acquireClient(Lease* lease) {
+  // No jumping the queue
+  if (!lease->critical && _queueCount > 0 && _queue[0] != lease) {
+    return false;
+  }
+  if (!acquire(NETWORK_SOCKET_CLIENT, lease->critical)) {
+    return false;
+  }
+  lease->held = true;
+  return true;
+}
+
+void NetworkSocketBudget::releaseClient(Lease* lease) {
+  dequeue(lease);
+  if (lease->held) {
+    lease->held = false;
+    release(NETWORK_SOCKET_CLIENT, lease->critical);
+  }
+}
+
+NetworkSocketBudget::Lease* NetworkSocketBudget::newLease(bool critical) {
+  for (uint8_t x = 0; x < NETWORKHUB_SOCKET_BUDGET_CLIENTS; x++) {
+    Lease* lease = &_leases[x];
+    if (lease->references == 0) {
+      *lease = Lease();
+      lease->references = 1;
+      lease->critical = critical;
+      return lease;
+    }
+  }
+  return NULL;
+}
+
+bool NetworkSocketBudget::enqueue(Lease* lease) {
+  if (_queueCount >= NETWORKHUB_SOCKET_QUEUE_SIZE) {
+    return false;
+  }
+  
+  _queue[_queueCount++] = lease;
+  lease->queued = true;
+  _waitedCount++;
+  return true;
+}
+
+void NetworkSocketBudget::dequeue(Lease* lease) {
+  if (!lease->queued) {
+    return;
+  }
+  
+  lease->queued = false;
+  for (uint8_t x = 0; x < _queueCount; x++) {
+    if (_queue[x] == lease) {
+      for (uint8_t y = x + 1; y < _queueCount; y++) {
+        _queue[y - 1] = _queue[y];
+      }
+      _queueCount--;
+      return;
+    }
+  }
+}
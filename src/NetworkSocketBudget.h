@@ -0,0 +1,144 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef NETWORKSOCKETBUDGET_H
+#define NETWORKSOCKETBUDGET_H
+
+#include <Arduino.h>
+
+#include "NetworkDecorator.h"
+#include "NetworkHub.h"
+
+// Number of clients a NetworkSocketBudget can keep track of at once,
+// connected or not. Copies of a client share one.
+#ifndef NETWORKHUB_SOCKET_BUDGET_CLIENTS
+#define NETWORKHUB_SOCKET_BUDGET_CLIENTS 16
+#endif
+
+// Number of connects that can wait for a socket.
+#ifndef NETWORKHUB_SOCKET_QUEUE_SIZE
+#define NETWORKHUB_SOCKET_QUEUE_SIZE 8
+#endif
+
+// Keeps count of the sockets the clients, servers and UDPs of a
+// DecoratedNetworkHub hold, against the limits of the hardware,
+// instead of finding out about the limit from an odd failure deep
+// in the backend. The limits start as the ones the hub reports (see
+// NetworkHub.getSocketLimit()), 0 being no limit.
+//
+// A client holds a socket from the start of its connect until
+// stop(), a server from begin() until it is deleted, and a UDP from
+// begin() until stop(). Sockets can be reserved for critical users,
+// which get their clients, servers and UDPs from getCriticalClient()
+// and the like. When no socket is free a non-critical connectStart()
+// to an IP address waits in a queue, in order, as
+// NETWORK_CONNECT_IN_PROGRESS, until the connect times out. Anything
+// else is refused, and counted, connect() included: nothing frees a
+// socket while it waits, so it would only wait out its timeout.
+//
+//   DecoratedNetworkHub networkHub(&wifiHub);
+//   NetworkSocketBudget budget;
+//   networkHub.addDecorator(&budget);
+//   budget.setReserved(NETWORK_SOCKET_CLIENT, 1);
+//   NetworkClient control = budget.getCriticalClient();
+//   ...
+//   budget.printStatus(&Serial);  // in use, high water, refused
+//
+// Clients accepted by a server hold their socket while the
+// application holds a copy of the client, and are never refused,
+// the connection being there already. They don't count as critical,
+// so they never take a socket reserved for critical users.
+//
+class NetworkSocketBudget : public NetworkDecorator {
+  public:
+    NetworkSocketBudget() { /* Nothing to see here, move along. */ };
+    
+    // Limits, 0 for no limit. These are set from the hub when the
+    // budget is added to it, so change them afterwards.
+    void setLimit(uint8_t type, uint8_t limit) { _limits[type] = limit; };
+    void setTotalLimit(uint8_t limit) { _totalLimit = limit; };
+    uint8_t getLimit(uint8_t type) { return _limits[type]; };
+    uint8_t getTotalLimit() { return _totalLimit; };
+    
+    // Keep sockets of a type, from its own limit and the total, for
+    // critical users only.
+    void setReserved(uint8_t type, uint8_t count) { _reserved[type] = count; };
+    
+    // Get sockets that may use the reserved ones.
+    NetworkClient getCriticalClient();
+    NetworkServer* getCriticalServer(uint32_t portNum);
+    NetworkUDP* getCriticalUDP();
+    
+    uint8_t getInUseCount(uint8_t type) { return _inUse[type]; };
+    uint8_t getHighWaterCount(uint8_t type) { return _highWater[type]; };
+    uint32_t getRefusedCount(uint8_t type) { return _refused[type]; };
+    uint8_t getTotalInUseCount() { return _totalInUse; };
+    uint8_t getTotalHighWaterCount() { return _totalHighWater; };
+    // Connects waiting for a socket now, and that have waited.
+    uint8_t getQueuedCount() { return _queueCount; };
+    uint32_t getWaitedCount() { return _waitedCount; };
+    void printStatus(Print* printer);
+    
+    // NetworkDecorator methods
+    void attach(NetworkHub* networkHub);
+    NetworkClientWrapper* decorateClient(NetworkClient& client, uint16_t localPort);
+    NetworkUDPWrapper* decorateUDP(NetworkUDP* udp);
+    NetworkServerWrapper* decorateServer(NetworkServer* server, uint16_t portNum);
+    
+  protected:
+    friend class BudgetClientWrapper;
+    friend class BudgetServerWrapper;
+    friend class BudgetUDPWrapper;
+    
+    // Shared by a client and its copies
+    struct Lease {
+      uint8_t references = 0;
+      bool critical = false;
+      bool accepted = false;
+      bool held = false;
+      bool queued = false;
+      // Where a queued connect goes, or an accepted client came from
+      IPAddress ip;
+      uint16_t port = 0;
+    };
+    
+    NetworkHub* _networkHub = NULL;
+    bool _nextCritical = false;
+    
+    uint8_t _limits[NETWORK_SOCKET_TYPE_COUNT] = { 0 };
+    uint8_t _reserved[NETWORK_SOCKET_TYPE_COUNT] = { 0 };
+    uint8_t _totalLimit = 0;
+    
+    uint8_t _inUse[NETWORK_SOCKET_TYPE_COUNT] = { 0 };
+    uint8_t _criticalInUse[NETWORK_SOCKET_TYPE_COUNT] = { 0 };
+    uint8_t _highWater[NETWORK_SOCKET_TYPE_COUNT] = { 0 };
+    uint32_t _refused[NETWORK_SOCKET_TYPE_COUNT] = { 0 };
+    uint8_t _totalInUse = 0;
+    uint8_t _totalHighWater = 0;
+    
+    Lease _leases[NETWORKHUB_SOCKET_BUDGET_CLIENTS];
+    
+    // Queued leases, oldest first
+    Lease* _queue[NETWORKHUB_SOCKET_QUEUE_SIZE];
+    uint8_t _queueCount = 0;
+    uint32_t _waitedCount = 0;
+    
+    // Take a socket if the limits allow, or always when forced.
+    bool acquire(uint8_t type, bool critical, bool force = false);
+    void release(uint8_t type, bool critical);
+    // Reserved sockets of the type not yet taken by critical users
+    uint8_t getOwedCount(uint8_t type);
+    
+    // Take a socket for a client's connect, unless others are
+    // queued ahead of it.
+    bool acquireClient(Lease* lease);
+    // Give back the client's socket, and its place in the queue.
+    void releaseClient(Lease* lease);
+    Lease* newLease(bool critical);
+    bool enqueue(Lease* lease);
+    void dequeue(Lease* lease);
+};
+
+#endif // NETWORKSOCKETBUDGET_H
@@ -0,0 +1,32 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+// Local includes
+#include "NetworkStagingBuffer.h"
+
+uint8_t NetworkStagingBuffer::_buffer[NETWORKHUB_STAGING_BUFFER_SIZE];
+const void* NetworkStagingBuffer::_owner = NULL;
+size_t NetworkStagingBuffer::_reservedSize = 0;
+
+uint8_t* NetworkStagingBuffer::reserve(const void* owner, size_t size) {
+  if (size > sizeof(_buffer) || (_owner != NULL && _owner != owner)) {
+    return NULL;
+  }
+  _owner = owner;
+  _reservedSize = size;
+  return _buffer;
+}
+
+bool NetworkStagingBuffer::holds(const void* owner, size_t size) {
+  return owner != NULL && _owner == owner && size <= _reservedSize;
+}
+
+const uint8_t* NetworkStagingBuffer::release(const void* owner, size_t used) {
+  if (owner == NULL || _owner != owner) {
+    return NULL;
+  }
+  _owner = NULL;
+  return used <= _reservedSize ? _buffer : NULL;
+}
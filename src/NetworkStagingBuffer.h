@@ -0,0 +1,56 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef NETWORKSTAGINGBUFFER_H
+#define NETWORKSTAGINGBUFFER_H
+
+#include <Arduino.h>
+
+// Size of the buffer reserve() hands out where the backend can't
+// hand out its own. Larger reservations fail, and the caller falls
+// back to write(). The default is the largest UDP payload that fits
+// an ethernet frame.
+#ifndef NETWORKHUB_STAGING_BUFFER_SIZE
+#define NETWORKHUB_STAGING_BUFFER_SIZE 1472
+#endif
+
+// The buffer behind reserve() and commit() on NetworkClient and
+// NetworkUDP, for backends without a transmit buffer of their own to
+// hand out. There is only one, shared by every client and UDP, and
+// it belongs to one of them from reserve() until it is released, so
+// hold it only while building a packet: until it is released every
+// other reserve() returns NULL. It is released by commit(), and by
+// a client's stop(), connect or destruction, or a UDP's stop(),
+// beginPacket() or destruction, so a reservation that is never
+// committed doesn't keep it.
+//
+// None of the backends is zero-copy. On QNEthernet a UDP packet
+// committed whole is sent straight from this buffer into an lwIP
+// pbuf, saving the copy through EthernetUDP's packet buffer. Every
+// other UDP, and every client, writes it out on commit() as write()
+// would, so reserve() saves nothing over a buffer of your own.
+//
+class NetworkStagingBuffer {
+  public:
+    // Returns room for size bytes, or NULL if they don't fit or the
+    // buffer belongs to another owner. Reserving again replaces the
+    // owner's earlier reservation.
+    static uint8_t* reserve(const void* owner, size_t size);
+    // Returns true if owner holds a reservation of at least size.
+    static bool holds(const void* owner, size_t size);
+    // Free the buffer and return it, or NULL if owner doesn't hold
+    // it or used is larger than the reservation. The bytes stay put
+    // until the next reserve(), so they can still be written out.
+    static const uint8_t* release(const void* owner, size_t used = 0);
+    
+  private:
+    static uint8_t _buffer[NETWORKHUB_STAGING_BUFFER_SIZE];
+    static const void* _owner;
+    static size_t _reservedSize;
+    
+    NetworkStagingBuffer() {};
+};
+
+#endif // NETWORKSTAGINGBUFFER_H
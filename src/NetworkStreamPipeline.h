@@ -0,0 +1,306 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef NETWORKSTREAMPIPELINE_H
+#define NETWORKSTREAMPIPELINE_H
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#include "NetworkClient.h"
+#else
+// Host builds, for testing the pipeline against plain files
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#endif
+
+// Moves len bytes from a source (an SD card File, any Stream) to a
+// sink (a NetworkClient) through BUFFER_COUNT buffers. Each step()
+// reads the source into a free buffer while earlier buffers are
+// still waiting on the network, and writes only as much as the
+// sink's send window takes, so the source is never left idle
+// waiting on the network or the other way around.
+//
+// The buffers live in the object, so give it static storage when
+// they are large:
+//
+//   NetworkStreamPipeline<File, NetworkClient, 4096, 2> pipeline;
+//   pipeline.begin(file, client, file.size());
+//   while (pipeline.step()) {}
+//
+// Source needs read(uint8_t* buf, size_t len), or be a Stream (which
+// is read with readBytes()). Sink needs availableForWrite(),
+// write(const uint8_t* buf, size_t len) and connected().
+//
+template <class Source, class Sink, size_t BUFFER_SIZE = 2048, uint8_t BUFFER_COUNT = 2>
+class NetworkStreamPipeline {
+  public:
+    static_assert(BUFFER_COUNT >= 2, "The pipeline needs at least two buffers");
+    
+    // Start sending. timeoutMs ends the transfer if no progress is
+    // made for that long, zero waits as long as the sink is connected.
+    // It is timed with micros(), so it is at most 4294967 (71 minutes).
+    void begin(Source& source, Sink& sink, size_t len, uint32_t timeoutMs = 0) {
+      _source = &source;
+      _sink = &sink;
+      _length = len;
+      _timeoutMs = timeoutMs;
+      
+      _bytesRead = 0;
+      _bytesSent = 0;
+      _sourceDone = false;
+      _timedOut = false;
+      _readMicros = 0;
+      _writeMicros = 0;
+      _networkStallCount = 0;
+      _sourceStallCount = 0;
+      
+      for (uint8_t x = 0; x < BUFFER_COUNT; x++) {
+        _fill[x] = 0;
+      }
+      _readIndex = 0;
+      _writeIndex = 0;
+      _writeOffset = 0;
+      _filledCount = 0;
+      
+      _startMicros = now();
+      _lastProgressMicros = _startMicros;
+      _endMicros = _startMicros;
+      _running = len > 0;
+    };
+    
+    // Do one read and one write if they can be done without waiting.
+    // Returns true while the transfer is still going.
+    bool step() {
+      if (!_running) {
+        return false;
+      }
+      
+      bool progress = readStep();
+      progress |= writeStep();
+      
+      uint32_t stepMicros = now();
+      if (progress) {
+        _lastProgressMicros = stepMicros;
+      } else if (_timeoutMs > 0 && (stepMicros - _lastProgressMicros) / 1000 >= _timeoutMs) {
+        _timedOut = true;
+      }
+      
+      bool drained = _sourceDone && _filledCount == 0;
+      if (_bytesSent >= _length || drained || _timedOut || !_sink->connected()) {
+        _running = false;
+        _endMicros = stepMicros;
+      }
+      return _running;
+    };
+    
+    // Run the whole transfer. Returns the number of bytes sent.
+    size_t send(Source& source, Sink& sink, size_t len, uint32_t timeoutMs = 0) {
+      begin(source, sink, len, timeoutMs);
+      while (step()) {
+#if defined(ARDUINO)
+        yield();
+#endif
+      }
+      return _bytesSent;
+    };
+    
+    bool isRunning() { return _running; };
+    // True if the whole length was sent.
+    bool isComplete() { return _bytesSent >= _length; };
+    bool hasTimedOut() { return _timedOut; };
+    
+    size_t getBytesSent() { return _bytesSent; };
+    uint32_t getElapsedMicros() { return (_running ? now() : _endMicros) - _startMicros; };
+    // Bytes per second over the transfer so far.
+    uint32_t getThroughput() {
+      uint32_t elapsed = getElapsedMicros();
+      return elapsed > 0 ? (uint32_t)((uint64_t)_bytesSent * 1000000 / elapsed) : 0;
+    };
+    // Time spent inside the source's read and the sink's write.
+    uint32_t getReadMicros() { return _readMicros; };
+    uint32_t getWriteMicros() { return _writeMicros; };
+    // Steps where every buffer was full and the sink's window was
+    // shut, ie the network was the bottleneck.
+    uint32_t getNetworkStallCount() { return _networkStallCount; };
+    // Steps where the sink could take data but no buffer was full,
+    // ie the source was the bottleneck.
+    uint32_t getSourceStallCount() { return _sourceStallCount; };
+
+#if defined(ARDUINO)
+    void printStats(Print* printer) {
+      printer->print("Sent ");
+      printer->print(_bytesSent);
+      printer->print(" of ");
+      printer->print(_length);
+      printer->print(" bytes in ");
+      printer->print(getElapsedMicros());
+      printer->print(" us, ");
+      printer->print(getThroughput());
+      printer->println(" bytes/second");
+      printer->print("Read ");
+      printer->print(_readMicros);
+      printer->print(" us, write ");
+      printer->print(_writeMicros);
+      printer->print(" us, network stalls ");
+      printer->print(_networkStallCount);
+      printer->print(", source stalls ");
+      printer->println(_sourceStallCount);
+    };
+#endif
+
+  protected:
+    uint8_t _buffers[BUFFER_COUNT][BUFFER_SIZE];
+    size_t _fill[BUFFER_COUNT];
+    uint8_t _readIndex;     // next buffer to fill
+    uint8_t _writeIndex;    // buffer being sent
+    size_t _writeOffset;    // bytes of it already sent
+    uint8_t _filledCount;
+    
+    Source* _source = NULL;
+    Sink* _sink = NULL;
+    size_t _length = 0;
+    size_t _bytesRead = 0;
+    size_t _bytesSent = 0;
+    bool _sourceDone = false;
+    bool _running = false;
+    bool _timedOut = false;
+    uint32_t _timeoutMs = 0;
+    
+    uint32_t _startMicros = 0;
+    uint32_t _endMicros = 0;
+    uint32_t _lastProgressMicros = 0;
+    uint32_t _readMicros = 0;
+    uint32_t _writeMicros = 0;
+    uint32_t _networkStallCount = 0;
+    uint32_t _sourceStallCount = 0;
+    
+    // Fill the next free buffer
+    bool readStep() {
+      if (_sourceDone || _filledCount >= BUFFER_COUNT) {
+        return false;
+      }
+      
+      size_t want = _length - _bytesRead;
+      if (want > BUFFER_SIZE) {
+        want = BUFFER_SIZE;
+      }
+      
+      uint32_t startMicros = now();
+      size_t got = readSource(*_source, _buffers[_readIndex], want);
+      _readMicros += now() - startMicros;
+      
+      if (got == 0) {
+        // The source ended early, send what we have
+        _sourceDone = true;
+        return false;
+      }
+      
+      _fill[_readIndex] = got;
+      _readIndex = (_readIndex + 1) % BUFFER_COUNT;
+      _filledCount++;
+      _bytesRead += got;
+      _sourceDone = _bytesRead >= _length;
+      return true;
+    };
+    
+    // Send what the window allows from the oldest full buffer
+    bool writeStep() {
+      int window = _sink->availableForWrite();
+      if (_filledCount == 0) {
+        if (window > 0) {
+          _sourceStallCount++;
+        }
+        return false;
+      }
+      if (window <= 0) {
+        if (_filledCount >= BUFFER_COUNT) {
+          _networkStallCount++;
+        }
+        return false;
+      }
+      
+      size_t left = _fill[_writeIndex] - _writeOffset;
+      size_t size = left < (size_t)window ? left : (size_t)window;
+      
+      uint32_t startMicros = now();
+      size_t sent = _sink->write(_buffers[_writeIndex] + _writeOffset, size);
+      _writeMicros += now() - startMicros;
+      
+      _bytesSent += sent;
+      _writeOffset += sent;
+      if (_writeOffset >= _fill[_writeIndex]) {
+        _writeIndex = (_writeIndex + 1) % BUFFER_COUNT;
+        _writeOffset = 0;
+        _filledCount--;
+      }
+      return sent > 0;
+    };
+
+#if defined(ARDUINO)
+    static size_t readSource(Stream& source, uint8_t* buf, size_t len) {
+      return source.readBytes((char*)buf, len);
+    };
+#endif
+    
+    // Preferred for sources with a block read, like File
+    template <class S>
+    static auto readSource(S& source, uint8_t* buf, size_t len) -> decltype(source.read(buf, len), size_t()) {
+      int got = source.read(buf, len);
+      return got > 0 ? got : 0;
+    };
+    
+    static uint32_t now() {
+#if defined(ARDUINO)
+      return micros();
+#else
+      return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    };
+};
+
+#if defined(ARDUINO)
+
+// Send len bytes from the source to the client, through the default
+// pipeline. The pipeline's buffers are static, so this isn't
+// reentrant. Returns the number of bytes sent.
+template <class Source>
+size_t sendStream(NetworkClient& client, Source& source, size_t len, uint32_t timeoutMs = 0) {
+  static NetworkStreamPipeline<Source, NetworkClient> pipeline;
+  return pipeline.send(source, client, len, timeoutMs);
+}
+
+#else
+
+// A plain file as a pipeline source, for host builds.
+class NetworkFileSource {
+  public:
+    NetworkFileSource(FILE* file) { _file = file; };
+    int read(uint8_t* buf, size_t len) { return (int)fread(buf, 1, len, _file); };
+    
+  protected:
+    FILE* _file;
+};
+
+// A plain file as a pipeline sink, for host builds. The window can
+// be limited to simulate a slow network.
+class NetworkFileSink {
+  public:
+    NetworkFileSink(FILE* file, int window = 1460) { _file = file; _window = window; };
+    int availableForWrite() { return _window; };
+    size_t write(const uint8_t* buf, size_t len) { return fwrite(buf, 1, len, _file); };
+    bool connected() { return _file != NULL; };
+    
+  protected:
+    FILE* _file;
+    int _window;
+};
+
+#endif
+
+#endif // NETWORKSTREAMPIPELINE_H
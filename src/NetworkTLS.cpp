@@ -0,0 +1,107 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+// Local includes
+#include "NetworkTLS.h"
+
+#if defined(NETWORKHUB_STATIC_ALLOC)
+static_assert(sizeof(NetworkTLSClientWrapper) <= NETWORKHUB_CLIENT_WRAPPER_SIZE, "Increase NETWORKHUB_CLIENT_WRAPPER_SIZE");
+#endif
+
+NetworkTLSClientWrapper* NetworkTLSClientWrapper::create(NetworkClientWrapper* transport, NetworkTLSProvider* provider) {
+#if defined(NETWORKHUB_STATIC_ALLOC)
+  static_assert(sizeof(Shared) <= NETWORKHUB_TLS_SHARED_SIZE, "Increase NETWORKHUB_TLS_SHARED_SIZE");
+#endif
+  
+  // With NETWORKHUB_STATIC_ALLOC both come from pools, and new
+  // returns NULL once one is full
+  Shared* shared = new Shared();
+  if (shared == NULL) {
+    return NULL;
+  }
+  shared->transport = transport;
+  shared->provider = provider;
+  shared->session = NULL;
+  shared->secure = false;
+  shared->refCount = 0;
+  
+  NetworkTLSClientWrapper* clientWrapper = new NetworkTLSClientWrapper(shared);
+  if (clientWrapper == NULL) {
+    delete shared;
+  }
+  return clientWrapper;
+}
+
+NetworkTLSClientWrapper::NetworkTLSClientWrapper(Shared* shared) {
+  _shared = shared;
+  _shared->refCount++;
+}
+
+NetworkTLSClientWrapper::~NetworkTLSClientWrapper() {
+  if (--_shared->refCount > 0) {
+    return;
+  }
+  
+  if (_shared->session != NULL) {
+    _shared->provider->releaseSession(_shared->session);
+  }
+  delete _shared->transport;
+  delete _shared;
+}
+
+NetworkClientWrapper* NetworkTLSClientWrapper::clone() {
+  return new NetworkTLSClientWrapper(_shared);
+}
+
+int NetworkTLSClientWrapper::connect(IPAddress ip, uint16_t port) {
+  _shared->secure = false;
+  return _shared->transport->connect(ip, port);
+}
+
+int NetworkTLSClientWrapper::connect(const char *host, uint16_t port) {
+  _shared->secure = false;
+  return _shared->transport->connect(host, port);
+}
+
+int NetworkTLSClientWrapper::availableForWrite() {
+  int window = _shared->transport->availableForWrite();
+  if (!_shared->secure) {
+    return window;
+  }
+  return window > TLS_RECORD_OVERHEAD ? window - TLS_RECORD_OVERHEAD : 0;
+}
+
+int NetworkTLSClientWrapper::startConnect(IPAddress ip, uint16_t port) {
+  _shared->secure = false;
+  return _shared->transport->startConnect(ip, port);
+}
+
+int NetworkTLSClientWrapper::startConnect(const char *host, uint16_t port) {
+  _shared->secure = false;
+  return _shared->transport->startConnect(host, port);
+}
+
+int NetworkTLSClientWrapper::connectSecure(IPAddress ip, uint16_t port) {
+  if (!prepareSession()) {
+    return 0;
+  }
+  _shared->secure = true;
+  return _shared->session->connect(ip, port);
+}
+
+int NetworkTLSClientWrapper::connectSecure(const char *host, uint16_t port) {
+  if (!prepareSession()) {
+    return 0;
+  }
+  _shared->secure = true;
+  return _shared->session->connect(host, port);
+}
+
+bool NetworkTLSClientWrapper::prepareSession() {
+  if (_shared->session == NULL) {
+    _shared->session = _shared->provider->createSession(*_shared->transport);
+  }
+  return _shared->session != NULL;
+}
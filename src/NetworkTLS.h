@@ -0,0 +1,121 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef NETWORKTLS_H
+#define NETWORKTLS_H
+
+#include <Arduino.h>
+#include <Client.h>
+
+#include "NetworkClientWrapper.h"
+
+// Ways a hub can secure a client connection, as returned by
+// NetworkHub.getSecureConnectSupport().
+enum NetworkSecureSupport {
+  NETWORK_SECURE_UNSUPPORTED,
+  NETWORK_SECURE_OFFLOAD,   // TLS runs on the network coprocessor
+  NETWORK_SECURE_SOFTWARE   // TLS runs on the Teensy, see NetworkTLSProvider
+};
+
+// Plugs a software TLS stack (SSLClient, for instance) into the
+// hub for backends that can't offload TLS. Most of these stacks
+// are a Client that takes the transport Client in its
+// constructor, so an implementation is usually just:
+//
+//   Client* createSession(Client& transport) {
+//     return new SSLClient(transport, TAs, TAs_NUM, A7);
+//   };
+//   void releaseSession(Client* session) { delete session; };
+//
+class NetworkTLSProvider {
+  public:
+    virtual ~NetworkTLSProvider(){};
+    
+    // Create a TLS session that runs over the given transport.
+    // Its connect() methods must perform the handshake. Returns
+    // NULL if a session can't be created.
+    virtual Client* createSession(Client& transport) = 0;
+    
+    // Release a session returned by createSession().
+    virtual void releaseSession(Client* session) = 0;
+};
+
+// NetworkClientWrapper that runs a NetworkTLSProvider session over
+// another wrapper. connect() and the non-blocking connect still
+// make a plain connection on the transport; connectSecure() goes
+// through the TLS session. Clones share the transport and the
+// session, the same way the backend clients share a socket.
+//
+class NetworkTLSClientWrapper : public NetworkClientWrapper {
+  public:
+    // Returns NULL if the wrapper can't be allocated, in which case
+    // the caller still owns the transport.
+    static NetworkTLSClientWrapper* create(NetworkClientWrapper* transport, NetworkTLSProvider* provider);
+    
+    ~NetworkTLSClientWrapper();
+    
+    int connect(IPAddress ip, uint16_t port);
+    int connect(const char *host, uint16_t port);
+    size_t write(uint8_t b) { return active()->write(b); };
+    size_t write(const uint8_t *buf, size_t size) { return active()->write(buf, size); };
+    int available() { return active()->available(); };
+    int read() { return active()->read(); };
+    int read(uint8_t *buf, size_t size) { return active()->read(buf, size); };
+    int peek() { return active()->peek(); };
+    void flush() { active()->flush(); };
+    void stop() { active()->stop(); };
+    uint8_t connected() { return active()->connected(); };
+    operator bool() { return *active() ? true : false; };
+    IPAddress remoteIP() { return _shared->transport->remoteIP(); };
+    uint16_t remotePort() { return _shared->transport->remotePort(); };
+    // The session buffers a record at a time, so this is the
+    // transport's window less the record overhead.
+    int availableForWrite();
+    
+    NetworkClientWrapper* clone();
+    
+    void setConnectionTimeout(uint32_t timeoutMs) { _shared->transport->setConnectionTimeout(timeoutMs); };
+    void setConnectWaits(bool waits) { _shared->transport->setConnectWaits(waits); };
+    bool hasNonBlockingConnect() { return _shared->transport->hasNonBlockingConnect(); };
+    bool hasNonBlockingWrite() { return _shared->transport->hasNonBlockingWrite(); };
+    int startConnect(IPAddress ip, uint16_t port);
+    int startConnect(const char *host, uint16_t port);
+    int pollConnect() { return _shared->transport->pollConnect(); };
+    
+    bool hasSecureConnect() { return true; };
+    int connectSecure(IPAddress ip, uint16_t port);
+    int connectSecure(const char *host, uint16_t port);
+    
+  private:
+    // Header, MAC and padding added to each TLS record
+    static const int TLS_RECORD_OVERHEAD = 64;
+    
+    struct Shared {
+      NetworkClientWrapper* transport;
+      NetworkTLSProvider* provider;
+      Client* session;
+      bool secure;
+      uint16_t refCount;
+
+#if defined(NETWORKHUB_STATIC_ALLOC)
+      static void* operator new(size_t size) noexcept { return NetworkAllocator::tlsShared.allocate(size); };
+      static void operator delete(void* shared) { NetworkAllocator::tlsShared.release(shared); };
+#endif
+    };
+    
+    NetworkTLSClientWrapper(Shared* shared);
+    
+    // The client currently carrying the data
+    Client* active() {
+      return _shared->secure ? _shared->session : (Client*)_shared->transport;
+    };
+    
+    // Returns false if there is no session and one can't be created
+    bool prepareSession();
+    
+    Shared* _shared;
+};
+
+#endif // NETWORKTLS_H
@@ -0,0 +1,79 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+// Local includes
+#include "NetworkTokenBucket.h"
+
+void NetworkTokenBucket::setRate(uint32_t bytesPerSecond, uint32_t burstBytes) {
+  if (burstBytes == 0) {
+    burstBytes = max(bytesPerSecond / 10, (uint32_t)1);
+  }
+  if (bytesPerSecond == _bytesPerSecond && burstBytes == _burstBytes) {
+    return;
+  }
+  
+  bool wasLimited = isLimited();
+  _bytesPerSecond = bytesPerSecond;
+  _burstBytes = burstBytes;
+  if (!wasLimited) {
+    // Start out full
+    _tokens = _burstBytes;
+    _lastMicros = micros();
+  } else if (_tokens > (int32_t)_burstBytes) {
+    _tokens = _burstBytes;
+  }
+}
+
+int32_t NetworkTokenBucket::available() {
+  if (!isLimited()) {
+    return INT32_MAX;
+  }
+  refill();
+  return _tokens;
+}
+
+size_t NetworkTokenBucket::take(size_t size) {
+  if (!isLimited()) {
+    return size;
+  }
+  refill();
+  size_t taken = _tokens > 0 ? min(size, (size_t)_tokens) : 0;
+  _tokens -= taken;
+  return taken;
+}
+
+void NetworkTokenBucket::consume(size_t size) {
+  if (!isLimited()) {
+    return;
+  }
+  refill();
+  _tokens -= min(size, (size_t)INT32_MAX);
+}
+
+uint32_t NetworkTokenBucket::microsUntil(size_t size) {
+  int32_t missing = (int32_t)min(size, (size_t)INT32_MAX) - available();
+  if (missing <= 0) {
+    return 0;
+  }
+  return ((uint64_t)missing * 1000000 + _bytesPerSecond - 1) / _bytesPerSecond;
+}
+
+void NetworkTokenBucket::refill() {
+  uint32_t now = micros();
+  uint64_t added = (uint64_t)(now - _lastMicros) * _bytesPerSecond / 1000000;
+  if (added == 0) {
+    // Let the time build up until it's worth a token
+    return;
+  }
+  
+  if ((int64_t)_tokens + (int64_t)added >= (int64_t)_burstBytes) {
+    _tokens = _burstBytes;
+    _lastMicros = now;
+  } else {
+    _tokens += added;
+    // Keep the part of a token that has built up
+    _lastMicros += added * 1000000 / _bytesPerSecond;
+  }
+}
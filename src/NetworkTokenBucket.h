@@ -0,0 +1,46 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef NETWORKTOKENBUCKET_H
+#define NETWORKTOKENBUCKET_H
+
+#include <Arduino.h>
+
+// A token bucket rate limiter: tokens (bytes) trickle in at a fixed
+// rate up to a burst size, and traffic may only be sent while there
+// are tokens to pay for it. It never waits; take() hands out what is
+// there and consume() may run the bucket into debt, to be paid off
+// before anything else is let through. A rate of 0 means unlimited.
+//
+class NetworkTokenBucket {
+  public:
+    NetworkTokenBucket(uint32_t bytesPerSecond = 0, uint32_t burstBytes = 0) { setRate(bytesPerSecond, burstBytes); };
+    
+    // Change the rate, and the most tokens that can be saved up. A
+    // burst of 0 is a tenth of a second's worth.
+    void setRate(uint32_t bytesPerSecond, uint32_t burstBytes = 0);
+    uint32_t getRate() { return _bytesPerSecond; };
+    uint32_t getBurst() { return _burstBytes; };
+    bool isLimited() { return _bytesPerSecond > 0; };
+    
+    // Tokens on hand now, negative while in debt.
+    int32_t available();
+    // Take up to size tokens, returning how many were taken.
+    size_t take(size_t size);
+    // Take size tokens whether they are there or not.
+    void consume(size_t size);
+    // Microseconds until size tokens will be on hand.
+    uint32_t microsUntil(size_t size);
+    
+  private:
+    uint32_t _bytesPerSecond = 0;
+    uint32_t _burstBytes = 0;
+    int32_t _tokens = 0;
+    uint32_t _lastMicros = 0;
+    
+    void refill();
+};
+
+#endif // NETWORKTOKENBUCKET_H
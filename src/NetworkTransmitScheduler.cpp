@@ -0,0 +1,248 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+// Local includes
+#include "NetworkTransmitScheduler.h"
+
+NetworkTransmitFlow::~NetworkTransmitFlow() {
+  if (_scheduler != NULL) {
+    _scheduler->remove(this);
+  }
+}
+
+bool NetworkTransmitFlow::write(const uint8_t* buf, size_t size) {
+  if (_client == NULL || size > _capacity - _count) {
+    _refusedCount++;
+    return false;
+  }
+  
+  if (_count == 0) {
+    _busySinceMicros = micros();
+  }
+  enqueue(buf, size);
+  return true;
+}
+
+bool NetworkTransmitFlow::send(IPAddress ip, uint16_t port, const uint8_t* buf, size_t size) {
+  if (_udp == NULL || size > 0xFFFF || DATAGRAM_HEADER_SIZE + size > _capacity - _count) {
+    _refusedCount++;
+    return false;
+  }
+  
+  if (_count == 0) {
+    _busySinceMicros = micros();
+  }
+  uint8_t header[DATAGRAM_HEADER_SIZE];
+  header[0] = size;
+  header[1] = size >> 8;
+  for (uint8_t x = 0; x < 4; x++) {
+    header[2 + x] = ip[x];
+  }
+  header[6] = port;
+  header[7] = port >> 8;
+  enqueue(header, sizeof(header));
+  enqueue(buf, size);
+  return true;
+}
+
+void NetworkTransmitFlow::enqueue(const uint8_t* data, size_t size) {
+  size_t tail = (_head + _count) % _capacity;
+  size_t first = min(size, _capacity - tail);
+  memcpy(_buffer + tail, data, first);
+  memcpy(_buffer, data + first, size - first);
+  _count += size;
+}
+
+void NetworkTransmitFlow::copyOut(size_t offset, uint8_t* data, size_t size) {
+  size_t position = (_head + offset) % _capacity;
+  size_t first = min(size, _capacity - position);
+  memcpy(data, _buffer + position, first);
+  memcpy(data + first, _buffer, size - first);
+}
+
+void NetworkTransmitFlow::dequeue(size_t size) {
+  _head = (_head + size) % _capacity;
+  _count -= size;
+  if (_count == 0) {
+    _head = 0;
+    _maxDrainMicros = max(_maxDrainMicros, (uint32_t)(micros() - _busySinceMicros));
+  }
+}
+
+int32_t NetworkTransmitFlow::transmit(size_t allowance) {
+  if (_client != NULL) {
+    size_t size = min(min(_count, _capacity - _head), allowance);
+    if (size == 0) {
+      return 0;
+    }
+    size_t written = _client->tryWrite(_buffer + _head, size);
+    if (written == 0) {
+      return -1;
+    }
+    dequeue(written);
+    _sentBytes += written;
+    return written;
+  }
+  
+  uint8_t header[DATAGRAM_HEADER_SIZE];
+  copyOut(0, header, sizeof(header));
+  size_t size = header[0] | (header[1] << 8);
+  if (size > allowance) {
+    return 0;
+  }
+  
+  IPAddress ip(header[2], header[3], header[4], header[5]);
+  uint16_t port = header[6] | (header[7] << 8);
+  if (_udp->beginPacket(ip, port) != 1) {
+    return -1;
+  }
+  // The datagram may wrap around the end of the queue
+  size_t position = (_head + DATAGRAM_HEADER_SIZE) % _capacity;
+  size_t first = min(size, _capacity - position);
+  _udp->write(_buffer + position, first);
+  _udp->write(_buffer, size - first);
+  bool sent = _udp->endPacket() == 1;
+  
+  // A datagram that failed is dropped rather than tried again, so
+  // one the UDP can never send doesn't hold up the flow
+  dequeue(DATAGRAM_HEADER_SIZE + size);
+  if (!sent) {
+    _failedCount++;
+    return -1;
+  }
+  _sentBytes += size;
+  return size;
+}
+
+bool NetworkTransmitScheduler::add(NetworkTransmitFlow* flow, uint8_t priority, uint8_t weight) {
+  if (flow == NULL || flow->_scheduler != NULL) {
+    return false;
+  }
+  
+  flow->_priority = min(priority, (uint8_t)(NETWORK_PRIORITY_COUNT - 1));
+  flow->_weight = max(weight, (uint8_t)1);
+  flow->_deficit = 0;
+  flow->_scheduler = this;
+  flow->_next = _flows[flow->_priority];
+  _flows[flow->_priority] = flow;
+  return true;
+}
+
+void NetworkTransmitScheduler::remove(NetworkTransmitFlow* flow) {
+  if (flow == NULL || flow->_scheduler != this) {
+    return;
+  }
+  
+  NetworkTransmitFlow** link = &_flows[flow->_priority];
+  while (*link != NULL && *link != flow) {
+    link = &(*link)->_next;
+  }
+  if (*link == NULL) {
+    return;
+  }
+  *link = flow->_next;
+  if (_resume[flow->_priority] == flow) {
+    _resume[flow->_priority] = NULL;
+    _inTurn[flow->_priority] = false;
+  }
+  flow->_scheduler = NULL;
+  flow->_next = NULL;
+}
+
+bool NetworkTransmitScheduler::service() {
+  uint32_t startMicros = micros();
+  
+  for (uint8_t priority = 0; priority < NETWORK_PRIORITY_COUNT; priority++) {
+    if (_flows[priority] == NULL) {
+      continue;
+    }
+    
+    // Deficit round robin: each round every flow with data may send
+    // its weight in quanta, and saves what it doesn't use toward a
+    // datagram too large for one round. Rounds go on until the
+    // priority is empty or its sockets won't take any more.
+    bool sending = true;
+    while (sending) {
+      sending = false;
+      NetworkTransmitFlow* first = _resume[priority] != NULL ? _resume[priority] : _flows[priority];
+      NetworkTransmitFlow* flow = first;
+      do {
+        NetworkTransmitFlow* next = flow->_next != NULL ? flow->_next : _flows[priority];
+        if (!flow->isEmpty()) {
+          // A turn cut short by the budget carries on where it was
+          if (!_inTurn[priority]) {
+            flow->_deficit += flow->_weight * NETWORKHUB_TRANSMIT_QUANTUM;
+          }
+          _inTurn[priority] = false;
+          while (!flow->isEmpty()) {
+            int32_t sent = flow->transmit(flow->_deficit);
+            if (sent < 0) {
+              // A blocked flow doesn't save up for later
+              flow->_deficit = 0;
+              break;
+            }
+            if (sent == 0) {
+              // Another round will make up the difference
+              sending = true;
+              break;
+            }
+            flow->_deficit -= sent;
+            sending = true;
+            
+            // A write that may have waited (see hasNonBlockingWrite())
+            // uses up the rest of the budget, so there is one at most
+            bool outOfTime = _budgetMicros > 0 && micros() - startMicros >= _budgetMicros;
+            if (outOfTime || (_budgetMicros > 0 && flow->mayBlock())) {
+              _inTurn[priority] = !flow->isEmpty() && flow->_deficit > 0;
+              _resume[priority] = _inTurn[priority] ? flow : next;
+              if (outOfTime) {
+                _budgetOverrunCount++;
+              }
+              return false;
+            }
+          }
+        }
+        if (flow->isEmpty()) {
+          flow->_deficit = 0;
+        }
+        flow = next;
+      } while (flow != first);
+    }
+  }
+  
+  for (uint8_t priority = 0; priority < NETWORK_PRIORITY_COUNT; priority++) {
+    if (getQueuedCount(priority) > 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t NetworkTransmitScheduler::getQueuedCount(uint8_t priority) {
+  size_t count = 0;
+  for (NetworkTransmitFlow* flow = _flows[priority]; flow != NULL; flow = flow->_next) {
+    count += flow->getQueuedCount();
+  }
+  return count;
+}
+
+uint8_t NetworkTransmitScheduler::getFlowCount(uint8_t priority) {
+  uint8_t count = 0;
+  for (NetworkTransmitFlow* flow = _flows[priority]; flow != NULL; flow = flow->_next) {
+    count++;
+  }
+  return count;
+}
+
+void NetworkTransmitScheduler::printStatus(Print* printer) {
+  printer->print("Transmit queued:");
+  for (uint8_t priority = 0; priority < NETWORK_PRIORITY_COUNT; priority++) {
+    printer->print(" ");
+    printer->print(getQueuedCount(priority));
+  }
+  printer->print(" bytes by priority, ");
+  printer->print(_budgetOverrunCount);
+  printer->println(" budget overruns");
+}
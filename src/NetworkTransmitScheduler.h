@@ -0,0 +1,174 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef NETWORKTRANSMITSCHEDULER_H
+#define NETWORKTRANSMITSCHEDULER_H
+
+#include <Arduino.h>
+
+#include "NetworkClient.h"
+#include "NetworkUDP.h"
+
+// Bytes a flow of weight 1 may send in each round of its priority.
+#ifndef NETWORKHUB_TRANSMIT_QUANTUM
+#define NETWORKHUB_TRANSMIT_QUANTUM 256
+#endif
+
+// Default time service() may spend sending, in microseconds.
+#ifndef NETWORKHUB_TRANSMIT_BUDGET_MICROS
+#define NETWORKHUB_TRANSMIT_BUDGET_MICROS 1000
+#endif
+
+// The priorities of transmit flows, most urgent first.
+enum NetworkTransmitPriority {
+  NETWORK_PRIORITY_CRITICAL,  // ie an emergency stop
+  NETWORK_PRIORITY_HIGH,      // commands and acknowledgements
+  NETWORK_PRIORITY_NORMAL,    // status and telemetry
+  NETWORK_PRIORITY_BULK,      // ie log uploads
+  NETWORK_PRIORITY_COUNT
+};
+
+class NetworkTransmitScheduler;
+
+// The outgoing data of one client or UDP, queued in storage
+// supplied by the caller until a NetworkTransmitScheduler sends it.
+// A write or datagram that doesn't fit is refused whole.
+//
+//   uint8_t stopBuffer[256];
+//   NetworkTransmitFlow stopFlow(udp, stopBuffer, sizeof(stopBuffer));
+//   scheduler.add(&stopFlow, NETWORK_PRIORITY_CRITICAL);
+//   ...
+//   stopFlow.send(robotIP, 5000, stopMessage, sizeof(stopMessage));
+//
+class NetworkTransmitFlow {
+  public:
+    NetworkTransmitFlow(NetworkClient& client, uint8_t* buffer, size_t capacity) {
+      _client = &client;
+      _buffer = buffer;
+      _capacity = capacity;
+    };
+    
+    NetworkTransmitFlow(NetworkUDP* udp, uint8_t* buffer, size_t capacity) {
+      _udp = udp;
+      _buffer = buffer;
+      _capacity = capacity;
+    };
+    
+    ~NetworkTransmitFlow();
+    
+    // A copy would share the queue storage and scheduler links
+    NetworkTransmitFlow(const NetworkTransmitFlow&) = delete;
+    NetworkTransmitFlow& operator=(const NetworkTransmitFlow&) = delete;
+    
+    // Queue bytes for a client flow. Returns false, and takes none
+    // of them, if they don't fit.
+    bool write(const uint8_t* buf, size_t size);
+    // Queue a datagram for a UDP flow. Returns false if it doesn't
+    // fit.
+    bool send(IPAddress ip, uint16_t port, const uint8_t* buf, size_t size);
+    
+    // Throw away anything queued, ie after the client disconnects.
+    void clear() { _head = 0; _count = 0; };
+    
+    size_t getQueuedCount() { return _count; };
+    bool isEmpty() { return _count == 0; };
+    uint32_t getSentBytes() { return _sentBytes; };
+    // Writes and datagrams refused because the queue was full.
+    uint32_t getRefusedCount() { return _refusedCount; };
+    // Datagrams the UDP failed to send, which are dropped.
+    uint32_t getFailedCount() { return _failedCount; };
+    // Longest time the flow has taken to empty after data was
+    // queued, which is what its priority has to keep down.
+    uint32_t getMaxDrainMicros() { return _maxDrainMicros; };
+    
+  private:
+    friend class NetworkTransmitScheduler;
+    
+    // Ahead of each queued datagram: length, address and port
+    static const size_t DATAGRAM_HEADER_SIZE = 8;
+    
+    NetworkClient* _client = NULL;
+    NetworkUDP* _udp = NULL;
+    uint8_t* _buffer;
+    size_t _capacity;
+    size_t _head = 0;
+    size_t _count = 0;
+    
+    uint32_t _sentBytes = 0;
+    uint32_t _refusedCount = 0;
+    uint32_t _failedCount = 0;
+    uint32_t _busySinceMicros = 0;
+    uint32_t _maxDrainMicros = 0;
+    
+    // Kept by the scheduler
+    NetworkTransmitScheduler* _scheduler = NULL;
+    NetworkTransmitFlow* _next = NULL;
+    uint8_t _priority = 0;
+    uint8_t _weight = 1;
+    int32_t _deficit = 0;
+    
+    void enqueue(const uint8_t* data, size_t size);
+    void copyOut(size_t offset, uint8_t* data, size_t size);
+    void dequeue(size_t size);
+    // Send the next bytes or datagram if allowance covers them.
+    // Returns the bytes sent, 0 if the allowance is too small, or -1
+    // if the socket won't take them now.
+    int32_t transmit(size_t allowance);
+    bool mayBlock() { return _client != NULL && !_client->hasNonBlockingWrite(); };
+};
+
+// Sends the queued data of its flows in order of priority: nothing
+// from one priority goes out while a higher priority has data its
+// socket will take. Flows of the same priority share by deficit
+// round robin, in proportion to their weights. Each call to
+// service() stops after the time budget, so the top priority waits
+// at most one loop() and one send.
+//
+// The budget can only be kept where writes don't wait. A client
+// flow on a backend without a real send window (WiFiNINA, see
+// NetworkClient.hasNonBlockingWrite()) makes at most one write per
+// service(), but that write can still take far longer than the
+// budget.
+//
+// Give it to a hub with setTransmitScheduler() and call the hub's
+// service() from loop(), or call service() here directly.
+//
+class NetworkTransmitScheduler {
+  public:
+    NetworkTransmitScheduler() { /* Nothing to see here, move along. */ };
+    
+    // Add a flow at a NetworkTransmitPriority. A flow of weight 2
+    // gets twice the share of one of weight 1 at the same priority.
+    // Returns false if the flow is already scheduled.
+    bool add(NetworkTransmitFlow* flow, uint8_t priority, uint8_t weight = 1);
+    void remove(NetworkTransmitFlow* flow);
+    
+    // Time service() may spend sending, 0 for no limit. A send that
+    // has started is always finished, so it can run over by one.
+    void setTimeBudget(uint32_t budgetMicros) { _budgetMicros = budgetMicros; };
+    
+    // Send what the sockets will take. Returns true if nothing is
+    // left queued.
+    bool service();
+    
+    // Bytes queued at a priority.
+    size_t getQueuedCount(uint8_t priority);
+    // Flows scheduled at a priority.
+    uint8_t getFlowCount(uint8_t priority);
+    // Calls to service() that ran out of time with data to send.
+    uint32_t getBudgetOverrunCount() { return _budgetOverrunCount; };
+    void printStatus(Print* printer);
+    
+  protected:
+    NetworkTransmitFlow* _flows[NETWORK_PRIORITY_COUNT] = { NULL };
+    // Where the next round of each priority starts
+    NetworkTransmitFlow* _resume[NETWORK_PRIORITY_COUNT] = { NULL };
+    // Whether that flow was part way through its turn
+    bool _inTurn[NETWORK_PRIORITY_COUNT] = { false };
+    uint32_t _budgetMicros = NETWORKHUB_TRANSMIT_BUDGET_MICROS;
+    uint32_t _budgetOverrunCount = 0;
+};
+
+#endif // NETWORKTRANSMITSCHEDULER_H
@@ -7,6 +7,7 @@
 #define NETWORKUDP_H
 
 #include <Udp.h>
+#include "NetworkAllocator.h"
 #include "NetworkUDPWrapper.h"
 
 // A class that will send data via the UDP
@@ -23,16 +24,25 @@ class NetworkUDP : public UDP {
     // initialize, start listening on specified multicast IP address and port. Returns 1 if successful, 0 on failure
     uint8_t beginMulticast(IPAddress ip, uint16_t p) { return _udpWrapper->beginMulticast(ip, p); };
     // Finish with the UDP socket
-    void stop() { _udpWrapper->stop(); };
+    void stop() {
+      NetworkStagingBuffer::release(_udpWrapper);
+      _udpWrapper->stop();
+    };
 
     // Sending UDP packets
   
     // Start building up a packet to send to the remote host specific in ip and port
     // Returns 1 if successful, 0 if there was a problem with the supplied IP address or port
-    int beginPacket(IPAddress ip, uint16_t port) { return _udpWrapper->beginPacket(ip, port); };
+    int beginPacket(IPAddress ip, uint16_t port) {
+      NetworkStagingBuffer::release(_udpWrapper);
+      return _udpWrapper->beginPacket(ip, port);
+    };
     // Start building up a packet to send to the remote host specific in host and port
     // Returns 1 if successful, 0 if there was a problem resolving the hostname or port
-    int beginPacket(const char *host, uint16_t port) { return _udpWrapper->beginPacket(host, port); };
+    int beginPacket(const char *host, uint16_t port) {
+      NetworkStagingBuffer::release(_udpWrapper);
+      return _udpWrapper->beginPacket(host, port);
+    };
     // Finish off this packet and send it
     // Returns 1 if the packet was sent successfully, 0 if there was an error
     int endPacket() { return _udpWrapper->endPacket(); };
@@ -40,6 +50,15 @@ class NetworkUDP : public UDP {
     size_t write(uint8_t b) { return _udpWrapper->write(b); };
     // Write size bytes from buffer into the packet
     size_t write(const uint8_t *buffer, size_t size) { return _udpWrapper->write(buffer, size); };
+    // Return room for size bytes of the packet, to be written in
+    // place, or NULL if there is none; write() instead. commit() adds
+    // the first used bytes to the packet, returning the number added,
+    // and commit(0) abandons the reservation. On QNEthernet a packet
+    // committed whole goes from this room straight into the network
+    // stack, saving a copy of the payload; elsewhere commit() writes
+    // it as write() would (see NetworkStagingBuffer).
+    uint8_t* reserve(size_t size) { return _udpWrapper->reserve(size); };
+    size_t commit(size_t used) { return _udpWrapper->commit(used); };
 
     // Start processing the next available incoming packet
     // Returns the size of the packet in bytes, or 0 if no packets are available
@@ -67,6 +86,12 @@ class NetworkUDP : public UDP {
       delete _udpWrapper;
     };
     
+#if defined(NETWORKHUB_STATIC_ALLOC)
+    // UDPs come from a fixed pool, new returns NULL when it is full
+    static void* operator new(size_t size) noexcept { return NetworkAllocator::udps.allocate(size); };
+    static void operator delete(void* udp) { NetworkAllocator::udps.release(udp); };
+#endif
+
   protected:
     NetworkUDPWrapper* _udpWrapper;
       
@@ -7,6 +7,8 @@
 #define NETWORKUDPWRAPPER_H
 
 #include <Udp.h>
+#include "NetworkAllocator.h"
+#include "NetworkStagingBuffer.h"
 
 // This class defines a wrapper class for UDP
 // that can be implemented by subclasses to "wrap"
@@ -15,7 +17,7 @@
 //
 class NetworkUDPWrapper : public UDP {
   public:
-    virtual ~NetworkUDPWrapper(){};
+    virtual ~NetworkUDPWrapper(){ NetworkStagingBuffer::release(this); };
     // initialize, start listening on specified port. Returns 1 if successful, 0 if there are no sockets available to use
     virtual uint8_t begin(uint16_t p) = 0;
     // initialize, start listening on specified multicast IP address and port. Returns 1 if successful, 0 on failure
@@ -38,6 +40,15 @@ class NetworkUDPWrapper : public UDP {
     virtual size_t write(uint8_t b) = 0;
     // Write size bytes from buffer into the packet
     virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+    // Return room for size bytes of the packet, to be built in place
+    // and added by commit(). Backends that can hand out their own
+    // packet buffer override these; the defaults stage the bytes in
+    // the NetworkStagingBuffer and write() them on commit.
+    virtual uint8_t* reserve(size_t size) { return NetworkStagingBuffer::reserve(this, size); };
+    virtual size_t commit(size_t used) {
+      const uint8_t* staged = NetworkStagingBuffer::release(this, used);
+      return staged != NULL ? write(staged, used) : 0;
+    };
 
     // Start processing the next available incoming packet
     // Returns the size of the packet in bytes, or 0 if no packets are available
@@ -61,6 +72,12 @@ class NetworkUDPWrapper : public UDP {
     virtual IPAddress remoteIP() = 0;
     // Return the port of the host who sent the current incoming packet
     virtual uint16_t remotePort() = 0;
+
+#if defined(NETWORKHUB_STATIC_ALLOC)
+    // Wrappers come from a fixed pool, new returns NULL when it is full
+    static void* operator new(size_t size) noexcept { return NetworkAllocator::udpWrappers.allocate(size); };
+    static void operator delete(void* wrapper) { NetworkAllocator::udpWrappers.release(wrapper); };
+#endif
 };
 
 #endif // NETWORKUDPWRAPPER_H
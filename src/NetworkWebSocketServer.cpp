@@ -0,0 +1,548 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#include <stdio.h>
+#include <strings.h>
+
+// Local includes
+#include "NetworkWebSocketServer.h"
+#include "NetworkHTTP.h"
+
+// Appended to the client's key to make the accept key (RFC 6455 1.3)
+static const char WEBSOCKET_GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+static uint32_t rotateLeft(uint32_t value, uint8_t bits) {
+  return (value << bits) | (value >> (32 - bits));
+}
+
+// SHA-1 of a short message, only used for the handshake.
+static void sha1(const uint8_t* message, size_t length, uint8_t digest[20]) {
+  uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+  
+  // Padded to a whole number of 64 byte blocks
+  size_t paddedLength = ((length + 8) / 64 + 1) * 64;
+  for (size_t blockStart = 0; blockStart < paddedLength; blockStart += 64) {
+    uint32_t w[80];
+    for (uint8_t x = 0; x < 16; x++) {
+      w[x] = 0;
+      for (uint8_t y = 0; y < 4; y++) {
+        size_t index = blockStart + x * 4 + y;
+        uint8_t b;
+        if (index < length) {
+          b = message[index];
+        } else if (index == length) {
+          b = 0x80;
+        } else if (index >= paddedLength - 8) {
+          // Length of the message in bits, big endian
+          uint8_t shift = (paddedLength - 1 - index) * 8;
+          b = shift < 64 ? (uint8_t)(((uint64_t)length * 8) >> shift) : 0;
+        } else {
+          b = 0;
+        }
+        w[x] = (w[x] << 8) | b;
+      }
+    }
+    for (uint8_t x = 16; x < 80; x++) {
+      w[x] = rotateLeft(w[x - 3] ^ w[x - 8] ^ w[x - 14] ^ w[x - 16], 1);
+    }
+    
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (uint8_t x = 0; x < 80; x++) {
+      uint32_t f, k;
+      if (x < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5A827999;
+      } else if (x < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1;
+      } else if (x < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDC;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6;
+      }
+      uint32_t temp = rotateLeft(a, 5) + f + e + k + w[x];
+      e = d;
+      d = c;
+      c = rotateLeft(b, 30);
+      b = a;
+      a = temp;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+  
+  for (uint8_t x = 0; x < 20; x++) {
+    digest[x] = h[x / 4] >> (24 - (x % 4) * 8);
+  }
+}
+
+static void base64Encode(const uint8_t* data, size_t length, char* out) {
+  static const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  
+  for (size_t x = 0; x < length; x += 3) {
+    uint32_t group = (uint32_t)data[x] << 16;
+    if (x + 1 < length) {
+      group |= (uint32_t)data[x + 1] << 8;
+    }
+    if (x + 2 < length) {
+      group |= data[x + 2];
+    }
+    *out++ = ALPHABET[(group >> 18) & 0x3F];
+    *out++ = ALPHABET[(group >> 12) & 0x3F];
+    *out++ = x + 1 < length ? ALPHABET[(group >> 6) & 0x3F] : '=';
+    *out++ = x + 2 < length ? ALPHABET[group & 0x3F] : '=';
+  }
+  *out = '\0';
+}
+
+void NetworkWebSocketServer::begin(NetworkServer* server) {
+  _server = server;
+  _server->begin();
+}
+
+void NetworkWebSocketServer::poll() {
+  if (_server == NULL) {
+    return;
+  }
+  
+  NetworkClient client = _server->available();
+  if (client) {
+    accept(client);
+  }
+  
+  for (uint8_t x = 0; x < NETWORKHUB_WEBSOCKET_MAX_CLIENTS; x++) {
+    switch (_connections[x].state) {
+      case CONNECTION_HANDSHAKE:
+        readHandshake(x);
+        break;
+      
+      case CONNECTION_OPEN:
+        readFrames(x);
+        checkAlive(x);
+        break;
+      
+      default:
+        break;
+    }
+  }
+}
+
+bool NetworkWebSocketServer::sendBinary(uint8_t clientId, const uint8_t* payload, size_t length,
+    NetworkWebSocketOpcode opcode) {
+  if (!isConnected(clientId)) {
+    return false;
+  }
+  Connection& connection = _connections[clientId];
+  
+  // Frames are built here so the header and payload go in one write
+  static uint8_t frame[NETWORKHUB_WEBSOCKET_BUFFER_SIZE + 10];
+  
+  size_t headerLength = buildHeader(frame, opcode, length);
+  size_t frameLength = headerLength + length;
+  if (connection.client.availableForWrite() < (int)frameLength) {
+    _droppedCount++;
+    return false;
+  }
+  
+  size_t written;
+  if (frameLength <= sizeof(frame)) {
+    memcpy(frame + headerLength, payload, length);
+    written = connection.client.write(frame, frameLength);
+  } else {
+    written = connection.client.write(frame, headerLength);
+    if (written == headerLength) {
+      written += connection.client.write(payload, length);
+    }
+  }
+  
+  // Part of a frame on the wire breaks every frame after it
+  if (written != frameLength) {
+    _droppedCount++;
+    disconnect(clientId);
+    return false;
+  }
+  _messagesSent++;
+  return true;
+}
+
+uint8_t NetworkWebSocketServer::broadcastBinary(const uint8_t* payload, size_t length,
+    NetworkWebSocketOpcode opcode) {
+  uint8_t sentCount = 0;
+  for (uint8_t x = 0; x < NETWORKHUB_WEBSOCKET_MAX_CLIENTS; x++) {
+    if (_connections[x].state == CONNECTION_OPEN && sendBinary(x, payload, length, opcode)) {
+      sentCount++;
+    }
+  }
+  return sentCount;
+}
+
+void NetworkWebSocketServer::close(uint8_t clientId, uint16_t statusCode) {
+  if (!isConnected(clientId)) {
+    return;
+  }
+  
+  uint8_t status[2] = { (uint8_t)(statusCode >> 8), (uint8_t)statusCode };
+  writeFrame(_connections[clientId], WEBSOCKET_CLOSE, status, sizeof(status));
+  disconnect(clientId);
+}
+
+bool NetworkWebSocketServer::isConnected(uint8_t clientId) {
+  return clientId < NETWORKHUB_WEBSOCKET_MAX_CLIENTS && _connections[clientId].state == CONNECTION_OPEN;
+}
+
+uint8_t NetworkWebSocketServer::getClientCount() {
+  uint8_t count = 0;
+  for (uint8_t x = 0; x < NETWORKHUB_WEBSOCKET_MAX_CLIENTS; x++) {
+    if (_connections[x].state == CONNECTION_OPEN) {
+      count++;
+    }
+  }
+  return count;
+}
+
+void NetworkWebSocketServer::accept(NetworkClient& client) {
+  int8_t freeSlot = -1;
+  for (uint8_t x = 0; x < NETWORKHUB_WEBSOCKET_MAX_CLIENTS; x++) {
+    Connection& connection = _connections[x];
+    if (connection.state == CONNECTION_FREE) {
+      if (freeSlot < 0) {
+        freeSlot = x;
+      }
+    } else if (connection.client.remotePort() == client.remotePort()
+        && connection.client.remoteIP() == client.remoteIP()) {
+      // Already have it, the server returns clients with data waiting
+      return;
+    }
+  }
+  
+  if (freeSlot < 0) {
+    client.print("HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    client.stop();
+    return;
+  }
+  
+  Connection& connection = _connections[freeSlot];
+  connection.client = client;
+  connection.state = CONNECTION_HANDSHAKE;
+  connection.messageLength = 0;
+  connection.lastReceiveMillis = millis();
+}
+
+void NetworkWebSocketServer::readHandshake(uint8_t clientId) {
+  Connection& connection = _connections[clientId];
+  
+  // The request is collected in the receive buffer
+  char* request = (char*)connection.buffer;
+  int available = connection.client.available();
+  if (available > 0) {
+    size_t room = NETWORKHUB_WEBSOCKET_BUFFER_SIZE - connection.messageLength;
+    int count = connection.client.read(connection.buffer + connection.messageLength, min((size_t)available, room));
+    if (count > 0) {
+      connection.messageLength += count;
+      connection.lastReceiveMillis = millis();
+    }
+  }
+  request[connection.messageLength] = '\0';
+  
+  if (strstr(request, "\r\n\r\n") == NULL) {
+    bool full = connection.messageLength >= NETWORKHUB_WEBSOCKET_BUFFER_SIZE;
+    bool timedOut = millis() - connection.lastReceiveMillis >= NETWORKHUB_WEBSOCKET_PONG_TIMEOUT;
+    if (full || timedOut || !connection.client.connected()) {
+      if (full) {
+        connection.client.print("HTTP/1.1 431 Request Header Fields Too Large\r\nConnection: close\r\n\r\n");
+      }
+      disconnect(clientId);
+    }
+    return;
+  }
+  
+  char value[64];
+  bool isUpgrade = strncmp(request, "GET ", 4) == 0
+    && NetworkHTTP::getHeader(request, "Upgrade", value, sizeof(value)) && strcasecmp(value, "websocket") == 0;
+  if (!isUpgrade || !NetworkHTTP::getHeader(request, "Sec-WebSocket-Key", value, sizeof(value))) {
+    connection.client.print("HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    disconnect(clientId);
+    return;
+  }
+  
+  // Only version 13 is spoken, tell the client so (RFC 6455 4.4)
+  char version[8];
+  if (!NetworkHTTP::getHeader(request, "Sec-WebSocket-Version", version, sizeof(version))
+    || strcmp(version, "13") != 0) {
+    connection.client.print("HTTP/1.1 426 Upgrade Required\r\nSec-WebSocket-Version: 13\r\n"
+      "Content-Length: 0\r\nConnection: close\r\n\r\n");
+    disconnect(clientId);
+    return;
+  }
+  
+  // Accept key is base64(SHA-1(key + GUID))
+  char keyAndGuid[sizeof(value) + sizeof(WEBSOCKET_GUID)];
+  snprintf(keyAndGuid, sizeof(keyAndGuid), "%s%s", value, WEBSOCKET_GUID);
+  uint8_t digest[20];
+  sha1((const uint8_t*)keyAndGuid, strlen(keyAndGuid), digest);
+  char acceptKey[32];
+  base64Encode(digest, sizeof(digest), acceptKey);
+  
+  char response[160];
+  int length = snprintf(response, sizeof(response),
+    "HTTP/1.1 101 Switching Protocols\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n"
+    "Sec-WebSocket-Accept: %s\r\n\r\n",
+    acceptKey);
+  connection.client.write((const uint8_t*)response, length);
+  
+  connection.state = CONNECTION_OPEN;
+  connection.headerLength = 0;
+  connection.headerNeeded = 2;
+  connection.messageOpcode = WEBSOCKET_CONTINUATION;
+  connection.messageLength = 0;
+  connection.pingSent = false;
+  connection.lastReceiveMillis = millis();
+  
+  if (_eventCallback != NULL) {
+    _eventCallback(clientId, true);
+  }
+}
+
+void NetworkWebSocketServer::readFrames(uint8_t clientId) {
+  Connection& connection = _connections[clientId];
+  
+  while (connection.state == CONNECTION_OPEN) {
+    if (connection.headerLength < connection.headerNeeded) {
+      if (connection.client.available() <= 0) {
+        return;
+      }
+      int count = connection.client.read(connection.header + connection.headerLength,
+        connection.headerNeeded - connection.headerLength);
+      if (count <= 0) {
+        return;
+      }
+      connection.headerLength += count;
+      connection.lastReceiveMillis = millis();
+      connection.pingSent = false;
+      
+      if (connection.headerLength == 2) {
+        // The second byte gives the size of the rest of the header
+        uint8_t length7 = connection.header[1] & 0x7F;
+        connection.headerNeeded = 2 + (length7 == 126 ? 2 : (length7 == 127 ? 8 : 0))
+          + ((connection.header[1] & 0x80) ? 4 : 0);
+      }
+      if (connection.headerLength < connection.headerNeeded) {
+        continue;
+      }
+      if (!beginFrame(clientId)) {
+        return;
+      }
+    }
+    
+    if (connection.payloadReceived < connection.payloadLength) {
+      int available = connection.client.available();
+      if (available <= 0) {
+        return;
+      }
+      size_t remaining = connection.payloadLength - connection.payloadReceived;
+      int count = connection.client.read(connection.payload + connection.payloadReceived,
+        min((size_t)available, remaining));
+      if (count <= 0) {
+        return;
+      }
+      connection.payloadReceived += count;
+      connection.lastReceiveMillis = millis();
+      if (connection.payloadReceived < connection.payloadLength) {
+        continue;
+      }
+    }
+    
+    if (!handleFrame(clientId)) {
+      return;
+    }
+    connection.headerLength = 0;
+    connection.headerNeeded = 2;
+  }
+}
+
+bool NetworkWebSocketServer::beginFrame(uint8_t clientId) {
+  Connection& connection = _connections[clientId];
+  const uint8_t* header = connection.header;
+  
+  connection.fin = (header[0] & 0x80) != 0;
+  connection.opcode = header[0] & 0x0F;
+  connection.payloadReceived = 0;
+  
+  // Clients must mask, and there are no extensions to set RSV bits
+  if ((header[0] & 0x70) != 0 || (header[1] & 0x80) == 0) {
+    close(clientId, 1002);
+    return false;
+  }
+  
+  uint64_t payloadLength = header[1] & 0x7F;
+  if (payloadLength == 126) {
+    payloadLength = ((uint16_t)header[2] << 8) | header[3];
+  } else if (payloadLength == 127) {
+    payloadLength = 0;
+    for (uint8_t x = 2; x < 10; x++) {
+      payloadLength = (payloadLength << 8) | header[x];
+    }
+  }
+  
+  if (connection.opcode & 0x08) {
+    // Control frames are short, unfragmented, and may arrive between
+    // the frames of a message, so they have their own buffer
+    if (!connection.fin || payloadLength > sizeof(connection.control)) {
+      close(clientId, 1002);
+      return false;
+    }
+    connection.payload = connection.control;
+  } else {
+    bool inMessage = connection.messageOpcode != WEBSOCKET_CONTINUATION;
+    bool isContinuation = connection.opcode == WEBSOCKET_CONTINUATION;
+    bool isData = connection.opcode == WEBSOCKET_TEXT || connection.opcode == WEBSOCKET_BINARY;
+    if ((!isContinuation && !isData) || inMessage != isContinuation) {
+      close(clientId, 1002);
+      return false;
+    }
+    if (payloadLength > NETWORKHUB_WEBSOCKET_BUFFER_SIZE - connection.messageLength) {
+      close(clientId, 1009);
+      return false;
+    }
+    if (isData) {
+      connection.messageOpcode = connection.opcode;
+      connection.messageLength = 0;
+    }
+    connection.payload = connection.buffer + connection.messageLength;
+  }
+  
+  connection.payloadLength = payloadLength;
+  return true;
+}
+
+bool NetworkWebSocketServer::handleFrame(uint8_t clientId) {
+  Connection& connection = _connections[clientId];
+  
+  // The masking key is the last four bytes of the header
+  unmask(connection.payload, connection.payloadLength, connection.header + connection.headerNeeded - 4);
+  
+  switch (connection.opcode) {
+    case WEBSOCKET_PING:
+      writeFrame(connection, WEBSOCKET_PONG, connection.control, connection.payloadLength);
+      break;
+    
+    case WEBSOCKET_PONG:
+      // Any frame counts as an answer, see readFrames()
+      break;
+    
+    case WEBSOCKET_CLOSE:
+      // Echo the status code back and hang up
+      writeFrame(connection, WEBSOCKET_CLOSE, connection.control, min(connection.payloadLength, (uint32_t)2));
+      disconnect(clientId);
+      return false;
+    
+    default:
+      connection.messageLength += connection.payloadLength;
+      if (connection.fin) {
+        connection.buffer[connection.messageLength] = '\0';
+        NetworkWebSocketOpcode opcode = (NetworkWebSocketOpcode)connection.messageOpcode;
+        size_t length = connection.messageLength;
+        connection.messageOpcode = WEBSOCKET_CONTINUATION;
+        connection.messageLength = 0;
+        
+        _messagesReceived++;
+        if (_messageCallback != NULL) {
+          _messageCallback(clientId, opcode, connection.buffer, length);
+        }
+      }
+      break;
+  }
+  
+  // The callback may have closed it
+  return connection.state == CONNECTION_OPEN;
+}
+
+void NetworkWebSocketServer::checkAlive(uint8_t clientId) {
+  Connection& connection = _connections[clientId];
+  if (connection.state != CONNECTION_OPEN) {
+    return;
+  }
+  
+  if (!connection.client.connected()) {
+    disconnect(clientId);
+    return;
+  }
+  
+  uint32_t idleMillis = millis() - connection.lastReceiveMillis;
+  if (idleMillis >= NETWORKHUB_WEBSOCKET_PING_INTERVAL + NETWORKHUB_WEBSOCKET_PONG_TIMEOUT) {
+    close(clientId, 1001);
+  } else if (idleMillis >= NETWORKHUB_WEBSOCKET_PING_INTERVAL && !connection.pingSent) {
+    writeFrame(connection, WEBSOCKET_PING, NULL, 0);
+    connection.pingSent = true;
+  }
+}
+
+bool NetworkWebSocketServer::writeFrame(Connection& connection, uint8_t opcode, const uint8_t* payload,
+    size_t length) {
+  uint8_t frame[4 + sizeof(connection.control)];
+  size_t headerLength = buildHeader(frame, opcode, length);
+  if (length > 0) {
+    memcpy(frame + headerLength, payload, length);
+  }
+  return connection.client.write(frame, headerLength + length) == headerLength + length;
+}
+
+void NetworkWebSocketServer::disconnect(uint8_t clientId) {
+  Connection& connection = _connections[clientId];
+  bool wasOpen = connection.state == CONNECTION_OPEN;
+  
+  connection.client.stop();
+  connection.client = NetworkClient();
+  connection.state = CONNECTION_FREE;
+  
+  if (wasOpen && _eventCallback != NULL) {
+    _eventCallback(clientId, false);
+  }
+}
+
+size_t NetworkWebSocketServer::buildHeader(uint8_t* header, uint8_t opcode, size_t length) {
+  // Server frames are never masked or fragmented
+  header[0] = 0x80 | opcode;
+  if (length < 126) {
+    header[1] = length;
+    return 2;
+  }
+  if (length <= 0xFFFF) {
+    header[1] = 126;
+    header[2] = length >> 8;
+    header[3] = length;
+    return 4;
+  }
+  header[1] = 127;
+  for (uint8_t x = 0; x < 8; x++) {
+    header[9 - x] = (uint64_t)length >> (x * 8);
+  }
+  return 10;
+}
+
+void NetworkWebSocketServer::unmask(uint8_t* payload, size_t length, const uint8_t* mask) {
+  // memcpy keeps the key's byte order, so this works on either
+  // endianness, and compiles to plain word loads and stores
+  uint32_t maskWord;
+  memcpy(&maskWord, mask, 4);
+  
+  size_t x = 0;
+  for (; x + 4 <= length; x += 4) {
+    uint32_t word;
+    memcpy(&word, payload + x, 4);
+    word ^= maskWord;
+    memcpy(payload + x, &word, 4);
+  }
+  for (; x < length; x++) {
+    payload[x] ^= mask[x & 3];
+  }
+}
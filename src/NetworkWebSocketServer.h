@@ -0,0 +1,170 @@
+//
+// Licensed under the MIT license.
+// See accompanying LICENSE file for details.
+//
+
+#ifndef NETWORKWEBSOCKETSERVER_H
+#define NETWORKWEBSOCKETSERVER_H
+
+#include <Arduino.h>
+
+#include "NetworkClient.h"
+#include "NetworkServer.h"
+
+// Number of WebSocket connections served at the same time.
+#ifndef NETWORKHUB_WEBSOCKET_MAX_CLIENTS
+#define NETWORKHUB_WEBSOCKET_MAX_CLIENTS 4
+#endif
+
+// Largest message that can be received, and the size of each
+// connection's receive buffer. The handshake request must also fit.
+#ifndef NETWORKHUB_WEBSOCKET_BUFFER_SIZE
+#define NETWORKHUB_WEBSOCKET_BUFFER_SIZE 512
+#endif
+
+// Time without hearing from a client, in milliseconds, before it
+// is pinged.
+#ifndef NETWORKHUB_WEBSOCKET_PING_INTERVAL
+#define NETWORKHUB_WEBSOCKET_PING_INTERVAL 10000
+#endif
+
+// Time to wait for the pong, in milliseconds, before the
+// connection is closed.
+#ifndef NETWORKHUB_WEBSOCKET_PONG_TIMEOUT
+#define NETWORKHUB_WEBSOCKET_PONG_TIMEOUT 5000
+#endif
+
+enum NetworkWebSocketOpcode {
+  WEBSOCKET_CONTINUATION = 0x0,
+  WEBSOCKET_TEXT = 0x1,
+  WEBSOCKET_BINARY = 0x2,
+  WEBSOCKET_CLOSE = 0x8,
+  WEBSOCKET_PING = 0x9,
+  WEBSOCKET_PONG = 0xA
+};
+
+// Called with each complete text or binary message. Text messages
+// are also null terminated, so payload can be used as a string.
+typedef void (*NetworkWebSocketMessageCallback)(uint8_t clientId, NetworkWebSocketOpcode opcode,
+  const uint8_t* payload, size_t length);
+
+// Called when a client finishes the handshake, and when it goes away.
+typedef void (*NetworkWebSocketEventCallback)(uint8_t clientId, bool connected);
+
+// A WebSocket (RFC 6455) server on a NetworkServer, for pushing
+// updates to a browser without a new connection and HTTP header
+// for each one. A message costs two to four bytes of framing.
+//
+// Each connection has a fixed receive buffer, so nothing is
+// allocated after begin(). Messages are sent only when the client's
+// send window can take the whole frame; otherwise they are dropped
+// and counted, so a slow browser doesn't stall a 50 Hz update loop.
+// Idle clients are pinged, and closed if they don't answer.
+//
+//   NetworkWebSocketServer webSocketServer;
+//   ...
+//   webSocketServer.begin(networkHub.getServer(81));
+//   ...
+//   webSocketServer.poll();                   // in loop()
+//   webSocketServer.broadcastText("42.0");
+//
+class NetworkWebSocketServer {
+  public:
+    NetworkWebSocketServer() { /* Nothing to see here, move along. */ };
+    
+    // Start serving on the given server.
+    void begin(NetworkServer* server);
+    
+    // Accept new connections, do handshakes, read frames, and keep
+    // connections alive. Call from loop().
+    void poll();
+    
+    void setMessageCallback(NetworkWebSocketMessageCallback callback) { _messageCallback = callback; };
+    void setEventCallback(NetworkWebSocketEventCallback callback) { _eventCallback = callback; };
+    
+    // Send a message to one client. Returns false if the client isn't
+    // connected or its send window can't take the message. A client
+    // that takes only part of a frame is disconnected, since the
+    // frames after it could no longer be read.
+    bool sendText(uint8_t clientId, const char* text) { return sendBinary(clientId, (const uint8_t*)text, strlen(text), WEBSOCKET_TEXT); };
+    bool sendBinary(uint8_t clientId, const uint8_t* payload, size_t length, NetworkWebSocketOpcode opcode = WEBSOCKET_BINARY);
+    
+    // Send a message to every connected client. Returns the number
+    // of clients it was sent to.
+    uint8_t broadcastText(const char* text) { return broadcastBinary((const uint8_t*)text, strlen(text), WEBSOCKET_TEXT); };
+    uint8_t broadcastBinary(const uint8_t* payload, size_t length, NetworkWebSocketOpcode opcode = WEBSOCKET_BINARY);
+    
+    // Close the connection with a close frame.
+    void close(uint8_t clientId, uint16_t statusCode = 1000);
+    
+    bool isConnected(uint8_t clientId);
+    uint8_t getClientCount();
+    
+    uint32_t getMessagesReceived() { return _messagesReceived; };
+    uint32_t getMessagesSent() { return _messagesSent; };
+    // Messages not sent because the client's send window was full,
+    // or cut short.
+    uint32_t getDroppedCount() { return _droppedCount; };
+    
+  protected:
+    enum ConnectionState {
+      CONNECTION_FREE,
+      CONNECTION_HANDSHAKE,
+      CONNECTION_OPEN
+    };
+    
+    struct Connection {
+      NetworkClient client;
+      ConnectionState state = CONNECTION_FREE;
+      
+      // Frame being read
+      uint8_t header[14];
+      uint8_t headerLength;
+      uint8_t headerNeeded;
+      uint8_t opcode;
+      bool fin;
+      uint32_t payloadLength;
+      uint32_t payloadReceived;
+      uint8_t* payload;
+      
+      // Message being assembled from one or more frames
+      uint8_t messageOpcode;
+      size_t messageLength;
+      
+      uint32_t lastReceiveMillis;
+      bool pingSent;
+      
+      uint8_t buffer[NETWORKHUB_WEBSOCKET_BUFFER_SIZE + 1];
+      uint8_t control[125];
+    };
+    
+    NetworkServer* _server = NULL;
+    Connection _connections[NETWORKHUB_WEBSOCKET_MAX_CLIENTS];
+    
+    NetworkWebSocketMessageCallback _messageCallback = NULL;
+    NetworkWebSocketEventCallback _eventCallback = NULL;
+    
+    uint32_t _messagesReceived = 0;
+    uint32_t _messagesSent = 0;
+    uint32_t _droppedCount = 0;
+    
+    void accept(NetworkClient& client);
+    void readHandshake(uint8_t clientId);
+    void readFrames(uint8_t clientId);
+    // A frame's header has been read, check it and pick where its
+    // payload goes. Returns false if the connection was closed.
+    bool beginFrame(uint8_t clientId);
+    // A frame has been read, act on it. Returns false if the
+    // connection was closed.
+    bool handleFrame(uint8_t clientId);
+    void checkAlive(uint8_t clientId);
+    // Write a control frame. These are small and never dropped.
+    bool writeFrame(Connection& connection, uint8_t opcode, const uint8_t* payload, size_t length);
+    void disconnect(uint8_t clientId);
+    
+    static size_t buildHeader(uint8_t* header, uint8_t opcode, size_t length);
+    // XOR the payload with the masking key, four bytes at a time.
+    static void unmask(uint8_t* payload, size_t length, const uint8_t* mask);
+};
+
+#endif // NETWORKWEBSOCKETSERVER_H
@@ -3,6 +3,11 @@
 // See accompanying LICENSE file for details.
 //
 
+// Backend selection
+#include "NetworkHubConfig.h"
+
+#if defined(NETWORKHUB_BACKEND_QNETHERNET)
+
 // Third-party includes
 #include <QNEthernet.h>  // https://github.com/ssilverman/QNEthernet
 
@@ -18,6 +23,9 @@
 
 using namespace qindesign::network;
 
+// EthernetClient's own connection timeout, in milliseconds
+static const uint16_t DEFAULT_CONNECTION_TIMEOUT = 1000;
+
 // NetworkClientWrapper implementation for QNEthernet EthernetClient.
 //
 class QNEthernetClientWrapper : public NetworkClientWrapper {
@@ -36,11 +44,43 @@ class QNEthernetClientWrapper : public NetworkClientWrapper {
     operator bool() { return _ethernetClient ? true : false; };
     IPAddress remoteIP() { return _ethernetClient.remoteIP(); };
     uint16_t remotePort() { return _ethernetClient.remotePort(); };
+    int availableForWrite() { return _ethernetClient.availableForWrite(); };
     
     NetworkClientWrapper* clone() {
       return new QNEthernetClientWrapper(_ethernetClient);
     }
     
+    // QNEthernet can start a connection without waiting for it.
+    // connectNoWait() ignores EthernetClient's connection timeout,
+    // so pollConnect() enforces it, keeping the 1 s default.
+    void setConnectionTimeout(uint32_t timeoutMs) {
+      _connectionTimeoutMs = timeoutMs > 0 ? timeoutMs : DEFAULT_CONNECTION_TIMEOUT;
+      _ethernetClient.setConnectionTimeout(min(_connectionTimeoutMs, (uint32_t)UINT16_MAX));
+    };
+    bool hasNonBlockingConnect() { return true; };
+    int startConnect(IPAddress ip, uint16_t port) {
+      _connectStartMillis = millis();
+      return _ethernetClient.connectNoWait(ip, port) ? 1 : 0;
+    };
+    int startConnect(const char *host, uint16_t port) {
+      _connectStartMillis = millis();
+      return _ethernetClient.connectNoWait(host, port) ? 1 : 0;
+    };
+    int pollConnect() {
+      if (_ethernetClient.connected()) {
+        return NETWORK_CONNECT_SUCCESS;
+      }
+      // No longer connecting means it was refused or aborted
+      if (!_ethernetClient.connecting()) {
+        return NETWORK_CONNECT_FAILED;
+      }
+      if (millis() - _connectStartMillis >= _connectionTimeoutMs) {
+        _ethernetClient.stop();
+        return NETWORK_CONNECT_TIMED_OUT;
+      }
+      return NETWORK_CONNECT_IN_PROGRESS;
+    };
+    
   private:
     friend class QNEthernetNetworkHub;
     friend class QNEthernetServerWrapper;
@@ -51,6 +91,8 @@ class QNEthernetClientWrapper : public NetworkClientWrapper {
     };
     
     EthernetClient _ethernetClient;
+    uint32_t _connectionTimeoutMs = DEFAULT_CONNECTION_TIMEOUT;
+    uint32_t _connectStartMillis = 0;
 };
 
 // NetworkServerWrapper implementation for QNEthernet EthernetServer.
@@ -58,68 +100,134 @@ class QNEthernetClientWrapper : public NetworkClientWrapper {
 class QNEthernetServerWrapper : public NetworkServerWrapper {
   public:
     NetworkClient available() {
-      EthernetClient ethernetClient = _ethernetServer->available();
+      EthernetClient ethernetClient = _ethernetServer.available();
       
       QNEthernetClientWrapper* clientWrapper = new QNEthernetClientWrapper(ethernetClient);
       
       return NetworkFactory::createNetworkClient(clientWrapper);
     };
     
-    void begin() { _ethernetServer->begin(); };
-    size_t write(uint8_t b) { return _ethernetServer->write(b); };
-    size_t write(const uint8_t *buf, size_t size) { return _ethernetServer->write(buf, size); };
-    
-    ~QNEthernetServerWrapper() {
-      delete _ethernetServer;
-    };
+    void begin() { _ethernetServer.begin(); };
+    size_t write(uint8_t b) { return _ethernetServer.write(b); };
+    size_t write(const uint8_t *buf, size_t size) { return _ethernetServer.write(buf, size); };
     
   private:
     friend class QNEthernetNetworkHub;
     
-    QNEthernetServerWrapper(EthernetServer* ethernetServer) {
-      _ethernetServer = ethernetServer;
-    };
+    QNEthernetServerWrapper(uint16_t port) : _ethernetServer(port) {};
     
-    EthernetServer* _ethernetServer;
+    EthernetServer _ethernetServer;
 };
 
 // NetworkUDPWrapper implementation for QNEthernet EthernetUDP.
 //
+// A packet that is committed whole from reserve() is sent with
+// EthernetUDP.send(), which copies it straight into an lwIP pbuf
+// rather than through EthernetUDP's own packet buffer first.
+//
 class QNEthernetUDPWrapper : public NetworkUDPWrapper {
   public:
     
-    uint8_t begin(uint16_t port) { return _ethernetUDP->begin(port); };
-    uint8_t beginMulticast(IPAddress ip, uint16_t port) { return _ethernetUDP->beginMulticast(ip, port); };
-    void stop() { _ethernetUDP->stop(); };
-    int beginPacket(IPAddress ip, uint16_t port) { return _ethernetUDP->beginPacket(ip, port); };
-    int beginPacket(const char *host, uint16_t port) { return _ethernetUDP->beginPacket(host, port); };
-    int endPacket() { return _ethernetUDP->endPacket(); };
-    size_t write(uint8_t b) { return _ethernetUDP->write(b); };
-    size_t write(const uint8_t *buffer, size_t size) { return _ethernetUDP->write(buffer, size); };
-    int parsePacket() { return _ethernetUDP->parsePacket(); };
-    int available() { return _ethernetUDP->available(); };
-    int read() { return _ethernetUDP->read(); };
-    int read(unsigned char* buffer, size_t len) { return _ethernetUDP->read(buffer, len); };
-    int read(char* buffer, size_t len) { return _ethernetUDP->read(buffer, len); };
-    int peek() { return _ethernetUDP->peek(); };
-    void flush() { _ethernetUDP->flush(); };
-    IPAddress remoteIP() { return _ethernetUDP->remoteIP(); };
-    uint16_t remotePort() { return _ethernetUDP->remotePort(); };
-    
-    ~QNEthernetUDPWrapper() {
-      delete _ethernetUDP;
+    uint8_t begin(uint16_t port) { return _ethernetUDP.begin(port); };
+    uint8_t beginMulticast(IPAddress ip, uint16_t port) { return _ethernetUDP.beginMulticast(ip, port); };
+    void stop() {
+      NetworkStagingBuffer::release(this);
+      _committedSize = 0;
+      _ethernetUDP.stop();
+    };
+    int beginPacket(IPAddress ip, uint16_t port) {
+      NetworkStagingBuffer::release(this);
+      _committedSize = 0;
+      _sendIP = ip;
+      _sendPort = port;
+      _sendDirect = true;
+      return _ethernetUDP.beginPacket(ip, port);
+    };
+    int beginPacket(const char *host, uint16_t port) {
+      NetworkStagingBuffer::release(this);
+      _committedSize = 0;
+      _sendDirect = false;
+      return _ethernetUDP.beginPacket(host, port);
+    };
+    int endPacket() {
+      if (_sendDirect && _committedSize > 0) {
+        size_t size = _committedSize;
+        const uint8_t* staged = NetworkStagingBuffer::release(this, size);
+        _committedSize = 0;
+        _sendDirect = false;
+        return staged != NULL && _ethernetUDP.send(_sendIP, _sendPort, staged, size) ? 1 : 0;
+      }
+      _sendDirect = false;
+      return _ethernetUDP.endPacket();
+    };
+    size_t write(uint8_t b) { return write(&b, 1); };
+    size_t write(const uint8_t *buffer, size_t size) {
+      writeCommitted();
+      _sendDirect = false;
+      return _ethernetUDP.write(buffer, size);
+    };
+    uint8_t* reserve(size_t size) {
+      // Only a reservation that starts the packet can be sent whole
+      if (_committedSize > 0) {
+        writeCommitted();
+        _sendDirect = false;
+      }
+      return NetworkStagingBuffer::reserve(this, size);
     };
+    size_t commit(size_t used) {
+      if (!_sendDirect) {
+        return NetworkUDPWrapper::commit(used);
+      }
+      if (used == 0 || !NetworkStagingBuffer::holds(this, used)) {
+        NetworkStagingBuffer::release(this);
+        return 0;
+      }
+      // Held until endPacket(), in case more is added
+      _committedSize = used;
+      return used;
+    };
+    int parsePacket() { return _ethernetUDP.parsePacket(); };
+    int available() { return _ethernetUDP.available(); };
+    int read() { return _ethernetUDP.read(); };
+    int read(unsigned char* buffer, size_t len) { return _ethernetUDP.read(buffer, len); };
+    int read(char* buffer, size_t len) { return _ethernetUDP.read(buffer, len); };
+    int peek() { return _ethernetUDP.peek(); };
+    void flush() { _ethernetUDP.flush(); };
+    IPAddress remoteIP() { return _ethernetUDP.remoteIP(); };
+    uint16_t remotePort() { return _ethernetUDP.remotePort(); };
     
   private:
     friend class QNEthernetNetworkHub;
     
-    QNEthernetUDPWrapper(EthernetUDP* ethernetUDP) {
-      _ethernetUDP = ethernetUDP;
-    };
+    QNEthernetUDPWrapper() {};
+    
+    EthernetUDP _ethernetUDP;
     
-    EthernetUDP* _ethernetUDP;
+    // The packet being built, while it can still be sent whole
+    IPAddress _sendIP;
+    uint16_t _sendPort = 0;
+    bool _sendDirect = false;
+    size_t _committedSize = 0;
+    
+    // Anything more added to the packet means it has to go through
+    // EthernetUDP's packet buffer after all.
+    void writeCommitted() {
+      if (_committedSize > 0) {
+        const uint8_t* staged = NetworkStagingBuffer::release(this, _committedSize);
+        if (staged != NULL) {
+          _ethernetUDP.write(staged, _committedSize);
+        }
+        _committedSize = 0;
+      }
+    };
 };
 
+#if defined(NETWORKHUB_STATIC_ALLOC)
+static_assert(sizeof(QNEthernetClientWrapper) <= NETWORKHUB_CLIENT_WRAPPER_SIZE, "Increase NETWORKHUB_CLIENT_WRAPPER_SIZE");
+static_assert(sizeof(QNEthernetServerWrapper) <= NETWORKHUB_SERVER_WRAPPER_SIZE, "Increase NETWORKHUB_SERVER_WRAPPER_SIZE");
+static_assert(sizeof(QNEthernetUDPWrapper) <= NETWORKHUB_UDP_WRAPPER_SIZE, "Increase NETWORKHUB_UDP_WRAPPER_SIZE");
+#endif
+
 bool QNEthernetNetworkHub::begin(Print* printer) {
 
   bool hadError = false;
@@ -161,86 +269,85 @@ IPAddress QNEthernetNetworkHub::getLocalIPAddress() {
 NetworkClient QNEthernetNetworkHub::getClient() {
   QNEthernetClientWrapper* clientWrapper = new QNEthernetClientWrapper();
   
-  return NetworkFactory::createNetworkClient(clientWrapper);
+  return NetworkFactory::createNetworkClient(addTLSProvider(clientWrapper));
 }
 
 NetworkServer* QNEthernetNetworkHub::getServer(uint32_t portNum) {
-  EthernetServer* server = new EthernetServer(portNum);
-  
-  QNEthernetServerWrapper* serverWrapper = new QNEthernetServerWrapper(server);
+  QNEthernetServerWrapper* serverWrapper = new QNEthernetServerWrapper(portNum);
   
   return NetworkFactory::createNetworkServer(serverWrapper);
 }
     
 NetworkUDP* QNEthernetNetworkHub::getUDP() {
-  EthernetUDP* udp = new EthernetUDP();
-  
-  QNEthernetUDPWrapper* udpWrapper = new QNEthernetUDPWrapper(udp);
+  QNEthernetUDPWrapper* udpWrapper = new QNEthernetUDPWrapper();
   
   return NetworkFactory::createNetworkUDP(udpWrapper);
 }
 
 
-void QNEthernetNetworkHub::printStatus(Print* printer) {
-  printer->print("Hardware Status: ");
+bool QNEthernetNetworkHub::isLinkUp() {
+  return Ethernet.linkState();
+}
+
+uint8_t QNEthernetNetworkHub::getSocketLimit(uint8_t type) {
+  // lwIP has a pool of each kind. DHCP and DNS take from the UDP pool
+  // too, so a little less of it is left than this says.
+  switch (type) {
+#if defined(MEMP_NUM_TCP_PCB)
+    case NETWORK_SOCKET_CLIENT:
+      return MEMP_NUM_TCP_PCB;
+#endif
+
+#if defined(MEMP_NUM_TCP_PCB_LISTEN)
+    case NETWORK_SOCKET_SERVER:
+      return MEMP_NUM_TCP_PCB_LISTEN;
+#endif
+
+#if defined(MEMP_NUM_UDP_PCB)
+    case NETWORK_SOCKET_UDP:
+      return MEMP_NUM_UDP_PCB;
+#endif
+    
+    default:
+      return 0;
+  }
+}
+
+void QNEthernetNetworkHub::readStatus(NetworkHubStatus& status) {
   switch(Ethernet.hardwareStatus()) {
     case EthernetNoHardware:
-      printer->println("No Hardware");
+      status.hardwareType = NETWORK_HARDWARE_NONE;
       break;
       
     case EthernetW5100:
-      printer->println("EthernetW5100");
+      status.hardwareType = NETWORK_HARDWARE_W5100;
       break;
       
     case EthernetW5200:
-      printer->println("EthernetW5200");
+      status.hardwareType = NETWORK_HARDWARE_W5200;
       break;
       
     case EthernetW5500:
-      printer->println("EthernetW5500");
+      status.hardwareType = NETWORK_HARDWARE_W5500;
       break;
       
     default:
-      printer->println("Unknown hardware");
+      status.hardwareType = NETWORK_HARDWARE_NATIVE;
       break;
   }
   
-  printer->print("Link Status: ");
-  printer->println(Ethernet.linkState() ? "Connected" : "Not Connected");
-  
-  if (Ethernet.linkState()) {
-    printer->print("Link Speed: ");
-    printer->println(Ethernet.linkSpeed());
-    
-    printer->print("Duplex mode: ");
-    printer->println(Ethernet.linkIsFullDuplex() ? "Full" : "Half");
-    
-    printer->print("Crossover: ");
-    printer->println(Ethernet.linkIsCrossover() ? "TRUE" : "FALSE");
-  }
-  
-  uint8_t macAddress[6];
-  Ethernet.macAddress(macAddress);
-  printer->print("MAC Address: ");
-  for (size_t x = 0; x < sizeof(macAddress); x++) {
-    printer->print(macAddress[x], HEX);
-    if (x < sizeof(macAddress) - 1) {
-      printer->print(":");
-    }
+  status.linkState = Ethernet.linkState() ? NETWORK_LINK_UP : NETWORK_LINK_DOWN;
+  if (status.isLinkUp()) {
+    status.linkSpeed = Ethernet.linkSpeed();
+    status.fullDuplex = Ethernet.linkIsFullDuplex();
+    status.crossover = Ethernet.linkIsCrossover();
   }
-  printer->println();
   
-  printer->print("IP Address: ");
-  printer->println(Ethernet.localIP());
-  
-  printer->print("Subnet Mask: ");
-  printer->println(Ethernet.subnetMask());
-  
-  printer->print("Gateway IP: ");
-  printer->println(Ethernet.gatewayIP());
-  
-  printer->print("DNS Server IP: ");
-  printer->println(Ethernet.dnsServerIP());
+  Ethernet.macAddress(status.macAddress);
+  status.localIP = Ethernet.localIP();
+  status.subnetMask = Ethernet.subnetMask();
+  status.gatewayIP = Ethernet.gatewayIP();
+  status.dnsServerIP = Ethernet.dnsServerIP();
 }
 
 // Static members and methods
@@ -250,8 +357,14 @@ QNEthernetNetworkHub* QNEthernetNetworkHub::_qnEthernetNetworkHub = NULL;
 // Returns the instance of EthernetNetworkHub
 QNEthernetNetworkHub QNEthernetNetworkHub::getInstance() {
   if (_qnEthernetNetworkHub == NULL) {
+#if defined(NETWORKHUB_STATIC_ALLOC)
+    static QNEthernetNetworkHub qnEthernetNetworkHub;
+    _qnEthernetNetworkHub = &qnEthernetNetworkHub;
+#else
     _qnEthernetNetworkHub = new QNEthernetNetworkHub();
+#endif
   }
   return *_qnEthernetNetworkHub;
 };
-    
+
+#endif // NETWORKHUB_BACKEND_QNETHERNET
@@ -9,6 +9,11 @@
 #include <Arduino.h>
 
 #include "NetworkHub.h"
+#include "NetworkHubConfig.h"
+
+#if !defined(NETWORKHUB_BACKEND_QNETHERNET)
+#error "QNEthernetNetworkHub is not compiled, see NetworkHubConfig.h"
+#endif
 
 // A network hub based on an ethernet connection
 // implemented by QNEthernet library.
@@ -24,7 +29,8 @@ class QNEthernetNetworkHub : public NetworkHub {
     NetworkClient getClient();
     NetworkServer* getServer(uint32_t portNum);
     NetworkUDP* getUDP();
-    void printStatus(Print* printer);
+    bool isLinkUp();
+    uint8_t getSocketLimit(uint8_t type);
     
     // Returns the singleton instance of EthernetNetworkHub
     static QNEthernetNetworkHub getInstance();
@@ -32,6 +38,8 @@ class QNEthernetNetworkHub : public NetworkHub {
   protected:
     QNEthernetNetworkHub() { /* Nothing to see here, move along. */ };
     
+    void readStatus(NetworkHubStatus& status);
+    
     static QNEthernetNetworkHub* _qnEthernetNetworkHub;
 };
 
@@ -3,12 +3,18 @@
 // See accompanying LICENSE file for details.
 //
 
+// Backend selection
+#include "NetworkHubConfig.h"
+
+#if defined(NETWORKHUB_BACKEND_WIFININA)
+
 // Third-party includes
 #include <SPI.h>
 #include <WiFiNINA.h> // https://github.com/adafruit/WiFiNINA
 #include <WiFiServer.h>
 #include <WiFiClient.h>
 #include <WiFiUdp.h>
+#include <utility/server_drv.h>
 
 // Local includes
 #include "WiFiNINANetworkHub.h"
@@ -20,6 +26,11 @@
 #include "NetworkServer.h"
 #include "NetworkServerWrapper.h"
 
+// The largest write WiFiClient hands to the ESP32 in one go.
+#ifndef NETWORKHUB_WIFININA_WRITE_WINDOW
+#define NETWORKHUB_WIFININA_WRITE_WINDOW 1400
+#endif
+
 // NetworkClientWrapper implementation for WiFiNINA WiFiClient.
 //
 class WiFiNINAClientWrapper : public NetworkClientWrapper {
@@ -28,8 +39,6 @@ class WiFiNINAClientWrapper : public NetworkClientWrapper {
     ~WiFiNINAClientWrapper() { };
     int connect(IPAddress ip, uint16_t port) { return _wifiClient.connect(ip, port); };
     int connect(const char *host, uint16_t port) { return _wifiClient.connect(host, port); };
-    int connectSSL(IPAddress ip, uint16_t port) { return _wifiClient.connectSSL(ip, port); };
-    int connectSSL(const char *host, uint16_t port) { return _wifiClient.connectSSL(host, port); };
     size_t write(uint8_t b) { return _wifiClient.write(b); };
     size_t write(const uint8_t *buf, size_t size) { return _wifiClient.write(buf, size); };
     int available() { return _wifiClient.available(); };
@@ -43,10 +52,58 @@ class WiFiNINAClientWrapper : public NetworkClientWrapper {
     IPAddress remoteIP() { return _wifiClient.remoteIP(); };
     uint16_t remotePort() { return _wifiClient.remotePort(); };
     
+    // WiFiClient can't report the ESP32's send buffer, so this is
+    // only an estimate: one SPI transfer's worth while connected.
+    // The ESP32 may still take less when its buffer is full, so
+    // callers must check what write() returns.
+    int availableForWrite() { return _wifiClient.connected() ? NETWORKHUB_WIFININA_WRITE_WINDOW : 0; };
+    // WiFiClient.write() polls the ESP32 until it confirms the data
+    // was sent, which can take seconds when its buffer is full.
+    bool hasNonBlockingWrite() { return false; };
+    
     NetworkClientWrapper* clone() {
       return new WiFiNINAClientWrapper(_wifiClient);
     }
     
+    // WiFiClient.connect() waits up to 10 seconds for the ESP32,
+    // so start the connection on a socket directly and poll it.
+    bool hasNonBlockingConnect() { return true; };
+    
+    int startConnect(IPAddress ip, uint16_t port) {
+      _wifiClient.stop();
+      
+      uint8_t sock = ServerDrv::getSocket();
+      if (sock == NO_SOCKET_AVAIL) {
+        return 0;
+      }
+      
+      ServerDrv::startClient(uint32_t(ip), port, sock);
+      _wifiClient = WiFiClient(sock);
+      return 1;
+    };
+    
+    int startConnect(const char *host, uint16_t port) {
+      IPAddress ip;
+      if (WiFi.hostByName(host, ip) != 1) {
+        return 0;
+      }
+      return startConnect(ip, port);
+    };
+    
+    int pollConnect() {
+      uint8_t state = _wifiClient.status();
+      if (state == SYN_SENT || state == SYN_RCVD) {
+        return NETWORK_CONNECT_IN_PROGRESS;
+      }
+      // Refused or aborted sockets go back to closed
+      return _wifiClient.connected() ? NETWORK_CONNECT_SUCCESS : NETWORK_CONNECT_FAILED;
+    };
+    
+    // The ESP32 does the TLS handshake and encryption itself
+    bool hasSecureConnect() { return true; };
+    int connectSecure(IPAddress ip, uint16_t port) { return _wifiClient.connectSSL(ip, port); };
+    int connectSecure(const char *host, uint16_t port) { return _wifiClient.connectSSL(host, port); };
+    
   private:
     friend class WiFiNINANetworkHub;
     friend class WiFiNINAServerWrapper;
@@ -63,29 +120,23 @@ class WiFiNINAClientWrapper : public NetworkClientWrapper {
 class WiFiNINAServerWrapper : public NetworkServerWrapper {
   public:
     NetworkClient available() {
-      WiFiClient wifiClient = _wifiServer->available();
+      WiFiClient wifiClient = _wifiServer.available();
       
       WiFiNINAClientWrapper* clientWrapper = new WiFiNINAClientWrapper(wifiClient);
       
       return NetworkFactory::createNetworkClient(clientWrapper);
     };
     
-    void begin() { _wifiServer->begin(); };
-    size_t write(uint8_t b) { return _wifiServer->write(b); };
-    size_t write(const uint8_t *buf, size_t size) { return _wifiServer->write(buf, size); };
-    
-    ~WiFiNINAServerWrapper() {
-      delete _wifiServer;
-    };
+    void begin() { _wifiServer.begin(); };
+    size_t write(uint8_t b) { return _wifiServer.write(b); };
+    size_t write(const uint8_t *buf, size_t size) { return _wifiServer.write(buf, size); };
     
   private:
     friend class WiFiNINANetworkHub;
     
-    WiFiNINAServerWrapper(WiFiServer* wifiServer) {
-      _wifiServer = wifiServer;
-    };
+    WiFiNINAServerWrapper(uint16_t port) : _wifiServer(port) {};
     
-    WiFiServer* _wifiServer;
+    WiFiServer _wifiServer;
 };
 
 // NetworkUDPWrapper implementation for WiFiNINA WiFiUDP.
@@ -93,38 +144,38 @@ class WiFiNINAServerWrapper : public NetworkServerWrapper {
 class WiFiNINAUDPWrapper : public NetworkUDPWrapper {
   public:
     
-    uint8_t begin(uint16_t port) { return _wifiUDP->begin(port); };
-    uint8_t beginMulticast(IPAddress ip, uint16_t port) { return _wifiUDP->beginMulticast(ip, port); };
-    void stop() { _wifiUDP->stop(); };
-    int beginPacket(IPAddress ip, uint16_t port) { return _wifiUDP->beginPacket(ip, port); };
-    int beginPacket(const char *host, uint16_t port) { return _wifiUDP->beginPacket(host, port); };
-    int endPacket() { return _wifiUDP->endPacket(); };
-    size_t write(uint8_t b) { return _wifiUDP->write(b); };
-    size_t write(const uint8_t *buffer, size_t size) { return _wifiUDP->write(buffer, size); };
-    int parsePacket() { return _wifiUDP->parsePacket(); };
-    int available() { return _wifiUDP->available(); };
-    int read() { return _wifiUDP->read(); };
-    int read(unsigned char* buffer, size_t len) { return _wifiUDP->read(buffer, len); };
-    int read(char* buffer, size_t len) { return _wifiUDP->read(buffer, len); };
-    int peek() { return _wifiUDP->peek(); };
-    void flush() { _wifiUDP->flush(); };
-    IPAddress remoteIP() { return _wifiUDP->remoteIP(); };
-    uint16_t remotePort() { return _wifiUDP->remotePort(); };
-    
-    ~WiFiNINAUDPWrapper() {
-      delete _wifiUDP;
-    };
+    uint8_t begin(uint16_t port) { return _wifiUDP.begin(port); };
+    uint8_t beginMulticast(IPAddress ip, uint16_t port) { return _wifiUDP.beginMulticast(ip, port); };
+    void stop() { _wifiUDP.stop(); };
+    int beginPacket(IPAddress ip, uint16_t port) { return _wifiUDP.beginPacket(ip, port); };
+    int beginPacket(const char *host, uint16_t port) { return _wifiUDP.beginPacket(host, port); };
+    int endPacket() { return _wifiUDP.endPacket(); };
+    size_t write(uint8_t b) { return _wifiUDP.write(b); };
+    size_t write(const uint8_t *buffer, size_t size) { return _wifiUDP.write(buffer, size); };
+    int parsePacket() { return _wifiUDP.parsePacket(); };
+    int available() { return _wifiUDP.available(); };
+    int read() { return _wifiUDP.read(); };
+    int read(unsigned char* buffer, size_t len) { return _wifiUDP.read(buffer, len); };
+    int read(char* buffer, size_t len) { return _wifiUDP.read(buffer, len); };
+    int peek() { return _wifiUDP.peek(); };
+    void flush() { _wifiUDP.flush(); };
+    IPAddress remoteIP() { return _wifiUDP.remoteIP(); };
+    uint16_t remotePort() { return _wifiUDP.remotePort(); };
     
   private:
     friend class WiFiNINANetworkHub;
     
-    WiFiNINAUDPWrapper(WiFiUDP* wifiUDP) {
-      _wifiUDP = wifiUDP;
-    };
+    WiFiNINAUDPWrapper() {};
     
-    WiFiUDP* _wifiUDP;
+    WiFiUDP _wifiUDP;
 };
 
+#if defined(NETWORKHUB_STATIC_ALLOC)
+static_assert(sizeof(WiFiNINAClientWrapper) <= NETWORKHUB_CLIENT_WRAPPER_SIZE, "Increase NETWORKHUB_CLIENT_WRAPPER_SIZE");
+static_assert(sizeof(WiFiNINAServerWrapper) <= NETWORKHUB_SERVER_WRAPPER_SIZE, "Increase NETWORKHUB_SERVER_WRAPPER_SIZE");
+static_assert(sizeof(WiFiNINAUDPWrapper) <= NETWORKHUB_UDP_WRAPPER_SIZE, "Increase NETWORKHUB_UDP_WRAPPER_SIZE");
+#endif
+
 // Set up all of the SPI, busy, and reset
 // pins used by the Adafruit Airlift/ESP32.
 //
@@ -201,56 +252,54 @@ NetworkClient WiFiNINANetworkHub::getClient() {
   
   WiFiNINAClientWrapper* clientWrapper = new WiFiNINAClientWrapper(client);
   
-  return NetworkFactory::createNetworkClient(clientWrapper);
+  return NetworkFactory::createNetworkClient(addTLSProvider(clientWrapper));
 }
 
 NetworkServer* WiFiNINANetworkHub::getServer(uint32_t portNum) {
-  WiFiServer* tcpServer = new WiFiServer(portNum);
-  
-  WiFiNINAServerWrapper* serverWrapper = new WiFiNINAServerWrapper(tcpServer);
+  WiFiNINAServerWrapper* serverWrapper = new WiFiNINAServerWrapper(portNum);
   
   return NetworkFactory::createNetworkServer(serverWrapper);
 }
 
 NetworkUDP* WiFiNINANetworkHub::getUDP() {
-  WiFiUDP* udp = new WiFiUDP();
-  
-  WiFiNINAUDPWrapper* udpWrapper = new WiFiNINAUDPWrapper(udp);
+  WiFiNINAUDPWrapper* udpWrapper = new WiFiNINAUDPWrapper();
   
   return NetworkFactory::createNetworkUDP(udpWrapper);
 }
 
-void WiFiNINANetworkHub::printStatus(Print* printer) {
-  // print the SSID of the network you're attached to:
-  printer->print("SSID: ");
-  printer->println(WiFi.SSID());
-  
-  // print the received signal strength:
-  long rssi = WiFi.RSSI();
-  printer->print("Signal Strength (RSSI): ");
-  printer->print(rssi);
-  printer->println(" dBm");
+bool WiFiNINANetworkHub::isLinkUp() {
+  return WiFi.status() == WL_CONNECTED;
+}
 
-  uint8_t macAddress[6];
-  WiFi.macAddress(macAddress);
-  printer->print("MAC Address: ");
-  for (size_t x = 0; x < sizeof(macAddress); x++) {
-    printer->print(macAddress[x], HEX);
-    if (x < sizeof(macAddress) - 1) {
-      printer->print(":");
-    } else {
-      printer->println();
-    }
-  }
+uint8_t WiFiNINANetworkHub::getTotalSocketLimit() {
+  // The NINA firmware has one pool for every kind of socket
+#if defined(MAX_SOCK_NUM)
+  return MAX_SOCK_NUM;
+#else
+  return 4;
+#endif
+}
 
-  printer->print("IP Address: ");
-  printer->println(WiFi.localIP());
+int WiFiNINANetworkHub::getSecureConnectSupport() {
+  // The ESP32 handles TLS unless a software provider was asked for
+  return _tlsProvider != NULL ? NETWORK_SECURE_SOFTWARE : NETWORK_SECURE_OFFLOAD;
+}
+
+void WiFiNINANetworkHub::readStatus(NetworkHubStatus& status) {
+  status.hardwareType = NETWORK_HARDWARE_WIFININA;
+  status.linkState = WiFi.status() == WL_CONNECTED ? NETWORK_LINK_UP : NETWORK_LINK_DOWN;
   
-  printer->print("Subnet Mask: ");
-  printer->println(WiFi.subnetMask());
+  // The SSID and the received signal strength
+  const char* ssid = WiFi.SSID();
+  if (ssid != NULL) {
+    strncpy(status.ssid, ssid, sizeof(status.ssid) - 1);
+  }
+  status.rssi = WiFi.RSSI();
   
-  printer->print("Gateway IP: ");
-  printer->println(WiFi.gatewayIP());
+  WiFi.macAddress(status.macAddress);
+  status.localIP = WiFi.localIP();
+  status.subnetMask = WiFi.subnetMask();
+  status.gatewayIP = WiFi.gatewayIP();
 }
 
 // Static members and methods
@@ -260,7 +309,14 @@ WiFiNINANetworkHub* WiFiNINANetworkHub::_wifiNetworkHub = NULL;
 // Returns the instance of WiFiNINANetworkHub
 WiFiNINANetworkHub WiFiNINANetworkHub::getInstance() {
   if (_wifiNetworkHub == NULL) {
+#if defined(NETWORKHUB_STATIC_ALLOC)
+    static WiFiNINANetworkHub wifiNetworkHub;
+    _wifiNetworkHub = &wifiNetworkHub;
+#else
     _wifiNetworkHub = new WiFiNINANetworkHub();
+#endif
   }
   return *_wifiNetworkHub;
 };
+
+#endif // NETWORKHUB_BACKEND_WIFININA
@@ -7,6 +7,11 @@
 #define WIFININANETWORKHUB_H
 
 #include "NetworkHub.h"
+#include "NetworkHubConfig.h"
+
+#if !defined(NETWORKHUB_BACKEND_WIFININA)
+#error "WiFiNINANetworkHub is not compiled, see NetworkHubConfig.h"
+#endif
 
 // A network hub based on a WiFi connection using
 // an Adafruit AirLift co-processor or equivalent
@@ -37,7 +42,9 @@ class WiFiNINANetworkHub : public NetworkHub {
     NetworkClient getClient();
     NetworkServer* getServer(uint32_t portNum);
     NetworkUDP* getUDP();
-    void printStatus(Print* printer);
+    bool isLinkUp();
+    int getSecureConnectSupport();
+    uint8_t getTotalSocketLimit();
     
     // Returns the singleton instance of WiFiNINANetworkHub
     static WiFiNINANetworkHub getInstance();
@@ -45,6 +52,8 @@ class WiFiNINANetworkHub : public NetworkHub {
   protected:
     WiFiNINANetworkHub() { /* Nothing to see here, move along. */ };
     
+    void readStatus(NetworkHubStatus& status);
+    
     static WiFiNINANetworkHub* _wifiNetworkHub;
 };
 